@@ -20,6 +20,8 @@
 *
 *****************************************************************************/
 
+#include <limits>
+
 #include <diffpy/EventTicker.hpp>
 #include <diffpy/serialization.ipp>
 
@@ -39,13 +41,8 @@ EventTicker::EventTicker() : mtick(0, 0)
 
 void EventTicker::click()
 {
-    ++gtick.second;
-    if (0 >= gtick.second)
-    {
-        ++gtick.first;
-        gtick.second = 0;
-    }
-    mtick = gtick;
+    count_type cnt = 1 + gcount.fetch_add(1, std::memory_order_relaxed);
+    mtick = tickValue(cnt);
 }
 
 
@@ -97,9 +94,27 @@ bool EventTicker::operator!=(const EventTicker& other) const
 }
 
 
+// Private Static Methods ----------------------------------------------------
+
+EventTicker::value_type EventTicker::tickValue(count_type cnt)
+{
+    // split the counter the same way as a pair of the (epoch, tick)
+    // values, where the tick restarts from 0 after overflow.
+    const int nbits = std::numeric_limits<long>::digits;
+    const count_type lmax = std::numeric_limits<long>::max();
+    value_type rv(long(cnt >> nbits), long(cnt & lmax));
+    return rv;
+}
+
+
+EventTicker::value_type EventTicker::globalTick()
+{
+    return tickValue(gcount.load(std::memory_order_relaxed));
+}
+
 // Static Global Data --------------------------------------------------------
 
-EventTicker::value_type EventTicker::gtick(0, 0);
+std::atomic<EventTicker::count_type> EventTicker::gcount(0);
 
 }   // namespace eventticker
 }   // namespace diffpy
@@ -18,11 +18,16 @@
 * of their dependencies.  The EventTicker class is inspired by the
 * ObjCryst::RefinableObjClock class.
 *
+* The global counter is a lock-free atomic integer so that tickers can be
+* clicked concurrently from several threads.  Individual EventTicker
+* objects are not synchronized.
+*
 *****************************************************************************/
 
 #ifndef EVENTTICKER_HPP_INCLUDED
 #define EVENTTICKER_HPP_INCLUDED
 
+#include <atomic>
 #include <boost/serialization/utility.hpp>
 #include <boost/serialization/split_member.hpp>
 
@@ -58,7 +63,10 @@ class EventTicker
     private:
 
         // global counter
-        static value_type gtick;
+        typedef unsigned long long count_type;
+        static std::atomic<count_type> gcount;
+        static value_type tickValue(count_type cnt);
+        static value_type globalTick();
 
         // data
         value_type mtick;
@@ -68,6 +76,7 @@ class EventTicker
         template<class Archive>
             void save(Archive& ar, const unsigned int version) const
         {
+            const value_type gtick = globalTick();
             ar << mtick << gtick;
         }
 
@@ -76,6 +85,7 @@ class EventTicker
         {
             value_type ga;
             ar >> mtick >> ga;
+            const value_type gtick = globalTick();
             if (ga > gtick)
             {
                 if (ga.first != gtick.first)  mtick.first = mtick.second = 0;
@@ -20,6 +20,7 @@
 #include <climits>
 #include <cstring>
 #include <cassert>
+#include <mutex>
 #include <sstream>
 #include <stdexcept>
 #include <sys/stat.h>
@@ -128,6 +129,9 @@ namespace runtimepath {
 
 string datapath(const std::string& f)
 {
+    // diffpyruntime caches the resolved path in static variables
+    static std::mutex mtx;
+    std::lock_guard<std::mutex> lock(mtx);
     string rv = diffpyruntime();
     rv += (f.empty() ? "" : "/") + f;
     return rv;
@@ -19,10 +19,16 @@
 
 #include <cassert>
 #include <algorithm>
+#include <atomic>
+#include <limits>
+#include <unordered_map>
 #include <boost/functional/hash.hpp>
+#include <boost/make_shared.hpp>
 
 #include <diffpy/serialization.ipp>
 #include <diffpy/srreal/AtomicStructureAdapter.hpp>
+#include <diffpy/srreal/CellListBondGenerator.hpp>
+#include <diffpy/srreal/NeighborListCache.hpp>
 #include <diffpy/srreal/StructureDifference.hpp>
 
 using std::string;
@@ -96,6 +102,83 @@ size_t hash_value(const Atom& a)
 // class AtomicStructureAdapter
 //////////////////////////////////////////////////////////////////////////////
 
+namespace {
+
+/// global counter for the site identities
+std::atomic<size_t> gsiteidentity(0);
+
+/// global counter for the change histories of adapter instances
+std::atomic<size_t> gjournalbranch(1);
+
+/// global clock for stamping the journal entries and structure copies
+std::atomic<size_t> gjournalclock(1);
+
+}   // namespace
+
+// Constructors --------------------------------------------------------------
+
+AtomicStructureAdapter::AtomicStructureAdapter() :
+    matoms(new AtomVector),
+    msiteids(new std::vector<size_t>),
+    mexposed(false),
+    mbranch(gjournalbranch.fetch_add(1)),
+    morigin(0, 0),
+    mjournalstart(0),
+    mjournalepoch(0),
+    mexposedall(0)
+{ }
+
+
+AtomicStructureAdapter::AtomicStructureAdapter(
+        const AtomicStructureAdapter& other) :
+    StructureAdapter(other),
+    matoms(other.shareAtoms()),
+    msiteids(other.msiteids),
+    mexposed(false),
+    mbranch(gjournalbranch.fetch_add(1)),
+    morigin(other.mbranch, other.mjournalepoch.load()),
+    mjournalstart(0),
+    mjournalepoch(0),
+    mexposedall(0),
+    mneighborlists(other.mneighborlists)
+{ }
+
+
+AtomicStructureAdapter&
+AtomicStructureAdapter::operator=(const AtomicStructureAdapter& other)
+{
+    if (this == &other)  return *this;
+    this->StructureAdapter::operator=(other);
+    // unmodified copy needs to update only the sites changed in other
+    if (this->isJournalCopyOf(other))
+    {
+        if (matoms != other.matoms)
+        {
+            const SiteIndices changed =
+                other.journaledSites(morigin.second);
+            const int n0 = this->countSites();
+            this->detach();
+            SiteIndices::const_iterator ii = changed.begin();
+            for (; ii != changed.end() && *ii < n0; ++ii)
+            {
+                (*matoms)[*ii] = (*other.matoms)[*ii];
+            }
+            matoms->insert(matoms->end(),
+                    other.matoms->begin() + n0, other.matoms->end());
+        }
+    }
+    else
+    {
+        matoms = other.shareAtoms();
+        mexposed = false;
+    }
+    msiteids = other.msiteids;
+    this->resetJournal();
+    morigin = std::make_pair(other.mbranch, other.mjournalepoch.load());
+    mneighborlists = other.mneighborlists;
+    return *this;
+}
+
 // Public Methods ------------------------------------------------------------
 
 StructureAdapterPtr AtomicStructureAdapter::clone() const
@@ -107,52 +190,53 @@ StructureAdapterPtr AtomicStructureAdapter::clone() const
 
 BaseBondGeneratorPtr AtomicStructureAdapter::createBondGenerator() const
 {
-    BaseBondGeneratorPtr bnds(new BaseBondGenerator(shared_from_this()));
+    BaseBondGeneratorPtr bnds(
+            new CellListBondGenerator(shared_from_this()));
     return bnds;
 }
 
 
 int AtomicStructureAdapter::countSites() const
 {
-    return matoms.size();
+    return matoms->size();
 }
 
 
 const string& AtomicStructureAdapter::siteAtomType(int idx) const
 {
     assert(0 <= idx && idx < this->countSites());
-    return matoms[idx].atomtype;
+    return (*matoms)[idx].atomtype;
 }
 
 
 const R3::Vector& AtomicStructureAdapter::siteCartesianPosition(int idx) const
 {
     assert(0 <= idx && idx < this->countSites());
-    return matoms[idx].xyz_cartn;
+    return (*matoms)[idx].xyz_cartn;
 }
 
 
 double AtomicStructureAdapter::siteOccupancy(int idx) const
 {
     assert(0 <= idx && idx < this->countSites());
-    return matoms[idx].occupancy;
+    return (*matoms)[idx].occupancy;
 }
 
 
 bool AtomicStructureAdapter::siteAnisotropy(int idx) const
 {
     assert(0 <= idx && idx < this->countSites());
-    return matoms[idx].anisotropy;
+    return (*matoms)[idx].anisotropy;
 }
 
 
 const R3::Matrix& AtomicStructureAdapter::siteCartesianUij(int idx) const
 {
     assert(0 <= idx && idx < this->countSites());
-    return matoms[idx].uij_cartn;
+    return (*matoms)[idx].uij_cartn;
 }
 
-// helper for diff
+// helpers for diff
 namespace {
 
 typedef std::pair<const Atom*, int> atomindex;
@@ -162,6 +246,52 @@ bool cmpatomindex(const atomindex& ai0, const atomindex& ai1)
     return (*(ai0.first) < *(ai1.first));
 }
 
+/// Match atoms with the same site identity in O(N) steps.
+/// Return false if site identities are not unique.
+bool diff_by_identity(
+        const AtomicStructureAdapter::AtomVector& atoms0,
+        const std::vector<size_t>& ids0,
+        const AtomicStructureAdapter::AtomVector& atoms1,
+        const std::vector<size_t>& ids1,
+        StructureDifference& sd)
+{
+    const int n0 = atoms0.size();
+    const int n1 = atoms1.size();
+    std::unordered_map<size_t, int> index0;
+    index0.reserve(n0);
+    for (int i = 0; i < n0; ++i)
+    {
+        if (!index0.insert(std::make_pair(ids0[i], i)).second)  return false;
+    }
+    sd.pop0.clear();
+    sd.add1.clear();
+    sd.moved.clear();
+    std::vector<bool> matched0(n0, false);
+    bool sameindex = true;
+    for (int j = 0; j < n1; ++j)
+    {
+        std::unordered_map<size_t, int>::const_iterator ii;
+        ii = index0.find(ids1[j]);
+        if (ii == index0.end())
+        {
+            sd.add1.push_back(j);
+            continue;
+        }
+        const int i = ii->second;
+        if (matched0[i])  return false;
+        matched0[i] = true;
+        sameindex = sameindex && (i == j);
+        if (atoms0[i] != atoms1[j])  sd.moved.push_back(std::make_pair(i, j));
+    }
+    for (int i = 0; i < n0; ++i)
+    {
+        if (!matched0[i])  sd.pop0.push_back(i);
+    }
+    sd.diffmethod = sameindex ? StructureDifference::Method::SIDEBYSIDE :
+        StructureDifference::Method::IDENTITY;
+    return true;
+}
+
 }   // namespace
 
 StructureDifference
@@ -179,44 +309,57 @@ AtomicStructureAdapter::diff(StructureAdapterConstPtr other) const
     const AtomicStructureAdapter& astru1 = *pother;
     sd.pop0.clear();
     sd.add1.clear();
-    const_iterator ai0 = astru0.matoms.begin();
-    const_iterator ai1 = astru1.matoms.begin();
+    // read the changes from the journal if this is an unmodified copy
+    if (this->diffFromJournal(astru1, sd))  return sd;
+    const_iterator ai0 = astru0.matoms->begin();
+    const_iterator ai1 = astru1.matoms->begin();
     int nboth = min(astru0.countSites(), astru1.countSites());
     for (int i = 0; i < nboth; ++i, ++ai0, ++ai1)
     {
-        if (*ai0 != *ai1)
+        if (*ai0 == *ai1)  continue;
+        // changed atom at the same site is moved
+        if ((*astru0.msiteids)[i] == (*astru1.msiteids)[i])
+        {
+            sd.moved.push_back(std::make_pair(i, i));
+        }
+        else
         {
             sd.pop0.push_back(i);
             sd.add1.push_back(i);
         }
     }
-    for (int i = nboth; ai0 != astru0.matoms.end(); ++i, ++ai0)
+    for (int i = nboth; ai0 != astru0.matoms->end(); ++i, ++ai0)
     {
         sd.pop0.push_back(i);
     }
-    for (int i = nboth; ai1 != astru1.matoms.end(); ++i, ++ai1)
+    for (int i = nboth; ai1 != astru1.matoms->end(); ++i, ++ai1)
     {
         sd.add1.push_back(i);
     }
     if (sd.allowsfastupdate())  return sd;
     // here the structures differ too much when compared side by side.
+    // Let's try to match atoms by their site identities.
+    bool idmatch = diff_by_identity(*astru0.matoms, *astru0.msiteids,
+            *astru1.matoms, *astru1.msiteids, sd);
+    if (idmatch && sd.allowsfastupdate())  return sd;
     // Let's compare assuming no relation in atom site order.
     sd.pop0.clear();
     sd.add1.clear();
+    sd.moved.clear();
     // let's build sorted vectors of atoms in stru0 and stru1
     sd.diffmethod = StructureDifference::Method::SORTED;
     std::vector<atomindex> satoms0, satoms1;
     satoms0.reserve(astru0.countSites());
-    const_iterator ai = astru0.matoms.begin();
-    for (int i = 0; ai != astru0.matoms.end(); ++ai, ++i)
+    const_iterator ai = astru0.matoms->begin();
+    for (int i = 0; ai != astru0.matoms->end(); ++ai, ++i)
     {
         satoms0.push_back(atomindex(&(*ai), i));
     }
     // use negative index for stru1 atoms so we can tell them apart
     // in the output of set_symmetric_difference
     satoms1.reserve(astru1.countSites());
-    ai = astru1.matoms.begin();
-    for (int i = -1; ai != astru1.matoms.end(); ++ai, --i)
+    ai = astru1.matoms->begin();
+    for (int i = -1; ai != astru1.matoms->end(); ++ai, --i)
     {
         satoms1.push_back(atomindex(&(*ai), i));
     }
@@ -240,63 +383,325 @@ AtomicStructureAdapter::diff(StructureAdapterConstPtr other) const
     return sd;
 }
 
+
+void AtomicStructureAdapter::updateSnapshot(StructureAdapterPtr& snap) const
+{
+    this->assignSnapshot<AtomicStructureAdapter>(snap);
+}
+
+
+size_t AtomicStructureAdapter::siteIdentity(int idx) const
+{
+    assert(0 <= idx && idx < this->countSites());
+    return (*msiteids)[idx];
+}
+
+
+void AtomicStructureAdapter::setNeighborListSkin(double skin)
+{
+    if (skin == this->getNeighborListSkin())  return;
+    NeighborListCachePtr nlc;
+    if (skin != 0.0)  nlc.reset(new NeighborListCache(skin));
+    mneighborlists = nlc;
+}
+
+
+double AtomicStructureAdapter::getNeighborListSkin() const
+{
+    return mneighborlists ? mneighborlists->getSkin() : 0.0;
+}
+
+
+NeighborListCache* AtomicStructureAdapter::neighborListCache() const
+{
+    return mneighborlists.get();
+}
+
 typedef AtomicStructureAdapter::iterator iterator;
+typedef AtomicStructureAdapter::reverse_iterator reverse_iterator;
 
 iterator AtomicStructureAdapter::insert(int idx, const Atom& atom)
 {
     assert(0 <= idx && idx <= this->countSites());
-    return this->insert(matoms.begin() + idx, atom);
+    this->detach();
+    return this->insert(matoms->begin() + idx, atom);
 }
 
 
 iterator AtomicStructureAdapter::insert(iterator ii, const Atom& atom)
 {
-    return matoms.insert(ii, atom);
+    size_t offset = ii - matoms->begin();
+    this->detach();
+    iterator rv = matoms->insert(matoms->begin() + offset, atom);
+    this->insertSiteIdentities(offset, 1);
+    this->resetJournal();
+    return rv;
 }
 
 
 void AtomicStructureAdapter::append(const Atom& atom)
 {
-    matoms.push_back(atom);
+    this->detach();
+    matoms->push_back(atom);
+    this->insertSiteIdentities(msiteids->size(), 1);
+    // appended atom does not shift the site indices
+    this->recordSiteChange(matoms->size() - 1);
 }
 
 
 void AtomicStructureAdapter::clear()
 {
-    matoms.clear();
+    this->detach();
+    matoms->clear();
+    this->detachSiteIdentities();
+    msiteids->clear();
+    this->resetJournal();
 }
 
 
 iterator AtomicStructureAdapter::erase(int idx)
 {
     assert(0 <= idx && idx < this->countSites());
-    return matoms.erase(matoms.begin() + idx);
+    this->detach();
+    return this->erase(matoms->begin() + idx);
 }
 
 
 iterator AtomicStructureAdapter::erase(iterator pos)
 {
-    return matoms.erase(pos);
+    return this->erase(pos, pos + 1);
 }
 
 
 iterator AtomicStructureAdapter::erase(iterator first, iterator last)
 {
-    return matoms.erase(first, last);
+    size_t offset0 = first - matoms->begin();
+    size_t offset1 = last - matoms->begin();
+    this->detach();
+    this->detachSiteIdentities();
+    msiteids->erase(msiteids->begin() + offset0,
+            msiteids->begin() + offset1);
+    iterator rv = matoms->erase(matoms->begin() + offset0,
+            matoms->begin() + offset1);
+    this->resetJournal();
+    return rv;
+}
+
+
+void AtomicStructureAdapter::reserve(size_t sz)
+{
+    this->detach();
+    matoms->reserve(sz);
+    if (msiteids.unique())  msiteids->reserve(sz);
 }
 
 
 Atom& AtomicStructureAdapter::operator[](int idx)
 {
     assert(0 <= idx && idx < this->countSites());
-    return matoms[idx];
+    this->detach();
+    mexposed = true;
+    this->recordSiteChange(idx);
+    return (*matoms)[idx];
 }
 
 
 const Atom& AtomicStructureAdapter::operator[](int idx) const
 {
     assert(0 <= idx && idx < this->countSites());
-    return matoms[idx];
+    return (*matoms)[idx];
+}
+
+
+void AtomicStructureAdapter::assign(size_t n, const Atom& a)
+{
+    matoms = boost::make_shared<AtomVector>(n, a);
+    mexposed = false;
+    this->resetSiteIdentities();
+    this->resetJournal();
+}
+
+
+iterator AtomicStructureAdapter::begin()
+{
+    this->modifyAll();
+    return matoms->begin();
+}
+
+
+iterator AtomicStructureAdapter::end()
+{
+    this->modifyAll();
+    return matoms->end();
+}
+
+
+reverse_iterator AtomicStructureAdapter::rbegin()
+{
+    this->modifyAll();
+    return matoms->rbegin();
+}
+
+
+reverse_iterator AtomicStructureAdapter::rend()
+{
+    this->modifyAll();
+    return matoms->rend();
+}
+
+// Private Methods -----------------------------------------------------------
+
+/// make a private copy of the atoms shared with other adapters
+void AtomicStructureAdapter::detach()
+{
+    if (matoms.unique())  return;
+    matoms = boost::make_shared<AtomVector>(*matoms);
+}
+
+
+/// make a private copy of the site identities before inserting
+/// or erasing sites
+void AtomicStructureAdapter::detachSiteIdentities()
+{
+    if (msiteids.unique())  return;
+    msiteids = boost::make_shared< std::vector<size_t> >(*msiteids);
+}
+
+
+/// atoms for a copy of this adapter.  Exposed atoms are copied, because
+/// the caller may change them through references held from before.
+boost::shared_ptr<AtomicStructureAdapter::AtomVector>
+AtomicStructureAdapter::shareAtoms() const
+{
+    if (!mexposed)  return matoms;
+    return boost::make_shared<AtomVector>(*matoms);
+}
+
+
+/// prepare for modification of any atom through the non-const iterators
+void AtomicStructureAdapter::modifyAll()
+{
+    this->detach();
+    mexposed = true;
+    morigin = std::make_pair(0, 0);
+    mexposedall = gjournalclock.load();
+}
+
+
+void AtomicStructureAdapter::insertSiteIdentities(size_t offset, size_t n)
+{
+    size_t id0 = gsiteidentity.fetch_add(n);
+    std::vector<size_t> newids(n);
+    for (size_t i = 0; i < n; ++i)  newids[i] = id0 + i;
+    this->detachSiteIdentities();
+    msiteids->insert(msiteids->begin() + offset, newids.begin(), newids.end());
+    assert(msiteids->size() == matoms->size());
+}
+
+
+void AtomicStructureAdapter::resetSiteIdentities()
+{
+    msiteids = boost::make_shared< std::vector<size_t> >();
+    this->insertSiteIdentities(0, matoms->size());
+}
+
+
+void AtomicStructureAdapter::recordSiteChange(int idx)
+{
+    // this is no longer an unmodified copy of another adapter
+    morigin = std::make_pair(0, 0);
+    const size_t epoch = mjournalepoch.load();
+    if (msitestamps.size() < matoms->size())
+    {
+        msitestamps.resize(matoms->size(), 0);
+    }
+    // site is in the journal since the last snapshot
+    if (msitestamps[idx] > epoch)  return;
+    // drop entries from before the snapshot when the journal grows long,
+    // the earlier copies then fall back to a full comparison
+    if (mjournal.size() > 2 * matoms->size() + 64)
+    {
+        std::vector< std::pair<size_t, int> >::iterator last;
+        last = std::upper_bound(mjournal.begin(), mjournal.end(),
+                std::make_pair(epoch, std::numeric_limits<int>::max()));
+        mjournal.erase(mjournal.begin(), last);
+        mjournalstart = epoch;
+    }
+    const size_t stamp = gjournalclock.load();
+    mjournal.push_back(std::make_pair(stamp, idx));
+    msitestamps[idx] = stamp;
+}
+
+
+/// start a new journal when site indices change.  Copies taken before
+/// cannot use it and references from before are no longer tracked.
+void AtomicStructureAdapter::resetJournal()
+{
+    morigin = std::make_pair(0, 0);
+    mjournalepoch = gjournalclock.fetch_add(1);
+    mjournalstart = mjournalepoch;
+    mjournal.clear();
+    msitestamps.clear();
+    mexposedall = 0;
+}
+
+
+/// start a new epoch of the journal for a snapshot, copies taken from now
+/// on compare only the sites exposed after this call
+void AtomicStructureAdapter::rebaseJournal() const
+{
+    mjournalepoch = gjournalclock.fetch_add(1);
+}
+
+
+/// Return sorted indices of the sites journaled after the clock stamp
+SiteIndices AtomicStructureAdapter::journaledSites(size_t stamp) const
+{
+    std::vector< std::pair<size_t, int> >::const_iterator first;
+    first = std::upper_bound(mjournal.begin(), mjournal.end(),
+            std::make_pair(stamp, std::numeric_limits<int>::max()));
+    SiteIndices rv;
+    rv.reserve(mjournal.end() - first);
+    for (; first != mjournal.end(); ++first)  rv.push_back(first->second);
+    std::sort(rv.begin(), rv.end());
+    rv.erase(std::unique(rv.begin(), rv.end()), rv.end());
+    return rv;
+}
+
+
+/// Return true if this adapter is an unmodified copy of stru1 that can
+/// read the changes from the journal of stru1.
+bool AtomicStructureAdapter::isJournalCopyOf(
+        const AtomicStructureAdapter& stru1) const
+{
+    const size_t& stamp0 = morigin.second;
+    bool rv = (morigin.first == stru1.mbranch) &&
+        (stamp0 >= stru1.mjournalstart) &&
+        (stru1.mexposedall <= stamp0) &&
+        (this->countSites() <= stru1.countSites());
+    return rv;
+}
+
+
+/// Fill the structure difference from the journal of stru1 if this adapter
+/// is its unmodified copy.  Sites exposed by stru1 since the start of
+/// the journal epoch of the copy are compared by value.
+bool AtomicStructureAdapter::diffFromJournal(
+        const AtomicStructureAdapter& stru1, StructureDifference& sd) const
+{
+    if (!this->isJournalCopyOf(stru1))  return false;
+    const SiteIndices dirty = stru1.journaledSites(morigin.second);
+    const int n0 = this->countSites();
+    SiteIndices::const_iterator ii = dirty.begin();
+    for (; ii != dirty.end() && *ii < n0; ++ii)
+    {
+        if ((*matoms)[*ii] == (*stru1.matoms)[*ii])  continue;
+        sd.moved.push_back(std::make_pair(*ii, *ii));
+    }
+    sd.add1.assign(ii, dirty.end());
+    assert(int(sd.add1.size()) == stru1.countSites() - n0);
+    sd.diffmethod = StructureDifference::Method::SIDEBYSIDE;
+    return true;
 }
 
 }   // namespace srreal
@@ -15,11 +15,26 @@
 * class AtomicStructureAdapter -- universal structure adapter for
 *     a non-periodic set of atoms.
 *
+* Copies of the adapter share their atoms until one of them is modified.
+* Atoms that were exposed to changes through the non-const access methods
+* are copied instead, so that references held by the caller cannot change
+* the copy.  The adapter keeps a journal of the exposed sites so that diff
+* of a structure copy against its unmodified source compares only those
+* sites.  The journal is re-based by updateSnapshot and by the insertion or
+* removal of sites, after that the references and iterators obtained before
+* need to be taken again for their changes to be seen by diff.
+* Bond generators may reuse neighbor lists from an optional cache that
+* is shared by the adapter copies, see NeighborListCache.
+*
 *****************************************************************************/
 
 #ifndef ATOMICSTRUCTUREADAPTER_HPP_INCLUDED
 #define ATOMICSTRUCTUREADAPTER_HPP_INCLUDED
 
+#include <atomic>
+#include <typeinfo>
+#include <utility>
+#include <boost/make_shared.hpp>
 #include <boost/serialization/vector.hpp>
 
 #include <diffpy/srreal/StructureAdapter.hpp>
@@ -27,6 +42,8 @@
 namespace diffpy {
 namespace srreal {
 
+class NeighborListCache;
+
 class Atom
 {
     public:
@@ -87,6 +104,11 @@ class AtomicStructureAdapter : public StructureAdapter
         typedef AtomVector::difference_type difference_type;
         typedef AtomVector::size_type size_type;
 
+        // constructors
+        AtomicStructureAdapter();
+        AtomicStructureAdapter(const AtomicStructureAdapter&);
+        AtomicStructureAdapter& operator=(const AtomicStructureAdapter&);
+
         // methods - overloaded
         virtual StructureAdapterPtr clone() const;
         virtual BaseBondGeneratorPtr createBondGenerator() const;
@@ -99,50 +121,121 @@ class AtomicStructureAdapter : public StructureAdapter
         virtual bool siteAnisotropy(int idx) const;
         virtual const R3::Matrix& siteCartesianUij(int idx) const;
         virtual StructureDifference diff(StructureAdapterConstPtr other) const;
+        virtual void updateSnapshot(StructureAdapterPtr& snap) const;
 
         // methods - own
+        /// identity of the atom site that is kept when the atom is modified
+        /// or when the adapter is copied.  New atoms get new identities.
+        size_t siteIdentity(int idx) const;
+        /// Reuse neighbor lists in bond generators for repeated evaluations.
+        /// The lists are built for rmax + skin, zero skin disables them.
+        void setNeighborListSkin(double skin);
+        double getNeighborListSkin() const;
+        /// neighbor list cache shared with the adapter copies or NULL
+        NeighborListCache* neighborListCache() const;
         iterator insert(int, const Atom&);
         iterator insert(iterator position, const Atom&);
         template <class Iter>
         void insert(iterator position, Iter first, Iter last)
         {
-            matoms.insert(position, first, last);
+            size_t offset = position - matoms->begin();
+            size_t n0 = matoms->size();
+            this->detach();
+            matoms->insert(matoms->begin() + offset, first, last);
+            this->insertSiteIdentities(offset, matoms->size() - n0);
+            this->resetJournal();
         }
         void append(const Atom&);
         void clear();
         iterator erase(int idx);
         iterator erase(iterator pos);
         iterator erase(iterator first, iterator last);
-        void reserve(size_t sz)  { matoms.reserve(sz); }
-        size_type size() const  { return matoms.size(); }
+        void reserve(size_t sz);
+        size_type size() const  { return matoms->size(); }
         Atom& operator[](int);
         const Atom& operator[](int) const;
         Atom& at(int idx)  { return (*this)[idx]; }
         const Atom& at(int idx) const  { return (*this)[idx]; }
         template <class Iter>
-            void assign (Iter first, Iter last)  { matoms.assign(first, last); }
-        void assign (size_t n, const Atom& a)  { matoms.assign(n, a); }
-        // iterator forwarding
-        iterator begin()  { return matoms.begin(); }
-        iterator end()  { return matoms.end(); }
-        const_iterator begin() const  { return matoms.begin(); }
-        const_iterator end() const  { return matoms.end(); }
-        reverse_iterator rbegin()  { return matoms.rbegin(); }
-        reverse_iterator rend()  { return matoms.rend(); }
-        const_reverse_iterator rbegin() const  { return matoms.rbegin(); }
-        const_reverse_iterator rend() const  { return matoms.rend(); }
+            void assign (Iter first, Iter last)
+        {
+            matoms = boost::make_shared<AtomVector>(first, last);
+            mexposed = false;
+            this->resetSiteIdentities();
+            this->resetJournal();
+        }
+        void assign (size_t n, const Atom& a);
+        // iterator forwarding.  Non-const iterators may change any atom,
+        // therefore diff of the earlier copies does not use the journal.
+        iterator begin();
+        iterator end();
+        const_iterator begin() const  { return matoms->begin(); }
+        const_iterator end() const  { return matoms->end(); }
+        reverse_iterator rbegin();
+        reverse_iterator rend();
+        const_reverse_iterator rbegin() const  { return matoms->rbegin(); }
+        const_reverse_iterator rend() const  { return matoms->rend(); }
+
+    protected:
+
+        /// Update the unshared snapshot of the same type T by assignment
+        /// or replace it with a clone.  Called from updateSnapshot.
+        template <class T>
+            void assignSnapshot(StructureAdapterPtr& snap) const
+        {
+            this->rebaseJournal();
+            const bool sametype = snap && typeid(*this) == typeid(T) &&
+                typeid(*snap) == typeid(T);
+            if (sametype && snap.unique())
+            {
+                static_cast<T&>(*snap) = static_cast<const T&>(*this);
+            }
+            else  snap = this->clone();
+        }
 
     private:
 
         // data
-        AtomVector matoms;
+        // atoms and their site identities.  Site identities are copied
+        // only when sites are inserted or erased.  Atoms are copied when
+        // modified, exposed atoms are never shared.
+        boost::shared_ptr<AtomVector> matoms;
+        boost::shared_ptr< std::vector<size_t> > msiteids;
+        bool mexposed;
+        // change journal of the sites exposed by the non-const access
+        // as pairs of clock stamp and site index
+        size_t mbranch;
+        std::pair<size_t, size_t> morigin;
+        size_t mjournalstart;
+        mutable std::atomic<size_t> mjournalepoch;
+        std::vector< std::pair<size_t, int> > mjournal;
+        std::vector<size_t> msitestamps;
+        size_t mexposedall;
+        // optional cache of neighbor lists for the bond generators
+        boost::shared_ptr<NeighborListCache> mneighborlists;
+
+        // methods
+        void detach();
+        void detachSiteIdentities();
+        boost::shared_ptr<AtomVector> shareAtoms() const;
+        void modifyAll();
+        void insertSiteIdentities(size_t offset, size_t n);
+        void resetSiteIdentities();
+        void recordSiteChange(int idx);
+        void resetJournal();
+        void rebaseJournal() const;
+        SiteIndices journaledSites(size_t stamp) const;
+        bool isJournalCopyOf(const AtomicStructureAdapter& stru1) const;
+        bool diffFromJournal(const AtomicStructureAdapter& stru1,
+                StructureDifference& sd) const;
 
         // comparison
         friend bool operator==(
                 const AtomicStructureAdapter& stru0,
                 const AtomicStructureAdapter& stru1)
         {
-            return (stru0.matoms == stru1.matoms);
+            return (stru0.matoms == stru1.matoms) ||
+                (*stru0.matoms == *stru1.matoms);
         }
 
         // serialization
@@ -151,7 +244,14 @@ class AtomicStructureAdapter : public StructureAdapter
             void serialize(Archive& ar, const unsigned int version)
         {
             ar & boost::serialization::base_object<StructureAdapter>(*this);
-            ar & matoms;
+            if (Archive::is_loading::value)  this->detach();
+            ar & *matoms;
+            // site identities are local to the process, create new ones
+            if (Archive::is_loading::value)
+            {
+                this->resetSiteIdentities();
+                this->resetJournal();
+            }
         }
 
 };
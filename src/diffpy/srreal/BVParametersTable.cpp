@@ -30,6 +30,14 @@ using namespace std;
 namespace diffpy {
 namespace srreal {
 
+// Declaration of Local Helpers ----------------------------------------------
+
+namespace {
+
+unique_ptr<BVParametersTable::SetOfBVParam> loadStandardSetOfBVParam();
+
+}   // namespace
+
 // Static Methods ------------------------------------------------------------
 
 const BVParam& BVParametersTable::none()
@@ -161,38 +169,48 @@ BVParametersTable::getAll() const
 
 const BVParametersTable::SetOfBVParam&
 BVParametersTable::getStandardSetOfBVParam() const
+{
+    // initialization of local static is thread safe in C++11
+    static const unique_ptr<SetOfBVParam> the_set(loadStandardSetOfBVParam());
+    return *the_set;
+}
+
+// Definition of Local Helpers -----------------------------------------------
+
+namespace {
+
+unique_ptr<BVParametersTable::SetOfBVParam> loadStandardSetOfBVParam()
 {
     using namespace diffpy::runtimepath;
     using diffpy::validators::ensureFileOK;
-    static unique_ptr<SetOfBVParam> the_set;
-    if (!the_set)
+    unique_ptr<BVParametersTable::SetOfBVParam>
+        the_set(new BVParametersTable::SetOfBVParam);
+    string bvparmfile = datapath("bvparm2011sel.cif");
+    ifstream fp(bvparmfile.c_str());
+    ensureFileOK(bvparmfile, fp);
+    // read the header up to _valence_param_B and then up to an empty line.
+    LineReader lnrd;
+    lnrd.commentmark = '#';
+    while (fp >> lnrd)
     {
-        the_set.reset(new SetOfBVParam);
-        string bvparmfile = datapath("bvparm2011sel.cif");
-        ifstream fp(bvparmfile.c_str());
-        ensureFileOK(bvparmfile, fp);
-        // read the header up to _valence_param_B and then up to an empty line.
-        LineReader lnrd;
-        lnrd.commentmark = '#';
-        while (fp >> lnrd)
-        {
-            if (lnrd.wcount() && lnrd.words[0] == "_valence_param_B")  break;
-        }
-        // skip to an empty line
-        while (fp >> lnrd && !lnrd.isblank())  { }
-        // load data lines skipping the empty or commented entries
-        while (fp >> lnrd)
-        {
-            if (lnrd.isignored())  continue;
-            BVParam bp;
-            bp.setFromCifLine(lnrd.line);
-            assert(!the_set->count(bp));
-            the_set->insert(bp);
-        }
+        if (lnrd.wcount() && lnrd.words[0] == "_valence_param_B")  break;
     }
-    return *the_set;
+    // skip to an empty line
+    while (fp >> lnrd && !lnrd.isblank())  { }
+    // load data lines skipping the empty or commented entries
+    while (fp >> lnrd)
+    {
+        if (lnrd.isignored())  continue;
+        BVParam bp;
+        bp.setFromCifLine(lnrd.line);
+        assert(!the_set->count(bp));
+        the_set->insert(bp);
+    }
+    return the_set;
 }
 
+}   // namespace
+
 }   // namespace srreal
 }   // namespace diffpy
 
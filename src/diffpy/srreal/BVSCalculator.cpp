@@ -22,6 +22,7 @@
 #include <diffpy/validators.hpp>
 #include <diffpy/serialization.ipp>
 #include <diffpy/srreal/AtomUtils.hpp>
+#include <diffpy/srreal/BondBatch.hpp>
 #include <diffpy/srreal/BVSCalculator.hpp>
 
 using namespace std;
@@ -179,6 +180,40 @@ void BVSCalculator::addPairContribution(const BaseBondGenerator& bnds,
     mvalue[bnds.site1()] += summationscale * pm1 * valencehalf * o0;
 }
 
+
+bool BVSCalculator::configureBondBatch(BondBatch& batch) const
+{
+    batch.withmsd = false;
+    return true;
+}
+
+
+void BVSCalculator::addPairContributions(const BondBatch& batch)
+{
+    const int i0 = batch.site0;
+    const string& a0 = mstructure_cache.baresymbols[i0];
+    int v0 = mstructure_cache.valences[i0];
+    int pm0 = (v0 >= 0) ? 1 : -1;
+    const double& o0 = mstructure->siteOccupancy(i0);
+    const BVParametersTable& bvtb = *(this->getBVParamTable());
+    const int n = batch.size();
+    for (int k = 0; k < n; ++k)
+    {
+        const int i1 = batch.site1[k];
+        const string& a1 = mstructure_cache.baresymbols[i1];
+        int v1 = mstructure_cache.valences[i1];
+        const BVParam& bp = bvtb.lookup(a0, v0, a1, v1);
+        // skip pairs without bond parameters
+        if (&bp == &bvtb.none())    continue;
+        double valencehalf = bp.bondvalence(batch.distance[k]) / 2.0;
+        int pm1 = (v1 >= 0) ? 1 : -1;
+        const double& o1 = mstructure->siteOccupancy(i1);
+        const int& smscale = batch.summationscale[k];
+        mvalue[i0] += smscale * pm0 * valencehalf * o1;
+        mvalue[i1] += smscale * pm1 * valencehalf * o0;
+    }
+}
+
 // Private Methods -----------------------------------------------------------
 
 void BVSCalculator::cacheStructureData()
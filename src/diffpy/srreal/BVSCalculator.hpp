@@ -63,6 +63,8 @@ class BVSCalculator : public PairQuantity
         virtual void resetValue();
         virtual void configureBondGenerator(BaseBondGenerator&) const;
         virtual void addPairContribution(const BaseBondGenerator&, int);
+        virtual bool configureBondBatch(BondBatch&) const;
+        virtual void addPairContributions(const BondBatch&);
 
     private:
 
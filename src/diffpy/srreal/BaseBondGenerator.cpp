@@ -17,6 +17,8 @@
 *
 *****************************************************************************/
 
+#include <functional>
+
 #include <diffpy/srreal/BaseBondGenerator.hpp>
 #include <diffpy/srreal/StructureAdapter.hpp>
 #include <diffpy/mathutils.hpp>
@@ -38,7 +40,12 @@ BaseBondGenerator::BaseBondGenerator(StructureAdapterConstPtr stru) :
     mr0(R3::zerovector),
     mr1(R3::zerovector),
     mr01(R3::zerovector),
-    mdistance(0.0)
+    mdistance(0.0),
+    mrankbase(NULL),
+    mranksize(0),
+    mranksvalid(false),
+    midentityranks(false),
+    mrankoffset(0)
 {
     int cnt = stru->countSites();
     msite_all.resize(cnt);
@@ -91,6 +98,7 @@ void BaseBondGenerator::selectSiteRange(int first, int last)
     assert(last <= mstructure->countSites());
     msite_first = msite_all.begin() + first;
     msite_last = msite_all.begin() + last;
+    mrankbase = NULL;
     this->setFinishedFlag();
 }
 
@@ -100,6 +108,7 @@ void BaseBondGenerator::selectSites(const SiteIndices& selection)
     msite_selection = selection;
     msite_first = msite_selection.begin();
     msite_last = msite_selection.end();
+    mrankbase = NULL;
     this->setFinishedFlag();
 }
 
@@ -107,6 +116,20 @@ void BaseBondGenerator::selectSites(const SiteIndices& selection)
 void BaseBondGenerator::selectSites(
         SiteIndices::const_iterator first,
         SiteIndices::const_iterator last)
+{
+    msite_first = first;
+    msite_last = last;
+    mrankbase = NULL;
+    this->setFinishedFlag();
+}
+
+
+/// Select sites in [first, last) and keep the site ranks of the last
+/// ranked array when the range is within that array.  The caller must
+/// ensure the array content has not changed since it was ranked.
+void BaseBondGenerator::narrowSiteSelection(
+        SiteIndices::const_iterator first,
+        SiteIndices::const_iterator last)
 {
     msite_first = first;
     msite_last = last;
@@ -197,8 +220,7 @@ const R3::Matrix& BaseBondGenerator::Ucartesian1() const
 
 double BaseBondGenerator::msd() const
 {
-    static R3::Vector s;
-    s = this->r01();
+    const R3::Vector& s = this->r01();
     double msd0 = meanSquareDisplacement(this->Ucartesian0(), s,
             mstructure->siteAnisotropy(this->site0()));
     double msd1 = meanSquareDisplacement(this->Ucartesian1(), s,
@@ -207,6 +229,39 @@ double BaseBondGenerator::msd() const
     return rv;
 }
 
+
+/// Derivative of msd with respect to the bond vector r01.
+R3::Vector BaseBondGenerator::msdGradient() const
+{
+    R3::Vector rv = R3::zerovector;
+    const R3::Vector sn = this->r01() / this->distance();
+    const int sites[2] = {this->site0(), this->site1()};
+    const R3::Matrix* Uij[2] = {&this->Ucartesian0(), &this->Ucartesian1()};
+    for (int k = 0; k < 2; ++k)
+    {
+        if (!mstructure->siteAnisotropy(sites[k]))  continue;
+        R3::Vector Usn = R3::mxvecproduct(*Uij[k], sn);
+        double msdk = R3::dot(sn, Usn);
+        rv += 2 * (Usn - msdk * sn) / this->distance();
+    }
+    return rv;
+}
+
+
+/// Derivative of r0 with respect to the Cartesian coordinates of site0.
+/// This is identity unless r0 is a symmetry image of the site.
+const R3::Matrix& BaseBondGenerator::r0Jacobian() const
+{
+    return R3::identity();
+}
+
+
+/// Derivative of r1 with respect to the Cartesian coordinates of site1.
+const R3::Matrix& BaseBondGenerator::r1Jacobian() const
+{
+    return R3::identity();
+}
+
 // Protected Methods ---------------------------------------------------------
 
 bool BaseBondGenerator::iterateSymmetry()
@@ -239,7 +294,6 @@ void BaseBondGenerator::updateDistance()
     mdistance = R3::norm(mr01);
 }
 
-// Private Methods -----------------------------------------------------------
 
 void BaseBondGenerator::advanceWhileInvalid()
 {
@@ -250,6 +304,50 @@ void BaseBondGenerator::advanceWhileInvalid()
     }
 }
 
+/// Rank selected sites by their position in the selected site array.
+/// The ranks are reused only for sub-ranges from narrowSiteSelection,
+/// the selectSites and selectSiteRange calls reset them.
+bool BaseBondGenerator::rankSelectedSites()
+{
+    if (msite_first >= msite_last)
+    {
+        midentityranks = true;
+        mrankoffset = 0;
+        return true;
+    }
+    const int* pfirst = &(*msite_first);
+    const int* plast = pfirst + (msite_last - msite_first);
+    std::less<const int*> before;
+    // site ranges from selectSiteRange are ranked by the site index
+    const int* pall = msite_all.data();
+    midentityranks = !before(pfirst, pall) &&
+        !before(pall + msite_all.size(), plast);
+    if (midentityranks)
+    {
+        mrankoffset = pfirst - pall;
+        return true;
+    }
+    const int* prankend = mrankbase + mranksize;
+    bool issubrange = mrankbase &&
+        !before(pfirst, mrankbase) && !before(prankend, plast) &&
+        !(pfirst == mrankbase && plast == prankend);
+    if (!issubrange)
+    {
+        const int cntsites = msite_all.size();
+        mrankbase = pfirst;
+        mranksize = plast - pfirst;
+        msiteranks.assign(cntsites, -1);
+        mranksvalid = true;
+        for (const int* p = pfirst; p != plast && mranksvalid; ++p)
+        {
+            mranksvalid = (0 <= *p && *p < cntsites && msiteranks[*p] < 0);
+            if (mranksvalid)  msiteranks[*p] = p - pfirst;
+        }
+    }
+    mrankoffset = pfirst - mrankbase;
+    return mranksvalid;
+}
+
 // Private Methods -----------------------------------------------------------
 
 bool BaseBondGenerator::bondOutOfRange() const
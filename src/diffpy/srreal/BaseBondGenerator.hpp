@@ -50,6 +50,9 @@ class BaseBondGenerator
         void selectSites(
                 SiteIndices::const_iterator first,
                 SiteIndices::const_iterator last);
+        void narrowSiteSelection(
+                SiteIndices::const_iterator first,
+                SiteIndices::const_iterator last);
         virtual void setRmin(double);
         virtual void setRmax(double);
 
@@ -66,6 +69,9 @@ class BaseBondGenerator
         virtual const R3::Matrix& Ucartesian0() const;
         virtual const R3::Matrix& Ucartesian1() const;
         double msd() const;
+        R3::Vector msdGradient() const;
+        virtual const R3::Matrix& r0Jacobian() const;
+        virtual const R3::Matrix& r1Jacobian() const;
 
     protected:
 
@@ -89,17 +95,39 @@ class BaseBondGenerator
         virtual void rewindSymmetry();
         virtual void getNextBond();
         void updateDistance();
+        void advanceWhileInvalid();
+        /// prepare selectedSiteOffset, return false for repeated sites
+        bool rankSelectedSites();
+        int selectedSiteOffset(int site) const;
 
     private:
 
+        // data
+        // ranks of sites in the last selected site array
+        const int* mrankbase;
+        size_t mranksize;
+        bool mranksvalid;
+        std::vector<int> msiteranks;
+        bool midentityranks;
+        int mrankoffset;
+
         // methods
-        void advanceWhileInvalid();
         bool bondOutOfRange() const;
         bool atSelfPair() const;
         void setFinishedFlag();
 
 };
 
+// Inline Methods ------------------------------------------------------------
+
+/// Return offset of the site from msite_first or -1 if it is not selected.
+/// This requires preceding call of rankSelectedSites.
+inline
+int BaseBondGenerator::selectedSiteOffset(int site) const
+{
+    int rv = (midentityranks ? site : msiteranks[site]) - mrankoffset;
+    return (0 <= rv && rv < msite_last - msite_first) ? rv : -1;
+}
 
 }   // namespace srreal
 }   // namespace diffpy
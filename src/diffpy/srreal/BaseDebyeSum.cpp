@@ -21,8 +21,14 @@
 #include <stdexcept>
 #include <sstream>
 #include <functional>
+#include <algorithm>
+#include <atomic>
+#include <thread>
 
 #include <diffpy/srreal/BaseDebyeSum.hpp>
+#include <diffpy/srreal/DebyeGrid.hpp>
+#include <diffpy/srreal/ConstantPeakWidth.hpp>
+#include <diffpy/srreal/JeongPeakWidth.hpp>
 #include <diffpy/mathutils.hpp>
 #include <diffpy/validators.hpp>
 #include <diffpy/serialization.ipp>
@@ -42,6 +48,145 @@ namespace {
 /// Default cutoff for the Q-decreasing scale of the sine contributions.
 const double DEFAULT_DEBYE_PRECISION = 1e-6;
 
+/// number of Q-points advanced together in addDebyeSineTerms
+const int DEBYE_LANES = 4;
+/// number of Q-points between exact evaluations of the recurrences,
+/// the accumulated relative error is about DEBYE_BLOCK * DOUBLE_EPS
+const int DEBYE_BLOCK = 64;
+/// number of Q-points in the tiles of flushDeferredTerms,
+/// a multiple of DEBYE_BLOCK
+const int Q_TILE_POINTS = 8 * DEBYE_BLOCK;
+
+/// Debye-Waller factors dw(q) = exp(-0.5 * (dwsigma * q)**2) on the
+/// Q-grid, which are evaluated in blocks by multiplication with the
+/// ratios exp(-a * (2 * k + 1)), which are also updated by multiplication
+class DebyeWallerRecurrence
+{
+    public:
+
+        DebyeWallerRecurrence(double dwsigma, double qstep) :
+            a(0.5 * pow(dwsigma * qstep, 2)),
+            c1(exp(-2 * a)),
+            cL(exp(-2 * a * DEBYE_LANES * DEBYE_LANES)),
+            cR(exp(-2 * a * DEBYE_LANES))
+        { }
+
+        /// store dw(q) for kq in [kb, kbhi) to gbuf[kq - kb]
+        void fillBlock(double* gbuf, int kb, int kbhi) const
+        {
+            const int L = DEBYE_LANES;
+            // exact values at the first point of the block
+            double g[L], r[L];
+            g[0] = exp(-a * kb * kb);
+            double r1 = exp(-a * (2 * kb + 1));
+            r[0] = exp(-a * (2 * kb * L + L * L));
+            for (int j = 1; j < L; ++j)
+            {
+                g[j] = g[j - 1] * r1;
+                r1 *= c1;
+                r[j] = r[j - 1] * cR;
+            }
+            // advance the lanes in steps of L points
+            for (int k = kb; k < kbhi; k += L)
+            {
+                double* gk = gbuf + (k - kb);
+                for (int j = 0; j < L; ++j)
+                {
+                    gk[j] = g[j];
+                    g[j] *= r[j];
+                    r[j] *= cL;
+                }
+            }
+        }
+
+    private:
+
+        const double a;
+        const double c1;
+        const double cL;
+        const double cR;
+};
+
+
+/// Add Debye sum terms scale * dw(q) * sfpair[kq] * sin(q * dist)
+/// for q = kq * qstep and kq in [kqlo, kqhi) to y[kq] and to yp[kq]
+/// unless yp is NULL.  dw(q) is the Debye-Waller factor
+/// exp(-0.5 * (dwsigma * q)**2).  Stop at the first term whose sine
+/// scale is negligible compared to sineprec and return its index.
+/// The recurrences restart at kqlo and at every DEBYE_BLOCK points.
+int addDebyeSineTerms(double* y, double* yp,
+        int kqlo, int kqhi, double qstep,
+        double dist, double dwsigma, double scale, const double* sfpair,
+        double sineprec)
+{
+    const int L = DEBYE_LANES;
+    // sin(k * theta) are advanced by rotation of the (sin, cos) pairs
+    const double theta = qstep * dist;
+    const double sinth = sin(theta);
+    const double costh = cos(theta);
+    const double sinLth = sin(L * theta);
+    const double cosLth = cos(L * theta);
+    const DebyeWallerRecurrence dw(dwsigma, qstep);
+    double gbuf[DEBYE_BLOCK];
+    double sbuf[DEBYE_BLOCK];
+    for (int kb = kqlo; kb < kqhi; kb += DEBYE_BLOCK)
+    {
+        const int kbhi = min(kqhi, kb + DEBYE_BLOCK);
+        dw.fillBlock(gbuf, kb, kbhi);
+        // exact values at the first point of the block
+        double sn[L], cs[L];
+        sn[0] = sin(kb * theta);
+        cs[0] = cos(kb * theta);
+        for (int j = 1; j < L; ++j)
+        {
+            sn[j] = sn[j - 1] * costh + cs[j - 1] * sinth;
+            cs[j] = cs[j - 1] * costh - sn[j - 1] * sinth;
+        }
+        // advance the lanes in steps of L points
+        for (int k = kb; k < kbhi; k += L)
+        {
+            double* sk = sbuf + (k - kb);
+            for (int j = 0; j < L; ++j)
+            {
+                sk[j] = sn[j];
+                const double snj = sn[j];
+                sn[j] = snj * cosLth + cs[j] * sinLth;
+                cs[j] = cs[j] * cosLth - snj * sinLth;
+            }
+        }
+        for (int k = kb; k < kbhi; ++k)
+        {
+            const double sinescale = scale * gbuf[k - kb] * sfpair[k];
+            if (eps_eq(0.0, sinescale, sineprec))  return k;
+            const double dsum = sinescale * sbuf[k - kb];
+            y[k] += dsum;
+            if (yp)  yp[k] += dsum;
+        }
+    }
+    return kqhi;
+}
+
+
+/// Return the index where addDebyeSineTerms for the same arguments
+/// would stop the summation.
+int debyeSineCutoff(int kqlo, int kqhi, double qstep,
+        double dwsigma, double scale, const double* sfpair, double sineprec)
+{
+    const DebyeWallerRecurrence dw(dwsigma, qstep);
+    double gbuf[DEBYE_BLOCK];
+    for (int kb = kqlo; kb < kqhi; kb += DEBYE_BLOCK)
+    {
+        const int kbhi = min(kqhi, kb + DEBYE_BLOCK);
+        dw.fillBlock(gbuf, kb, kbhi);
+        for (int k = kb; k < kbhi; ++k)
+        {
+            const double sinescale = scale * gbuf[k - kb] * sfpair[k];
+            if (eps_eq(0.0, sinescale, sineprec))  return k;
+        }
+    }
+    return kqhi;
+}
+
 }   // namespace
 
 // Constructor ---------------------------------------------------------------
@@ -50,9 +195,15 @@ BaseDebyeSum::BaseDebyeSum() :
     mqmin(0.0),
     mqmax(DEFAULT_QGRID_QMAX),
     mqstep(DEFAULT_QGRID_QSTEP),
-    mdebyeprecision(DEFAULT_DEBYE_PRECISION)
+    mdebyeprecision(DEFAULT_DEBYE_PRECISION),
+    mdebyebinwidth(0.0),
+    mdebyegridprecision(0.0),
+    mevaluatepartials(false),
+    mevaluategradients(false),
+    mqtilethreads(0)
 {
     mstructure_cache.totaloccupancy = 0.0;
+    mstructure_cache.sfqstep = 0.0;
     // default configuration
     this->setPeakWidthModelByType("jeong");
     this->setEvaluatorType(OPTIMIZED);
@@ -60,6 +211,12 @@ BaseDebyeSum::BaseDebyeSum() :
     this->registerDoubleAttribute("debyeprecision", this,
             &BaseDebyeSum::getDebyePrecision,
             &BaseDebyeSum::setDebyePrecision);
+    this->registerDoubleAttribute("debyebinwidth", this,
+            &BaseDebyeSum::getDebyeBinWidth,
+            &BaseDebyeSum::setDebyeBinWidth);
+    this->registerDoubleAttribute("debyegridprecision", this,
+            &BaseDebyeSum::getDebyeGridPrecision,
+            &BaseDebyeSum::setDebyeGridPrecision);
 }
 
 // Public Methods ------------------------------------------------------------
@@ -79,6 +236,8 @@ QuantityType BaseDebyeSum::getF() const
     QuantityType rv = this->value();
     const double& totocc = mstructure_cache.totaloccupancy;
     const int npts = pdfutils_qmaxSteps(this);
+    // discard the partial sums
+    if (int(rv.size()) > npts)  rv.resize(npts);
     for (int kq = pdfutils_qminSteps(this); kq < npts; ++kq)
     {
         double sfavg = this->sfAverageAtkQ(kq);
@@ -152,18 +311,183 @@ const double& BaseDebyeSum::getDebyePrecision() const
     return mdebyeprecision;
 }
 
+// distance histogram
+
+void BaseDebyeSum::setDebyeBinWidth(double binwidth)
+{
+    ensureNonNegative("debyebinwidth", binwidth);
+    if (mdebyebinwidth != binwidth)  mticker.click();
+    mdebyebinwidth = binwidth;
+}
+
+
+const double& BaseDebyeSum::getDebyeBinWidth() const
+{
+    return mdebyebinwidth;
+}
+
+// Q-grid decomposition
+
+void BaseDebyeSum::setQTileThreads(int nthreads)
+{
+    ensureNonNegative("qtilethreads", nthreads);
+    mqtilethreads = nthreads;
+}
+
+
+int BaseDebyeSum::getQTileThreads() const
+{
+    return mqtilethreads;
+}
+
+// reciprocal-space grid
+
+void BaseDebyeSum::setDebyeGridPrecision(double eps)
+{
+    ensureNonNegative("debyegridprecision", eps);
+    if (eps >= 1)
+    {
+        const char* emsg = "debyegridprecision must be less than 1.";
+        throw invalid_argument(emsg);
+    }
+    if (mdebyegridprecision != eps)  mticker.click();
+    mdebyegridprecision = eps;
+}
+
+
+const double& BaseDebyeSum::getDebyeGridPrecision() const
+{
+    return mdebyegridprecision;
+}
+
+// partial structure factors
+
+void BaseDebyeSum::setEvaluatePartials(bool flag)
+{
+    if (mevaluatepartials != flag)  mticker.click();
+    mevaluatepartials = flag;
+}
+
+
+bool BaseDebyeSum::getEvaluatePartials() const
+{
+    return mevaluatepartials;
+}
+
+
+const vector<string>& BaseDebyeSum::getPartialTypes() const
+{
+    return mstructure_cache.atomtypes;
+}
+
+
+QuantityType BaseDebyeSum::getPartialF(int tp0, int tp1) const
+{
+    const double* pv = this->value().data() + this->partialOffset(tp0, tp1);
+    const double& totocc = mstructure_cache.totaloccupancy;
+    const QuantityType& sf0 = mstructure_cache.sftypeatkq[tp0];
+    const QuantityType& sf1 = mstructure_cache.sftypeatkq[tp1];
+    // partial F = F_pair / weight = F_pair * <f>^2 / (c0 f0 c1 f1)
+    const double mpairs = ((tp0 == tp1) ? 1.0 : 2.0) *
+        mstructure_cache.typemultiplicity[tp0] *
+        mstructure_cache.typemultiplicity[tp1];
+    const int npts = pdfutils_qmaxSteps(this);
+    QuantityType rv(npts, 0.0);
+    for (int kq = pdfutils_qminSteps(this); kq < npts; ++kq)
+    {
+        double sfpairs = mpairs * sf0[kq] * sf1[kq];
+        rv[kq] = (sfpairs == 0) ? 0.0 : (pv[kq] * totocc / sfpairs);
+    }
+    return rv;
+}
+
+
+QuantityType BaseDebyeSum::getPartialWeights(int tp0, int tp1) const
+{
+    this->partialOffset(tp0, tp1);
+    const double& totocc = mstructure_cache.totaloccupancy;
+    const QuantityType& sf0 = mstructure_cache.sftypeatkq[tp0];
+    const QuantityType& sf1 = mstructure_cache.sftypeatkq[tp1];
+    const double mpairs = ((tp0 == tp1) ? 1.0 : 2.0) *
+        mstructure_cache.typemultiplicity[tp0] *
+        mstructure_cache.typemultiplicity[tp1];
+    const int npts = pdfutils_qmaxSteps(this);
+    QuantityType rv(npts, 0.0);
+    for (int kq = pdfutils_qminSteps(this); kq < npts; ++kq)
+    {
+        double sftotal = this->sfAverageAtkQ(kq) * totocc;
+        rv[kq] = (sftotal == 0) ? 0.0 :
+            (mpairs * sf0[kq] * sf1[kq] / (sftotal * sftotal));
+    }
+    return rv;
+}
+
+// site gradients
+
+void BaseDebyeSum::setEvaluateGradients(bool flag)
+{
+    if (mevaluategradients != flag)  mticker.click();
+    mevaluategradients = flag;
+}
+
+
+bool BaseDebyeSum::getEvaluateGradients() const
+{
+    return mevaluategradients;
+}
+
+
+QuantityType BaseDebyeSum::getFGradient(int siteidx, SiteParameter p) const
+{
+    const double* gv = this->value().data() +
+        this->gradientOffset(siteidx, p);
+    const double& totocc = mstructure_cache.totaloccupancy;
+    const int npts = pdfutils_qmaxSteps(this);
+    QuantityType rv(npts, 0.0);
+    for (int kq = pdfutils_qminSteps(this); kq < npts; ++kq)
+    {
+        double sfavg = this->sfAverageAtkQ(kq);
+        double fscale = (sfavg * totocc) == 0 ? 0.0 :
+            1.0 / (sfavg * sfavg * totocc);
+        rv[kq] = gv[kq] * fscale;
+    }
+    return rv;
+}
+
 // Protected Methods ---------------------------------------------------------
 
 // PairQuantity overloads
 
 void BaseDebyeSum::resetValue()
 {
+    this->cacheSiteTypeData();
+    this->BaseDebyeSum::resetFrameValue();
+}
+
+
+void BaseDebyeSum::resetFrameValue()
+{
+    mhistogram.clear();
+    mpairterms.clear();
+    // the Q-grid may follow the displacement parameters of the frame
+    if (mstructure_cache.sfqstep != this->getQstep())
+    {
+        this->cacheSiteTypeData();
+    }
     this->cacheStructureData();
-    this->resizeValue(pdfutils_qmaxSteps(this));
+    const int nsums = 1 + this->countPartials() + this->countGradients();
+    this->resizeValue(nsums * pdfutils_qmaxSteps(this));
     this->PairQuantity::resetValue();
 }
 
 
+void BaseDebyeSum::configureBondGenerator(BaseBondGenerator& bnds) const
+{
+    bnds.setRmin(this->debyeRmin());
+    bnds.setRmax(this->debyeRmax());
+}
+
+
 void BaseDebyeSum::addPairContribution(const BaseBondGenerator& bnds,
         int summationscale)
 {
@@ -175,30 +499,163 @@ void BaseDebyeSum::addPairContribution(const BaseBondGenerator& bnds,
     const double dwsigma = fwhmtosigma * fwhm;
     const int nqpts = pdfutils_qmaxSteps(this);
     const int smscale = summationscale * bnds.multiplicity();
+    int kqhi = nqpts;
+    if (this->defersSummation())
+    {
+        this->deferPairTerm(bnds.site0(), bnds.site1(),
+                dist, fwhm, smscale);
+    }
+    else
+    {
+        const QuantityType& sfpair =
+            this->sfPairAtkQ(bnds.site0(), bnds.site1());
+        assert(nqpts <= int(sfpair.size()));
+        double* pv = this->partialValue(bnds.site0(), bnds.site1());
+        kqhi = addDebyeSineTerms(mvalue.data(), pv,
+                pdfutils_qminSteps(this), nqpts, this->getQstep(), dist,
+                dwsigma, double(smscale) / dist, sfpair.data(),
+                this->getDebyePrecision());
+    }
+    if (mevaluategradients)
+    {
+        this->addPairGradients(bnds, fwhm, smscale, kqhi);
+    }
+}
+
+
+bool BaseDebyeSum::configureBondBatch(BondBatch& batch) const
+{
+    // site gradients need the bond generator
+    if (mevaluategradients)  return false;
+    return this->getPeakWidthModel()->configureBondBatch(batch);
+}
+
+
+void BaseDebyeSum::addPairContributions(const BondBatch& batch)
+{
+    this->getPeakWidthModel()->calculateBatch(batch, mbatchfwhm);
+    const double fwhmtosigma = 1.0 / (2 * sqrt(2 * M_LN2));
+    const int kqlo = pdfutils_qminSteps(this);
+    const int nqpts = pdfutils_qmaxSteps(this);
+    const double& qstep = this->getQstep();
     const double& sineprec = this->getDebyePrecision();
-    for (int kq = pdfutils_qminSteps(this); kq < nqpts; ++kq)
+    const int n = batch.size();
+    for (int k = 0; k < n; ++k)
     {
-        const double q = kq * this->getQstep();
-        const double dwscale = exp(-0.5 * pow(dwsigma * q, 2));
-        const double sinescale = smscale * dwscale *
-            this->sfSiteAtkQ(bnds.site0(), kq) *
-            this->sfSiteAtkQ(bnds.site1(), kq) / dist;
-        if (eps_eq(0.0, sinescale, sineprec))   break;
-        mvalue[kq] += sinescale * sin(q * dist);
+        const double& dist = batch.distance[k];
+        if (eps_eq(0.0, dist))  continue;
+        const int smscale = batch.summationscale[k] * batch.multiplicity[k];
+        if (this->defersSummation())
+        {
+            this->deferPairTerm(batch.site0, batch.site1[k],
+                    dist, mbatchfwhm[k], smscale);
+            continue;
+        }
+        const double dwsigma = fwhmtosigma * mbatchfwhm[k];
+        const QuantityType& sfpair =
+            this->sfPairAtkQ(batch.site0, batch.site1[k]);
+        assert(nqpts <= int(sfpair.size()));
+        double* pv = this->partialValue(batch.site0, batch.site1[k]);
+        addDebyeSineTerms(mvalue.data(), pv, kqlo, nqpts, qstep, dist,
+                dwsigma, double(smscale) / dist, sfpair.data(), sineprec);
+    }
+}
+
+
+void BaseDebyeSum::executeThreadedMerge(const PairQuantity& other)
+{
+    this->PairQuantity::executeThreadedMerge(other);
+    const BaseDebyeSum& dbs = dynamic_cast<const BaseDebyeSum&>(other);
+    for (const Histogram::value_type& bc : dbs.mhistogram)
+    {
+        mhistogram[bc.first] += bc.second;
+    }
+    mpairterms.insert(mpairterms.end(),
+            dbs.mpairterms.begin(), dbs.mpairterms.end());
+}
+
+
+void BaseDebyeSum::finishValue()
+{
+    this->flushDeferredTerms();
+    // parallel workers leave the grid sum to the merged value
+    if (this->usesGridSum() && !mevaluator->isParallel())
+    {
+        this->evaluateGridSum();
     }
+    this->PairQuantity::finishValue();
+}
+
+
+bool BaseDebyeSum::sumsPairContributions() const
+{
+    // the grid summation evaluates all pairs in finishValue
+    return !this->usesGridSum();
+}
+
+
+bool BaseDebyeSum::hasSiteIndexedValue() const
+{
+    return mevaluategradients;
 }
 
 
 void BaseDebyeSum::stashPartialValue()
 {
+    // the deferred pairs use atom type indices of the current structure
+    this->flushDeferredTerms();
     mdbsumstash = this->value();
+    mdbsumstashtypes = mstructure_cache.atomtypes;
+    mdbsumstashsites = this->countCachedSites();
 }
 
 
 void BaseDebyeSum::restorePartialValue()
 {
-    assert(mdbsumstash.size() == mvalue.size());
-    mvalue.swap(mdbsumstash);
+    const bool sametypes = !mevaluatepartials ||
+        mdbsumstashtypes == mstructure_cache.atomtypes;
+    const bool samesites = !mevaluategradients ||
+        mdbsumstashsites == this->countCachedSites();
+    if (sametypes && samesites)
+    {
+        assert(mdbsumstash.size() == mvalue.size());
+        mvalue.swap(mdbsumstash);
+        mdbsumstash.clear();
+        return;
+    }
+    // value layout has changed, move the sums to their new positions
+    const int nqpts = pdfutils_qmaxSteps(this);
+    QuantityType::const_iterator src = mdbsumstash.begin();
+    copy(src, src + nqpts, mvalue.begin());
+    int npairs = 0;
+    if (this->countPartials())
+    {
+        // atom types may have changed, map the partials to new type pairs
+        vector<int> pairmap = pdfutils_typePairRemap(
+                mdbsumstashtypes, mstructure_cache.atomtypes);
+        npairs = pairmap.size();
+        for (int ps = 0; ps < npairs; ++ps)
+        {
+            // contributions of the removed atom types have been subtracted
+            if (pairmap[ps] < 0)  continue;
+            src = mdbsumstash.begin() + (1 + ps) * nqpts;
+            copy(src, src + nqpts,
+                    mvalue.begin() + (1 + pairmap[ps]) * nqpts);
+        }
+    }
+    if (this->countGradients())
+    {
+        // site indices are preserved, the gradients of the removed sites
+        // are discarded and the added sites start from zero.
+        const int ngrads0 = SITE_PARAMETER_COUNT * mdbsumstashsites;
+        const int ngrads = min(ngrads0, this->countGradients());
+        src = mdbsumstash.begin() + (1 + npairs) * nqpts;
+        copy(src, src + ngrads * nqpts,
+                mvalue.begin() + (1 + this->countPartials()) * nqpts);
+    }
+    assert(int(mdbsumstash.size()) == (1 + npairs) * nqpts +
+            (mevaluategradients ?
+             SITE_PARAMETER_COUNT * mdbsumstashsites * nqpts : 0));
     mdbsumstash.clear();
 }
 
@@ -208,16 +665,29 @@ double BaseDebyeSum::sfSiteAtQ(int siteidx, const double& q) const
     return 1.0;
 }
 
+
+double BaseDebyeSum::debyeRmin() const
+{
+    return this->getRmin();
+}
+
+
+double BaseDebyeSum::debyeRmax() const
+{
+    return this->getRmax();
+}
+
 // Private Methods -----------------------------------------------------------
 
-double BaseDebyeSum::sfSiteAtkQ(int siteidx, int kq) const
+const QuantityType& BaseDebyeSum::sfPairAtkQ(int site0, int site1) const
 {
-    assert(0 <= siteidx && siteidx < int(mstructure_cache.typeofsite.size()));
-    int typeidx = mstructure_cache.typeofsite[siteidx];
-    assert(typeidx < int(mstructure_cache.sftypeatkq.size()));
-    const QuantityType& sfarray = mstructure_cache.sftypeatkq[typeidx];
-    assert(0 <= kq && kq < int(sfarray.size()));
-    return sfarray[kq];
+    const vector<int>& typeofsite = mstructure_cache.typeofsite;
+    assert(0 <= site0 && site0 < int(typeofsite.size()));
+    assert(0 <= site1 && site1 < int(typeofsite.size()));
+    const int ps = pdfutils_typePairIndex(
+            typeofsite[site0], typeofsite[site1]);
+    assert(ps < int(mstructure_cache.sfpairatkq.size()));
+    return mstructure_cache.sfpairatkq[ps];
 }
 
 
@@ -228,9 +698,18 @@ double BaseDebyeSum::sfAverageAtkQ(int kq) const
 }
 
 
-void BaseDebyeSum::cacheStructureData()
+/// Number of sites in the value layout.  This is the site count at the
+/// last value reset, the structure may be changed in place before
+/// PQEvaluatorOptimized removes the contributions of its old sites.
+int BaseDebyeSum::countCachedSites() const
+{
+    return mstructure_cache.typeofsite.size();
+}
+
+
+/// Cache scattering factors of the atom types on the current Q-grid.
+void BaseDebyeSum::cacheSiteTypeData()
 {
-    using std::placeholders::_1;
     int cntsites = this->countSites();
     const int nqpts = pdfutils_qmaxSteps(this);
     QuantityType zeros(nqpts, 0.0);
@@ -238,6 +717,7 @@ void BaseDebyeSum::cacheStructureData()
     // sftypeatkq
     mstructure_cache.typeofsite.clear();
     mstructure_cache.typeofsite.reserve(cntsites);
+    mstructure_cache.atomtypes.clear();
     mstructure_cache.sftypeatkq.clear();
     for (int siteidx = 0; siteidx < cntsites; ++siteidx)
     {
@@ -245,6 +725,7 @@ void BaseDebyeSum::cacheStructureData()
         if (!atomtypeidx.count(smbl))
         {
             atomtypeidx.insert(make_pair(smbl, int(atomtypeidx.size())));
+            mstructure_cache.atomtypes.push_back(smbl);
         }
         int tpidx = atomtypeidx[smbl];
         mstructure_cache.typeofsite.push_back(tpidx);
@@ -262,13 +743,27 @@ void BaseDebyeSum::cacheStructureData()
     }
     assert(cntsites == int(mstructure_cache.typeofsite.size()));
     assert(atomtypeidx.size() == mstructure_cache.sftypeatkq.size());
+    mstructure_cache.sfqstep = this->getQstep();
+    // sfpairatkq
+    this->cacheTypePairProducts();
+}
+
+
+void BaseDebyeSum::cacheStructureData()
+{
+    using std::placeholders::_1;
+    int cntsites = this->countSites();
+    assert(cntsites == int(mstructure_cache.typeofsite.size()));
+    const int nqpts = pdfutils_qmaxSteps(this);
+    QuantityType zeros(nqpts, 0.0);
     // totaloccupancy
     mstructure_cache.totaloccupancy = mstructure->totalOccupancy();
     // sfaverageatkq
     QuantityType& sfak = mstructure_cache.sfaverageatkq;
     sfak = zeros;
     int ntps = mstructure_cache.sftypeatkq.size();
-    vector<int> tpmultipl(ntps, 0);
+    vector<int>& tpmultipl = mstructure_cache.typemultiplicity;
+    tpmultipl.assign(ntps, 0);
     for (int siteidx = 0; siteidx < cntsites; ++siteidx)
     {
         int tpidx = mstructure_cache.typeofsite[siteidx];
@@ -290,6 +785,331 @@ void BaseDebyeSum::cacheStructureData()
             bind(multiplies<double>(), tosc, _1));
 }
 
+
+void BaseDebyeSum::cacheTypePairProducts()
+{
+    const vector<QuantityType>& sftp = mstructure_cache.sftypeatkq;
+    const int ntps = sftp.size();
+    vector<QuantityType>& sfpair = mstructure_cache.sfpairatkq;
+    sfpair.resize(pdfutils_countTypePairs(ntps));
+    for (int j = 0; j < ntps; ++j)
+    {
+        for (int i = 0; i <= j; ++i)
+        {
+            QuantityType& sfij = sfpair[pdfutils_typePairIndex(i, j)];
+            sfij.resize(sftp[i].size());
+            transform(sftp[i].begin(), sftp[i].end(), sftp[j].begin(),
+                    sfij.begin(), multiplies<double>());
+        }
+    }
+}
+
+
+int BaseDebyeSum::countPartials() const
+{
+    if (!mevaluatepartials)  return 0;
+    return pdfutils_countTypePairs(mstructure_cache.atomtypes.size());
+}
+
+
+double* BaseDebyeSum::partialValue(int site0, int site1)
+{
+    if (!mevaluatepartials)  return NULL;
+    const vector<int>& typeofsite = mstructure_cache.typeofsite;
+    assert(0 <= site0 && site0 < int(typeofsite.size()));
+    assert(0 <= site1 && site1 < int(typeofsite.size()));
+    const int ps = pdfutils_typePairIndex(
+            typeofsite[site0], typeofsite[site1]);
+    const int nqpts = pdfutils_qmaxSteps(this);
+    assert(int(mvalue.size()) >= (2 + ps) * nqpts);
+    return mvalue.data() + (1 + ps) * nqpts;
+}
+
+
+int BaseDebyeSum::partialOffset(int tp0, int tp1) const
+{
+    const int nqpts = pdfutils_qmaxSteps(this);
+    const int nsums = 1 + this->countPartials() + this->countGradients();
+    if (!mevaluatepartials || int(mvalue.size()) != nsums * nqpts)
+    {
+        const char* emsg = "Partial sums are not available, "
+            "enable evaluatepartials and recalculate.";
+        throw logic_error(emsg);
+    }
+    const int ntps = mstructure_cache.atomtypes.size();
+    if (tp0 < 0 || tp0 >= ntps || tp1 < 0 || tp1 >= ntps)
+    {
+        const char* emsg = "Index out of range.";
+        throw invalid_argument(emsg);
+    }
+    return (1 + pdfutils_typePairIndex(tp0, tp1)) * nqpts;
+}
+
+
+int BaseDebyeSum::countGradients() const
+{
+    if (!mevaluategradients)  return 0;
+    return SITE_PARAMETER_COUNT * this->countCachedSites();
+}
+
+
+int BaseDebyeSum::gradientOffset(int siteidx, int p) const
+{
+    const int nqpts = pdfutils_qmaxSteps(this);
+    const int nsums = 1 + this->countPartials() + this->countGradients();
+    if (!mevaluategradients || int(mvalue.size()) != nsums * nqpts)
+    {
+        const char* emsg = "Site gradients are not available, "
+            "enable evaluategradients and recalculate.";
+        throw logic_error(emsg);
+    }
+    if (siteidx < 0 || siteidx >= this->countCachedSites() ||
+            p < 0 || p >= SITE_PARAMETER_COUNT)
+    {
+        const char* emsg = "Index out of range.";
+        throw invalid_argument(emsg);
+    }
+    const int gs = SITE_PARAMETER_COUNT * siteidx + p;
+    return (1 + this->countPartials() + gs) * nqpts;
+}
+
+
+void BaseDebyeSum::addPairGradients(const BaseBondGenerator& bnds,
+        double fwhm, int smscale, int kqhi)
+{
+    const double dist = bnds.distance();
+    const double fwhmtosigma = 1.0 / (2 * sqrt(2 * M_LN2));
+    const double dwsigma = fwhmtosigma * fwhm;
+    const int kqlo = pdfutils_qminSteps(this);
+    const int nqpts = pdfutils_qmaxSteps(this);
+    const QuantityType& sfpair = this->sfPairAtkQ(bnds.site0(), bnds.site1());
+    mbondderivatives.resize(2 * nqpts);
+    double* dvdd = mbondderivatives.data();
+    double* dvdmsd = dvdd + nqpts;
+    double dwdd, dwdmsd;
+    this->getPeakWidthModel()->calculateDerivatives(bnds, dwdd, dwdmsd);
+    const double& sineprec = this->getDebyePrecision();
+    // use the same summation cutoff as addPairContribution
+    int kq = kqlo;
+    for (; kq < kqhi; ++kq)
+    {
+        const double q = kq * this->getQstep();
+        const double dwscale = exp(-0.5 * pow(dwsigma * q, 2));
+        const double sinescale = smscale * dwscale * sfpair[kq] / dist;
+        if (eps_eq(0.0, sinescale, sineprec))   break;
+        const double sinqd = sin(q * dist);
+        const double dsum = sinescale * sinqd;
+        // derivative with respect to fwhm from the Debye-Waller factor
+        const double dsumdw = -dsum * dwsigma * q * q * fwhmtosigma;
+        dvdd[kq - kqlo] = sinescale * (q * cos(q * dist) - sinqd / dist) +
+            dsumdw * dwdd;
+        dvdmsd[kq - kqlo] = dsumdw * dwdmsd;
+    }
+    double* grad = mvalue.data() + (1 + this->countPartials()) * nqpts;
+    pdfutils_addBondGradients(grad, nqpts, bnds,
+            kqlo, kq - kqlo, dvdd, dvdmsd);
+}
+
+
+bool BaseDebyeSum::defersSummation() const
+{
+    return mdebyebinwidth > 0 || mqtilethreads > 1;
+}
+
+
+void BaseDebyeSum::deferPairTerm(int site0, int site1,
+        double dist, double fwhm, int smscale)
+{
+    const vector<int>& typeofsite = mstructure_cache.typeofsite;
+    const int typepair = pdfutils_typePairIndex(
+            typeofsite[site0], typeofsite[site1]);
+    if (mdebyebinwidth > 0)
+    {
+        HistogramBin b;
+        b.typepair = typepair;
+        b.widthbin = int(floor(fwhm / mdebyebinwidth + 0.5));
+        b.distbin = long(floor(dist / mdebyebinwidth + 0.5));
+        mhistogram[b] += smscale;
+        return;
+    }
+    const double fwhmtosigma = 1.0 / (2 * sqrt(2 * M_LN2));
+    PairTerm t = {typepair, dist, fwhmtosigma * fwhm, smscale / dist};
+    mpairterms.push_back(t);
+}
+
+
+void BaseDebyeSum::flushDeferredTerms()
+{
+    // convert the occupied bins to pair terms
+    const double fwhmtosigma = 1.0 / (2 * sqrt(2 * M_LN2));
+    for (const Histogram::value_type& bc : mhistogram)
+    {
+        const HistogramBin& b = bc.first;
+        const int& count = bc.second;
+        if (count == 0 || b.distbin == 0)  continue;
+        const double dist = b.distbin * mdebyebinwidth;
+        PairTerm t = {b.typepair, dist,
+            fwhmtosigma * b.widthbin * mdebyebinwidth, count / dist};
+        mpairterms.push_back(t);
+    }
+    mhistogram.clear();
+    if (mpairterms.empty())  return;
+    const int kqlo = pdfutils_qminSteps(this);
+    const int nqpts = pdfutils_qmaxSteps(this);
+    const double& qstep = this->getQstep();
+    const double& sineprec = this->getDebyePrecision();
+    const vector<QuantityType>& sfpairatkq = mstructure_cache.sfpairatkq;
+    const int nterms = mpairterms.size();
+    // Q-tiles start at multiples of the recurrence block so that the
+    // recurrences are the same as in the untiled summation
+    const int ntiles = (nqpts - kqlo + Q_TILE_POINTS - 1) / Q_TILE_POINTS;
+    const int nthreads = max(1, min(mqtilethreads, ntiles));
+    auto runthreads = [nthreads](const function<void()>& work) {
+        vector<thread> threads;
+        threads.reserve(nthreads - 1);
+        for (int i = 1; i < nthreads; ++i)  threads.emplace_back(work);
+        work();
+        for (thread& th : threads)  th.join();
+    };
+    // find the debyeprecision cutoffs over the full Q-range so that
+    // the tiles stop each term at the same point as the untiled sum
+    vector<int> kqcut(nterms, nqpts);
+    if (ntiles > 1)
+    {
+        atomic<int> nextterm(0);
+        auto findcutoffs = [&]() {
+            for (int i = nextterm++; i < nterms; i = nextterm++)
+            {
+                const PairTerm& t = mpairterms[i];
+                const QuantityType& sfpair = sfpairatkq[t.typepair];
+                kqcut[i] = debyeSineCutoff(kqlo, nqpts, qstep,
+                        t.dwsigma, t.scale, sfpair.data(), sineprec);
+            }
+        };
+        runthreads(findcutoffs);
+    }
+    atomic<int> nexttile(0);
+    auto sumtiles = [&]() {
+        for (int tile = nexttile++; tile < ntiles; tile = nexttile++)
+        {
+            const int k0 = kqlo + tile * Q_TILE_POINTS;
+            const int k1 = min(nqpts, k0 + Q_TILE_POINTS);
+            for (int i = 0; i < nterms; ++i)
+            {
+                const PairTerm& t = mpairterms[i];
+                if (kqcut[i] <= k0)  continue;
+                assert(t.typepair < int(sfpairatkq.size()));
+                const QuantityType& sfpair = sfpairatkq[t.typepair];
+                assert(nqpts <= int(sfpair.size()));
+                double* pv = !mevaluatepartials ? NULL :
+                    (mvalue.data() + (1 + t.typepair) * nqpts);
+                addDebyeSineTerms(mvalue.data(), pv, k0, min(k1, kqcut[i]),
+                        qstep, t.dist, t.dwsigma, t.scale, sfpair.data(),
+                        sineprec);
+            }
+        }
+    };
+    runthreads(sumtiles);
+    mpairterms.clear();
+}
+
+
+bool BaseDebyeSum::usesGridSum() const
+{
+    return mdebyegridprecision > 0;
+}
+
+
+double BaseDebyeSum::gridSiteVariance(int siteidx) const
+{
+    const PeakWidthModel* pwm = this->getPeakWidthModel().get();
+    const JeongPeakWidth* jpw = dynamic_cast<const JeongPeakWidth*>(pwm);
+    const bool nocorrections = !jpw ||
+        (jpw->getDelta1() == 0 && jpw->getDelta2() == 0 &&
+         jpw->getQbroad() == 0 && jpw->getQbroad_seperable() == 0);
+    if (dynamic_cast<const DebyeWallerPeakWidth*>(pwm) && nocorrections)
+    {
+        const R3::Matrix& Uij = mstructure->siteCartesianUij(siteidx);
+        return (Uij(0, 0) + Uij(1, 1) + Uij(2, 2)) / 3;
+    }
+    const ConstantPeakWidth* cpw = dynamic_cast<const ConstantPeakWidth*>(pwm);
+    if (cpw)
+    {
+        // the pair variance is split evenly among the sites
+        const double fwhmtosigma = 1.0 / (2 * sqrt(2 * M_LN2));
+        return 0.5 * pow(fwhmtosigma * cpw->getWidth(), 2);
+    }
+    const char* emsg = "Grid summation requires constant, debye-waller "
+        "or jeong peak width without corrections.";
+    throw invalid_argument(emsg);
+}
+
+
+void BaseDebyeSum::evaluateGridSum()
+{
+    if (mevaluategradients)
+    {
+        const char* emsg = "Site gradients are not available "
+            "for the grid summation, set debyegridprecision to 0.";
+        throw logic_error(emsg);
+    }
+    if (mstructure->numberDensity() > 0)
+    {
+        const char* emsg = "Grid summation requires non-periodic structure.";
+        throw invalid_argument(emsg);
+    }
+    const int kqlo = pdfutils_qminSteps(this);
+    const int nqpts = pdfutils_qmaxSteps(this);
+    const int nsums = 1 + this->countPartials();
+    assert(int(mvalue.size()) >= nsums * nqpts);
+    fill(mvalue.begin(), mvalue.begin() + nsums * nqpts, 0.0);
+    const int cntsites = this->countSites();
+    if (nqpts < 2 || cntsites < 2)  return;
+    const double& qstep = this->getQstep();
+    DebyeGrid grid((nqpts - 1) * qstep, mdebyegridprecision);
+    const vector<int>& typeofsite = mstructure_cache.typeofsite;
+    for (int i = 0; i < cntsites; ++i)
+    {
+        grid.addAtom(typeofsite[i], mstructure->siteCartesianPosition(i),
+                this->gridSiteVariance(i));
+    }
+    vector<DebyeGrid::Distribution> dists =
+        grid.pairDistributions(this->debyeRmin(), this->debyeRmax());
+    const vector<QuantityType>& sfpairatkq = mstructure_cache.sfpairatkq;
+    assert(dists.size() <= sfpairatkq.size());
+    for (int ps = 0; ps < int(dists.size()); ++ps)
+    {
+        const QuantityType& sfpair = sfpairatkq[ps];
+        double* pv = !mevaluatepartials ? NULL :
+            (mvalue.data() + (1 + ps) * nqpts);
+        for (const DebyeGrid::Bin& b : dists[ps])
+        {
+            if (b.distance > 0)
+            {
+                // keep the terms of all bins as their sum is exact
+                addDebyeSineTerms(mvalue.data(), pv, kqlo, nqpts, qstep,
+                        b.distance, 0.0, b.weight / b.distance,
+                        sfpair.data(), 0.0);
+                continue;
+            }
+            // sin(q r) / r is q at zero distance
+            for (int kq = kqlo; kq < nqpts; ++kq)
+            {
+                const double dsum = b.weight * kq * qstep * sfpair[kq];
+                mvalue[kq] += dsum;
+                if (pv)  pv[kq] += dsum;
+            }
+        }
+    }
+    // divide out the Debye-Waller factor of the Gaussian spreading
+    const double a = 0.5 * grid.pairSpreadVariance();
+    for (int kq = kqlo; kq < nqpts; ++kq)
+    {
+        const double dwinv = exp(a * pow(kq * qstep, 2));
+        for (int n = 0; n < nsums; ++n)  mvalue[n * nqpts + kq] *= dwinv;
+    }
+}
+
 }   // namespace srreal
 }   // namespace diffpy
 
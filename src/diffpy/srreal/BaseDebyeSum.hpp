@@ -14,11 +14,56 @@
 *
 * class BaseDebyeSum -- base class for concrete Debye sum calculators
 *
+* When partials are evaluated, the value array holds the total Debye sums
+* followed by the sums for every unordered pair of atom types, each on
+* the full Q-grid.  The pairs are ordered by pdfutils_typePairIndex of
+* the atom type indices, which follow the first occurrence of the atom
+* type in the structure.  When gradients are evaluated, the derivatives
+* of the total sums with respect to the SiteParameter values of every
+* site follow in the site-major order.
+*
+* The sine terms of every pair are evaluated on the Q-grid by the angle
+* addition and Debye-Waller ratio recurrences, which are restarted from
+* exact values every 64 points.
+*
+* When debyebinwidth is positive, the pairs are first counted in bins
+* of their atom types, distance and peak width, where the distance and
+* width are rounded to multiples of debyebinwidth.  The sine terms are
+* then summed over the occupied bins in finishValue.  The rounding
+* changes every pair term by less than (qmax + 1/d) * debyebinwidth
+* relative to its amplitude, that is about 0.25% for qmax = 25 and
+* debyebinwidth = 1e-4.  Pairs at distance below debyebinwidth / 2
+* are ignored.  The OPTIMIZED evaluator adds and subtracts the bin
+* counts of the changed pairs only.
+*
+* When qtilethreads is above 1, the pair terms are also collected and
+* summed in finishValue over tiles of 512 Q-points, which are shared
+* among qtilethreads threads.  The tiles keep their slices of the value
+* and of the scattering factors in cache.  This helps small structures
+* on fine Q-grids, where the THREADED evaluator has too few pairs
+* per thread.  Both can be combined for a pair and Q decomposition.
+* Every collected pair needs about 32 bytes; use debyebinwidth to
+* reduce the count of terms for large structures.
+*
+* When debyegridprecision is positive, the pair sums are replaced by
+* the grid summation of DebyeGrid for the atom densities of the whole
+* structure, which is evaluated in finishValue.  The evaluators then skip
+* the loop over pairs, the OPTIMIZED and THREADED evaluations fall back
+* to BASIC.  The cost depends on the structure size and Q-range rather
+* than on the number of atoms, which favors large non-periodic
+* structures.  The grid sum needs isotropic peak widths from the constant
+* or debye-waller models, or the jeong model without corrections.
+* The mean square displacements of the sites are their Uij traces / 3
+* and the peaks of the pairs close to the summation bounds are cut at
+* the bounds.  Site gradients are not available.  The precision of about
+* 1e-4 is a good compromise between accuracy and grid size.
+*
 *****************************************************************************/
 
 #ifndef BASEDEBYESUM_HPP_INCLUDED
 #define BASEDEBYESUM_HPP_INCLUDED
 
+#include <unordered_map>
 #include <diffpy/srreal/PairQuantity.hpp>
 #include <diffpy/srreal/PeakWidthModel.hpp>
 #include <diffpy/srreal/PDFUtils.hpp>
@@ -59,25 +104,145 @@ class BaseDebyeSum :
         /// return relative cutoff value for Debye sum contribution
         const double& getDebyePrecision() const;
 
+        // distance histogram
+        /// round pair distances and peak widths to multiples of binwidth
+        /// and sum over the occupied bins.  Pairs are summed directly
+        /// when binwidth is 0.
+        void setDebyeBinWidth(double binwidth);
+        /// return the bin width for pair distances and peak widths
+        const double& getDebyeBinWidth() const;
+
+        // Q-grid decomposition
+        /// sum the pair terms over Q-grid tiles in nthreads threads
+        /// when nthreads is above 1
+        void setQTileThreads(int nthreads);
+        /// return the number of threads for the Q-grid tiles
+        int getQTileThreads() const;
+
+        // reciprocal-space grid
+        /// sum all pairs from the atom densities on a 3-D grid with
+        /// the relative precision eps.  Pairs are summed when eps is 0.
+        void setDebyeGridPrecision(double eps);
+        /// return the precision of the grid summation
+        const double& getDebyeGridPrecision() const;
+
+        // partial structure factors
+        /// accumulate Debye sums separately for every pair of atom types
+        void setEvaluatePartials(bool);
+        /// return true when the atom type pairs are summed separately
+        bool getEvaluatePartials() const;
+        /// atom types in the order of the type indices of the partials
+        const std::vector<std::string>& getPartialTypes() const;
+        /// Faber-Ziman partial F for atom type indices tp0 and tp1
+        /// on a full Q-grid starting at 0
+        QuantityType getPartialF(int tp0, int tp1) const;
+        /// weights of the partial F in the total F on a full Q-grid.
+        /// The weights of all unordered pairs add up to 1.
+        QuantityType getPartialWeights(int tp0, int tp1) const;
+
+        // site gradients
+        /// accumulate derivatives with respect to the site parameters
+        void setEvaluateGradients(bool);
+        /// return true when the site gradients are evaluated
+        bool getEvaluateGradients() const;
+        /// derivative of F with respect to parameter p of a site
+        /// on a full Q-grid starting at 0
+        QuantityType getFGradient(int siteidx, SiteParameter p) const;
+
     protected:
 
         // PairQuantity overloads
         virtual void resetValue();
+        virtual void resetFrameValue();
+        virtual void configureBondGenerator(BaseBondGenerator&) const;
         virtual void addPairContribution(const BaseBondGenerator&, int);
+        virtual bool configureBondBatch(BondBatch&) const;
+        virtual void addPairContributions(const BondBatch&);
+        virtual bool sumsPairContributions() const;
+        virtual void executeThreadedMerge(const PairQuantity& other);
+        virtual void finishValue();
         // support for PQEvaluatorOptimized
+        virtual bool hasSiteIndexedValue() const;
         virtual void stashPartialValue();
         virtual void restorePartialValue();
 
         // own methods
         virtual double sfSiteAtQ(int, const double& Q) const;
+        /// lower bound of the summed pair distances
+        virtual double debyeRmin() const;
+        /// upper bound of the summed pair distances
+        virtual double debyeRmax() const;
 
     private:
 
         // methods
         /// cache structure factors data for a quick access during summation
-        double sfSiteAtkQ(int siteidx, int kq) const;
+        const QuantityType& sfPairAtkQ(int site0, int site1) const;
         double sfAverageAtkQ(int kq) const;
+        void cacheSiteTypeData();
         void cacheStructureData();
+        void cacheTypePairProducts();
+        /// number of atom type pairs with separate Debye sums
+        int countPartials() const;
+        /// partial sums for the atom types of two sites or NULL
+        /// when partials are not evaluated
+        double* partialValue(int site0, int site1);
+        /// checked offset of the partial sums for two atom type indices
+        int partialOffset(int tp0, int tp1) const;
+        /// number of site gradient arrays in the value
+        int countGradients() const;
+        /// number of sites at the last value reset
+        int countCachedSites() const;
+        /// checked offset of the sum derivative for a site parameter
+        int gradientOffset(int siteidx, int p) const;
+        /// add derivatives of the bond contribution to the site gradients
+        /// for Q-indices below the summation cutoff kqhi
+        void addPairGradients(const BaseBondGenerator& bnds,
+                double fwhm, int smscale, int kqhi);
+        /// true when the pair terms are summed in finishValue
+        bool defersSummation() const;
+        /// count a pair in the histogram or add it to the pair terms
+        void deferPairTerm(int site0, int site1,
+                double dist, double fwhm, int smscale);
+        /// add the sine terms of the deferred pairs to the value
+        void flushDeferredTerms();
+        /// true when the Debye sums are evaluated on the 3-D grid
+        bool usesGridSum() const;
+        /// isotropic mean square displacement of a site for the grid sum
+        double gridSiteVariance(int siteidx) const;
+        /// replace the sums in the value with the grid summation
+        void evaluateGridSum();
+
+        // types
+        struct PairTerm
+        {
+            int typepair;
+            double dist;
+            double dwsigma;
+            double scale;
+        };
+        struct HistogramBin
+        {
+            int typepair;
+            int widthbin;
+            long distbin;
+            bool operator==(const HistogramBin& other) const
+            {
+                return distbin == other.distbin &&
+                    widthbin == other.widthbin && typepair == other.typepair;
+            }
+        };
+        struct HistogramBinHash
+        {
+            size_t operator()(const HistogramBin& b) const
+            {
+                size_t h = std::hash<long>()(b.distbin);
+                h = h * 1000003 + b.widthbin;
+                return h * 1000003 + b.typepair;
+            }
+        };
+        typedef std::unordered_map<HistogramBin, int, HistogramBinHash>
+            Histogram;
 
         // data
         // configuration
@@ -85,13 +250,33 @@ class BaseDebyeSum :
         double mqmax;
         double mqstep;
         double mdebyeprecision;
+        double mdebyebinwidth;
+        double mdebyegridprecision;
+        bool mevaluatepartials;
+        bool mevaluategradients;
+        int mqtilethreads;
         struct {
             std::vector<int> typeofsite;
+            std::vector<std::string> atomtypes;
+            std::vector<int> typemultiplicity;
             std::vector<QuantityType> sftypeatkq;
+            // products of the sftypeatkq arrays per pdfutils_typePairIndex
+            std::vector<QuantityType> sfpairatkq;
             QuantityType sfaverageatkq;
             double totaloccupancy;
+            // Q-step of the sftypeatkq arrays, zero when unknown
+            double sfqstep;
         } mstructure_cache;
         QuantityType mdbsumstash;
+        std::vector<std::string> mdbsumstashtypes;
+        int mdbsumstashsites;
+        // peak widths for the bonds in addPairContributions
+        std::vector<double> mbatchfwhm;
+        // work array for the bond derivatives in addPairGradients
+        std::vector<double> mbondderivatives;
+        // pair counts and terms not yet added to the value
+        Histogram mhistogram;
+        std::vector<PairTerm> mpairterms;
 
         // serialization
         friend class boost::serialization::access;
@@ -109,6 +294,32 @@ class BaseDebyeSum :
             ar & mstructure_cache.sftypeatkq;
             ar & mstructure_cache.sfaverageatkq;
             ar & mstructure_cache.totaloccupancy;
+            if (version >= 1) {
+                ar & mevaluatepartials;
+                ar & mstructure_cache.atomtypes;
+                ar & mstructure_cache.typemultiplicity;
+            }
+            else if (Archive::is_loading::value)
+            {
+                mevaluatepartials = false;
+                mstructure_cache.atomtypes.clear();
+                mstructure_cache.typemultiplicity.clear();
+            }
+            if (version >= 2)  ar & mevaluategradients;
+            else if (Archive::is_loading::value)  mevaluategradients = false;
+            if (version >= 3)  ar & mdebyebinwidth;
+            else if (Archive::is_loading::value)  mdebyebinwidth = 0.0;
+            if (version >= 4)  ar & mqtilethreads;
+            else if (Archive::is_loading::value)  mqtilethreads = 0;
+            if (version >= 5)  ar & mdebyegridprecision;
+            else if (Archive::is_loading::value)  mdebyegridprecision = 0.0;
+            if (Archive::is_loading::value)
+            {
+                mhistogram.clear();
+                mpairterms.clear();
+                mstructure_cache.sfqstep = 0.0;
+            }
+            if (Archive::is_loading::value)  this->cacheTypePairProducts();
         }
 
 };  // class BaseDebyeSum
@@ -118,6 +329,7 @@ class BaseDebyeSum :
 
 // Serialization -------------------------------------------------------------
 
+BOOST_CLASS_VERSION(diffpy::srreal::BaseDebyeSum, 5)
 BOOST_CLASS_EXPORT_KEY(diffpy::srreal::BaseDebyeSum)
 
 #endif  // BASEDEBYESUM_HPP_INCLUDED
@@ -0,0 +1,48 @@
+/*****************************************************************************
+*
+* libdiffpy         Complex Modeling Initiative
+*                   (c) 2026 Brookhaven Science Associates,
+*                   Brookhaven National Laboratory.
+*                   All rights reserved.
+*
+* File coded by:    Pavol Juhas
+*
+* See AUTHORS.txt for a list of people who contributed.
+* See LICENSE.txt for license information.
+*
+******************************************************************************
+*
+* class BondBatch -- bonds of one anchor site stored as arrays of bond
+*     properties for the PairQuantity::addPairContributions hook.
+*
+*****************************************************************************/
+
+#include <diffpy/srreal/BondBatch.hpp>
+
+namespace diffpy {
+namespace srreal {
+
+// Constructor ---------------------------------------------------------------
+
+BondBatch::BondBatch() : withmsd(false), site0(-1)
+{ }
+
+// Public Methods ------------------------------------------------------------
+
+void BondBatch::clear()
+{
+    site0 = -1;
+    site1.clear();
+    multiplicity.clear();
+    summationscale.clear();
+    distance.clear();
+    r01x.clear();
+    r01y.clear();
+    r01z.clear();
+    msd.clear();
+}
+
+}   // namespace srreal
+}   // namespace diffpy
+
+// End of file
@@ -0,0 +1,83 @@
+/*****************************************************************************
+*
+* libdiffpy         Complex Modeling Initiative
+*                   (c) 2026 Brookhaven Science Associates,
+*                   Brookhaven National Laboratory.
+*                   All rights reserved.
+*
+* File coded by:    Pavol Juhas
+*
+* See AUTHORS.txt for a list of people who contributed.
+* See LICENSE.txt for license information.
+*
+******************************************************************************
+*
+* class BondBatch -- bonds of one anchor site stored as arrays of bond
+*     properties for the PairQuantity::addPairContributions hook.
+*
+* The batch is filled from a bond generator by the PQEvaluator classes
+* when PairQuantity::configureBondBatch returns true.  The msd values
+* are evaluated only when the withmsd flag is set.
+*
+*****************************************************************************/
+
+#ifndef BONDBATCH_HPP_INCLUDED
+#define BONDBATCH_HPP_INCLUDED
+
+#include <vector>
+#include <diffpy/srreal/BaseBondGenerator.hpp>
+
+namespace diffpy {
+namespace srreal {
+
+class BondBatch
+{
+    public:
+
+        // constructor
+        BondBatch();
+
+        // methods
+        void clear();
+        void append(const BaseBondGenerator& bnds, int summationscale);
+        int size() const  { return site1.size(); }
+        bool empty() const  { return site1.empty(); }
+
+        // data
+        // configuration
+        /// evaluate mean square displacements along the bonds
+        bool withmsd;
+        // bond properties
+        int site0;
+        std::vector<int> site1;
+        std::vector<int> multiplicity;
+        std::vector<int> summationscale;
+        std::vector<double> distance;
+        std::vector<double> r01x;
+        std::vector<double> r01y;
+        std::vector<double> r01z;
+        std::vector<double> msd;
+
+};
+
+// Inline Methods ------------------------------------------------------------
+
+inline
+void BondBatch::append(const BaseBondGenerator& bnds, int smscale)
+{
+    const R3::Vector& r01 = bnds.r01();
+    site0 = bnds.site0();
+    site1.push_back(bnds.site1());
+    multiplicity.push_back(bnds.multiplicity());
+    summationscale.push_back(smscale);
+    distance.push_back(bnds.distance());
+    r01x.push_back(r01[0]);
+    r01y.push_back(r01[1]);
+    r01z.push_back(r01[2]);
+    if (withmsd)  msd.push_back(bnds.msd());
+}
+
+}   // namespace srreal
+}   // namespace diffpy
+
+#endif  // BONDBATCH_HPP_INCLUDED
@@ -21,6 +21,7 @@
 #include <sstream>
 
 #include <diffpy/srreal/BondCalculator.hpp>
+#include <diffpy/srreal/SharedParallelData.hpp>
 #include <diffpy/validators.hpp>
 #include <diffpy/mathutils.hpp>
 #include <diffpy/serialization.ipp>
@@ -194,6 +195,13 @@ string BondCalculator::getParallelData() const
     return storage.str();
 }
 
+
+void BondCalculator::exportSharedParallelData(const string& shmname) const
+{
+    // bond entries are not a plain value array, store the archive string
+    SharedParallelData::writeArchive(shmname, this->getParallelData());
+}
+
 // Protected Methods ---------------------------------------------------------
 
 void BondCalculator::resetValue()
@@ -211,9 +219,8 @@ void BondCalculator::addPairContribution(
         int summationscale)
 {
     assert(summationscale == +1 || summationscale == -1);
-    static R3::Vector ru01;
     const R3::Vector& r01 = bnds.r01();
-    ru01 = r01 / bnds.distance();
+    R3::Vector ru01 = r01 / bnds.distance();
     if (!(this->checkConeFilters(ru01)))  return;
     BondDataStorage& bes = (summationscale > 0) ? maddbonds : mpopbonds;
     bes.push_back(BondOp::entryFrom(bnds));
@@ -231,6 +238,17 @@ void BondCalculator::executeParallelMerge(const std::string& pdata)
 }
 
 
+void BondCalculator::executeThreadedMerge(const PairQuantity& other)
+{
+    const BondCalculator& bc = dynamic_cast<const BondCalculator&>(other);
+    // the merged bonds get sorted in finishValue
+    mpopbonds.insert(mpopbonds.end(),
+            bc.mpopbonds.begin(), bc.mpopbonds.end());
+    maddbonds.insert(maddbonds.end(),
+            bc.maddbonds.begin(), bc.maddbonds.end());
+}
+
+
 void BondCalculator::finishValue()
 {
     // filter-out entries marked for removal
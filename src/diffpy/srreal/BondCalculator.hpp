@@ -44,6 +44,7 @@ class BondCalculator : public PairQuantity
 
         // PairQuantity overloads
         virtual std::string getParallelData() const;
+        virtual void exportSharedParallelData(const std::string& shmname) const;
 
     protected:
 
@@ -51,6 +52,7 @@ class BondCalculator : public PairQuantity
         virtual void resetValue();
         virtual void addPairContribution(const BaseBondGenerator&, int);
         virtual void executeParallelMerge(const std::string& pdata);
+        virtual void executeThreadedMerge(const PairQuantity& other);
         virtual void finishValue();
 
         // support for PQEvaluatorOptimized
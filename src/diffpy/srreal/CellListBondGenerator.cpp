@@ -0,0 +1,342 @@
+/*****************************************************************************
+*
+* libdiffpy         Complex Modeling Initiative
+*                   (c) 2026 Brookhaven Science Associates,
+*                   Brookhaven National Laboratory.
+*                   All rights reserved.
+*
+* File coded by:    Pavol Juhas
+*
+* See AUTHORS.txt for a list of people who contributed.
+* See LICENSE.txt for license information.
+*
+******************************************************************************
+*
+* class CellListBondGenerator -- bond generator for non-periodic structures
+*   that looks up neighbors of the anchor site in a grid of cubic cells.
+*
+*****************************************************************************/
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+#include <diffpy/srreal/CellListBondGenerator.hpp>
+#include <diffpy/srreal/AtomicStructureAdapter.hpp>
+
+using namespace std;
+
+namespace diffpy {
+namespace srreal {
+
+// Local Helpers -------------------------------------------------------------
+
+namespace {
+
+/// smaller structures are faster to scan by the plain loop
+const int CELLLIST_MIN_SITES = 256;
+/// upper limit for the number of cells per site
+const double CELLLIST_MAX_CELLS_PER_SITE = 2.0;
+/// use the grid only if 27 adjacent cells cover at most this grid fraction
+const double CELLLIST_MAX_COVERAGE = 0.5;
+/// relative increase of cell edge over rmax that absorbs round-off errors
+const double CELLLIST_EDGE_MARGIN = 1e-6;
+
+}   // namespace
+
+// Constructor ---------------------------------------------------------------
+
+CellListBondGenerator::CellListBondGenerator(StructureAdapterConstPtr stru) :
+    BaseBondGenerator(stru),
+    mgridready(false),
+    mgridused(false),
+    mcellsize(0.0),
+    mgridorigin(R3::zerovector),
+    mneighborsready(false),
+    mcellmode(false),
+    mlistmode(false)
+{
+    fill(mgridshape, mgridshape + 3, 0);
+}
+
+// Public Methods ------------------------------------------------------------
+
+// loop control
+
+void CellListBondGenerator::rewind()
+{
+    const bool hassites = (msite_first < msite_last);
+    mlistmode = hassites &&
+        this->useNeighborList() && this->rankSelectedSites();
+    mcellmode = hassites && !mlistmode &&
+        this->useCellGrid() && this->rankSelectedSites();
+    if (!mcellmode && !mlistmode)
+    {
+        this->BaseBondGenerator::rewind();
+        return;
+    }
+    this->collectCandidates();
+    mcandidate = mcandidates.begin();
+    this->setCandidateBond();
+    if (this->finished())   return;
+    this->advanceWhileInvalid();
+}
+
+// configuration
+
+void CellListBondGenerator::setRmax(double rmax)
+{
+    // cell size and neighbor list depend on rmax, update them on rewind
+    if (this->getRmax() != rmax)
+    {
+        mgridready = false;
+        mneighborsready = false;
+    }
+    this->BaseBondGenerator::setRmax(rmax);
+}
+
+
+bool CellListBondGenerator::usesCellGrid() const
+{
+    return mcellmode;
+}
+
+
+bool CellListBondGenerator::usesNeighborList() const
+{
+    return mlistmode;
+}
+
+// Protected Methods ---------------------------------------------------------
+
+void CellListBondGenerator::getNextBond()
+{
+    if (!mcellmode && !mlistmode)
+    {
+        this->BaseBondGenerator::getNextBond();
+        return;
+    }
+    ++mcandidate;
+    this->setCandidateBond();
+}
+
+// Private Methods -----------------------------------------------------------
+
+bool CellListBondGenerator::useCellGrid()
+{
+    if (!mgridready)
+    {
+        const int cntsites = mstructure->countSites();
+        vector<R3::Vector> positions(cntsites);
+        for (int i = 0; i < cntsites; ++i)
+        {
+            positions[i] = mstructure->siteCartesianPosition(i);
+        }
+        mgridused = (cntsites >= CELLLIST_MIN_SITES) &&
+            this->buildCellGrid(this->getRmax(), positions);
+        mgridready = true;
+    }
+    return mgridused;
+}
+
+
+bool CellListBondGenerator::buildCellGrid(
+        double rcell, const vector<R3::Vector>& xyz)
+{
+    mcellstart.clear();
+    mcellsites.clear();
+    const int cntsites = xyz.size();
+    if (!cntsites || !(rcell > 0.0 && isfinite(rcell)))  return false;
+    R3::Vector xyzlo = xyz[0];
+    R3::Vector xyzhi = xyz[0];
+    for (const R3::Vector& v : xyz)
+    {
+        for (int k = 0; k < R3::Ndim; ++k)
+        {
+            xyzlo[k] = min(xyzlo[k], v[k]);
+            xyzhi[k] = max(xyzhi[k], v[k]);
+        }
+    }
+    // find cell size so that the grid has a limited number of cells
+    const double maxcells = CELLLIST_MAX_CELLS_PER_SITE * cntsites;
+    double cellsize = rcell * (1.0 + CELLLIST_EDGE_MARGIN);
+    double shape[R3::Ndim];
+    double ncells;
+    while (true)
+    {
+        ncells = 1.0;
+        for (int k = 0; k < R3::Ndim; ++k)
+        {
+            shape[k] = floor((xyzhi[k] - xyzlo[k]) / cellsize) + 1;
+            ncells *= shape[k];
+        }
+        if (!isfinite(ncells))  return false;
+        if (ncells <= maxcells)  break;
+        cellsize *= max(1.01, cbrt(ncells / maxcells));
+    }
+    // the grid is not worth it when neighbor cells cover most of it
+    double nadjacent = 1.0;
+    for (int k = 0; k < R3::Ndim; ++k)  nadjacent *= min(3.0, shape[k]);
+    if (nadjacent > CELLLIST_MAX_COVERAGE * ncells)  return false;
+    mcellsize = cellsize;
+    mgridorigin = xyzlo;
+    for (int k = 0; k < R3::Ndim; ++k)  mgridshape[k] = int(shape[k]);
+    // sort site indices by cells, keep ascending indices in each cell
+    vector<int> cellofsite(cntsites);
+    mcellstart.assign(int(ncells) + 1, 0);
+    int ijk[R3::Ndim];
+    for (int i = 0; i < cntsites; ++i)
+    {
+        this->cellIndices(xyz[i], ijk);
+        int c = (ijk[0] * mgridshape[1] + ijk[1]) * mgridshape[2] + ijk[2];
+        cellofsite[i] = c;
+        ++mcellstart[c + 1];
+    }
+    partial_sum(mcellstart.begin(), mcellstart.end(), mcellstart.begin());
+    vector<int> cellfill(mcellstart.begin(), mcellstart.end() - 1);
+    mcellsites.resize(cntsites);
+    for (int i = 0; i < cntsites; ++i)
+    {
+        mcellsites[cellfill[cellofsite[i]]++] = i;
+    }
+    return true;
+}
+
+
+void CellListBondGenerator::cellIndices(
+        const R3::Vector& xyz, int ijk[3]) const
+{
+    for (int k = 0; k < R3::Ndim; ++k)
+    {
+        double ck = floor((xyz[k] - mgridorigin[k]) / mcellsize);
+        ck = min(max(ck, 0.0), mgridshape[k] - 1.0);
+        ijk[k] = int(ck);
+    }
+}
+
+
+/// call f for every site in the 27 cells around the xyz position
+template <class F>
+void CellListBondGenerator::visitAdjacentSites(
+        const R3::Vector& xyz, F f) const
+{
+    int ijk[R3::Ndim];
+    this->cellIndices(xyz, ijk);
+    int lo[R3::Ndim], hi[R3::Ndim];
+    for (int k = 0; k < R3::Ndim; ++k)
+    {
+        lo[k] = max(0, ijk[k] - 1);
+        hi[k] = min(mgridshape[k] - 1, ijk[k] + 1);
+    }
+    for (int i = lo[0]; i <= hi[0]; ++i)
+    {
+        for (int j = lo[1]; j <= hi[1]; ++j)
+        {
+            // cells along the last axis have adjacent site ranges
+            int c = (i * mgridshape[1] + j) * mgridshape[2] + lo[2];
+            vector<int>::const_iterator ii = mcellsites.begin();
+            vector<int>::const_iterator ii0 = ii + mcellstart[c];
+            vector<int>::const_iterator ii1 = ii + mcellstart[c + 1 +
+                hi[2] - lo[2]];
+            for (ii = ii0; ii != ii1; ++ii)  f(*ii);
+        }
+    }
+}
+
+
+bool CellListBondGenerator::useNeighborList()
+{
+    if (!mneighborsready)
+    {
+        mneighbors = this->fetchNeighborList();
+        mneighborsready = true;
+    }
+    return bool(mneighbors);
+}
+
+
+NeighborListCache::NeighborListPtr CellListBondGenerator::fetchNeighborList()
+{
+    NeighborListCache::NeighborListPtr rv;
+    const AtomicStructureAdapter* astru =
+        dynamic_cast<const AtomicStructureAdapter*>(mstructure.get());
+    NeighborListCache* cache = astru ? astru->neighborListCache() : NULL;
+    const double& rmax = this->getRmax();
+    if (!cache || !(rmax > 0.0 && isfinite(rmax)))  return rv;
+    const int cntsites = mstructure->countSites();
+    vector<R3::Vector> positions(cntsites);
+    for (int i = 0; i < cntsites; ++i)
+    {
+        positions[i] = mstructure->siteCartesianPosition(i);
+    }
+    rv = cache->lookup(*astru, rmax, positions);
+    if (rv)  return rv;
+    // build new neighbor list for rmax plus skin.  Use the cell grid
+    // when it helps or compare all pairs of sites.
+    boost::shared_ptr<NeighborListCache::NeighborList> nl(
+            new NeighborListCache::NeighborList);
+    const double cutoff = rmax + cache->getSkin();
+    const bool usegrid = this->buildCellGrid(cutoff, positions);
+    // the cell grid for rmax needs to be built again
+    mgridready = false;
+    nl->cutoff = cutoff;
+    nl->offsets.reserve(cntsites + 1);
+    nl->offsets.push_back(0);
+    vector<int>& sites = nl->sites;
+    for (int i = 0; i < cntsites; ++i)
+    {
+        const R3::Vector& xyz0 = positions[i];
+        auto addneighbor = [&](int j) {
+            if (j == i)  return;
+            if (R3::distance(positions[j], xyz0) > cutoff)  return;
+            sites.push_back(j);
+        };
+        size_t first = sites.size();
+        if (usegrid)  this->visitAdjacentSites(xyz0, addneighbor);
+        else  for (int j = 0; j < cntsites; ++j)  addneighbor(j);
+        sort(sites.begin() + first, sites.end());
+        nl->offsets.push_back(sites.size());
+    }
+    nl->positions.swap(positions);
+    cache->store(*astru, nl);
+    rv = nl;
+    return rv;
+}
+
+
+void CellListBondGenerator::collectCandidates()
+{
+    mcandidates.clear();
+    auto addcandidate = [this](int site) {
+        int offset = this->selectedSiteOffset(site);
+        if (offset >= 0)  mcandidates.push_back(offset);
+    };
+    if (mlistmode)
+    {
+        const int i0 = this->site0();
+        vector<int>::const_iterator ii = mneighbors->sites.begin();
+        vector<int>::const_iterator ii0 = ii + mneighbors->offsets[i0];
+        vector<int>::const_iterator ii1 = ii + mneighbors->offsets[i0 + 1];
+        for (ii = ii0; ii != ii1; ++ii)  addcandidate(*ii);
+    }
+    else
+    {
+        this->visitAdjacentSites(this->r0(), addcandidate);
+    }
+    // generate bonds in the same order as BaseBondGenerator
+    sort(mcandidates.begin(), mcandidates.end());
+}
+
+
+void CellListBondGenerator::setCandidateBond()
+{
+    msite_current = (mcandidate == mcandidates.end()) ? msite_last :
+        (msite_first + *mcandidate);
+    // avoid calling rewindSymmetry at an invalid site
+    if (!(this->finished()))  this->rewindSymmetry();
+}
+
+}   // namespace srreal
+}   // namespace diffpy
+
+// End of file
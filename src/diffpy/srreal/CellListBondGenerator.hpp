@@ -0,0 +1,101 @@
+/*****************************************************************************
+*
+* libdiffpy         Complex Modeling Initiative
+*                   (c) 2026 Brookhaven Science Associates,
+*                   Brookhaven National Laboratory.
+*                   All rights reserved.
+*
+* File coded by:    Pavol Juhas
+*
+* See AUTHORS.txt for a list of people who contributed.
+* See LICENSE.txt for license information.
+*
+******************************************************************************
+*
+* class CellListBondGenerator -- bond generator for non-periodic structures
+*   that looks up neighbors of the anchor site in a grid of cubic cells.
+*
+* The sites are binned to cells with an edge of at least rmax so that
+* all neighbors of the anchor are in the 27 adjacent cells.  The grid is
+* used only when it excludes a significant part of the structure,
+* otherwise the generator falls back to the plain BaseBondGenerator loop.
+* Bonds are generated in the same order as in BaseBondGenerator, they are
+* restricted to the selected sites and follow the selectSites semantics.
+* Sub-ranges of the most recently selected site array are assumed to have
+* unchanged content, selecting the whole array again refreshes the lookup.
+* When the AtomicStructureAdapter has a neighbor list cache, the neighbors
+* are taken from a cached Verlet list instead of the cell grid.
+*
+*****************************************************************************/
+
+#ifndef CELLLISTBONDGENERATOR_HPP_INCLUDED
+#define CELLLISTBONDGENERATOR_HPP_INCLUDED
+
+#include <vector>
+#include <diffpy/srreal/BaseBondGenerator.hpp>
+#include <diffpy/srreal/NeighborListCache.hpp>
+
+namespace diffpy {
+namespace srreal {
+
+class CellListBondGenerator : public BaseBondGenerator
+{
+    public:
+
+        // constructor
+        CellListBondGenerator(StructureAdapterConstPtr);
+
+        // methods
+        // loop control
+        virtual void rewind();
+
+        // configuration
+        virtual void setRmax(double);
+
+        /// return true if the last rewind used the cell grid
+        bool usesCellGrid() const;
+        /// return true if the last rewind used the cached neighbor list
+        bool usesNeighborList() const;
+
+    protected:
+
+        // methods
+        virtual void getNextBond();
+
+    private:
+
+        // data
+        // cell grid
+        bool mgridready;
+        bool mgridused;
+        double mcellsize;
+        R3::Vector mgridorigin;
+        int mgridshape[3];
+        std::vector<int> mcellstart;
+        std::vector<int> mcellsites;
+        // neighbor list
+        bool mneighborsready;
+        NeighborListCache::NeighborListPtr mneighbors;
+        // neighbor candidates as offsets from msite_first
+        bool mcellmode;
+        bool mlistmode;
+        std::vector<int> mcandidates;
+        std::vector<int>::const_iterator mcandidate;
+
+        // methods
+        bool useCellGrid();
+        bool buildCellGrid(double rcell, const std::vector<R3::Vector>& xyz);
+        void cellIndices(const R3::Vector& xyz, int ijk[3]) const;
+        template <class F>
+            void visitAdjacentSites(const R3::Vector& xyz, F f) const;
+        bool useNeighborList();
+        NeighborListCache::NeighborListPtr fetchNeighborList();
+        void collectCandidates();
+        void setCandidateBond();
+
+};
+
+}   // namespace srreal
+}   // namespace diffpy
+
+#endif  // CELLLISTBONDGENERATOR_HPP_INCLUDED
@@ -0,0 +1,187 @@
+/*****************************************************************************
+*
+* libdiffpy         Complex Modeling Initiative
+*                   (c) 2026 Brookhaven Science Associates,
+*                   Brookhaven National Laboratory.
+*                   All rights reserved.
+*
+* File coded by:    Pavol Juhas
+*
+* See AUTHORS.txt for a list of people who contributed.
+* See LICENSE.txt for license information.
+*
+******************************************************************************
+*
+* class CompiledPairMask -- pair mask of a PairQuantity compiled for
+*     fast lookup in the summation loops.
+*
+*****************************************************************************/
+
+#include <cassert>
+
+#include <diffpy/srreal/CompiledPairMask.hpp>
+
+using namespace std;
+
+namespace diffpy {
+namespace srreal {
+
+// Constructor ---------------------------------------------------------------
+
+CompiledPairMask::CompiledPairMask() :
+    mdefault(true),
+    mbytype(false),
+    mntypes(0)
+{ }
+
+// Public Methods ------------------------------------------------------------
+
+void CompiledPairMask::compilePairs(bool defaultmask, int cntsites,
+        const PairIndexSet& invertedpairs)
+{
+    mdefault = defaultmask;
+    mbytype = false;
+    msitetypes.clear();
+    mntypes = 0;
+    mtypematrix.clear();
+    // rows must cover inverted pairs beyond the current structure size
+    int nrows = cntsites;
+    for (auto&& ij : invertedpairs)
+    {
+        assert(0 <= ij.first && ij.first <= ij.second);
+        nrows = max(nrows, ij.second + 1);
+    }
+    vector<int> degree(nrows, 0);
+    for (auto&& ij : invertedpairs)
+    {
+        ++degree[ij.first];
+        if (ij.first != ij.second)  ++degree[ij.second];
+    }
+    // use bitset rows where they take less memory than index arrays
+    const size_t nwords = (nrows + 63) / 64;
+    mrows.resize(nrows);
+    size_t npartners = 0;
+    size_t nbits = 0;
+    for (int i = 0; i < nrows; ++i)
+    {
+        MaskRow& row = mrows[i];
+        row.count = degree[i];
+        row.dense = (size_t(row.count) > 2 * nwords);
+        row.offset = row.dense ? nbits : npartners;
+        if (row.dense)  nbits += nwords;
+        else  npartners += row.count;
+    }
+    mpartners.assign(npartners, 0);
+    mbits.assign(nbits, 0);
+    fill(degree.begin(), degree.end(), 0);
+    auto addpartner = [&](int i, int j) {
+        const MaskRow& row = mrows[i];
+        if (!row.dense)
+        {
+            mpartners[row.offset + degree[i]++] = j;
+            return;
+        }
+        mbits[row.offset + j / 64] |= (uint64_t(1) << (j % 64));
+    };
+    for (auto&& ij : invertedpairs)
+    {
+        addpartner(ij.first, ij.second);
+        if (ij.first != ij.second)  addpartner(ij.second, ij.first);
+    }
+    for (const MaskRow& row : mrows)
+    {
+        if (row.dense)  continue;
+        vector<int>::iterator first = mpartners.begin() + row.offset;
+        sort(first, first + row.count);
+    }
+}
+
+
+void CompiledPairMask::resetTypes(
+        bool defaultmask, const vector<int>& sitetypes)
+{
+    mdefault = defaultmask;
+    mbytype = true;
+    msitetypes = sitetypes;
+    mntypes = sitetypes.empty() ? 0 :
+        (1 + *max_element(sitetypes.begin(), sitetypes.end()));
+    mtypematrix.assign(mntypes * mntypes, defaultmask);
+    mrows.clear();
+    mpartners.clear();
+    mbits.clear();
+}
+
+
+void CompiledPairMask::setTypePairMask(int ti, int tj, bool mask)
+{
+    assert(mbytype);
+    assert(0 <= ti && ti < mntypes && 0 <= tj && tj < mntypes);
+    mtypematrix[ti * mntypes + tj] = mask;
+    mtypematrix[tj * mntypes + ti] = mask;
+}
+
+
+double CompiledPairMask::invertedPairsSum(const vector<double>& w) const
+{
+    const int nw = w.size();
+    double rv = 0.0;
+    if (mbytype)
+    {
+        // sum the weights per each type and add up inverted type pairs
+        vector<double> wtype(mntypes, 0.0);
+        const int n = min(nw, int(msitetypes.size()));
+        for (int i = 0; i < n; ++i)  wtype[msitetypes[i]] += w[i];
+        for (int ti = 0; ti < mntypes; ++ti)
+        {
+            for (int tj = ti; tj < mntypes; ++tj)
+            {
+                if (mtypematrix[ti * mntypes + tj] == mdefault)  continue;
+                const int sumscale = (ti == tj) ? 1 : 2;
+                rv += sumscale * wtype[ti] * wtype[tj];
+            }
+        }
+        return rv;
+    }
+    const int n = min(nw, int(mrows.size()));
+    for (int i = 0; i < n; ++i)
+    {
+        const MaskRow& row = mrows[i];
+        if (!row.count)  continue;
+        if (row.dense)
+        {
+            for (int j = i; j < nw; ++j)
+            {
+                if (!this->isInverted(i, j))  continue;
+                rv += ((i == j) ? 1 : 2) * w[i] * w[j];
+            }
+            continue;
+        }
+        const int* first = mpartners.data() + row.offset;
+        const int* last = first + row.count;
+        for (const int* pj = lower_bound(first, last, i); pj != last; ++pj)
+        {
+            if (*pj >= nw)  break;
+            rv += ((i == *pj) ? 1 : 2) * w[i] * w[*pj];
+        }
+    }
+    return rv;
+}
+
+
+void CompiledPairMask::exportTypePairs(PairIndexSet& rv) const
+{
+    assert(mbytype);
+    const int n = msitetypes.size();
+    for (int i = 0; i < n; ++i)
+    {
+        for (int j = i; j < n; ++j)
+        {
+            if ((*this)(i, j) != mdefault)  rv.insert(make_pair(i, j));
+        }
+    }
+}
+
+}   // namespace srreal
+}   // namespace diffpy
+
+// End of file
@@ -0,0 +1,122 @@
+/*****************************************************************************
+*
+* libdiffpy         Complex Modeling Initiative
+*                   (c) 2026 Brookhaven Science Associates,
+*                   Brookhaven National Laboratory.
+*                   All rights reserved.
+*
+* File coded by:    Pavol Juhas
+*
+* See AUTHORS.txt for a list of people who contributed.
+* See LICENSE.txt for license information.
+*
+******************************************************************************
+*
+* class CompiledPairMask -- pair mask of a PairQuantity compiled for
+*     fast lookup in the summation loops.
+*
+* Type masks are stored as a boolean matrix of type indices, index masks
+* as per-site rows of the inverted partner sites.  A row is kept either
+* as a sorted array of site indices or as a bitset, whichever is smaller.
+*
+*****************************************************************************/
+
+#ifndef COMPILEDPAIRMASK_HPP_INCLUDED
+#define COMPILEDPAIRMASK_HPP_INCLUDED
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include <boost/functional/hash.hpp>
+
+namespace diffpy {
+namespace srreal {
+
+class CompiledPairMask
+{
+    public:
+
+        // types
+        typedef std::unordered_set<
+            std::pair<int,int>,
+            boost::hash< std::pair<int,int> >
+                > PairIndexSet;
+
+        // constructor
+        CompiledPairMask();
+
+        // methods
+        /// compile index mask with the default value and inverted pairs
+        void compilePairs(bool defaultmask, int cntsites,
+                const PairIndexSet& invertedpairs);
+        /// reset to type mask for the specified type index of each site
+        void resetTypes(bool defaultmask, const std::vector<int>& sitetypes);
+        /// set mask value for a pair of type indices
+        void setTypePairMask(int ti, int tj, bool mask);
+        /// mask value for a pair of site indices
+        bool operator()(int i, int j) const;
+        /// sum of the (i == j ? 1 : 2) * w[i] * w[j] terms for inverted pairs
+        double invertedPairsSum(const std::vector<double>& w) const;
+        /// insert all inverted pairs (i <= j) within the type mask sites
+        void exportTypePairs(PairIndexSet& rv) const;
+
+    private:
+
+        // types
+        struct MaskRow
+        {
+            size_t offset;
+            int count;
+            bool dense;
+        };
+
+        // data
+        bool mdefault;
+        bool mbytype;
+        // type masks
+        std::vector<int> msitetypes;
+        int mntypes;
+        std::vector<char> mtypematrix;
+        // index masks
+        std::vector<MaskRow> mrows;
+        std::vector<int> mpartners;
+        std::vector<uint64_t> mbits;
+
+        // methods
+        bool isInverted(int i, int j) const;
+
+};
+
+// Inline Methods ------------------------------------------------------------
+
+inline
+bool CompiledPairMask::operator()(int i, int j) const
+{
+    if (mbytype)
+    {
+        const int n = msitetypes.size();
+        if (i < 0 || i >= n || j < 0 || j >= n)  return mdefault;
+        return mtypematrix[msitetypes[i] * mntypes + msitetypes[j]];
+    }
+    return this->isInverted(i, j) ? !mdefault : mdefault;
+}
+
+
+inline
+bool CompiledPairMask::isInverted(int i, int j) const
+{
+    const int n = mrows.size();
+    if (i < 0 || i >= n || j < 0 || j >= n)  return false;
+    const MaskRow& row = mrows[i];
+    if (!row.count)  return false;
+    if (row.dense)  return (mbits[row.offset + j / 64] >> (j % 64)) & 1;
+    const int* first = mpartners.data() + row.offset;
+    return std::binary_search(first, first + row.count, j);
+}
+
+}   // namespace srreal
+}   // namespace diffpy
+
+#endif  // COMPILEDPAIRMASK_HPP_INCLUDED
@@ -101,6 +101,28 @@ double ConstantPeakWidth::calculate(const BaseBondGenerator& bnds) const
 }
 
 
+bool ConstantPeakWidth::configureBondBatch(BondBatch& batch) const
+{
+    batch.withmsd = false;
+    return true;
+}
+
+
+void ConstantPeakWidth::calculateBatch(
+        const BondBatch& batch, vector<double>& fwhm) const
+{
+    fwhm.assign(batch.size(), this->getWidth());
+}
+
+
+void ConstantPeakWidth::calculateDerivatives(const BaseBondGenerator& bnds,
+        double& dfwhmdr, double& dfwhmdmsd) const
+{
+    dfwhmdr = 0.0;
+    dfwhmdmsd = 0.0;
+}
+
+
 double ConstantPeakWidth::maxWidth(
         StructureAdapterPtr stru, double rmin, double rmax) const
 {
@@ -19,6 +19,7 @@
 *****************************************************************************/
 
 #include <cmath>
+#include <typeinfo>
 
 #include <gsl/gsl_sf_erf.h>
 
@@ -71,6 +72,47 @@ double CroppedGaussianProfile::operator()(double x, double fwhm) const
 }
 
 
+void CroppedGaussianProfile::evaluateGrid(double x0, double dx, int n,
+        double fwhm, double* y) const
+{
+    // derived classes may override operator()
+    if (fwhm <= 0 || typeid(*this) != typeid(CroppedGaussianProfile))
+    {
+        this->PeakProfile::evaluateGrid(x0, dx, n, fwhm, y);
+        return;
+    }
+    this->gaussianGrid(x0, dx, n, fwhm, y);
+    for (int k = 0; k < n; ++k)
+    {
+        double xrel = (x0 + k * dx) / fwhm;
+        y[k] = (fabs(xrel) >= mhalfboundrel) ? 0.0 : (mscale * y[k]);
+    }
+}
+
+
+void CroppedGaussianProfile::evaluateGridDerivatives(
+        double x0, double dx, int n,
+        double fwhm, double* dydx, double* dydfwhm) const
+{
+    // derived classes may override operator()
+    if (fwhm <= 0 || typeid(*this) != typeid(CroppedGaussianProfile))
+    {
+        this->PeakProfile::evaluateGridDerivatives(
+                x0, dx, n, fwhm, dydx, dydfwhm);
+        return;
+    }
+    this->gaussianGridDerivatives(x0, dx, n, fwhm, dydx, dydfwhm);
+    // ignore the step at the cropping boundary
+    for (int k = 0; k < n; ++k)
+    {
+        double xrel = (x0 + k * dx) / fwhm;
+        const bool cropped = (fabs(xrel) >= mhalfboundrel);
+        dydx[k] = cropped ? 0.0 : (mscale * dydx[k]);
+        dydfwhm[k] = cropped ? 0.0 : (mscale * dydfwhm[k]);
+    }
+}
+
+
 void CroppedGaussianProfile::setPrecision(double eps)
 {
     this->GaussianProfile::setPrecision(eps);
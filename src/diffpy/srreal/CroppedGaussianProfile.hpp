@@ -38,6 +38,10 @@ class CroppedGaussianProfile : public GaussianProfile
         // methods
         const std::string& type() const;
         double operator()(double x, double fwhm) const;
+        void evaluateGrid(double x0, double dx, int n,
+                double fwhm, double* y) const;
+        void evaluateGridDerivatives(double x0, double dx, int n,
+                double fwhm, double* dydx, double* dydfwhm) const;
         void setPrecision(double eps);
 
     private:
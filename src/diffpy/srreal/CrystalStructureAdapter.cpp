@@ -69,7 +69,7 @@ BaseBondGeneratorPtr CrystalStructureAdapter::createBondGenerator() const
 
 int CrystalStructureAdapter::siteMultiplicity(int idx) const
 {
-    if (!this->isSymmetryCached())  this->updateSymmetryPositions();
+    this->ensureSymmetryCached();
     int rv = msymatoms[idx].size();
     return rv;
 }
@@ -94,6 +94,12 @@ CrystalStructureAdapter::diff(StructureAdapterConstPtr other) const
 }
 
 
+void CrystalStructureAdapter::updateSnapshot(StructureAdapterPtr& snap) const
+{
+    this->assignSnapshot<CrystalStructureAdapter>(snap);
+}
+
+
 void CrystalStructureAdapter::setSymmetryPrecision(double eps)
 {
     using namespace diffpy::validators;
@@ -147,13 +153,51 @@ const CrystalStructureAdapter::AtomVector&
 CrystalStructureAdapter::getEquivalentAtoms(int idx) const
 {
     assert(0 <= idx && idx < this->countSites());
-    if (!this->isSymmetryCached())  this->updateSymmetryPositions();
+    this->ensureSymmetryCached();
     return msymatoms[idx];
 }
 
 
 CrystalStructureAdapter::AtomVector
 CrystalStructureAdapter::expandLatticeAtom(const Atom& a0) const
+{
+    vector<R3::Matrix> eqrotations;
+    return this->expandLatticeAtom(a0, eqrotations);
+}
+
+
+void CrystalStructureAdapter::updateSymmetryPositions() const
+{
+    vector<AtomVector> symatoms;
+    vector< vector<R3::Matrix> > symjacobians;
+    this->expandSymmetryPositions(symatoms, symjacobians);
+    lock_guard<mutex> lock(msymmetry_lock.mutex);
+    // keep the cache intact when nothing changed as it may be in use
+    // by bond generators from other threads
+    bool samesymmetry = msymmetry_cached &&
+        symatoms == msymatoms && symjacobians == msymjacobians;
+    if (!samesymmetry)
+    {
+        msymatoms.swap(symatoms);
+        msymjacobians.swap(symjacobians);
+        msymmetry_cached = true;
+    }
+}
+
+
+const vector<R3::Matrix>&
+CrystalStructureAdapter::getEquivalentJacobians(int idx) const
+{
+    assert(0 <= idx && idx < this->countSites());
+    this->ensureSymmetryCached();
+    return msymjacobians[idx];
+}
+
+// Private Methods -----------------------------------------------------------
+
+CrystalStructureAdapter::AtomVector
+CrystalStructureAdapter::expandLatticeAtom(const Atom& a0,
+        vector<R3::Matrix>& eqrotations) const
 {
     using mathutils::eps_eq;
     AtomVector eqsites;
@@ -161,6 +205,7 @@ CrystalStructureAdapter::expandLatticeAtom(const Atom& a0) const
     vector<int> eqduplicity;
     eqsumpos.reserve(this->countSymOps());
     eqduplicity.reserve(this->countSymOps());
+    eqrotations.clear();
     const Lattice& L = this->getLattice();
     SymOpVector::const_iterator op = msymops.begin();
     Atom a1 = a0;
@@ -179,10 +224,12 @@ CrystalStructureAdapter::expandLatticeAtom(const Atom& a0) const
             eqsites.push_back(a1);
             eqsumpos.push_back(R3::zerovector);
             eqduplicity.push_back(0);
+            eqrotations.push_back(R3::zeromatrix());
             ieq = eqsites.size() - 1;
         }
         eqsumpos[ieq] += L.ucvFractional(a1.xyz_cartn);
         eqduplicity[ieq] += 1;
+        eqrotations[ieq] += op->R;
     }
     // assume P1 if symmetry operations were not defined
     if (msymops.empty())
@@ -193,43 +240,25 @@ CrystalStructureAdapter::expandLatticeAtom(const Atom& a0) const
         eqsites.push_back(a0);
         eqsumpos.push_back(a0.xyz_cartn);
         eqduplicity.push_back(1);
+        eqrotations.push_back(R3::identity());
     }
     // calculate mean values from equivalent sites and adjust any roundoffs
     assert(eqsites.size() == eqduplicity.size());
     assert(eqsites.size() == eqsumpos.size());
+    assert(eqsites.size() == eqrotations.size());
     iterator ai = eqsites.begin();
     vector<R3::Vector>::const_iterator sii = eqsumpos.begin();
     vector<int>::const_iterator dpi = eqduplicity.begin();
-    for (; ai != eqsites.end(); ++ai, ++sii, ++dpi)
+    vector<R3::Matrix>::iterator rti = eqrotations.begin();
+    for (; ai != eqsites.end(); ++ai, ++sii, ++dpi, ++rti)
     {
         ai->xyz_cartn = (*sii) / (*dpi);
+        *rti /= (*dpi);
     }
     return eqsites;
 }
 
 
-void CrystalStructureAdapter::updateSymmetryPositions() const
-{
-    // build asymmetric unit in lattice coordinates
-    AtomVector lcatoms(this->begin(), this->end());
-    AtomVector::iterator lcai = lcatoms.begin();
-    for (; lcai != lcatoms.end(); ++lcai)  this->toFractional(*lcai);
-    // build symmetry positions for all atoms in the asymmetric unit
-    msymatoms.resize(this->countSites());
-    assert(lcatoms.size() == msymatoms.size());
-    lcai = lcatoms.begin();
-    std::vector<AtomVector>::iterator saii = msymatoms.begin();
-    for (; lcai != lcatoms.end(); ++lcai, ++saii)
-    {
-        *saii = this->expandLatticeAtom(*lcai);
-        iterator ai = saii->begin();
-        for (; ai != saii->end(); ++ai)  this->toCartesian(*ai);
-    }
-    msymmetry_cached = true;
-}
-
-// Private Methods -----------------------------------------------------------
-
 int CrystalStructureAdapter::findEqualPosition(
         const AtomVector& eqsites, const Atom& a0) const
 {
@@ -251,10 +280,61 @@ int CrystalStructureAdapter::findEqualPosition(
 bool CrystalStructureAdapter::isSymmetryCached() const
 {
     msymmetry_cached = msymmetry_cached &&
-        (int(msymatoms.size()) == this->countSites());
+        (int(msymatoms.size()) == this->countSites()) &&
+        (msymjacobians.size() == msymatoms.size());
     return msymmetry_cached;
 }
 
+
+void CrystalStructureAdapter::ensureSymmetryCached() const
+{
+    {
+        lock_guard<mutex> lock(msymmetry_lock.mutex);
+        if (this->isSymmetryCached())  return;
+    }
+    this->updateSymmetryPositions();
+}
+
+
+void CrystalStructureAdapter::expandSymmetryPositions(
+        vector<AtomVector>& symatoms,
+        vector< vector<R3::Matrix> >& symjacobians) const
+{
+    // build asymmetric unit in lattice coordinates
+    AtomVector lcatoms(this->begin(), this->end());
+    AtomVector::iterator lcai = lcatoms.begin();
+    for (; lcai != lcatoms.end(); ++lcai)  this->toFractional(*lcai);
+    // build symmetry positions for all atoms in the asymmetric unit
+    symatoms.resize(this->countSites());
+    symjacobians.resize(this->countSites());
+    assert(lcatoms.size() == symatoms.size());
+    const Lattice& L = this->getLattice();
+    lcai = lcatoms.begin();
+    std::vector<AtomVector>::iterator saii = symatoms.begin();
+    std::vector< vector<R3::Matrix> >::iterator sjii = symjacobians.begin();
+    for (; lcai != lcatoms.end(); ++lcai, ++saii, ++sjii)
+    {
+        *saii = this->expandLatticeAtom(*lcai, *sjii);
+        iterator ai = saii->begin();
+        for (; ai != saii->end(); ++ai)  this->toCartesian(*ai);
+        // convert the mean rotations to Cartesian Jacobian matrices
+        vector<R3::Matrix>::iterator jj = sjii->begin();
+        for (; jj != sjii->end(); ++jj)
+        {
+            R3::Matrix J;
+            for (int j = 0; j < R3::Ndim; ++j)
+            {
+                R3::Vector ej = R3::zerovector;
+                ej[j] = 1.0;
+                R3::Vector lej = R3::mxvecproduct(*jj, L.fractional(ej));
+                R3::Vector cej = L.cartesian(lej);
+                for (int i = 0; i < R3::Ndim; ++i)  J(i, j) = cej[i];
+            }
+            *jj = J;
+        }
+    }
+}
+
 // Comparison functions ------------------------------------------------------
 
 bool operator==(
@@ -290,6 +370,8 @@ CrystalStructureBondGenerator::CrystalStructureBondGenerator(
     assert(mcstructure);
     msymidx = 0;
     mpuc1 = &(R3::zeromatrix());
+    mpjac0 = &(R3::identity());
+    mpjac1 = &(R3::identity());
 }
 
 // Public Methods ------------------------------------------------------------
@@ -299,6 +381,7 @@ void CrystalStructureBondGenerator::selectAnchorSite(int anchor)
     this->BaseBondGenerator::selectAnchorSite(anchor);
     const Atom& a0 = this->symatoms(anchor)[0];
     mr0 = a0.xyz_cartn;
+    mpjac0 = &(mcstructure->msymjacobians[anchor][0]);
 }
 
 
@@ -307,6 +390,18 @@ const R3::Matrix& CrystalStructureBondGenerator::Ucartesian1() const
     return *mpuc1;
 }
 
+
+const R3::Matrix& CrystalStructureBondGenerator::r0Jacobian() const
+{
+    return *mpjac0;
+}
+
+
+const R3::Matrix& CrystalStructureBondGenerator::r1Jacobian() const
+{
+    return *mpjac1;
+}
+
 // Protected Methods ---------------------------------------------------------
 
 bool CrystalStructureBondGenerator::iterateSymmetry()
@@ -349,9 +444,17 @@ void CrystalStructureBondGenerator::updater1()
     assert(msymidx < sa.size());
     mr1 = mrcsphere + sa[msymidx].xyz_cartn;
     mpuc1 = &(sa[msymidx].uij_cartn);
+    mpjac1 = &(mcstructure->msymjacobians[this->site1()][msymidx]);
     this->updateDistance();
 }
 
+
+bool CrystalStructureBondGenerator::allowsCellGrid() const
+{
+    // the sub-cells do not account for the symmetry equivalent positions
+    return false;
+}
+
 // Private Methods -----------------------------------------------------------
 
 const CrystalStructureAdapter::AtomVector&
@@ -23,6 +23,8 @@
 #ifndef CRYSTALSTRUCTUREADAPTER_HPP_INCLUDED
 #define CRYSTALSTRUCTUREADAPTER_HPP_INCLUDED
 
+#include <mutex>
+
 #include <diffpy/srreal/PeriodicStructureAdapter.hpp>
 
 namespace diffpy {
@@ -78,6 +80,7 @@ class CrystalStructureAdapter : public PeriodicStructureAdapter
         virtual BaseBondGeneratorPtr createBondGenerator() const;
         virtual int siteMultiplicity(int idx) const;
         virtual StructureDifference diff(StructureAdapterConstPtr other) const;
+        virtual void updateSnapshot(StructureAdapterPtr& snap) const;
 
         // methods - own
         void setSymmetryPrecision(double eps);
@@ -91,7 +94,13 @@ class CrystalStructureAdapter : public PeriodicStructureAdapter
         const AtomVector& getEquivalentAtoms(int idx) const;
         /// return all symmetry related atoms in fractional coordinates
         AtomVector expandLatticeAtom(const Atom&) const;
+        /// recalculate symmetry positions for the current asymmetric unit.
+        /// The cache is only overwritten when the expansion has changed,
+        /// so that bond generators of other threads can keep reading it.
         void updateSymmetryPositions() const;
+        /// Cartesian derivatives of the symmetry equivalent positions
+        /// with respect to the position of site i
+        const std::vector<R3::Matrix>& getEquivalentJacobians(int idx) const;
 
     private:
 
@@ -100,15 +109,36 @@ class CrystalStructureAdapter : public PeriodicStructureAdapter
         SymOpVector msymops;
         double msymmetry_precision;
         mutable std::vector<AtomVector> msymatoms;
+        mutable std::vector< std::vector<R3::Matrix> > msymjacobians;
         mutable bool msymmetry_cached;
+        /// lock for the symmetry cache, which is not copied with the adapter
+        class SymmetryLock
+        {
+            public:
+                SymmetryLock()  { }
+                SymmetryLock(const SymmetryLock&)  { }
+                SymmetryLock& operator=(const SymmetryLock&)  { return *this; }
+                std::mutex mutex;
+        };
+        mutable SymmetryLock msymmetry_lock;
 
         // symmetry helpers
+        /// expand lattice atom and set mean rotation matrix of the
+        /// symmetry operations that generate each equivalent position
+        AtomVector expandLatticeAtom(const Atom&,
+                std::vector<R3::Matrix>& eqrotations) const;
         /// return index of AtomVector atom at an equal position or -1
         int findEqualPosition(const AtomVector&, const Atom&) const;
         /// fuzzy check if symmetry positions are up to date
         /// this only detects addition or removal of atom in the asymmetric
         /// unit, but does not check for changes in atom positions.
         bool isSymmetryCached() const;
+        /// update symmetry positions if they are not cached
+        void ensureSymmetryCached() const;
+        /// expand all sites in the asymmetric unit into symmetry positions
+        /// and Cartesian Jacobian matrices
+        void expandSymmetryPositions(std::vector<AtomVector>& symatoms,
+                std::vector< std::vector<R3::Matrix> >& symjacobians) const;
 
         // comparison
         friend bool operator==(
@@ -124,6 +154,8 @@ class CrystalStructureAdapter : public PeriodicStructureAdapter
             ar & msymmetry_precision;
             ar & msymatoms;
             ar & msymmetry_cached;
+            if (version >= 1)  ar & msymjacobians;
+            else if (Archive::is_loading::value)  msymmetry_cached = false;
         }
 
 };
@@ -149,6 +181,8 @@ class CrystalStructureBondGenerator : public PeriodicStructureBondGenerator
 
         // data access
         virtual const R3::Matrix& Ucartesian1() const;
+        virtual const R3::Matrix& r0Jacobian() const;
+        virtual const R3::Matrix& r1Jacobian() const;
 
     protected:
 
@@ -157,11 +191,14 @@ class CrystalStructureBondGenerator : public PeriodicStructureBondGenerator
         virtual void rewindSymmetry();
         virtual void getNextBond();
         virtual void updater1();
+        virtual bool allowsCellGrid() const;
 
         // data
         const CrystalStructureAdapter* mcstructure;
         size_t msymidx;
         const R3::Matrix* mpuc1;
+        const R3::Matrix* mpjac0;
+        const R3::Matrix* mpjac1;
 
     private:
 
@@ -175,6 +212,7 @@ class CrystalStructureBondGenerator : public PeriodicStructureBondGenerator
 }   // namespace srreal
 }   // namespace diffpy
 
+BOOST_CLASS_VERSION(diffpy::srreal::CrystalStructureAdapter, 1)
 BOOST_CLASS_EXPORT_KEY(diffpy::srreal::CrystalStructureAdapter)
 
 #endif  // CRYSTALSTRUCTUREADAPTER_HPP_INCLUDED
@@ -0,0 +1,586 @@
+/*****************************************************************************
+*
+* libdiffpy         Complex Modeling Initiative
+*                   (c) 2026 Brookhaven Science Associates,
+*                   Brookhaven National Laboratory.
+*                   All rights reserved.
+*
+* File coded by:    Pavol Juhas
+*
+* See AUTHORS.txt for a list of people who contributed.
+* See LICENSE.txt for license information.
+*
+******************************************************************************
+*
+* class DebyeGrid -- pair distance distributions of a large non-periodic
+*     structure from the densities of its atom types on a 3-D grid.
+*
+*****************************************************************************/
+
+#include <cmath>
+#include <cassert>
+#include <stdexcept>
+#include <sstream>
+#include <algorithm>
+#include <map>
+#include <gsl/gsl_errno.h>
+#include <gsl/gsl_fft_real.h>
+#include <gsl/gsl_fft_halfcomplex.h>
+#include <gsl/gsl_fft_complex.h>
+
+#include <diffpy/srreal/DebyeGrid.hpp>
+#include <diffpy/srreal/PDFUtils.hpp>
+
+using namespace std;
+
+namespace diffpy {
+namespace srreal {
+
+// Local Helpers -------------------------------------------------------------
+
+namespace {
+
+const char* EMSGFFT = "Fourier Transformation failed.";
+/// number of adjacent grid lines transformed together along the first axes
+const size_t LINE_BLOCK = 16;
+/// largest number of grid points, about 8 GB for one grid
+const double GRID_MAX_POINTS = 1 << 30;
+/// number of grid values for the cached spectra of the atom types,
+/// the spectra beyond this limit are evaluated again for every pair
+const size_t GRID_CACHE_VALUES = size_t(1) << 28;
+/// amplification of the spectra at qmax by the division with
+/// the Debye-Waller factor of the Gaussian spreading
+const double GRID_AMPLIFICATION = 1e4;
+
+/// Wrapped index of a grid point or frequency in [-n/2, n/2)
+inline int wrapped(int i, int n)
+{
+    return (2 * i < n) ? i : (i - n);
+}
+
+/// Real 3-D FFT of a grid of an even length along the last axis.
+/// The spectrum holds complex values for the non-negative frequencies
+/// along the last axis, its shape is (n0, n1, n2 / 2 + 1).
+class GridFFT
+{
+    public:
+
+        // constructor
+        explicit GridFFT(const int shape[R3::Ndim])
+        {
+            copy(shape, shape + R3::Ndim, mn);
+            assert(0 == mn[2] % 2);
+            mnh = mn[2] / 2 + 1;
+            for (int k = 0; k < 2; ++k)
+            {
+                mcwavetable[k] = gsl_fft_complex_wavetable_alloc(mn[k]);
+                mcworkspace[k] = gsl_fft_complex_workspace_alloc(mn[k]);
+            }
+            mrwavetable = gsl_fft_real_wavetable_alloc(mn[2]);
+            mhwavetable = gsl_fft_halfcomplex_wavetable_alloc(mn[2]);
+            mrworkspace = gsl_fft_real_workspace_alloc(mn[2]);
+        }
+
+        // destructor
+        ~GridFFT()
+        {
+            gsl_fft_real_workspace_free(mrworkspace);
+            gsl_fft_halfcomplex_wavetable_free(mhwavetable);
+            gsl_fft_real_wavetable_free(mrwavetable);
+            for (int k = 0; k < 2; ++k)
+            {
+                gsl_fft_complex_workspace_free(mcworkspace[k]);
+                gsl_fft_complex_wavetable_free(mcwavetable[k]);
+            }
+        }
+
+        // methods
+        /// number of doubles in the spectrum
+        size_t spectrumSize() const
+        {
+            return 2 * size_t(mn[0]) * mn[1] * mnh;
+        }
+
+        /// Transform the real grid in g to its spectrum in place.
+        /// The real grid takes the first n0 * n1 * n2 values of g.
+        void forward(vector<double>& g) const
+        {
+            const int n2 = mn[2];
+            g.resize(this->spectrumSize());
+            // unpack the halfcomplex rows from the last one, the spectrum
+            // rows are longer and would overwrite the following real rows
+            for (size_t row = size_t(mn[0]) * mn[1]; row > 0; --row)
+            {
+                double* y = g.data() + (row - 1) * n2;
+                int status = gsl_fft_real_transform(y, 1, n2,
+                        mrwavetable, mrworkspace);
+                if (status != GSL_SUCCESS)  throw runtime_error(EMSGFFT);
+                double* z = g.data() + 2 * (row - 1) * mnh;
+                const double y0 = y[0];
+                const double yn = y[n2 - 1];
+                copy_backward(y + 1, y + n2 - 1, z + n2);
+                z[0] = y0;
+                z[1] = 0.0;
+                z[2 * mnh - 2] = yn;
+                z[2 * mnh - 1] = 0.0;
+            }
+            this->transformComplexAxes(g, true);
+        }
+
+        /// Transform the spectrum in s back to the real grid in place
+        /// and divide by the number of points.
+        void inverse(vector<double>& s) const
+        {
+            const int n2 = mn[2];
+            const double scale = 1.0 / (double(mn[0]) * mn[1] * n2);
+            this->transformComplexAxes(s, false);
+            for (size_t row = 0; row < size_t(mn[0]) * mn[1]; ++row)
+            {
+                double* y = s.data() + row * n2;
+                const double* z = s.data() + 2 * row * mnh;
+                const double zn = z[2 * mnh - 2];
+                y[0] = z[0];
+                copy(z + 2, z + n2, y + 1);
+                y[n2 - 1] = zn;
+                int status = gsl_fft_halfcomplex_backward(y, 1, n2,
+                        mhwavetable, mrworkspace);
+                if (status != GSL_SUCCESS)  throw runtime_error(EMSGFFT);
+                for (int i = 0; i < n2; ++i)  y[i] *= scale;
+            }
+            s.resize(size_t(mn[0]) * mn[1] * n2);
+        }
+
+    private:
+
+        // methods
+        /// complex FFT of s along the first two axes
+        void transformComplexAxes(vector<double>& s, bool forward) const
+        {
+            // The lines are gathered in blocks of adjacent lines to
+            // a contiguous buffer, the strided transformations of large
+            // grids would miss the cache for every value.
+            vector<double> lines;
+            for (int k = 1; k >= 0; --k)
+            {
+                const int n = mn[k];
+                // complex values between the points of a line along axis k
+                const size_t stride = (k == 0) ? (size_t(mn[1]) * mnh) : mnh;
+                const size_t nouter = (k == 0) ? 1 : mn[0];
+                lines.resize(2 * LINE_BLOCK * n);
+                for (size_t o = 0; o < nouter; ++o)
+                {
+                    double* base = s.data() + 2 * o * n * stride;
+                    for (size_t i = 0; i < stride; i += LINE_BLOCK)
+                    {
+                        const size_t nb = min(LINE_BLOCK, stride - i);
+                        for (int j = 0; j < n; ++j)
+                        {
+                            const double* z = base + 2 * (j * stride + i);
+                            for (size_t b = 0; b < nb; ++b)
+                            {
+                                lines[2 * (b * n + j)] = z[2 * b];
+                                lines[2 * (b * n + j) + 1] = z[2 * b + 1];
+                            }
+                        }
+                        for (size_t b = 0; b < nb; ++b)
+                        {
+                            double* z = lines.data() + 2 * b * n;
+                            int status = forward ?
+                                gsl_fft_complex_forward(z, 1, n,
+                                        mcwavetable[k], mcworkspace[k]) :
+                                gsl_fft_complex_backward(z, 1, n,
+                                        mcwavetable[k], mcworkspace[k]);
+                            if (status != GSL_SUCCESS)
+                            {
+                                throw runtime_error(EMSGFFT);
+                            }
+                        }
+                        for (int j = 0; j < n; ++j)
+                        {
+                            double* z = base + 2 * (j * stride + i);
+                            for (size_t b = 0; b < nb; ++b)
+                            {
+                                z[2 * b] = lines[2 * (b * n + j)];
+                                z[2 * b + 1] = lines[2 * (b * n + j) + 1];
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        // data
+        int mn[R3::Ndim];
+        int mnh;
+        gsl_fft_complex_wavetable* mcwavetable[2];
+        gsl_fft_complex_workspace* mcworkspace[2];
+        gsl_fft_real_wavetable* mrwavetable;
+        gsl_fft_halfcomplex_wavetable* mhwavetable;
+        gsl_fft_real_workspace* mrworkspace;
+
+        // disable copying
+        GridFFT(const GridFFT&);
+        GridFFT& operator=(const GridFFT&);
+};
+
+}   // namespace
+
+// Constructor ---------------------------------------------------------------
+
+DebyeGrid::DebyeGrid(double qmax, double eps) :
+    mqmax(qmax), meps(eps), mdeconvolved(false)
+{
+    if (!(qmax > 0))
+    {
+        const char* emsg = "DebyeGrid qmax must be positive.";
+        throw invalid_argument(emsg);
+    }
+    if (!(eps > 0 && eps < 1))
+    {
+        const char* emsg = "DebyeGrid precision must be within (0, 1).";
+        throw invalid_argument(emsg);
+    }
+    // The Gaussian spreading damps the spectra of the types by
+    // exp(-0.5 * mspreadvariance * k**2) and the pair spectra by its square,
+    // which is divided out with the GRID_AMPLIFICATION at qmax.
+    // The type spectra are periodic in 2 * pi / h, their aliases at q <= qmax
+    // come from |k| >= 2 * pi / h - qmax.  The pair spectra with one alias
+    // are below eps relative to the spectrum at q when
+    // 0.5 * mspreadvariance * (k**2 - q**2) >= log(1 / eps).
+    mspreadvariance = log(GRID_AMPLIFICATION) / (qmax * qmax);
+    const double kalias =
+        sqrt(qmax * qmax + 2 * log(1 / eps) / mspreadvariance);
+    mgridstep = 2 * M_PI / (qmax + kalias);
+}
+
+// Public Methods ------------------------------------------------------------
+
+void DebyeGrid::addAtom(int tp, const R3::Vector& xyz, double msd)
+{
+    assert(tp >= 0);
+    Atom a = {tp, xyz, max(0.0, msd) + mspreadvariance};
+    matoms.push_back(a);
+}
+
+
+int DebyeGrid::countTypes() const
+{
+    int rv = 0;
+    for (const Atom& a : matoms)  rv = max(rv, a.type + 1);
+    return rv;
+}
+
+
+vector<DebyeGrid::Distribution>
+DebyeGrid::pairDistributions(double rlo, double rhi)
+{
+    const int ntps = this->countTypes();
+    vector<Distribution> rv(pdfutils_countTypePairs(ntps));
+    mdeconvolved = false;
+    if (matoms.empty() || !(rlo <= rhi))  return rv;
+    // The spreading is divided out on the grid when the range cuts the
+    // pair correlations, the Debye-Waller correction would otherwise
+    // amplify the cut Gaussians of the pairs close to the bounds.
+    mdeconvolved = !this->enclosesPairs(rlo, rhi);
+    int shape[R3::Ndim];
+    R3::Vector origin;
+    this->gridShape(rhi, shape, origin);
+    const double h = mgridstep;
+    GridFFT fft(shape);
+    // Spectra of the first atom types are kept within GRID_CACHE_VALUES,
+    // the others are spread and transformed again for every type pair.
+    const int ncached = int(min(size_t(ntps),
+                GRID_CACHE_VALUES / fft.spectrumSize()));
+    vector< vector<double> > spectra(ncached);
+    auto typespectrum = [&](int tp, vector<double>& buffer)
+        -> vector<double>&
+    {
+        if (tp < ncached && !spectra[tp].empty())  return spectra[tp];
+        vector<double>& s = (tp < ncached) ? spectra[tp] : buffer;
+        s.reserve(fft.spectrumSize());
+        this->spreadType(tp, shape, origin, s);
+        fft.forward(s);
+        return s;
+    };
+    // atom counts per their variance for the self correlations
+    vector< map<double, int> > selfcounts(ntps);
+    const map<double, int> noselfs;
+    for (const Atom& a : matoms)  ++selfcounts[a.type][a.variance];
+    // squared frequencies along every axis
+    const int nh = shape[2] / 2 + 1;
+    const int klen[R3::Ndim] = {shape[0], shape[1], nh};
+    // and the inverse spreading factors for the deconvolution
+    vector<double> ksq[R3::Ndim];
+    vector<double> ea[R3::Ndim];
+    for (int k = 0; k < R3::Ndim; ++k)
+    {
+        const double dk = 2 * M_PI / (shape[k] * h);
+        ksq[k].resize(klen[k]);
+        ea[k].resize(klen[k]);
+        for (int i = 0; i < klen[k]; ++i)
+        {
+            ksq[k][i] = pow(dk * wrapped(i, shape[k]), 2);
+            ea[k][i] = exp(mspreadvariance * ksq[k][i]);
+        }
+    }
+    // radial bins up to the largest distance within the grid
+    const double rbin = this->binWidth();
+    double rgrid = 0.0;
+    for (int k = 0; k < R3::Ndim; ++k)  rgrid += pow(shape[k] / 2 * h, 2);
+    const double rbinmax = min(rhi, sqrt(rgrid));
+    const int nbins = int(rbinmax / rbin) + 1;
+    vector<double> bsum, brsum;
+    vector<double> pbuffer, buffer0, buffer1;
+    for (int tp1 = 0; tp1 < ntps; ++tp1)
+    {
+        vector<double>& s1 = typespectrum(tp1, buffer1);
+        for (int tp0 = 0; tp0 <= tp1; ++tp0)
+        {
+            const vector<double>& s0 =
+                (tp0 == tp1) ? s1 : typespectrum(tp0, buffer0);
+            // the like pair comes last and overwrites s1 unless
+            // it is cached for the following types
+            const bool reuse = (tp0 == tp1) &&
+                (tp1 >= ncached || tp1 == ntps - 1);
+            vector<double>& p = reuse ? s1 : pbuffer;
+            // spectrum of the symmetrized cross correlation
+            p.resize(s0.size());
+            for (size_t i = 0; i < p.size(); i += 2)
+            {
+                p[i] = s0[i] * s1[i] + s0[i + 1] * s1[i + 1];
+                p[i + 1] = 0.0;
+            }
+            // remove the self correlations of the atoms,
+            // which are Gaussians of twice the atom variance
+            const map<double, int>& selfs =
+                (tp0 == tp1) ? selfcounts[tp0] : noselfs;
+            for (const auto& vc : selfs)
+            {
+                const double& v = vc.first;
+                vector<double> e[R3::Ndim];
+                for (int k = 0; k < R3::Ndim; ++k)
+                {
+                    e[k].resize(klen[k]);
+                    for (int i = 0; i < klen[k]; ++i)
+                    {
+                        e[k][i] = exp(-v * ksq[k][i]);
+                    }
+                }
+                double* pp = p.data();
+                for (int i0 = 0; i0 < klen[0]; ++i0)
+                {
+                    for (int i1 = 0; i1 < klen[1]; ++i1)
+                    {
+                        const double e01 = vc.second * e[0][i0] * e[1][i1];
+                        for (int i2 = 0; i2 < klen[2]; ++i2, pp += 2)
+                        {
+                            *pp -= e01 * e[2][i2];
+                        }
+                    }
+                }
+            }
+            if (mdeconvolved)
+            {
+                // multiply by exp(mspreadvariance * min(k**2, qmax**2))
+                const double amax = exp(mspreadvariance * mqmax * mqmax);
+                double* pp = p.data();
+                for (int i0 = 0; i0 < klen[0]; ++i0)
+                {
+                    for (int i1 = 0; i1 < klen[1]; ++i1)
+                    {
+                        const double a01 = ea[0][i0] * ea[1][i1];
+                        for (int i2 = 0; i2 < klen[2]; ++i2, pp += 2)
+                        {
+                            *pp *= min(amax, a01 * ea[2][i2]);
+                        }
+                    }
+                }
+            }
+            fft.inverse(p);
+            // sum the correlations in the radial bins
+            bsum.assign(nbins, 0.0);
+            brsum.assign(nbins, 0.0);
+            const double* c = p.data();
+            for (int i0 = 0; i0 < shape[0]; ++i0)
+            {
+                const double dsq0 = pow(h * wrapped(i0, shape[0]), 2);
+                for (int i1 = 0; i1 < shape[1]; ++i1)
+                {
+                    const double dsq01 = dsq0 +
+                        pow(h * wrapped(i1, shape[1]), 2);
+                    for (int i2 = 0; i2 < shape[2]; ++i2, ++c)
+                    {
+                        const double r = sqrt(dsq01 +
+                                pow(h * wrapped(i2, shape[2]), 2));
+                        if (r < rlo || r > rhi)  continue;
+                        const int b = min(nbins - 1, int(r / rbin));
+                        bsum[b] += *c;
+                        brsum[b] += *c * r;
+                    }
+                }
+            }
+            // unlike types contribute in both orders
+            const double pairscale = (tp0 == tp1) ? 1.0 : 2.0;
+            Distribution& dst = rv[pdfutils_typePairIndex(tp0, tp1)];
+            for (int b = 0; b < nbins; ++b)
+            {
+                if (bsum[b] == 0)  continue;
+                // use the bin center when the weights have mixed signs
+                double r = brsum[b] / bsum[b];
+                if (!(r >= b * rbin && r <= (b + 1) * rbin))
+                {
+                    r = (b + 0.5) * rbin;
+                }
+                Bin bn = {r, pairscale * bsum[b]};
+                dst.push_back(bn);
+            }
+        }
+    }
+    return rv;
+}
+
+
+double DebyeGrid::pairSpreadVariance() const
+{
+    return mdeconvolved ? 0.0 : (2 * mspreadvariance);
+}
+
+
+double DebyeGrid::gridStep() const
+{
+    return mgridstep;
+}
+
+
+double DebyeGrid::binWidth() const
+{
+    // the second-order error of sin(q r) / r within a bin is below eps
+    // after the amplification of the spectra at qmax
+    return sqrt(8 * meps / GRID_AMPLIFICATION) / mqmax;
+}
+
+// Private Methods -----------------------------------------------------------
+
+void DebyeGrid::gridShape(double rhi,
+        int shape[R3::Ndim], R3::Vector& origin) const
+{
+    assert(!matoms.empty());
+    R3::Vector xyzlo = matoms[0].xyz;
+    R3::Vector xyzhi = matoms[0].xyz;
+    double vmax = 0.0;
+    for (const Atom& a : matoms)
+    {
+        for (int k = 0; k < R3::Ndim; ++k)
+        {
+            xyzlo[k] = min(xyzlo[k], a.xyz[k]);
+            xyzhi[k] = max(xyzhi[k], a.xyz[k]);
+        }
+        vmax = max(vmax, a.variance);
+    }
+    const double h = mgridstep;
+    const double margin = this->tailSigmas() * sqrt(vmax) + h;
+    double n[R3::Ndim];
+    double npoints = 1.0;
+    for (int k = 0; k < R3::Ndim; ++k)
+    {
+        // correlations extend to the density span, the period must
+        // keep their images beyond rhi or beyond the span itself
+        const double span = xyzhi[k] - xyzlo[k] + 2 * margin;
+        const double period = span + min(rhi, span) + h;
+        n[k] = ceil(period / h);
+        npoints *= n[k];
+        origin[k] = xyzlo[k] - margin;
+    }
+    if (npoints <= GRID_MAX_POINTS)
+    {
+        npoints = 1.0;
+        for (int k = 0; k < R3::Ndim; ++k)
+        {
+            npoints *= (shape[k] = fftPaddedSize(int(n[k])));
+        }
+    }
+    if (npoints > GRID_MAX_POINTS)
+    {
+        ostringstream emsg;
+        emsg << "DebyeGrid of " << npoints << " points is too large, " <<
+            "reduce the precision, qmax or the distance range.";
+        throw runtime_error(emsg.str());
+    }
+}
+
+
+void DebyeGrid::spreadType(int tp, const int shape[R3::Ndim],
+        const R3::Vector& origin, vector<double>& g) const
+{
+    const double h = mgridstep;
+    g.assign(size_t(shape[0]) * shape[1] * shape[2], 0.0);
+    vector<double> w[R3::Ndim];
+    int ilo[R3::Ndim];
+    for (const Atom& a : matoms)
+    {
+        if (a.type != tp)  continue;
+        // separable weights of the Gaussian times the cell volume
+        const double sigma = sqrt(a.variance);
+        const double xtail = this->tailSigmas() * sigma / h;
+        for (int k = 0; k < R3::Ndim; ++k)
+        {
+            const double x = (a.xyz[k] - origin[k]) / h;
+            ilo[k] = int(ceil(x - xtail));
+            const int ihi = int(floor(x + xtail));
+            assert(ilo[k] >= 0 && ihi < shape[k]);
+            w[k].resize(ihi - ilo[k] + 1);
+            for (int i = ilo[k]; i <= ihi; ++i)
+            {
+                const double dx = (i - x) * h;
+                w[k][i - ilo[k]] = h * exp(-0.5 * dx * dx / a.variance) /
+                    (sqrt(2 * M_PI) * sigma);
+            }
+        }
+        for (size_t j0 = 0; j0 < w[0].size(); ++j0)
+        {
+            for (size_t j1 = 0; j1 < w[1].size(); ++j1)
+            {
+                const double w01 = w[0][j0] * w[1][j1];
+                double* gp = g.data() + ((size_t(ilo[0] + j0) * shape[1] +
+                            (ilo[1] + j1)) * shape[2] + ilo[2]);
+                for (size_t j2 = 0; j2 < w[2].size(); ++j2)
+                {
+                    gp[j2] += w01 * w[2][j2];
+                }
+            }
+        }
+    }
+}
+
+
+bool DebyeGrid::enclosesPairs(double rlo, double rhi) const
+{
+    if (rlo > 0)  return false;
+    // the pair distances are at most twice the largest distance
+    // from the center of the atoms
+    R3::Vector center = R3::zerovector;
+    for (const Atom& a : matoms)  center += a.xyz;
+    center /= matoms.size();
+    double dmax = 0.0;
+    double vmax = 0.0;
+    for (const Atom& a : matoms)
+    {
+        dmax = max(dmax, R3::distance(a.xyz, center));
+        vmax = max(vmax, a.variance);
+    }
+    const double dhi = 2 * dmax + this->tailSigmas() * sqrt(2 * vmax);
+    return rhi >= dhi;
+}
+
+
+double DebyeGrid::tailSigmas() const
+{
+    // the truncated tails stay below eps relative to the spectrum at qmax,
+    // which is damped by the square root of the amplification for a type
+    return sqrt(2 * log(1 / meps) + log(GRID_AMPLIFICATION));
+}
+
+}   // namespace srreal
+}   // namespace diffpy
+
+// End of file
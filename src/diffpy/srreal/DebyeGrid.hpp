@@ -0,0 +1,132 @@
+/*****************************************************************************
+*
+* libdiffpy         Complex Modeling Initiative
+*                   (c) 2026 Brookhaven Science Associates,
+*                   Brookhaven National Laboratory.
+*                   All rights reserved.
+*
+* File coded by:    Pavol Juhas
+*
+* See AUTHORS.txt for a list of people who contributed.
+* See LICENSE.txt for license information.
+*
+******************************************************************************
+*
+* class DebyeGrid -- pair distance distributions of a large non-periodic
+*     structure from the densities of its atom types on a 3-D grid.
+*
+* Every atom is spread as an isotropic Gaussian with its own mean square
+* displacement plus a common spreading variance.  The densities of the
+* atom types are transformed by a real 3-D FFT and the correlation
+* function of every type pair is obtained by the inverse transformation
+* of the product of their spectra.  The self correlation of the atoms is
+* subtracted from the spectra of the like-type pairs.  The correlations
+* are then summed in thin radial bins within the requested distance range.
+*
+* The bins of a type pair with correlation weight w at distance r give
+* the Debye sum w * exp(0.5 * pairSpreadVariance() * q**2) * sin(q r) / r,
+* where the exponential removes the Gaussian spreading.  The bin at zero
+* distance gives its limit w * exp(...) * q.  When the distance range
+* cuts the spread correlations of some pairs, the spreading is removed
+* from the spectra up to qmax before the inverse transformation instead
+* and pairSpreadVariance() is 0.  The pairs then have sharper profiles
+* of a width about pi / qmax, which are cut at the bounds.  The cut
+* profiles are not amplified by the correction of the spreading, but
+* they are exact only for the pairs well within the range.
+*
+* The grid parameters are derived from the maximum Q and from the
+* precision, which is the relative error of the spectra at the maximum Q.
+* The spreading is fixed by qmax so that its Debye-Waller factor amplifies
+* the spectra at qmax 1e4 times and the grid step is the largest one that
+* keeps the aliases of the spectra below the precision.  The step is
+* 2.3 / qmax for the precision of 1e-4 and 1.9 / qmax for 1e-8.  The grid
+* spans the structure plus the maximum distance, therefore its size grows
+* with (qmax * (D + rmax))**3 for a structure of diameter D.  The
+* evaluation keeps the spectra of as many atom types as fit in 2 GB and
+* up to three more grids, a single atom type needs one grid.  The spectra
+* of the other types are evaluated again for every type pair.
+*
+*****************************************************************************/
+
+#ifndef DEBYEGRID_HPP_INCLUDED
+#define DEBYEGRID_HPP_INCLUDED
+
+#include <vector>
+#include <diffpy/srreal/R3linalg.hpp>
+
+namespace diffpy {
+namespace srreal {
+
+class DebyeGrid
+{
+    public:
+
+        // types
+        struct Bin
+        {
+            double distance;
+            double weight;
+        };
+        typedef std::vector<Bin> Distribution;
+
+        // constructor
+        /// grid for Debye sums up to qmax with the relative precision eps
+        DebyeGrid(double qmax, double eps);
+
+        // methods
+        /// add atom with the type index tp at xyz with the isotropic
+        /// mean square displacement msd
+        void addAtom(int tp, const R3::Vector& xyz, double msd);
+        /// number of atom types, the largest type index plus 1
+        int countTypes() const;
+        /// occupied radial bins of the correlations of every type pair
+        /// for distances in [rlo, rhi] in the pdfutils_typePairIndex order.
+        /// The weights of unlike types count both orders of the pairs.
+        std::vector<Distribution>
+            pairDistributions(double rlo, double rhi);
+        /// pair variance of the last pairDistributions, which is divided
+        /// out by the Debye-Waller factor
+        /// exp(0.5 * pairSpreadVariance() * q**2).  This is 0 when
+        /// the distributions were deconvolved on the grid.
+        double pairSpreadVariance() const;
+        /// grid step
+        double gridStep() const;
+        /// width of the radial bins
+        double binWidth() const;
+
+    private:
+
+        // types
+        struct Atom
+        {
+            int type;
+            R3::Vector xyz;
+            double variance;
+        };
+
+        // methods
+        /// grid shape and origin for the structure and maximum distance rhi
+        void gridShape(double rhi,
+                int shape[R3::Ndim], R3::Vector& origin) const;
+        /// spread atoms of type tp to the real grid g
+        void spreadType(int tp, const int shape[R3::Ndim],
+                const R3::Vector& origin, std::vector<double>& g) const;
+        /// true if [rlo, rhi] holds the whole correlations of all pairs
+        bool enclosesPairs(double rlo, double rhi) const;
+        /// half width of the spread Gaussians in their standard deviations
+        double tailSigmas() const;
+
+        // data
+        double mqmax;
+        double meps;
+        double mspreadvariance;
+        double mgridstep;
+        bool mdeconvolved;
+        std::vector<Atom> matoms;
+
+};
+
+}   // namespace srreal
+}   // namespace diffpy
+
+#endif  // DEBYEGRID_HPP_INCLUDED
@@ -97,27 +97,57 @@ eventticker::EventTicker& DebyePDFCalculator::ticker() const
 
 QuantityType DebyePDFCalculator::getPDF() const
 {
+    this->updateResultsCache();
+    if (mresults_cache.has(PDF))  return mresults_cache.get(PDF);
     QuantityType rgrid = this->getRgrid();
-    QuantityType pdf0 = this->getPDFAtQmin(this->getQmin());
+    // reuse the cached RDF/r when all F(Q) points are included
+    QuantityType pdf0 = (0.0 == this->getQmin()) ? this->getRDFperR() :
+        this->getPDFAtQmin(this->getF(), this->getQmin());
     QuantityType pdf1 = this->applyEnvelopes(rgrid, pdf0);
-    return pdf1;
+    return mresults_cache.store(PDF, pdf1);
 }
 
 
 QuantityType DebyePDFCalculator::getRDF() const
 {
+    this->updateResultsCache();
+    if (mresults_cache.has(RDF))  return mresults_cache.get(RDF);
     QuantityType rgrid = this->getRgrid();
     QuantityType rv = this->getRDFperR();
     assert(rv.size() == rgrid.size());
     transform(rgrid.begin(), rgrid.end(), rv.begin(), rv.begin(),
             multiplies<double>());
-    return rv;
+    return mresults_cache.store(RDF, rv);
 }
 
 
 QuantityType DebyePDFCalculator::getRDFperR() const
 {
-    return this->getPDFAtQmin(0.0);
+    this->updateResultsCache();
+    if (mresults_cache.has(RDFPERR))  return mresults_cache.get(RDFPERR);
+    QuantityType rv = this->getPDFAtQmin(this->getF(), 0.0);
+    return mresults_cache.store(RDFPERR, rv);
+}
+
+
+QuantityType DebyePDFCalculator::getPartialPDF(int tp0, int tp1) const
+{
+    QuantityType rgrid = this->getRgrid();
+    QuantityType fpart = this->getPartialF(tp0, tp1);
+    QuantityType pdf0 = this->getPDFAtQmin(fpart, this->getQmin());
+    QuantityType pdf1 = this->applyEnvelopes(rgrid, pdf0);
+    return pdf1;
+}
+
+
+QuantityType DebyePDFCalculator::getPDFGradient(
+        int siteidx, SiteParameter p) const
+{
+    QuantityType rgrid = this->getRgrid();
+    QuantityType fgrad = this->getFGradient(siteidx, p);
+    QuantityType pdf0 = this->getPDFAtQmin(fgrad, this->getQmin());
+    QuantityType pdf1 = this->applyEnvelopes(rgrid, pdf0);
+    return pdf1;
 }
 
 // Q-range configuration
@@ -169,7 +199,10 @@ bool DebyePDFCalculator::isOptimumQstep() const
 
 QuantityType DebyePDFCalculator::getRgrid() const
 {
-    return pdfutils_getRgrid(this);
+    this->updateResultsCache();
+    if (mresults_cache.has(RGRID))  return mresults_cache.get(RGRID);
+    QuantityType rv = pdfutils_getRgrid(this);
+    return mresults_cache.store(RGRID, rv);
 }
 
 // R-range configuration
@@ -268,13 +301,41 @@ void DebyePDFCalculator::resetValue()
     this->cacheRlimitsData();
     this->updateQstep();
     this->BaseDebyeSum::resetValue();
+    mresults_cache.clear();
+}
+
+
+void DebyePDFCalculator::resetFrameValue()
+{
+    this->cacheRlimitsData();
+    this->updateQstep();
+    this->BaseDebyeSum::resetFrameValue();
+    mresults_cache.clear();
+}
+
+
+void DebyePDFCalculator::finishValue()
+{
+    this->BaseDebyeSum::finishValue();
+    mresults_cache.clear();
 }
 
 
-void DebyePDFCalculator::configureBondGenerator(BaseBondGenerator& bnds) const
+double DebyePDFCalculator::debyeRmin() const
 {
-    bnds.setRmin(this->rcalclo());
-    bnds.setRmax(this->rcalchi());
+    return this->rcalclo();
+}
+
+
+double DebyePDFCalculator::debyeRmax() const
+{
+    return this->rcalchi();
+}
+
+
+QuantityType DebyePDFCalculator::batchValue() const
+{
+    return this->getPDF();
 }
 
 
@@ -289,10 +350,27 @@ double DebyePDFCalculator::sfSiteAtQ(int siteidx, const double& Q) const
 
 // Private Methods -----------------------------------------------------------
 
-QuantityType DebyePDFCalculator::getPDFAtQmin(double qmin) const
+/// Check the key of the results cache and discard the outdated results.
+void DebyePDFCalculator::updateResultsCache() const
+{
+    mresults_cache.beginKey(this->ticker());
+    mresults_cache.addToKey(mqminpdf);
+    mresults_cache.addToKey(mrstep);
+    set<string> evnames = this->usedEnvelopeTypes();
+    set<string>::const_iterator nm = evnames.begin();
+    for (; nm != evnames.end(); ++nm)
+    {
+        mresults_cache.addToKey(*nm, *(this->getEnvelopeByType(*nm)));
+    }
+    mresults_cache.endKey();
+}
+
+
+QuantityType DebyePDFCalculator::getPDFAtQmin(
+        const QuantityType& f, double qmin) const
 {
     // build a zero padded F vector that gives dr <= rstep
-    QuantityType fpad = this->getF();
+    QuantityType fpad = f;
     // zero all F values below qmin
     int nqmin = pdfutils_qminSteps(qmin, this->getQstep());
     if (nqmin > int(fpad.size()))  nqmin = fpad.size();
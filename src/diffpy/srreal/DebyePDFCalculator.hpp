@@ -51,6 +51,7 @@
 #include <diffpy/srreal/BaseDebyeSum.hpp>
 #include <diffpy/srreal/ScatteringFactorTable.hpp>
 #include <diffpy/srreal/PDFEnvelope.hpp>
+#include <diffpy/srreal/PDFResultsCache.hpp>
 
 namespace diffpy {
 namespace srreal {
@@ -73,6 +74,12 @@ class DebyePDFCalculator :
         QuantityType getPDF() const;
         QuantityType getRDF() const;
         QuantityType getRDFperR() const;
+        /// PDF from the partial F of atom type indices tp0 and tp1.
+        /// For Q-independent scattering factors the PDF is equal to
+        /// the sum of partial PDFs times their weights.
+        QuantityType getPartialPDF(int tp0, int tp1) const;
+        /// derivative of the PDF with respect to parameter p of a site
+        QuantityType getPDFGradient(int siteidx, SiteParameter p) const;
 
         // Q-range configuration
         void setQmin(double);
@@ -104,13 +111,21 @@ class DebyePDFCalculator :
 
         // BaseDebyeSum overloads
         virtual void resetValue();
-        virtual void configureBondGenerator(BaseBondGenerator&) const;
+        virtual void resetFrameValue();
+        virtual void finishValue();
+        virtual double debyeRmin() const;
+        virtual double debyeRmax() const;
         virtual double sfSiteAtQ(int, const double& Q) const;
 
+        // PairQuantity overloads
+        virtual QuantityType batchValue() const;
+
     private:
 
         // methods
-        QuantityType getPDFAtQmin(double qmin) const;
+        QuantityType getPDFAtQmin(const QuantityType& f, double qmin) const;
+        /// discard cached results when the calculator has changed
+        void updateResultsCache() const;
         void updateQstep();
         /// complete lower bound extension of the calculated grid
         double rcalclo() const;
@@ -130,6 +145,9 @@ class DebyePDFCalculator :
         mutable int mrcalclosteps;
         mutable int mrcalchisteps;
         mutable bool mrlimits_are_cached;
+        // results derived from the F(Q) value, these are not serialized
+        enum { RGRID, RDFPERR, RDF, PDF };
+        mutable PDFResultsCache mresults_cache;
 
         // serialization
         friend class boost::serialization::access;
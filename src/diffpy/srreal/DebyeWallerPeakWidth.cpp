@@ -59,6 +59,39 @@ double DebyeWallerPeakWidth::calculate(const BaseBondGenerator& bnds) const
 }
 
 
+bool DebyeWallerPeakWidth::configureBondBatch(BondBatch& batch) const
+{
+    batch.withmsd = true;
+    return true;
+}
+
+
+void DebyeWallerPeakWidth::calculateBatch(
+        const BondBatch& batch, vector<double>& fwhm) const
+{
+    using diffpy::mathutils::GAUSS_SIGMA_TO_FWHM;
+    const int n = batch.size();
+    fwhm.resize(n);
+    const double* msd = batch.msd.data();
+    for (int k = 0; k < n; ++k)
+    {
+        fwhm[k] = (msd[k] < 0.0) ? 0.0 : GAUSS_SIGMA_TO_FWHM * sqrt(msd[k]);
+    }
+}
+
+
+void DebyeWallerPeakWidth::calculateDerivatives(
+        const BaseBondGenerator& bnds,
+        double& dfwhmdr, double& dfwhmdmsd) const
+{
+    using diffpy::mathutils::GAUSS_SIGMA_TO_FWHM;
+    double msdval = bnds.msd();
+    dfwhmdr = 0.0;
+    dfwhmdmsd = (msdval <= 0.0) ? 0.0 :
+        GAUSS_SIGMA_TO_FWHM / (2 * sqrt(msdval));
+}
+
+
 double DebyeWallerPeakWidth::maxWidth(StructureAdapterPtr stru,
                 double rmin, double rmax) const
 {
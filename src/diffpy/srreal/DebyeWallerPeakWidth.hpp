@@ -37,6 +37,11 @@ class DebyeWallerPeakWidth : public PeakWidthModel
         // methods
         virtual const std::string& type() const;
         virtual double calculate(const BaseBondGenerator&) const;
+        virtual bool configureBondBatch(BondBatch&) const;
+        virtual void calculateBatch(const BondBatch&,
+                std::vector<double>& fwhm) const;
+        virtual void calculateDerivatives(const BaseBondGenerator&,
+                double& dfwhmdr, double& dfwhmdmsd) const;
         virtual double maxWidth(StructureAdapterPtr,
                 double rmin, double rmax) const;
 
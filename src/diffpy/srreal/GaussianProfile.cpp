@@ -18,6 +18,8 @@
 *****************************************************************************/
 
 #include <cmath>
+#include <typeinfo>
+#include <algorithm>
 
 #include <diffpy/srreal/GaussianProfile.hpp>
 #include <diffpy/mathutils.hpp>
@@ -30,6 +32,46 @@ namespace srreal {
 
 using diffpy::mathutils::DOUBLE_EPS;
 
+// Local Helpers -------------------------------------------------------------
+
+namespace {
+
+/// number of recurrence steps between exact evaluations of exp
+const int RECURRENCE_BLOCK = 32;
+
+/// Fill y[k] = exp(-a * (x0 + k * dx)**2) for k in [0, n).
+/// Successive values are obtained by multiplication with the ratio
+/// exp(-a * dx * (2 * x + dx)), which is also updated by multiplication.
+/// The recurrence proceeds outward from the grid point nearest to zero
+/// so that the ratios never exceed 1.
+void expRecurrence(double x0, double dx, int n, double a, double* y)
+{
+    if (n <= 0)  return;
+    const double c = exp(-2 * a * dx * dx);
+    int kc = int(floor(-x0 / dx + 0.5));
+    kc = std::max(0, std::min(n - 1, kc));
+    // upward from kc
+    for (int kb = kc; kb < n; kb += RECURRENCE_BLOCK)
+    {
+        const int kbhi = std::min(n, kb + RECURRENCE_BLOCK);
+        double x = x0 + kb * dx;
+        double g = exp(-a * x * x);
+        double q = exp(-a * dx * (2 * x + dx));
+        for (int k = kb; k < kbhi; ++k, g *= q, q *= c)  y[k] = g;
+    }
+    // downward from kc
+    for (int kb = kc - 1; kb >= 0; kb -= RECURRENCE_BLOCK)
+    {
+        const int kblo = std::max(-1, kb - RECURRENCE_BLOCK);
+        double x = x0 + kb * dx;
+        double g = exp(-a * x * x);
+        double q = exp(-a * dx * (dx - 2 * x));
+        for (int k = kb; k > kblo; --k, g *= q, q *= c)  y[k] = g;
+    }
+}
+
+}   // namespace
+
 // Constructors --------------------------------------------------------------
 
 GaussianProfile::GaussianProfile()
@@ -83,6 +125,33 @@ double GaussianProfile::xboundhi(double fwhm) const
 }
 
 
+void GaussianProfile::evaluateGrid(double x0, double dx, int n,
+        double fwhm, double* y) const
+{
+    // derived classes may override operator()
+    if (typeid(*this) != typeid(GaussianProfile))
+    {
+        this->PeakProfile::evaluateGrid(x0, dx, n, fwhm, y);
+        return;
+    }
+    this->gaussianGrid(x0, dx, n, fwhm, y);
+}
+
+
+void GaussianProfile::evaluateGridDerivatives(double x0, double dx, int n,
+        double fwhm, double* dydx, double* dydfwhm) const
+{
+    // derived classes may override operator()
+    if (typeid(*this) != typeid(GaussianProfile))
+    {
+        this->PeakProfile::evaluateGridDerivatives(
+                x0, dx, n, fwhm, dydx, dydfwhm);
+        return;
+    }
+    this->gaussianGridDerivatives(x0, dx, n, fwhm, dydx, dydfwhm);
+}
+
+
 void GaussianProfile::setPrecision(double eps)
 {
     // correct any settings below DOUBLE_EPS
@@ -92,6 +161,45 @@ void GaussianProfile::setPrecision(double eps)
     else  mhalfboundrel = 0.0;
 }
 
+// Protected Methods ---------------------------------------------------------
+
+/// Evaluate Gaussian profile on a grid using the exp recurrence.
+void GaussianProfile::gaussianGrid(double x0, double dx, int n,
+        double fwhm, double* y) const
+{
+    if (fwhm <= 0)
+    {
+        std::fill(y, y + n, 0.0);
+        return;
+    }
+    const double a = 4 * M_LN2 / (fwhm * fwhm);
+    const double amplitude = 2 * sqrt(M_LN2 / M_PI) / fwhm;
+    expRecurrence(x0, dx, n, a, y);
+    for (int k = 0; k < n; ++k)  y[k] *= amplitude;
+}
+
+
+/// Evaluate analytical derivatives of Gaussian profile on a grid.
+void GaussianProfile::gaussianGridDerivatives(double x0, double dx, int n,
+        double fwhm, double* dydx, double* dydfwhm) const
+{
+    if (fwhm <= 0)
+    {
+        std::fill(dydx, dydx + n, 0.0);
+        std::fill(dydfwhm, dydfwhm + n, 0.0);
+        return;
+    }
+    const double a = 4 * M_LN2 / (fwhm * fwhm);
+    this->gaussianGrid(x0, dx, n, fwhm, dydx);
+    for (int k = 0; k < n; ++k)
+    {
+        const double x = x0 + k * dx;
+        const double y = dydx[k];
+        dydx[k] = -2 * a * x * y;
+        dydfwhm[k] = (2 * a * x * x - 1) * y / fwhm;
+    }
+}
+
 // Registration --------------------------------------------------------------
 
 bool reg_GaussianProfile = GaussianProfile().registerThisType();
@@ -39,10 +39,20 @@ class GaussianProfile : public PeakProfile
         double operator()(double x, double fwhm) const;
         double xboundlo(double fwhm) const;
         double xboundhi(double fwhm) const;
+        void evaluateGrid(double x0, double dx, int n,
+                double fwhm, double* y) const;
+        void evaluateGridDerivatives(double x0, double dx, int n,
+                double fwhm, double* dydx, double* dydfwhm) const;
         void setPrecision(double eps);
 
     protected:
 
+        // methods
+        void gaussianGrid(double x0, double dx, int n,
+                double fwhm, double* y) const;
+        void gaussianGridDerivatives(double x0, double dx, int n,
+                double fwhm, double* dydx, double* dydfwhm) const;
+
         // data
         double mhalfboundrel;
 
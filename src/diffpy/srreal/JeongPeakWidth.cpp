@@ -77,6 +77,41 @@ double JeongPeakWidth::calculate(const BaseBondGenerator& bnds) const
 }
 
 
+void JeongPeakWidth::calculateBatch(
+        const BondBatch& batch, vector<double>& fwhm) const
+{
+    this->DebyeWallerPeakWidth::calculateBatch(batch, fwhm);
+    const int n = batch.size();
+    const double qbsep = this->getQbroad_seperable();
+    for (int k = 0; k < n; ++k)
+    {
+        const double& r = batch.distance[k];
+        double corr = this->msdSharpeningRatio(r);
+        fwhm[k] = (corr <= 0) ? 0.0 :
+            (sqrt(corr) * fwhm[k] + pow(qbsep * r, 2));
+    }
+}
+
+
+void JeongPeakWidth::calculateDerivatives(const BaseBondGenerator& bnds,
+        double& dfwhmdr, double& dfwhmdmsd) const
+{
+    double r = bnds.distance();
+    double corr = this->msdSharpeningRatio(r);
+    dfwhmdr = 0.0;
+    dfwhmdmsd = 0.0;
+    if (corr <= 0)  return;
+    double fwhmdw = this->DebyeWallerPeakWidth::calculate(bnds);
+    this->DebyeWallerPeakWidth::calculateDerivatives(
+            bnds, dfwhmdr, dfwhmdmsd);
+    double dcorrdr = this->getDelta1() / pow(r, 2) +
+        2 * this->getDelta2() / pow(r, 3) + 2 * pow(this->getQbroad(), 2) * r;
+    dfwhmdr = fwhmdw * dcorrdr / (2 * sqrt(corr)) +
+        2 * pow(this->getQbroad_seperable(), 2) * r;
+    dfwhmdmsd *= sqrt(corr);
+}
+
+
 double JeongPeakWidth::maxWidth(StructureAdapterPtr stru,
         double rmin, double rmax) const
 {
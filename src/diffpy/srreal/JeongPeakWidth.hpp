@@ -39,6 +39,10 @@ class JeongPeakWidth : public DebyeWallerPeakWidth
         // methods
         virtual const std::string& type() const;
         virtual double calculate(const BaseBondGenerator&) const;
+        virtual void calculateBatch(const BondBatch&,
+                std::vector<double>& fwhm) const;
+        virtual void calculateDerivatives(const BaseBondGenerator&,
+                double& dfwhmdr, double& dfwhmdmsd) const;
         virtual double maxWidth(StructureAdapterPtr,
                 double rmin, double rmax) const;
 
@@ -184,68 +184,57 @@ double Lattice::volume() const
 }
 
 
-const R3::Vector& Lattice::cartesian(const R3::Vector& lv) const
+R3::Vector Lattice::cartesian(const R3::Vector& lv) const
 {
-    static R3::Vector res;
-    res = R3::mxvecproduct(lv, mbase);
-    return res;
+    return R3::mxvecproduct(lv, mbase);
 }
 
-const R3::Vector& Lattice::fractional(const R3::Vector& cv) const
+R3::Vector Lattice::fractional(const R3::Vector& cv) const
 {
-    static R3::Vector res;
-    res = R3::mxvecproduct(cv, mrecbase);
-    return res;
+    return R3::mxvecproduct(cv, mrecbase);
 }
 
-const R3::Vector& Lattice::ucvCartesian(const R3::Vector& cv) const
+R3::Vector Lattice::ucvCartesian(const R3::Vector& cv) const
 {
-    static R3::Vector res;
-    res = cartesian(ucvFractional(fractional(cv)));
-    return res;
+    return cartesian(ucvFractional(fractional(cv)));
 }
 
-const R3::Vector& Lattice::ucvFractional(const R3::Vector& lv) const
+R3::Vector Lattice::ucvFractional(const R3::Vector& lv) const
 {
     using mathutils::eps_eq;
-    static R3::Vector res;
-    res = lv - floor(lv);
+    R3::Vector res = lv - floor(lv);
     if (eps_eq(res[0], 1.0))  res[0] = 0.0;
     if (eps_eq(res[1], 1.0))  res[1] = 0.0;
     if (eps_eq(res[2], 1.0))  res[2] = 0.0;
     return res;
 }
 
-const R3::Matrix& Lattice::cartesianMatrix(const R3::Matrix& Ml) const
+R3::Matrix Lattice::cartesianMatrix(const R3::Matrix& Ml) const
 {
-    static R3::Matrix res0, res1;
-    res0 = prod(Ml, mnormbase);
-    res1 = prod(R3::trans(mnormbase), res0);
+    R3::Matrix res0 = prod(Ml, mnormbase);
+    R3::Matrix res1 = prod(R3::trans(mnormbase), res0);
     return res1;
 }
 
-const R3::Matrix& Lattice::fractionalMatrix(const R3::Matrix& Mc) const
+R3::Matrix Lattice::fractionalMatrix(const R3::Matrix& Mc) const
 {
-    static R3::Matrix res0, res1;
-    res0 = prod(Mc, mrecnormbase);
-    res1 = prod(R3::trans(mrecnormbase), res0);
+    R3::Matrix res0 = prod(Mc, mrecnormbase);
+    R3::Matrix res1 = prod(R3::trans(mrecnormbase), res0);
     return res1;
 }
 
 
 const R3::Vector& Lattice::ucMaxDiagonal() const
 {
-    static list<R3::Vector> ucdiagonals;
-    if (ucdiagonals.empty())
-    {
-        ucdiagonals.push_back(R3::Vector(+1, +1, +1));
-        ucdiagonals.push_back(R3::Vector(-1, +1, +1));
-        ucdiagonals.push_back(R3::Vector(+1, -1, +1));
-        ucdiagonals.push_back(R3::Vector(+1, +1, -1));
-    }
+    static const list<R3::Vector> ucdiagonals = {
+        R3::Vector(+1, +1, +1),
+        R3::Vector(-1, +1, +1),
+        R3::Vector(+1, -1, +1),
+        R3::Vector(+1, +1, -1),
+    };
     double maxnorm = -1;
-    list<R3::Vector>::iterator ucd;
-    list<R3::Vector>::iterator maxucd = ucdiagonals.end();
+    list<R3::Vector>::const_iterator ucd;
+    list<R3::Vector>::const_iterator maxucd = ucdiagonals.end();
     for (ucd = ucdiagonals.begin(); ucd != ucdiagonals.end(); ++ucd)
     {
         double normucd = this->norm(*ucd);
@@ -0,0 +1,125 @@
+/*****************************************************************************
+*
+* libdiffpy         Complex Modeling Initiative
+*                   (c) 2026 Brookhaven Science Associates,
+*                   Brookhaven National Laboratory.
+*                   All rights reserved.
+*
+* File coded by:    Pavol Juhas
+*
+* See AUTHORS.txt for a list of people who contributed.
+* See LICENSE.txt for license information.
+*
+******************************************************************************
+*
+* class NeighborListCache -- Verlet neighbor lists reused by the bond
+*   generators of a structure for repeated evaluations.
+*
+*****************************************************************************/
+
+#include <cassert>
+#include <algorithm>
+#include <stdexcept>
+
+#include <diffpy/srreal/NeighborListCache.hpp>
+#include <diffpy/srreal/AtomicStructureAdapter.hpp>
+#include <diffpy/srreal/StructureDifference.hpp>
+
+using namespace std;
+
+namespace diffpy {
+namespace srreal {
+
+// Static Data ---------------------------------------------------------------
+
+const NeighborListCache::ImageSlot NeighborListCache::ZERO_IMAGE;
+
+// Constructor ---------------------------------------------------------------
+
+NeighborListCache::NeighborListCache(double skin) :
+    mskin(skin), mbuilds(0), mreuses(0)
+{
+    if (!(skin > 0.0))
+    {
+        throw invalid_argument("Neighbor list skin must be positive.");
+    }
+}
+
+// Public Methods ------------------------------------------------------------
+
+const double& NeighborListCache::getSkin() const
+{
+    return mskin;
+}
+
+
+size_t NeighborListCache::countBuilds() const
+{
+    lock_guard<mutex> lock(mlock);
+    return mbuilds;
+}
+
+
+size_t NeighborListCache::countReuses() const
+{
+    lock_guard<mutex> lock(mlock);
+    return mreuses;
+}
+
+
+NeighborListCache::NeighborListPtr
+NeighborListCache::lookup(const AtomicStructureAdapter& stru,
+        double rmax, const vector<R3::Vector>& positions)
+{
+    lock_guard<mutex> lock(mlock);
+    NeighborListPtr rv;
+    if (!mlist || mlist->cutoff < rmax)  return rv;
+    const vector<R3::Vector>& xyz0 = mlist->positions;
+    if (xyz0.size() != positions.size())  return rv;
+    StructureDifference sd = msnapshot->diff(stru.shared_from_this());
+    if (sd.diffmethod == StructureDifference::Method::NONE)  return rv;
+    // check only the moved sites when the difference has no other changes
+    bool onlymoved = sd.pop0.empty() && sd.add1.empty();
+    for (auto&& mv : sd.moved)  onlymoved = onlymoved && mv.first == mv.second;
+    SiteIndices changed;
+    if (onlymoved)
+    {
+        changed.reserve(sd.moved.size());
+        for (auto&& mv : sd.moved)  changed.push_back(mv.first);
+    }
+    else
+    {
+        changed.resize(positions.size());
+        for (size_t i = 0; i < changed.size(); ++i)  changed[i] = i;
+    }
+    double maxshift = 0.0;
+    for (int i : changed)
+    {
+        maxshift = max(maxshift, R3::distance(positions[i], xyz0[i]));
+    }
+    // distance of two sites changes at most by twice the maximum shift
+    if (rmax + 2 * maxshift > mlist->cutoff)  return rv;
+    ++mreuses;
+    rv = mlist;
+    return rv;
+}
+
+
+void NeighborListCache::store(
+        const AtomicStructureAdapter& stru, NeighborListPtr nl)
+{
+    // snapshot must not refer to this cache to avoid reference cycle
+    boost::shared_ptr<AtomicStructureAdapter> snapshot =
+        boost::dynamic_pointer_cast<AtomicStructureAdapter>(stru.clone());
+    assert(snapshot);
+    snapshot->setNeighborListSkin(0.0);
+    lock_guard<mutex> lock(mlock);
+    msnapshot = snapshot;
+    mlist = nl;
+    ++mbuilds;
+}
+
+}   // namespace srreal
+}   // namespace diffpy
+
+// End of file
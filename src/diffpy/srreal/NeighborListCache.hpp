@@ -0,0 +1,103 @@
+/*****************************************************************************
+*
+* libdiffpy         Complex Modeling Initiative
+*                   (c) 2026 Brookhaven Science Associates,
+*                   Brookhaven National Laboratory.
+*                   All rights reserved.
+*
+* File coded by:    Pavol Juhas
+*
+* See AUTHORS.txt for a list of people who contributed.
+* See LICENSE.txt for license information.
+*
+******************************************************************************
+*
+* class NeighborListCache -- Verlet neighbor lists reused by the bond
+*   generators of a structure for repeated evaluations.
+*
+* The neighbor list is built for a cutoff of rmax plus skin distance.
+* It remains valid for any rmax while the sites moved by less than half
+* of the cutoff excess since the list was built.  The cache keeps a copy
+* of the structure from the time of the build and finds the moved sites
+* with StructureAdapter::diff, which uses the change journal of
+* AtomicStructureAdapter when the structure was modified in place.
+* The cache is shared by the adapter copies and is safe to use from
+* several threads.
+*
+*****************************************************************************/
+
+#ifndef NEIGHBORLISTCACHE_HPP_INCLUDED
+#define NEIGHBORLISTCACHE_HPP_INCLUDED
+
+#include <mutex>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+
+#include <diffpy/srreal/R3linalg.hpp>
+#include <diffpy/srreal/forwardtypes.hpp>
+
+namespace diffpy {
+namespace srreal {
+
+class AtomicStructureAdapter;
+
+class NeighborListCache
+{
+    public:
+
+        // types
+        /// index of a translation by -1, 0 or 1 cells along every axis
+        /// for the neighbor image in the periodic structures
+        typedef unsigned char ImageSlot;
+        static const ImageSlot ZERO_IMAGE = 13;
+
+        class NeighborList
+        {
+            public:
+
+                // data
+                /// neighbors are listed within the cutoff distance
+                double cutoff;
+                /// site positions used for building the list
+                std::vector<R3::Vector> positions;
+                /// neighbors of site i are in [offsets[i], offsets[i + 1])
+                std::vector<int> offsets;
+                std::vector<int> sites;
+                std::vector<ImageSlot> images;
+        };
+
+        typedef boost::shared_ptr<const NeighborList> NeighborListPtr;
+
+        // constructor
+        explicit NeighborListCache(double skin);
+
+        // methods
+        const double& getSkin() const;
+        /// number of neighbor lists built for this cache
+        size_t countBuilds() const;
+        /// number of neighbor lists reused from this cache
+        size_t countReuses() const;
+        /// return neighbor list valid for rmax or an empty pointer
+        NeighborListPtr lookup(const AtomicStructureAdapter& stru,
+                double rmax, const std::vector<R3::Vector>& positions);
+        /// store new neighbor list for the current state of the structure
+        void store(const AtomicStructureAdapter& stru, NeighborListPtr nl);
+
+    private:
+
+        // data
+        double mskin;
+        mutable std::mutex mlock;
+        StructureAdapterConstPtr msnapshot;
+        NeighborListPtr mlist;
+        size_t mbuilds;
+        size_t mreuses;
+
+};
+
+typedef boost::shared_ptr<NeighborListCache> NeighborListCachePtr;
+
+}   // namespace srreal
+}   // namespace diffpy
+
+#endif  // NEIGHBORLISTCACHE_HPP_INCLUDED
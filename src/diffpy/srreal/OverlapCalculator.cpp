@@ -17,9 +17,11 @@
 *****************************************************************************/
 
 #include <algorithm>
+#include <numeric>
 
 #include <diffpy/srreal/OverlapCalculator.hpp>
 #include <diffpy/srreal/ConstantRadiiTable.hpp>
+#include <diffpy/srreal/SharedParallelData.hpp>
 #include <diffpy/validators.hpp>
 #include <diffpy/mathutils.hpp>
 #include <diffpy/serialization.ipp>
@@ -34,6 +36,10 @@ namespace srreal {
 
 namespace {
 
+// typical number of pairs per site within the sum of atom radii
+const int ESTIMATED_COORDINATION = 12;
+
+// layout of the pair records in the mvalue array of older versions
 enum {
     DISTANCE_OFFSET,
     DIRECTION0_OFFSET,
@@ -44,18 +50,6 @@ enum {
     CHUNK_SIZE,
 };
 
-
-template <class T>
-vector<T> vectorconvert(const QuantityType& v)
-{
-    vector<T> rv;
-    rv.reserve(v.size());
-    QuantityType::const_iterator x = v.begin();
-    for (; x != v.end(); ++x)  rv.push_back(T(*x));
-    return rv;
-}
-
-
 }   // namespace
 
 // Constructor ---------------------------------------------------------------
@@ -69,7 +63,7 @@ OverlapCalculator::OverlapCalculator()
     this->cacheStructureData();
     // use very large rmax, it will be cropped by rmaxused
     this->setRmax(100);
-    mneighborids_cached = false;
+    this->indexBonds();
     // attributes
     this->registerDoubleAttribute("rmaxused", this,
             &OverlapCalculator::getRmaxUsed);
@@ -94,7 +88,15 @@ QuantityType OverlapCalculator::overlaps() const
 
 QuantityType OverlapCalculator::distances() const
 {
-    return this->subvector(DISTANCE_OFFSET, OVERLAPPING);
+    int n = this->count();
+    QuantityType rv;
+    rv.reserve(n);
+    for (int index = 0; index < n; ++index)
+    {
+        if (this->suboverlap(index) <= 0.0)  continue;
+        rv.push_back(mbonds.distance[index]);
+    }
+    return rv;
 }
 
 
@@ -114,15 +116,29 @@ vector<R3::Vector> OverlapCalculator::directions() const
 
 SiteIndices OverlapCalculator::sites0() const
 {
-    QuantityType rv0 = this->subvector(SITE0_OFFSET, OVERLAPPING);
-    return vectorconvert<int>(rv0);
+    int n = this->count();
+    SiteIndices rv;
+    rv.reserve(n);
+    for (int index = 0; index < n; ++index)
+    {
+        if (this->suboverlap(index) <= 0.0)  continue;
+        rv.push_back(mbonds.site0[index]);
+    }
+    return rv;
 }
 
 
 SiteIndices OverlapCalculator::sites1() const
 {
-    QuantityType rv0 = this->subvector(SITE1_OFFSET, OVERLAPPING);
-    return vectorconvert<int>(rv0);
+    int n = this->count();
+    SiteIndices rv;
+    rv.reserve(n);
+    for (int index = 0; index < n; ++index)
+    {
+        if (this->suboverlap(index) <= 0.0)  continue;
+        rv.push_back(mbonds.site1[index]);
+    }
+    return rv;
 }
 
 
@@ -140,21 +156,22 @@ vector<string> OverlapCalculator::types1() const
 
 QuantityType OverlapCalculator::siteSquareOverlaps() const
 {
-    int n = this->count();
     int cntsites = this->countSites();
     QuantityType rv(cntsites, 0.0);
-    for (int index = 0; index < n; ++index)
+    for (int i = 0; i < cntsites; ++i)
     {
-        double olp = this->suboverlap(index);
-        if (olp <= 0.0)  continue;
-        double sqoverlap = olp * olp;
-        int i = int(this->subvalue(SITE0_OFFSET, index));
-        int j = int(this->subvalue(SITE1_OFFSET, index));
-        rv[i] += sqoverlap * mstructure->siteOccupancy(j);
+        double sqoverlaps = 0.0;
+        const int last = mneighboroffsets[i + 1];
+        for (int index = mneighboroffsets[i]; index < last; ++index)
+        {
+            double olp = this->suboverlap(index);
+            if (olp <= 0.0)  continue;
+            int j = mbonds.site1[index];
+            sqoverlaps += olp * olp * mstructure->siteOccupancy(j);
+        }
+        // overlaps are shared by 2 atoms
+        rv[i] = sqoverlaps / 2;
     }
-    // overlaps are shared by 2 atoms
-    QuantityType::iterator xi;
-    for (xi = rv.begin(); xi != rv.end(); ++xi)  *xi /= 2;
     return rv;
 }
 
@@ -193,25 +210,25 @@ double OverlapCalculator::flipDiffTotal(int i, int j) const
         (mstructure_cache.siteradii[i] == mstructure_cache.siteradii[j]);
     if (sameradii)  return 0.0;
     // here we have to remove the overlap contributions for i and j
+    // pairs of the sites i and j are disjoint, because i != j.
     double rv = 0.0;
-    const list<int>& ineighbors = this->getNeighborIds(i);
-    const list<int>& jneighbors = this->getNeighborIds(j);
-    unordered_set<int> allids;
-    allids.insert(ineighbors.begin(), ineighbors.end());
-    allids.insert(jneighbors.begin(), jneighbors.end());
-    unordered_set<int>::const_iterator idx;
-    for (idx = allids.begin(); idx != allids.end(); ++idx)
+    for (int i1 : {i, j})
     {
-        int i1 = int(this->subvalue(SITE0_OFFSET, *idx));
-        int j1 = int(this->subvalue(SITE1_OFFSET, *idx));
-        double sqscale =
-            ((i1 == j1) ? 1 : 2) *
-            mstructure->siteOccupancy(i1) * mstructure->siteOccupancy(j1) *
-            mstructure->siteMultiplicity(i1) / 2;
-        double olp0 = this->suboverlap(*idx);
-        double olp1 = this->suboverlap(*idx, i, j);
-        rv -= sqscale * olp0 * olp0;
-        rv += sqscale * olp1 * olp1;
+        const int last = mneighboroffsets[i1 + 1];
+        for (int index = mneighboroffsets[i1]; index < last; ++index)
+        {
+            assert(i1 == mbonds.site0[index]);
+            int j1 = mbonds.site1[index];
+            double sqscale =
+                ((i1 == j1) ? 1 : 2) *
+                mstructure->siteOccupancy(i1) *
+                mstructure->siteOccupancy(j1) *
+                mstructure->siteMultiplicity(i1) / 2;
+            double olp0 = this->suboverlap(index);
+            double olp1 = this->suboverlap(index, i, j);
+            rv -= sqscale * olp0 * olp0;
+            rv += sqscale * olp1 * olp1;
+        }
     }
     return rv;
 }
@@ -236,9 +253,9 @@ vector<R3::Vector> OverlapCalculator::gradients() const
     {
         double olp = this->suboverlap(index);
         if (olp <= 0.0)  continue;
-        const double& dst = this->subvalue(DISTANCE_OFFSET, index);
+        const double& dst = mbonds.distance[index];
         assert(eps_gt(dst, 0.0));
-        int j = int(this->subvalue(SITE1_OFFSET, index));
+        int j = mbonds.site1[index];
         gij = -2.0 * olp / dst * this->subdirection(index);
         rv[j] += gij;
     }
@@ -248,16 +265,15 @@ vector<R3::Vector> OverlapCalculator::gradients() const
 
 unordered_set<int> OverlapCalculator::getNeighborSites(int i) const
 {
+    assert(0 <= i && i < this->countSites());
     unordered_set<int> rv;
-    const list<int>& ineighbors = this->getNeighborIds(i);
-    list<int>::const_iterator idx;
-    for (idx = ineighbors.begin(); idx != ineighbors.end(); ++idx)
+    const int last = mneighboroffsets[i + 1];
+    for (int index = mneighboroffsets[i]; index < last; ++index)
     {
-        double olp = this->suboverlap(*idx);
+        double olp = this->suboverlap(index);
         if (olp <= 0.0)  continue;
-        assert(i == int(this->subvalue(SITE0_OFFSET, *idx)));
-        int j1 = int(this->subvalue(SITE1_OFFSET, *idx));
-        rv.insert(j1);
+        assert(i == mbonds.site0[index]);
+        rv.insert(mbonds.site1[index]);
     }
     return rv;
 }
@@ -267,14 +283,16 @@ QuantityType OverlapCalculator::coordinations() const
 {
     int cntsites = this->countSites();
     QuantityType rv(cntsites, 0.0);
-    int n = this->count();
-    for (int index = 0; index < n; ++index)
+    for (int j0 = 0; j0 < cntsites; ++j0)
     {
-        double olp = this->suboverlap(index);
-        if (olp <= 0.0)  continue;
-        int j0 = int(this->subvalue(SITE0_OFFSET, index));
-        int j1 = int(this->subvalue(SITE1_OFFSET, index));
-        rv[j0] += mstructure->siteOccupancy(j1);
+        const int last = mneighboroffsets[j0 + 1];
+        for (int index = mneighboroffsets[j0]; index < last; ++index)
+        {
+            double olp = this->suboverlap(index);
+            if (olp <= 0.0)  continue;
+            int j1 = mbonds.site1[index];
+            rv[j0] += mstructure->siteOccupancy(j1);
+        }
     }
     return rv;
 }
@@ -283,28 +301,17 @@ QuantityType OverlapCalculator::coordinations() const
 unordered_map<string,double>
 OverlapCalculator::coordinationByTypes(int i) const
 {
+    assert(0 <= i && i < this->countSites());
     unordered_map<string,double> rv;
-    const list<int>& ineighbors = this->getNeighborIds(i);
-    list<int>::const_iterator idx;
-    for (idx = ineighbors.begin(); idx != ineighbors.end(); ++idx)
+    const int last = mneighboroffsets[i + 1];
+    for (int index = mneighboroffsets[i]; index < last; ++index)
     {
-        double olp = this->suboverlap(*idx);
+        double olp = this->suboverlap(index);
         if (olp <= 0.0)  continue;
-        int j0 = int(this->subvalue(SITE0_OFFSET, *idx));
-        int j1 = int(this->subvalue(SITE1_OFFSET, *idx));
-        if (j0 == i)
-        {
-            const string& tp = mstructure->siteAtomType(j1);
-            rv[tp] += mstructure->siteOccupancy(j1);
-        }
-        else
-        {
-            assert(j1 == i);
-            const string& tp = mstructure->siteAtomType(j0);
-            rv[tp] += mstructure->siteOccupancy(j0) *
-                mstructure->siteMultiplicity(j0) /
-                mstructure->siteMultiplicity(j1);
-        }
+        assert(i == mbonds.site0[index]);
+        int j1 = mbonds.site1[index];
+        const string& tp = mstructure->siteAtomType(j1);
+        rv[tp] += mstructure->siteOccupancy(j1);
     }
     return rv;
 }
@@ -321,8 +328,8 @@ vector< unordered_set<int> > OverlapCalculator::neighborhoods() const
     {
         double olp = this->suboverlap(index);
         if (olp <= 0.0)  continue;
-        int j0 = int(this->subvalue(SITE0_OFFSET, index));
-        int j1 = int(this->subvalue(SITE1_OFFSET, index));
+        int j0 = mbonds.site0[index];
+        int j1 = mbonds.site1[index];
         if (!rvptr[j0].get())
         {
             rvptr[j0].reset(new SiteSet);
@@ -410,13 +417,31 @@ double OverlapCalculator::getRmaxUsed() const
     return rv;
 }
 
+// PairQuantity overloads
+
+string OverlapCalculator::getParallelData() const
+{
+    ostringstream storage(ios::binary);
+    diffpy::serialization::oarchive oa(storage, ios::binary);
+    oa << mbonds;
+    return storage.str();
+}
+
+
+void OverlapCalculator::exportSharedParallelData(const string& shmname) const
+{
+    // pair records are not a plain value array, store the archive string
+    SharedParallelData::writeArchive(shmname, this->getParallelData());
+}
+
 // Protected Methods ---------------------------------------------------------
 
 void OverlapCalculator::resetValue()
 {
     mvalue.clear();
-    mneighborids.clear();
-    mneighborids_cached = false;
+    mbonds.clear();
+    mbonds.reserve(ESTIMATED_COORDINATION * this->countSites());
+    this->indexBonds();
     this->cacheStructureData();
     this->PairQuantity::resetValue();
 }
@@ -435,14 +460,12 @@ void OverlapCalculator::addPairContribution(
     assert(summationscale == 1);
     assert(bnds.distance() <= mstructure_cache.maxseparation);
     const R3::Vector& r01 = bnds.r01();
-    int baseidx = mvalue.size();
-    mvalue.insert(mvalue.end(), CHUNK_SIZE, 0.0);
-    mvalue[baseidx + DISTANCE_OFFSET] = bnds.distance();
-    mvalue[baseidx + DIRECTION0_OFFSET] = r01[0];
-    mvalue[baseidx + DIRECTION1_OFFSET] = r01[1];
-    mvalue[baseidx + DIRECTION2_OFFSET] = r01[2];
-    mvalue[baseidx + SITE0_OFFSET] = bnds.site0();
-    mvalue[baseidx + SITE1_OFFSET] = bnds.site1();
+    mbonds.distance.push_back(bnds.distance());
+    mbonds.r01x.push_back(r01[0]);
+    mbonds.r01y.push_back(r01[1]);
+    mbonds.r01z.push_back(r01[2]);
+    mbonds.site0.push_back(bnds.site0());
+    mbonds.site1.push_back(bnds.site1());
 }
 
 
@@ -450,51 +473,39 @@ void OverlapCalculator::executeParallelMerge(const std::string& pdata)
 {
     istringstream storage(pdata, ios::binary);
     diffpy::serialization::iarchive ia(storage, ios::binary);
-    QuantityType pvalue;
-    ia >> pvalue;
-    mvalue.insert(mvalue.end(), pvalue.begin(), pvalue.end());
+    BondColumns pbonds;
+    ia >> pbonds;
+    // the merged pairs get ordered by their first site in finishValue
+    mbonds.append(pbonds);
 }
 
-// Private Methods -----------------------------------------------------------
 
-int OverlapCalculator::count() const
+void OverlapCalculator::executeThreadedMerge(const PairQuantity& other)
 {
-    int rv = int(mvalue.size()) / CHUNK_SIZE;
-    return rv;
+    const OverlapCalculator& olc =
+        dynamic_cast<const OverlapCalculator&>(other);
+    mbonds.append(olc.mbonds);
 }
 
 
-QuantityType OverlapCalculator::subvector(int offset,
-        OverlapCalculator::OverlapFlag flag) const
+void OverlapCalculator::finishValue()
 {
-    assert(0 <= offset && offset < CHUNK_SIZE);
-    assert(flag == ALLVALUES || flag == OVERLAPPING);
-    int n = this->count();
-    QuantityType rv;
-    rv.reserve(n);
-    for (int index = 0; index < n; ++index)
-    {
-        if (OVERLAPPING == flag && this->suboverlap(index) <= 0.0)  continue;
-        rv.push_back(this->subvalue(offset, index));
-    }
-    return rv;
+    this->indexBonds();
+    mvalue = mbonds.distance;
 }
 
+// Private Methods -----------------------------------------------------------
 
-const double& OverlapCalculator::subvalue(int offset, int index) const
+int OverlapCalculator::count() const
 {
-    assert(0 <= offset && offset < CHUNK_SIZE);
-    assert(0 <= index && index < this->count());
-    return mvalue[offset + CHUNK_SIZE * index];
+    return mbonds.size();
 }
 
 
-const R3::Vector& OverlapCalculator::subdirection(int index) const
+R3::Vector OverlapCalculator::subdirection(int index) const
 {
-    static R3::Vector rv;
-    rv[0] = this->subvalue(DIRECTION0_OFFSET, index);
-    rv[1] = this->subvalue(DIRECTION1_OFFSET, index);
-    rv[2] = this->subvalue(DIRECTION2_OFFSET, index);
+    assert(0 <= index && index < this->count());
+    R3::Vector rv(mbonds.r01x[index], mbonds.r01y[index], mbonds.r01z[index]);
     return rv;
 }
 
@@ -503,8 +514,9 @@ double OverlapCalculator::suboverlap(int index, int flipi, int flipj) const
 {
     assert(0 <= flipi && flipi < this->countSites());
     assert(0 <= flipj && flipj < this->countSites());
-    int i = int(this->subvalue(SITE0_OFFSET, index));
-    int j = int(this->subvalue(SITE1_OFFSET, index));
+    assert(0 <= index && index < this->count());
+    int i = mbonds.site0[index];
+    int j = mbonds.site1[index];
     const double& radiusi = (flipi == flipj) ? mstructure_cache.siteradii[i] :
         (i == flipi) ? mstructure_cache.siteradii[flipj] :
         (i == flipj) ? mstructure_cache.siteradii[flipi] :
@@ -513,7 +525,7 @@ double OverlapCalculator::suboverlap(int index, int flipi, int flipj) const
         (j == flipi) ? mstructure_cache.siteradii[flipj] :
         (j == flipj) ? mstructure_cache.siteradii[flipi] :
         mstructure_cache.siteradii[j];
-    const double& dij = this->subvalue(DISTANCE_OFFSET, index);
+    const double& dij = mbonds.distance[index];
     double sepij = radiusi + radiusj;
     double rv = (dij < sepij) ? (sepij - dij) : 0.0;
     return rv;
@@ -537,27 +549,117 @@ void OverlapCalculator::cacheStructureData()
 }
 
 
-const std::list<int>&
-OverlapCalculator::getNeighborIds(int k) const
+/// Order the pair records by their first site and build the offsets
+/// of the pairs per each site in mneighboroffsets.
+void OverlapCalculator::indexBonds()
 {
-    typedef std::list<int> NbList;
-    assert(0 <= k && k < this->countSites());
-    if (!mneighborids_cached)
+    const int cntsites = this->countSites();
+    const int n = this->count();
+    mneighboroffsets.assign(cntsites + 1, 0);
+    for (int i : mbonds.site0)
     {
-        assert(mneighborids.empty());
-        int n = this->count();
-        for (int idx = 0; idx < n; ++idx)
-        {
-            int i = int(this->subvalue(SITE0_OFFSET, idx));
-            mneighborids[i].push_back(idx);
-        }
-        mneighborids_cached = true;
+        assert(0 <= i && i < cntsites);
+        ++mneighboroffsets[i + 1];
     }
-    static NbList noneighbors;
-    NeighborIdsStorage::const_iterator nbit = mneighborids.find(k);
-    const NbList& rv =
-        (nbit == mneighborids.end()) ?  noneighbors : nbit->second;
-    return rv;
+    partial_sum(mneighboroffsets.begin(), mneighboroffsets.end(),
+            mneighboroffsets.begin());
+    // pairs from a serial evaluation are already in order
+    if (is_sorted(mbonds.site0.begin(), mbonds.site0.end()))  return;
+    // stable counting sort keeps the pair order within each site
+    vector<int> nextindex(mneighboroffsets.begin(),
+            mneighboroffsets.end() - 1);
+    BondColumns sorted;
+    sorted.resize(n);
+    for (int index = 0; index < n; ++index)
+    {
+        const int k = nextindex[mbonds.site0[index]]++;
+        sorted.distance[k] = mbonds.distance[index];
+        sorted.r01x[k] = mbonds.r01x[index];
+        sorted.r01y[k] = mbonds.r01y[index];
+        sorted.r01z[k] = mbonds.r01z[index];
+        sorted.site0[k] = mbonds.site0[index];
+        sorted.site1[k] = mbonds.site1[index];
+    }
+    mbonds.swap(sorted);
+}
+
+
+/// Restore pair records from mvalue of an older serialization version.
+void OverlapCalculator::unpackValueChunks()
+{
+    const int n = mvalue.size() / CHUNK_SIZE;
+    mbonds.resize(n);
+    for (int index = 0; index < n; ++index)
+    {
+        QuantityType::const_iterator chunk =
+            mvalue.begin() + CHUNK_SIZE * index;
+        mbonds.distance[index] = chunk[DISTANCE_OFFSET];
+        mbonds.r01x[index] = chunk[DIRECTION0_OFFSET];
+        mbonds.r01y[index] = chunk[DIRECTION1_OFFSET];
+        mbonds.r01z[index] = chunk[DIRECTION2_OFFSET];
+        mbonds.site0[index] = int(chunk[SITE0_OFFSET]);
+        mbonds.site1[index] = int(chunk[SITE1_OFFSET]);
+    }
+    mvalue = mbonds.distance;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// class OverlapCalculator::BondColumns
+//////////////////////////////////////////////////////////////////////////////
+
+void OverlapCalculator::BondColumns::clear()
+{
+    distance.clear();
+    r01x.clear();
+    r01y.clear();
+    r01z.clear();
+    site0.clear();
+    site1.clear();
+}
+
+
+void OverlapCalculator::BondColumns::reserve(int n)
+{
+    distance.reserve(n);
+    r01x.reserve(n);
+    r01y.reserve(n);
+    r01z.reserve(n);
+    site0.reserve(n);
+    site1.reserve(n);
+}
+
+
+void OverlapCalculator::BondColumns::resize(int n)
+{
+    distance.resize(n);
+    r01x.resize(n);
+    r01y.resize(n);
+    r01z.resize(n);
+    site0.resize(n);
+    site1.resize(n);
+}
+
+
+void OverlapCalculator::BondColumns::append(const BondColumns& other)
+{
+    distance.insert(distance.end(),
+            other.distance.begin(), other.distance.end());
+    r01x.insert(r01x.end(), other.r01x.begin(), other.r01x.end());
+    r01y.insert(r01y.end(), other.r01y.begin(), other.r01y.end());
+    r01z.insert(r01z.end(), other.r01z.begin(), other.r01z.end());
+    site0.insert(site0.end(), other.site0.begin(), other.site0.end());
+    site1.insert(site1.end(), other.site1.begin(), other.site1.end());
+}
+
+
+void OverlapCalculator::BondColumns::swap(BondColumns& other)
+{
+    distance.swap(other.distance);
+    r01x.swap(other.r01x);
+    r01y.swap(other.r01y);
+    r01z.swap(other.r01z);
+    site0.swap(other.site0);
+    site1.swap(other.site1);
 }
 
 }   // namespace srreal
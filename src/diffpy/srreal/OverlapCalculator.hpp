@@ -14,12 +14,19 @@
 *
 * class OverlapCalculator -- calculator of atom radii overlaps
 *
+* The pairs within the maximum separation of atom radii are stored in
+* typed columns ordered by the first site.  After each evaluation the
+* pairs of site i are in [mneighboroffsets[i], mneighboroffsets[i + 1]),
+* which is a compressed-sparse-row index of the neighbor pairs.
+*
 *****************************************************************************/
 
 #ifndef OVERLAPCALCULATOR_HPP_INCLUDED
 #define OVERLAPCALCULATOR_HPP_INCLUDED
 
+#include <cstdint>
 #include <boost/serialization/list.hpp>
+#include <boost/serialization/vector.hpp>
 
 #include <diffpy/srreal/PairQuantity.hpp>
 #include <diffpy/srreal/AtomRadiiTable.hpp>
@@ -82,6 +89,9 @@ class OverlapCalculator : public PairQuantity
         /// effective rmax value, usually a double of the maximum atom radius.
         double getRmaxUsed() const;
 
+        // PairQuantity overloads
+        virtual std::string getParallelData() const;
+        virtual void exportSharedParallelData(const std::string& shmname) const;
 
     protected:
 
@@ -90,26 +100,56 @@ class OverlapCalculator : public PairQuantity
         virtual void configureBondGenerator(BaseBondGenerator&) const;
         virtual void addPairContribution(const BaseBondGenerator&, int);
         virtual void executeParallelMerge(const std::string&);
+        virtual void executeThreadedMerge(const PairQuantity&);
+        virtual void finishValue();
 
     private:
 
         // types
-        enum OverlapFlag {ALLVALUES, OVERLAPPING};
-        typedef std::unordered_map<int, std::list<int> > NeighborIdsStorage;
+        class BondColumns
+        {
+            public:
+
+                // methods
+                int size() const  { return distance.size(); }
+                void clear();
+                void reserve(int n);
+                void resize(int n);
+                void append(const BondColumns& other);
+                void swap(BondColumns& other);
+
+                // data
+                std::vector<double> distance;
+                std::vector<double> r01x;
+                std::vector<double> r01y;
+                std::vector<double> r01z;
+                std::vector<int32_t> site0;
+                std::vector<int32_t> site1;
+
+            private:
+
+                friend class boost::serialization::access;
+                template<class Archive>
+                void serialize(Archive& ar, const unsigned int version)
+                {
+                    ar & distance & r01x & r01y & r01z;
+                    ar & site0 & site1;
+                }
+
+        };
 
         // methods
         int count() const;
-        QuantityType subvector(int offset, OverlapFlag flag) const;
-        const double& subvalue(int offset, int index) const;
-        const R3::Vector& subdirection(int index) const;
+        R3::Vector subdirection(int index) const;
         double suboverlap(int index, int iflip=0, int jflip=0) const;
         void cacheStructureData();
-        const std::list<int>& getNeighborIds(int i) const;
+        void indexBonds();
+        void unpackValueChunks();
 
         // data
         AtomRadiiTablePtr matomradiitable;
-        mutable NeighborIdsStorage mneighborids;
-        mutable bool mneighborids_cached;
+        BondColumns mbonds;
+        std::vector<int> mneighboroffsets;
         // cache
         struct {
             QuantityType siteradii;
@@ -124,9 +164,18 @@ class OverlapCalculator : public PairQuantity
             using boost::serialization::base_object;
             ar & base_object<PairQuantity>(*this);
             ar & matomradiitable;
-            ar & mneighborids;
+            if (version >= 1) {
+                ar & mbonds;
+            }
+            else {
+                // older versions kept pair records in the mvalue array
+                std::unordered_map<int, std::list<int> > neighborids;
+                ar & neighborids;
+                this->unpackValueChunks();
+            }
             ar & mstructure_cache.siteradii;
             ar & mstructure_cache.maxseparation;
+            if (Archive::is_loading::value)  this->indexBonds();
         }
 
 };
@@ -146,6 +195,7 @@ QuantityType OverlapCalculator::operator()(const T& stru)
 
 // Serialization -------------------------------------------------------------
 
+BOOST_CLASS_VERSION(diffpy::srreal::OverlapCalculator, 1)
 BOOST_CLASS_EXPORT_KEY(diffpy::srreal::OverlapCalculator)
 
 #endif  // OVERLAPCALCULATOR_HPP_INCLUDED
@@ -20,6 +20,7 @@
 #include <sstream>
 #include <cmath>
 #include <cassert>
+#include <algorithm>
 
 #include <diffpy/serialization.ipp>
 #include <diffpy/srreal/PDFCalculator.hpp>
@@ -52,6 +53,18 @@ bool _initialQstepUpdate(const PDFC* pc)
     return rv;
 }
 
+
+/// Copy r-grid segment of n0 points to a segment of n1 points, which
+/// starts leftshift r-steps to the right.  Skip the non-overlapping points.
+void copy_shifted_segment(QuantityType::const_iterator src, int n0,
+        QuantityType::iterator dst, int n1, int leftshift)
+{
+    const int skip0 = (leftshift >= 0) ? min(leftshift, n0) : 0;
+    const int skip1 = (leftshift < 0) ? min(-leftshift, n1) : 0;
+    const int n = min(n0 - skip0, n1 - skip1);
+    copy(src + skip0, src + skip0 + n, dst + skip1);
+}
+
 }   // namespace
 
 // Constructor ---------------------------------------------------------------
@@ -60,7 +73,9 @@ PDFCalculator::PDFCalculator() :
     mqmin(0.0),
     mqmax(DOUBLE_MAX),
     mrstep(DEFAULT_PDFCALCULATOR_RSTEP),
-    mmaxextension(DEFAULT_PDFCALCULATOR_MAXEXTENSION)
+    mmaxextension(DEFAULT_PDFCALCULATOR_MAXEXTENSION),
+    mevaluatepartials(false),
+    mevaluategradients(false)
 {
     // default configuration
     mrmax = DEFAULT_PDFCALCULATOR_RMAX;
@@ -141,7 +156,7 @@ QuantityType PDFCalculator::getRDFperR() const
 
 QuantityType PDFCalculator::getF() const
 {
-    QuantityType f_ext = this->getExtendedF();
+    const QuantityType& f_ext = this->cachedExtendedF();
     assert(pdfutils_qmaxSteps(this) <= int(f_ext.size()));
     QuantityType rv(f_ext.begin(), f_ext.begin() + pdfutils_qmaxSteps(this));
     return rv;
@@ -150,104 +165,139 @@ QuantityType PDFCalculator::getF() const
 
 QuantityType PDFCalculator::getExtendedPDF() const
 {
-    QuantityType rgrid_ext = this->getExtendedRgrid();
-    // Skip FFT when qmax is not specified and qmin does not exclude the
-    // the F(Q=Qstep) point (excluding F(0) == 0 makes no difference to G).
-    const bool skipfft =
-        !eps_lt(this->getQmax(), M_PI / this->getRstep()) &&
-        !(1 < pdfutils_qminSteps(this));
-    if (skipfft)
-    {
-        QuantityType rdfpr = this->getExtendedRDFperR();
-        QuantityType rdfprb = this->applyBaseline(rgrid_ext, rdfpr);
-        QuantityType pdf = this->applyEnvelopes(rgrid_ext, rdfprb);
-        return pdf;
-    }
-    // FFT required here
-    // we need a full range PDF to apply termination ripples correctly
-    QuantityType f_ext = this->getExtendedF();
-    // zero all F points at Q < Qmin
-    QuantityType::iterator ii_qmin =
-        f_ext.begin() + min(pdfutils_qminSteps(this), int(f_ext.size()));
-    fill(f_ext.begin(), ii_qmin, 0.0);
-    // zero all F points at Q >= Qmax
-    assert(pdfutils_qmaxSteps(this) <= int(f_ext.size()));
-    QuantityType::iterator ii_qmax = f_ext.begin() + pdfutils_qmaxSteps(this);
-    fill(ii_qmax, f_ext.end(), 0.0);
-    QuantityType pdf1 = fftftog(f_ext, this->getQstep());
-    // cut away the FFT padded points
-    assert(this->extendedRmaxSteps() <= int(pdf1.size()));
-    pdf1.erase(pdf1.begin() + this->extendedRmaxSteps(), pdf1.end());
-    pdf1.erase(pdf1.begin(), pdf1.begin() + this->extendedRminSteps());
-    QuantityType pdf2 = this->applyEnvelopes(rgrid_ext, pdf1);
-    return pdf2;
+    return this->cachedExtendedPDF();
 }
 
 
 QuantityType PDFCalculator::getExtendedRDF() const
 {
-    QuantityType rdf(this->countExtendedPoints());
-    const double& totocc = mstructure_cache.totaloccupancy;
-    double sfavg = this->sfAverage();
-    double rdf_scale = (totocc * sfavg == 0.0) ? 0.0 :
-        1.0 / (totocc * sfavg * sfavg);
-    QuantityType::iterator iirdf = rdf.begin();
-    QuantityType::const_iterator iival, iival_last;
-    iival = this->value().begin() +
-        this->extendedRminSteps() - this->rcalcloSteps();
-    iival_last = this->value().begin() +
-        this->extendedRmaxSteps() - this->rcalcloSteps();
-    assert(iival >= this->value().begin());
-    assert(iival_last <= this->value().end());
-    assert(rdf.size() == size_t(iival_last - iival));
-    for (; iirdf != rdf.end(); ++iival, ++iirdf)
-    {
-        *iirdf = *iival * rdf_scale;
-    }
-    return rdf;
+    return this->cachedExtendedRDF();
 }
 
 
 QuantityType PDFCalculator::getExtendedRDFperR() const
 {
-    QuantityType rdf_ext = this->getExtendedRDF();
-    QuantityType rgrid_ext = this->getExtendedRgrid();
-    assert(rdf_ext.size() == rgrid_ext.size());
-    QuantityType::const_iterator ri = rgrid_ext.begin();
-    QuantityType::iterator rdfi = rdf_ext.begin();
-    for (; ri != rgrid_ext.end(); ++ri, ++rdfi)
-    {
-        *rdfi = eps_gt(*ri, 0) ? (*rdfi / *ri) : 0.0;
-    }
-    return rdf_ext;
+    return this->cachedExtendedRDFperR();
 }
 
 
 QuantityType PDFCalculator::getExtendedF() const
 {
-    QuantityType rdfperr_ext = this->getExtendedRDFperR();
-    QuantityType rgrid_ext = this->getExtendedRgrid();
-    QuantityType rdfperr_ext1 = this->applyBaseline(rgrid_ext, rdfperr_ext);
-    const double rmin_ext = this->getExtendedRmin();
-    QuantityType rv = fftgtof(rdfperr_ext1, this->getRstep(), rmin_ext);
-    assert(rv.empty() || eps_eq(M_PI,
-                this->getQstep() * rv.size() * this->getRstep()));
-    return rv;
+    return this->cachedExtendedF();
 }
 
 
 QuantityType PDFCalculator::getExtendedRgrid() const
 {
-    QuantityType rv;
-    rv.reserve(this->countExtendedPoints());
-    // make sure exact value of rmin will be in the extended grid
-    for (int i = this->extendedRminSteps(); i < this->extendedRmaxSteps(); ++i)
+    return this->cachedExtendedRgrid();
+}
+
+// partial PDFs
+
+void PDFCalculator::setEvaluatePartials(bool flag)
+{
+    if (mevaluatepartials != flag)  mticker.click();
+    mevaluatepartials = flag;
+}
+
+
+bool PDFCalculator::getEvaluatePartials() const
+{
+    return mevaluatepartials;
+}
+
+
+const vector<string>& PDFCalculator::getPartialTypes() const
+{
+    return mstructure_cache.atomtypes;
+}
+
+
+QuantityType PDFCalculator::getPartialPDF(int tp0, int tp1) const
+{
+    QuantityType rdfperr = this->extendedRDFperRFromRDF(
+            this->extendedPartialRDF(tp0, tp1));
+    QuantityType pdf = this->skipsPDFFilter() ?
+        this->extendedPDFFromRDFperR(rdfperr) :
+        this->extendedPDFFromF(this->extendedFFromRDFperR(rdfperr));
+    this->cutRipplePoints(pdf);
+    return pdf;
+}
+
+
+QuantityType PDFCalculator::getPartialRDF(int tp0, int tp1) const
+{
+    QuantityType rdf = this->extendedPartialRDF(tp0, tp1);
+    this->cutRipplePoints(rdf);
+    return rdf;
+}
+
+
+QuantityType PDFCalculator::getPartialF(int tp0, int tp1) const
+{
+    QuantityType rdfperr = this->extendedRDFperRFromRDF(
+            this->extendedPartialRDF(tp0, tp1));
+    QuantityType rv = this->extendedFFromRDFperR(rdfperr);
+    assert(pdfutils_qmaxSteps(this) <= int(rv.size()));
+    rv.resize(pdfutils_qmaxSteps(this));
+    return rv;
+}
+
+
+double PDFCalculator::getPartialWeight(int tp0, int tp1) const
+{
+    this->partialOffset(tp0, tp1);
+    const double& totocc = mstructure_cache.totaloccupancy;
+    const double sftotal = totocc * this->sfAverage();
+    const double sfpairs = ((tp0 == tp1) ? 1.0 : 2.0) *
+        mstructure_cache.sftypetotal[tp0] * mstructure_cache.sftypetotal[tp1];
+    double rv = (sftotal == 0.0) ? 0.0 : (sfpairs / (sftotal * sftotal));
+    return rv;
+}
+
+// site gradients
+
+void PDFCalculator::setEvaluateGradients(bool flag)
+{
+    if (mevaluategradients != flag)  mticker.click();
+    mevaluategradients = flag;
+}
+
+
+bool PDFCalculator::getEvaluateGradients() const
+{
+    return mevaluategradients;
+}
+
+
+QuantityType PDFCalculator::getPDFGradient(
+        int siteidx, SiteParameter p) const
+{
+    QuantityType rdfperr = this->extendedRDFperRFromRDF(
+            this->extendedRDFGradient(siteidx, p));
+    // baseline does not depend on the site parameters
+    QuantityType pdf;
+    if (this->skipsPDFFilter())
     {
-        rv.push_back(i * this->getRstep());
+        pdf = this->applyEnvelopes(this->cachedExtendedRgrid(), rdfperr);
     }
-    assert(rv.empty() || !eps_lt(rv.front(), this->getExtendedRmin()));
-    assert(rv.empty() || !eps_gt(rv.back(), this->getExtendedRmax()));
-    return rv;
+    else
+    {
+        QuantityType f = fftgtof(rdfperr,
+                this->getRstep(), this->getExtendedRmin());
+        pdf = this->extendedPDFFromF(f);
+    }
+    this->cutRipplePoints(pdf);
+    return pdf;
+}
+
+
+QuantityType PDFCalculator::getRDFGradient(
+        int siteidx, SiteParameter p) const
+{
+    QuantityType rdf = this->extendedRDFGradient(siteidx, p);
+    this->cutRipplePoints(rdf);
+    return rdf;
 }
 
 // Q-range methods
@@ -282,21 +332,19 @@ void PDFCalculator::setQmax(double qmax)
 }
 
 
-const double& PDFCalculator::getQmax() const
+double PDFCalculator::getQmax() const
 {
-    static double rv;
-    rv = min(mqmax, M_PI / this->getRstep());
+    double rv = min(mqmax, M_PI / this->getRstep());
     return rv;
 }
 
 
-const double& PDFCalculator::getQstep() const
+double PDFCalculator::getQstep() const
 {
-    static double rv;
     // replicate the zero padding as done in fftgtof
     int Npad1 = this->extendedRmaxSteps();
-    int Npad2 = (Npad1 > 0) ? (1 << int(ceil(log2(Npad1)))) : 0;
-    rv = (Npad2 > 0) ? M_PI / (Npad2 * this->getRstep()) : 0.0;
+    int Npad2 = (Npad1 > 0) ? fftPaddedSize(Npad1) : 0;
+    double rv = (Npad2 > 0) ? M_PI / (Npad2 * this->getRstep()) : 0.0;
     return rv;
 }
 
@@ -484,6 +532,13 @@ void PDFCalculator::accept(diffpy::BaseAttributesVisitor& v) const
 // PairQuantity overloads
 
 void PDFCalculator::resetValue()
+{
+    this->cacheSiteTypeData();
+    this->PDFCalculator::resetFrameValue();
+}
+
+
+void PDFCalculator::resetFrameValue()
 {
     // calcPoints requires that structure and rlimits data are cached.
     this->cacheStructureData();
@@ -498,8 +553,17 @@ void PDFCalculator::resetValue()
         PDFBaseline& bl = *(this->getBaseline());
         bl.setDoubleAttr("slope", -4 * M_PI * pnumdensity);
     }
-    this->resizeValue(this->countCalcPoints());
+    const int nsums = 1 + this->countPartials() + this->countGradients();
+    this->resizeValue(nsums * this->countCalcPoints());
     this->PairQuantity::resetValue();
+    mresults_cache.clear();
+}
+
+
+void PDFCalculator::finishValue()
+{
+    this->PairQuantity::finishValue();
+    mresults_cache.clear();
 }
 
 
@@ -516,31 +580,55 @@ void PDFCalculator::addPairContribution(const BaseBondGenerator& bnds,
     double sfprod = this->sfSite(bnds.site0()) * this->sfSite(bnds.site1());
     double peakscale = sfprod * bnds.multiplicity() * summationscale;
     double fwhm = this->getPeakWidthModel()->calculate(bnds);
-    const PeakProfile& pkf = *(this->getPeakProfile());
-    double dist = bnds.distance();
-    double xlo = dist + pkf.xboundlo(fwhm);
-    double xhi = dist + pkf.xboundhi(fwhm);
-    int i = max(0, this->calcIndex(xlo));
-    int ilast = min(this->countCalcPoints(), this->calcIndex(xhi) + 1);
-    assert(ilast <= int(mvalue.size()));
-    assert(eps_gt(dist, 0.0));
-    for (; i < ilast; ++i)
+    double* pv = this->partialValue(bnds.site0(), bnds.site1());
+    this->addPeak(bnds.distance(), fwhm, peakscale, pv);
+    if (mevaluategradients)  this->addPeakGradients(bnds, fwhm, peakscale);
+}
+
+
+bool PDFCalculator::configureBondBatch(BondBatch& batch) const
+{
+    // site gradients need the bond generator
+    if (mevaluategradients)  return false;
+    return this->getPeakWidthModel()->configureBondBatch(batch);
+}
+
+
+void PDFCalculator::addPairContributions(const BondBatch& batch)
+{
+    this->getPeakWidthModel()->calculateBatch(batch, mbatchfwhm);
+    const double& sf0 = this->sfSite(batch.site0);
+    const int n = batch.size();
+    for (int k = 0; k < n; ++k)
     {
-        double x = (this->rcalcloSteps() + i) * this->getRstep() - dist;
-        double y = pkf(x, fwhm);
-        // Contributions in G(r) need to be normalized by pair distance,
-        // not by r as done in PDFfit or PDFfit2.  Here we rescale RDF
-        // in such way that division by r will give a correct result.
-        double yrdf = y * (x / dist + 1);
-        mvalue[i] += peakscale * yrdf;
+        double sfprod = sf0 * this->sfSite(batch.site1[k]);
+        double peakscale = sfprod * batch.multiplicity[k] *
+            batch.summationscale[k];
+        double* pv = this->partialValue(batch.site0, batch.site1[k]);
+        this->addPeak(batch.distance[k], mbatchfwhm[k], peakscale, pv);
     }
 }
 
 
+QuantityType PDFCalculator::batchValue() const
+{
+    return this->getPDF();
+}
+
+
+bool PDFCalculator::hasSiteIndexedValue() const
+{
+    return mevaluategradients;
+}
+
+
 void PDFCalculator::stashPartialValue()
 {
     mstashedvalue.value = this->value();
     mstashedvalue.rclosteps = this->rcalcloSteps();
+    mstashedvalue.calcpoints = this->countCalcPoints();
+    mstashedvalue.atomtypes = mstructure_cache.atomtypes;
+    mstashedvalue.cntsites = this->countCachedSites();
 }
 
 
@@ -548,20 +636,119 @@ void PDFCalculator::restorePartialValue()
 {
     assert(!mstashedvalue.value.empty());
     assert(!mvalue.empty());
-    QuantityType::const_iterator si = mstashedvalue.value.begin();
-    QuantityType::const_iterator slast = mstashedvalue.value.end();
-    QuantityType::iterator ti = mvalue.begin();
-    QuantityType::iterator tlast = mvalue.end();
+    const QuantityType& sv = mstashedvalue.value;
+    const int n0 = mstashedvalue.calcpoints;
+    const int n1 = this->countCalcPoints();
     int leftshift = this->rcalcloSteps() - mstashedvalue.rclosteps;
-    int sz = mstashedvalue.value.size();
-    if (leftshift >= 0)  si += min(leftshift, sz);
-    else  ti += min(-leftshift, int(mvalue.size()));
-    for (; si != slast && ti != tlast; ++si, ++ti)  *ti = *si;
+    copy_shifted_segment(sv.begin(), n0, mvalue.begin(), n1, leftshift);
+    int npairs = 0;
+    if (this->countPartials())
+    {
+        // atom types may have changed, map the partials to new type pairs
+        vector<int> pairmap = pdfutils_typePairRemap(
+                mstashedvalue.atomtypes, mstructure_cache.atomtypes);
+        npairs = pairmap.size();
+        for (int ps = 0; ps < npairs; ++ps)
+        {
+            // contributions of the removed atom types have been subtracted
+            if (pairmap[ps] < 0)  continue;
+            copy_shifted_segment(sv.begin() + (1 + ps) * n0, n0,
+                    mvalue.begin() + (1 + pairmap[ps]) * n1, n1, leftshift);
+        }
+    }
+    if (this->countGradients())
+    {
+        // site indices are preserved, the gradients of the removed sites
+        // are discarded and the added sites start from zero.
+        const int ngrads0 = SITE_PARAMETER_COUNT * mstashedvalue.cntsites;
+        const int ngrads1 = this->countGradients();
+        const int offset0 = (1 + npairs) * n0;
+        const int offset1 = (1 + this->countPartials()) * n1;
+        for (int gs = 0; gs < min(ngrads0, ngrads1); ++gs)
+        {
+            copy_shifted_segment(sv.begin() + offset0 + gs * n0, n0,
+                    mvalue.begin() + offset1 + gs * n1, n1, leftshift);
+        }
+    }
+    assert(int(sv.size()) == (1 + npairs) * n0 +
+            (mevaluategradients ? SITE_PARAMETER_COUNT *
+             mstashedvalue.cntsites * n0 : 0));
     mstashedvalue.value.clear();
 }
 
 // calculation specific
 
+/// Add profile of a peak at distance dist to the calculated RDF.
+void PDFCalculator::addPeak(double dist, double fwhm, double peakscale,
+        double* pv)
+{
+    const PeakProfile& pkf = *(this->getPeakProfile());
+    double xlo = dist + pkf.xboundlo(fwhm);
+    double xhi = dist + pkf.xboundhi(fwhm);
+    int i = max(0, this->calcIndex(xlo));
+    int ilast = min(this->countCalcPoints(), this->calcIndex(xhi) + 1);
+    assert(ilast <= int(mvalue.size()));
+    assert(eps_gt(dist, 0.0));
+    if (i >= ilast)  return;
+    const double dr = this->getRstep();
+    const double x0 = (this->rcalcloSteps() + i) * dr - dist;
+    const int npts = ilast - i;
+    if (int(mpeakvalues.size()) < npts)  mpeakvalues.resize(npts);
+    double* y = mpeakvalues.data();
+    pkf.evaluateGrid(x0, dr, npts, fwhm, y);
+    double* v = mvalue.data() + i;
+    for (int k = 0; k < npts; ++k)
+    {
+        double x = (this->rcalcloSteps() + i + k) * dr - dist;
+        // Contributions in G(r) need to be normalized by pair distance,
+        // not by r as done in PDFfit or PDFfit2.  Here we rescale RDF
+        // in such way that division by r will give a correct result.
+        double yrdf = y[k] * (x / dist + 1);
+        y[k] = peakscale * yrdf;
+        v[k] += y[k];
+    }
+    if (!pv)  return;
+    for (int k = 0; k < npts; ++k)  pv[i + k] += y[k];
+}
+
+
+void PDFCalculator::addPeakGradients(const BaseBondGenerator& bnds,
+        double fwhm, double peakscale)
+{
+    const PeakProfile& pkf = *(this->getPeakProfile());
+    const double dist = bnds.distance();
+    double xlo = dist + pkf.xboundlo(fwhm);
+    double xhi = dist + pkf.xboundhi(fwhm);
+    int i = max(0, this->calcIndex(xlo));
+    int ilast = min(this->countCalcPoints(), this->calcIndex(xhi) + 1);
+    if (i >= ilast)  return;
+    const double dr = this->getRstep();
+    const double x0 = (this->rcalcloSteps() + i) * dr - dist;
+    const int npts = ilast - i;
+    if (int(mpeakvalues.size()) < 3 * npts)  mpeakvalues.resize(3 * npts);
+    double* y = mpeakvalues.data();
+    double* dvdd = y + npts;
+    double* dvdmsd = dvdd + npts;
+    pkf.evaluateGrid(x0, dr, npts, fwhm, y);
+    pkf.evaluateGridDerivatives(x0, dr, npts, fwhm, dvdd, dvdmsd);
+    double dwdd, dwdmsd;
+    this->getPeakWidthModel()->calculateDerivatives(bnds, dwdd, dwdmsd);
+    for (int k = 0; k < npts; ++k)
+    {
+        // the contribution is peakscale * y(r - dist, fwhm) * r / dist
+        const double rd = (x0 + k * dr) / dist + 1;
+        const double dvdw = peakscale * rd * dvdmsd[k];
+        dvdd[k] = dvdw * dwdd - peakscale * rd * (dvdd[k] + y[k] / dist);
+        dvdmsd[k] = dvdw * dwdmsd;
+    }
+    const int ncalc = this->countCalcPoints();
+    double* grad = mvalue.data() + (1 + this->countPartials()) * ncalc;
+    assert(int(mvalue.size()) ==
+            (1 + this->countPartials() + this->countGradients()) * ncalc);
+    pdfutils_addBondGradients(grad, ncalc, bnds, i, npts, dvdd, dvdmsd);
+}
+
+
 double PDFCalculator::rcalclo() const
 {
     double rv = this->rcalcloSteps() * this->getRstep();
@@ -582,7 +769,7 @@ double PDFCalculator::extFromTerminationRipples() const
     const int nripples = 6;
     // extension due to termination ripples.
     // apply only when qmax is below the Nyquist frequency for rstep.
-    const double& qmax = this->getQmax();
+    const double qmax = this->getQmax();
     const double& dr = this->getRstep();
     double rv = (eps_gt(qmax, 0.0) && eps_lt(qmax, M_PI / dr)) ?
         (nripples * 2 * M_PI / qmax) : 0.0;
@@ -651,6 +838,293 @@ int PDFCalculator::calcIndex(double r) const
 }
 
 
+// cached results
+
+/// Check the key of the results cache and discard the outdated results.
+void PDFCalculator::updateResultsCache() const
+{
+    mresults_cache.beginKey(this->ticker());
+    mresults_cache.addToKey(mqmin);
+    mresults_cache.addToKey(mqmax);
+    const PDFBaseline& bl = *(this->getBaseline());
+    mresults_cache.addToKey(bl.type(), bl);
+    set<string> evnames = this->usedEnvelopeTypes();
+    set<string>::const_iterator nm = evnames.begin();
+    for (; nm != evnames.end(); ++nm)
+    {
+        mresults_cache.addToKey(*nm, *(this->getEnvelopeByType(*nm)));
+    }
+    mresults_cache.endKey();
+}
+
+
+const QuantityType& PDFCalculator::cachedExtendedPDF() const
+{
+    this->updateResultsCache();
+    if (mresults_cache.has(EXTENDED_PDF))
+    {
+        return mresults_cache.get(EXTENDED_PDF);
+    }
+    QuantityType pdf = this->skipsPDFFilter() ?
+        this->extendedPDFFromRDFperR(this->cachedExtendedRDFperR()) :
+        this->extendedPDFFromF(this->cachedExtendedF());
+    return mresults_cache.store(EXTENDED_PDF, pdf);
+}
+
+
+const QuantityType& PDFCalculator::cachedExtendedRDF() const
+{
+    this->updateResultsCache();
+    if (mresults_cache.has(EXTENDED_RDF))
+    {
+        return mresults_cache.get(EXTENDED_RDF);
+    }
+    QuantityType rdf = this->extendedRDFFromValue(0, this->rdfScale());
+    return mresults_cache.store(EXTENDED_RDF, rdf);
+}
+
+
+const QuantityType& PDFCalculator::cachedExtendedRDFperR() const
+{
+    this->updateResultsCache();
+    if (mresults_cache.has(EXTENDED_RDFPERR))
+    {
+        return mresults_cache.get(EXTENDED_RDFPERR);
+    }
+    QuantityType rv = this->extendedRDFperRFromRDF(this->cachedExtendedRDF());
+    return mresults_cache.store(EXTENDED_RDFPERR, rv);
+}
+
+
+const QuantityType& PDFCalculator::cachedExtendedF() const
+{
+    this->updateResultsCache();
+    if (mresults_cache.has(EXTENDED_F))
+    {
+        return mresults_cache.get(EXTENDED_F);
+    }
+    QuantityType rv = this->extendedFFromRDFperR(
+            this->cachedExtendedRDFperR());
+    return mresults_cache.store(EXTENDED_F, rv);
+}
+
+
+const QuantityType& PDFCalculator::cachedExtendedRgrid() const
+{
+    this->updateResultsCache();
+    if (mresults_cache.has(EXTENDED_RGRID))
+    {
+        return mresults_cache.get(EXTENDED_RGRID);
+    }
+    QuantityType rv;
+    rv.reserve(this->countExtendedPoints());
+    // make sure exact value of rmin will be in the extended grid
+    for (int i = this->extendedRminSteps(); i < this->extendedRmaxSteps(); ++i)
+    {
+        rv.push_back(i * this->getRstep());
+    }
+    assert(rv.empty() || !eps_lt(rv.front(), this->getExtendedRmin()));
+    assert(rv.empty() || !eps_gt(rv.back(), this->getExtendedRmax()));
+    return mresults_cache.store(EXTENDED_RGRID, rv);
+}
+
+// conversions of the results on the extended r-grid
+
+double PDFCalculator::rdfScale() const
+{
+    const double& totocc = mstructure_cache.totaloccupancy;
+    double sfavg = this->sfAverage();
+    double rv = (totocc * sfavg == 0.0) ? 0.0 :
+        1.0 / (totocc * sfavg * sfavg);
+    return rv;
+}
+
+
+/// Scaled RDF at the offset in the value array cut to the extended r-grid.
+QuantityType PDFCalculator::extendedRDFFromValue(
+        int offset, double scale) const
+{
+    QuantityType rdf(this->countExtendedPoints());
+    QuantityType::iterator iirdf = rdf.begin();
+    QuantityType::const_iterator iival, iival_last;
+    iival = this->value().begin() + offset +
+        this->extendedRminSteps() - this->rcalcloSteps();
+    iival_last = this->value().begin() + offset +
+        this->extendedRmaxSteps() - this->rcalcloSteps();
+    assert(iival >= this->value().begin());
+    assert(iival_last <= this->value().end());
+    assert(rdf.size() == size_t(iival_last - iival));
+    for (; iirdf != rdf.end(); ++iival, ++iirdf)
+    {
+        *iirdf = *iival * scale;
+    }
+    return rdf;
+}
+
+
+QuantityType PDFCalculator::extendedRDFperRFromRDF(
+        const QuantityType& rdf) const
+{
+    QuantityType rdf_ext = rdf;
+    const QuantityType& rgrid_ext = this->cachedExtendedRgrid();
+    assert(rdf_ext.size() == rgrid_ext.size());
+    QuantityType::const_iterator ri = rgrid_ext.begin();
+    QuantityType::iterator rdfi = rdf_ext.begin();
+    for (; ri != rgrid_ext.end(); ++ri, ++rdfi)
+    {
+        *rdfi = eps_gt(*ri, 0) ? (*rdfi / *ri) : 0.0;
+    }
+    return rdf_ext;
+}
+
+
+QuantityType PDFCalculator::extendedFFromRDFperR(
+        const QuantityType& rdfperr) const
+{
+    const QuantityType& rgrid_ext = this->cachedExtendedRgrid();
+    QuantityType rdfperr_ext1 = this->applyBaseline(rgrid_ext, rdfperr);
+    const double rmin_ext = this->getExtendedRmin();
+    QuantityType rv = fftgtof(rdfperr_ext1, this->getRstep(), rmin_ext);
+    assert(rv.empty() || eps_eq(M_PI,
+                this->getQstep() * rv.size() * this->getRstep()));
+    return rv;
+}
+
+
+QuantityType PDFCalculator::extendedPDFFromRDFperR(
+        const QuantityType& rdfperr) const
+{
+    const QuantityType& rgrid_ext = this->cachedExtendedRgrid();
+    QuantityType rdfprb = this->applyBaseline(rgrid_ext, rdfperr);
+    QuantityType pdf = this->applyEnvelopes(rgrid_ext, rdfprb);
+    return pdf;
+}
+
+
+QuantityType PDFCalculator::extendedPDFFromF(const QuantityType& f) const
+{
+    const QuantityType& rgrid_ext = this->cachedExtendedRgrid();
+    // we need a full range PDF to apply termination ripples correctly
+    QuantityType f_ext = f;
+    // zero all F points at Q < Qmin
+    QuantityType::iterator ii_qmin =
+        f_ext.begin() + min(pdfutils_qminSteps(this), int(f_ext.size()));
+    fill(f_ext.begin(), ii_qmin, 0.0);
+    // zero all F points at Q >= Qmax
+    assert(pdfutils_qmaxSteps(this) <= int(f_ext.size()));
+    QuantityType::iterator ii_qmax = f_ext.begin() + pdfutils_qmaxSteps(this);
+    fill(ii_qmax, f_ext.end(), 0.0);
+    QuantityType pdf1 = fftftog(f_ext, this->getQstep());
+    // cut away the FFT padded points
+    assert(this->extendedRmaxSteps() <= int(pdf1.size()));
+    pdf1.erase(pdf1.begin() + this->extendedRmaxSteps(), pdf1.end());
+    pdf1.erase(pdf1.begin(), pdf1.begin() + this->extendedRminSteps());
+    QuantityType pdf2 = this->applyEnvelopes(rgrid_ext, pdf1);
+    return pdf2;
+}
+
+
+/// Skip FFT when qmax is not specified and qmin does not exclude the
+/// the F(Q=Qstep) point (excluding F(0) == 0 makes no difference to G).
+bool PDFCalculator::skipsPDFFilter() const
+{
+    const bool rv =
+        !eps_lt(this->getQmax(), M_PI / this->getRstep()) &&
+        !(1 < pdfutils_qminSteps(this));
+    return rv;
+}
+
+
+QuantityType PDFCalculator::extendedPartialRDF(int tp0, int tp1) const
+{
+    const int offset = this->partialOffset(tp0, tp1);
+    // partial RDF = RDF_pair / weight = RDF_pair * <f>^2 / (c0 f0 c1 f1)
+    const double& totocc = mstructure_cache.totaloccupancy;
+    const double sfpairs = ((tp0 == tp1) ? 1.0 : 2.0) *
+        mstructure_cache.sftypetotal[tp0] * mstructure_cache.sftypetotal[tp1];
+    double rdf_scale = (sfpairs == 0.0) ? 0.0 : (totocc / sfpairs);
+    return this->extendedRDFFromValue(offset, rdf_scale);
+}
+
+
+QuantityType PDFCalculator::extendedRDFGradient(int siteidx, int p) const
+{
+    const int offset = this->gradientOffset(siteidx, p);
+    return this->extendedRDFFromValue(offset, this->rdfScale());
+}
+
+// partial PDFs
+
+int PDFCalculator::countPartials() const
+{
+    if (!mevaluatepartials)  return 0;
+    return pdfutils_countTypePairs(mstructure_cache.atomtypes.size());
+}
+
+
+double* PDFCalculator::partialValue(int site0, int site1)
+{
+    if (!mevaluatepartials)  return NULL;
+    const vector<int>& typeofsite = mstructure_cache.typeofsite;
+    assert(0 <= site0 && site0 < int(typeofsite.size()));
+    assert(0 <= site1 && site1 < int(typeofsite.size()));
+    const int ps = pdfutils_typePairIndex(
+            typeofsite[site0], typeofsite[site1]);
+    const int npts = this->countCalcPoints();
+    assert(int(mvalue.size()) >= (2 + ps) * npts);
+    return mvalue.data() + (1 + ps) * npts;
+}
+
+
+int PDFCalculator::partialOffset(int tp0, int tp1) const
+{
+    const int npts = this->countCalcPoints();
+    const int nsums = 1 + this->countPartials() + this->countGradients();
+    if (!mevaluatepartials || int(mvalue.size()) != nsums * npts)
+    {
+        const char* emsg = "Partial RDFs are not available, "
+            "enable evaluatepartials and recalculate.";
+        throw logic_error(emsg);
+    }
+    const int ntps = mstructure_cache.atomtypes.size();
+    if (tp0 < 0 || tp0 >= ntps || tp1 < 0 || tp1 >= ntps)
+    {
+        const char* emsg = "Index out of range.";
+        throw invalid_argument(emsg);
+    }
+    return (1 + pdfutils_typePairIndex(tp0, tp1)) * npts;
+}
+
+// site gradients
+
+int PDFCalculator::countGradients() const
+{
+    if (!mevaluategradients)  return 0;
+    return SITE_PARAMETER_COUNT * this->countCachedSites();
+}
+
+
+int PDFCalculator::gradientOffset(int siteidx, int p) const
+{
+    const int npts = this->countCalcPoints();
+    const int nsums = 1 + this->countPartials() + this->countGradients();
+    if (!mevaluategradients || int(mvalue.size()) != nsums * npts)
+    {
+        const char* emsg = "Site gradients are not available, "
+            "enable evaluategradients and recalculate.";
+        throw logic_error(emsg);
+    }
+    if (siteidx < 0 || siteidx >= this->countCachedSites() ||
+            p < 0 || p >= SITE_PARAMETER_COUNT)
+    {
+        const char* emsg = "Index out of range.";
+        throw invalid_argument(emsg);
+    }
+    const int gs = SITE_PARAMETER_COUNT * siteidx + p;
+    return (1 + this->countPartials() + gs) * npts;
+}
+
+
 void PDFCalculator::cutRipplePoints(QuantityType& y) const
 {
     if (y.empty())  return;
@@ -677,12 +1151,25 @@ double PDFCalculator::sfAverage() const
 }
 
 
-void PDFCalculator::cacheStructureData()
+/// Number of sites in the value layout.  This is the site count at the
+/// last value reset, the structure may be changed in place before
+/// PQEvaluatorOptimized removes the contributions of its old sites.
+int PDFCalculator::countCachedSites() const
+{
+    return mstructure_cache.sfsite.size();
+}
+
+
+/// Cache data that depend only on atom types and occupancies.
+void PDFCalculator::cacheSiteTypeData()
 {
     int cntsites = this->countSites();
-    // sfsite
+    // sfsite and atom type indices of the sites
     unordered_map<string, double> fcache;
+    unordered_map<string, int> atomtypeidx;
     mstructure_cache.sfsite.resize(cntsites);
+    mstructure_cache.typeofsite.resize(cntsites);
+    mstructure_cache.atomtypes.clear();
     const ScatteringFactorTablePtr sftable = this->getScatteringFactorTable();
     for (int i = 0; i < cntsites; ++i)
     {
@@ -692,33 +1179,41 @@ void PDFCalculator::cacheStructureData()
         {
             const double value = sftable->lookup(smbl);
             ff = fcache.insert(make_pair(smbl, value)).first;
+            atomtypeidx.insert(make_pair(smbl, int(atomtypeidx.size())));
+            mstructure_cache.atomtypes.push_back(smbl);
         }
         mstructure_cache.sfsite[i] = ff->second * mstructure->siteOccupancy(i);
+        mstructure_cache.typeofsite[i] = atomtypeidx[smbl];
     }
+}
+
+
+void PDFCalculator::cacheStructureData()
+{
+    int cntsites = this->countSites();
+    assert(cntsites == int(mstructure_cache.sfsite.size()));
     // sfaverage
     double totocc = mstructure->totalOccupancy();
     double totsf = 0.0;
+    vector<double>& sftp = mstructure_cache.sftypetotal;
+    sftp.assign(mstructure_cache.atomtypes.size(), 0.0);
     for (int i = 0; i < cntsites; ++i)
     {
-        totsf += this->sfSite(i) * mstructure->siteMultiplicity(i);
+        double sfi = this->sfSite(i) * mstructure->siteMultiplicity(i);
+        totsf += sfi;
+        sftp[mstructure_cache.typeofsite[i]] += sfi;
     }
     mstructure_cache.sfaverage = (totocc == 0.0) ? 0.0 : (totsf / totocc);
     // totaloccupancy
     mstructure_cache.totaloccupancy = totocc;
     // active occupancy
-    double invmasktotal = 0.0;
-    for (auto&& ij : minvertpairmask)
+    vector<double> siteocc(cntsites);
+    for (int i = 0; i < cntsites; ++i)
     {
-        const int& i = ij.first;
-        const int& j = ij.second;
-        bool outofbounds = (i < 0 || i >= cntsites || j < 0 || j >= cntsites);
-        if (outofbounds)  continue;
-        int sumscale = (i == j) ? 1 : 2;
-        double occij = sumscale *
-            mstructure->siteOccupancy(i) * mstructure->siteMultiplicity(i) *
-            mstructure->siteOccupancy(j) * mstructure->siteMultiplicity(j);
-        invmasktotal += occij;
+        siteocc[i] = mstructure->siteOccupancy(i) *
+            mstructure->siteMultiplicity(i);
     }
+    double invmasktotal = this->compiledPairMask().invertedPairsSum(siteocc);
     if (totocc > 0.0)   invmasktotal /= totocc;
     mstructure_cache.activeoccupancy = (mdefaultpairmask) ?
         (totocc - invmasktotal) : invmasktotal;
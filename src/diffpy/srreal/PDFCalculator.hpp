@@ -14,6 +14,14 @@
 *
 * class PDFCalculator -- real space PDF calculator
 *
+* When partials are evaluated, the value array holds the total RDF
+* followed by the RDF contributions from every unordered pair of atom
+* types, each on the complete calculated r-grid.  The pairs are ordered
+* by pdfutils_typePairIndex of the atom type indices, which follow the
+* first occurrence of the atom type in the structure.  When gradients are
+* evaluated, the RDF derivatives with respect to the SiteParameter values
+* of every site follow in the site-major order.
+*
 *****************************************************************************/
 
 #ifndef PDFCALCULATOR_HPP_INCLUDED
@@ -25,6 +33,8 @@
 #include <diffpy/srreal/PDFBaseline.hpp>
 #include <diffpy/srreal/PDFEnvelope.hpp>
 #include <diffpy/srreal/ScatteringFactorTable.hpp>
+#include <diffpy/srreal/PDFResultsCache.hpp>
+#include <diffpy/srreal/PDFUtils.hpp>
 
 namespace diffpy {
 namespace srreal {
@@ -60,14 +70,41 @@ class PDFCalculator :
         /// r-grid extended for termination ripples
         QuantityType getExtendedRgrid() const;
 
+        // partial PDFs
+        /// accumulate RDF separately for every pair of atom types
+        void setEvaluatePartials(bool);
+        /// return true when the atom type pairs are summed separately
+        bool getEvaluatePartials() const;
+        /// atom types in the order of the type indices of the partials
+        const std::vector<std::string>& getPartialTypes() const;
+        /// Faber-Ziman partial PDF for atom type indices tp0 and tp1
+        QuantityType getPartialPDF(int tp0, int tp1) const;
+        /// partial RDF for atom type indices tp0 and tp1
+        QuantityType getPartialRDF(int tp0, int tp1) const;
+        /// partial F(Q) for atom type indices tp0 and tp1
+        QuantityType getPartialF(int tp0, int tp1) const;
+        /// weight of the partial PDF, RDF or F(Q) in the total quantity.
+        /// The weights of all unordered pairs add up to 1.
+        double getPartialWeight(int tp0, int tp1) const;
+
+        // site gradients
+        /// accumulate derivatives with respect to the site parameters
+        void setEvaluateGradients(bool);
+        /// return true when the site gradients are evaluated
+        bool getEvaluateGradients() const;
+        /// derivative of the PDF with respect to parameter p of a site
+        QuantityType getPDFGradient(int siteidx, SiteParameter p) const;
+        /// derivative of the RDF with respect to parameter p of a site
+        QuantityType getRDFGradient(int siteidx, SiteParameter p) const;
+
         // Q-range methods
         QuantityType getQgrid() const;
         // Q-range configuration
         void setQmin(double);
         const double& getQmin() const;
         void setQmax(double);
-        const double& getQmax() const;
-        const double& getQstep() const;
+        double getQmax() const;
+        double getQstep() const;
 
         // R-range methods
         QuantityType getRgrid() const;
@@ -109,15 +146,28 @@ class PDFCalculator :
 
         // PairQuantity overloads
         virtual void resetValue();
+        virtual void resetFrameValue();
+        virtual void finishValue();
         virtual void configureBondGenerator(BaseBondGenerator&) const;
         virtual void addPairContribution(const BaseBondGenerator&, int);
+        virtual bool configureBondBatch(BondBatch&) const;
+        virtual void addPairContributions(const BondBatch&);
+        virtual QuantityType batchValue() const;
         // support for PQEvaluatorOptimized
+        virtual bool hasSiteIndexedValue() const;
         virtual void stashPartialValue();
         virtual void restorePartialValue();
 
     private:
 
         // methods - calculation specific
+        /// add profile of one peak to the calculated RDF and to the
+        /// partial RDF pv when not NULL
+        void addPeak(double dist, double fwhm, double peakscale,
+                double* pv);
+        /// add derivatives of the bond peak to the site gradients
+        void addPeakGradients(const BaseBondGenerator& bnds,
+                double fwhm, double peakscale);
         /// complete lower bound extension of the calculated grid
         double rcalclo() const;
         /// complete upper bound extension of the calculated grid
@@ -144,11 +194,52 @@ class PDFCalculator :
         /// by cutting away the points for termination ripples
         void cutRipplePoints(QuantityType& y) const;
 
+        // cached results
+        /// discard cached results when the calculator has changed
+        void updateResultsCache() const;
+        const QuantityType& cachedExtendedPDF() const;
+        const QuantityType& cachedExtendedRDF() const;
+        const QuantityType& cachedExtendedRDFperR() const;
+        const QuantityType& cachedExtendedF() const;
+        const QuantityType& cachedExtendedRgrid() const;
+        // conversions of the results on the extended r-grid
+        /// scale of the value array that gives RDF
+        double rdfScale() const;
+        QuantityType extendedRDFFromValue(int offset, double scale) const;
+        QuantityType extendedRDFperRFromRDF(const QuantityType& rdf) const;
+        QuantityType extendedFFromRDFperR(const QuantityType& rdfperr) const;
+        QuantityType extendedPDFFromRDFperR(const QuantityType& rdfperr) const;
+        QuantityType extendedPDFFromF(const QuantityType& f_ext) const;
+        /// return true if PDF can be obtained without Fourier filtering
+        bool skipsPDFFilter() const;
+        /// Faber-Ziman partial RDF on the extended r-grid
+        QuantityType extendedPartialRDF(int tp0, int tp1) const;
+        /// RDF derivative on the extended r-grid
+        QuantityType extendedRDFGradient(int siteidx, int p) const;
+
+        // partial PDFs
+        /// number of atom type pairs with separate RDF sums
+        int countPartials() const;
+        /// partial RDF for the atom types of two sites or NULL
+        /// when partials are not evaluated
+        double* partialValue(int site0, int site1);
+        /// checked offset of the partial RDF for two atom type indices
+        int partialOffset(int tp0, int tp1) const;
+
+        // site gradients
+        /// number of site gradient arrays in the value
+        int countGradients() const;
+        /// number of sites at the last value reset
+        int countCachedSites() const;
+        /// checked offset of the RDF derivative for a site parameter
+        int gradientOffset(int siteidx, int p) const;
+
         // structure factors - fast lookup by site index
         /// effective scattering factor at a given site scaled by occupancy
         const double& sfSite(int) const;
         /// average scattering factor
         double sfAverage() const;
+        void cacheSiteTypeData();
         void cacheStructureData();
         void cacheRlimitsData();
 
@@ -160,11 +251,17 @@ class PDFCalculator :
         double mmaxextension;
         PeakProfilePtr mpeakprofile;
         PDFBaselinePtr mbaseline;
+        bool mevaluatepartials;
+        bool mevaluategradients;
         struct {
             std::vector<double> sfsite;
             double sfaverage;
             double totaloccupancy;
             double activeoccupancy;
+            std::vector<int> typeofsite;
+            std::vector<std::string> atomtypes;
+            /// sum of site scattering factors times multiplicity per type
+            std::vector<double> sftypetotal;
         } mstructure_cache;
         struct {
             int extendedrminsteps;
@@ -176,7 +273,21 @@ class PDFCalculator :
         struct {
             QuantityType value;
             int rclosteps;
+            int calcpoints;
+            std::vector<std::string> atomtypes;
+            int cntsites;
         } mstashedvalue;
+        // peak widths for the bonds in addPairContributions
+        std::vector<double> mbatchfwhm;
+        // work array for peak profile values in addPeak
+        // and addPeakGradients
+        std::vector<double> mpeakvalues;
+        // results derived from mvalue, these are not serialized
+        enum {
+            EXTENDED_RGRID, EXTENDED_RDF, EXTENDED_RDFPERR,
+            EXTENDED_F, EXTENDED_PDF
+        };
+        mutable PDFResultsCache mresults_cache;
         // serialization
         friend class boost::serialization::access;
         template<class Archive>
@@ -201,6 +312,21 @@ class PDFCalculator :
             ar & mrlimits_cache.extendedrmaxsteps;
             ar & mrlimits_cache.rcalclosteps;
             ar & mrlimits_cache.rcalchisteps;
+            if (version >= 1) {
+                ar & mevaluatepartials;
+                ar & mstructure_cache.typeofsite;
+                ar & mstructure_cache.atomtypes;
+                ar & mstructure_cache.sftypetotal;
+            }
+            else if (Archive::is_loading::value)
+            {
+                mevaluatepartials = false;
+                mstructure_cache.typeofsite.clear();
+                mstructure_cache.atomtypes.clear();
+                mstructure_cache.sftypetotal.clear();
+            }
+            if (version >= 2)  ar & mevaluategradients;
+            else if (Archive::is_loading::value)  mevaluategradients = false;
         }
 
 };  // class PDFCalculator
@@ -210,6 +336,7 @@ class PDFCalculator :
 
 // Serialization -------------------------------------------------------------
 
+BOOST_CLASS_VERSION(diffpy::srreal::PDFCalculator, 2)
 BOOST_CLASS_EXPORT_KEY(diffpy::srreal::PDFCalculator)
 
 #endif  // PDFCALCULATOR_HPP_INCLUDED
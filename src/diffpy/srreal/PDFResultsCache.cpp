@@ -0,0 +1,100 @@
+/*****************************************************************************
+*
+* libdiffpy         Complex Modeling Initiative
+*                   (c) 2026 Brookhaven Science Associates,
+*                   Brookhaven National Laboratory.
+*                   All rights reserved.
+*
+* File coded by:    Pavol Juhas
+*
+* See AUTHORS.txt for a list of people who contributed.
+* See LICENSE.txt for license information.
+*
+******************************************************************************
+*
+* class PDFResultsCache -- storage of arrays derived from the calculated
+*     value of a PDF calculator, such as the extended PDF, RDF or F(Q).
+*
+*****************************************************************************/
+
+#include <cassert>
+
+#include <diffpy/srreal/PDFResultsCache.hpp>
+
+using namespace std;
+
+namespace diffpy {
+namespace srreal {
+
+// Public Methods ------------------------------------------------------------
+
+void PDFResultsCache::beginKey(const eventticker::EventTicker& tic)
+{
+    mnewkey.ticker = tic;
+    mnewkey.types.clear();
+    mnewkey.values.clear();
+}
+
+
+void PDFResultsCache::addToKey(double value)
+{
+    mnewkey.values.push_back(value);
+}
+
+
+void PDFResultsCache::addToKey(
+        const string& tp, const diffpy::Attributes& obj)
+{
+    mnewkey.types.push_back(tp);
+    set<string> names = obj.namesOfDoubleAttributes();
+    set<string>::const_iterator nm = names.begin();
+    for (; nm != names.end(); ++nm)
+    {
+        mnewkey.values.push_back(obj.getDoubleAttr(*nm));
+    }
+}
+
+
+void PDFResultsCache::endKey()
+{
+    bool samekey = (mkey.ticker == mnewkey.ticker) &&
+        (mkey.types == mnewkey.types) &&
+        (mkey.values == mnewkey.values);
+    if (samekey)  return;
+    this->clear();
+    mkey.ticker = mnewkey.ticker;
+    mkey.types.swap(mnewkey.types);
+    mkey.values.swap(mnewkey.values);
+}
+
+
+void PDFResultsCache::clear()
+{
+    mresults.clear();
+}
+
+
+bool PDFResultsCache::has(int idx) const
+{
+    return mresults.count(idx);
+}
+
+
+const QuantityType& PDFResultsCache::get(int idx) const
+{
+    assert(this->has(idx));
+    return mresults.find(idx)->second;
+}
+
+
+const QuantityType& PDFResultsCache::store(int idx, QuantityType& value)
+{
+    QuantityType& rv = mresults[idx];
+    rv.swap(value);
+    return rv;
+}
+
+}   // namespace srreal
+}   // namespace diffpy
+
+// End of file
@@ -0,0 +1,84 @@
+/*****************************************************************************
+*
+* libdiffpy         Complex Modeling Initiative
+*                   (c) 2026 Brookhaven Science Associates,
+*                   Brookhaven National Laboratory.
+*                   All rights reserved.
+*
+* File coded by:    Pavol Juhas
+*
+* See AUTHORS.txt for a list of people who contributed.
+* See LICENSE.txt for license information.
+*
+******************************************************************************
+*
+* class PDFResultsCache -- storage of arrays derived from the calculated
+*     value of a PDF calculator, such as the extended PDF, RDF or F(Q).
+*
+* The cached arrays are valid for a key, which consists of the ticker
+* of the calculator and of the configuration objects and values that are
+* applied after the summation, for example the PDF envelopes and baseline.
+* The key objects contribute their type name and all their double
+* attributes, so that an equal replacement object keeps the results.  The cache has to be cleared when the calculated value
+* changes.  The cache is transient and it is not serialized.
+*
+*****************************************************************************/
+
+#ifndef PDFRESULTSCACHE_HPP_INCLUDED
+#define PDFRESULTSCACHE_HPP_INCLUDED
+
+#include <vector>
+#include <map>
+#include <string>
+
+#include <diffpy/Attributes.hpp>
+#include <diffpy/EventTicker.hpp>
+#include <diffpy/srreal/QuantityType.hpp>
+
+namespace diffpy {
+namespace srreal {
+
+class PDFResultsCache
+{
+    public:
+
+        // methods
+        /// start a new key with the ticker of the calculator
+        void beginKey(const eventticker::EventTicker& tic);
+        /// add configuration value to the key
+        void addToKey(double value);
+        /// add type name and double attributes of an object to the key
+        void addToKey(const std::string& tp, const diffpy::Attributes& obj);
+        /// complete the key and clear the results if the key has changed
+        void endKey();
+        /// discard all cached results
+        void clear();
+        /// check if result of the specified index is cached
+        bool has(int idx) const;
+        /// return cached result of the specified index
+        const QuantityType& get(int idx) const;
+        /// move the value into cache and return reference to the result,
+        /// the reference stays valid until the cache is cleared
+        const QuantityType& store(int idx, QuantityType& value);
+
+    private:
+
+        // types
+        struct Key
+        {
+            eventticker::EventTicker ticker;
+            std::vector<std::string> types;
+            std::vector<double> values;
+        };
+
+        // data
+        Key mkey;
+        Key mnewkey;
+        std::map<int, QuantityType> mresults;
+
+};
+
+}   // namespace srreal
+}   // namespace diffpy
+
+#endif  // PDFRESULTSCACHE_HPP_INCLUDED
@@ -17,11 +17,17 @@
 *****************************************************************************/
 
 #include <stdexcept>
+#include <cassert>
+#include <algorithm>
+#include <map>
+#include <vector>
+#include <boost/shared_ptr.hpp>
 
 #include <gsl/gsl_errno.h>
-#include <gsl/gsl_fft_complex.h>
+#include <gsl/gsl_fft_real.h>
 
 #include <diffpy/srreal/PDFUtils.hpp>
+#include <diffpy/srreal/BaseBondGenerator.hpp>
 #include <diffpy/mathutils.hpp>
 #include <diffpy/validators.hpp>
 
@@ -37,49 +43,132 @@ namespace srreal {
 namespace {
 
 const char* EMSGFFT = "Fourier Transformation failed.";
+// maximum number of cached sine transformation plans per thread
+const size_t MAX_CACHED_PLANS = 8;
+
+}   // namespace
+
+// Local Helpers -------------------------------------------------------------
+
+namespace {
+
+/// Discrete sine transformation of an even length n computed with
+/// a real mixed-radix FFT of the same length.  The transformation is
+///
+///     y[k] = sum(y[j] * sin(pi * j * k / n) for j in [1, n))
+///
+/// and it uses about a quarter of the work and memory of the odd
+/// extension to a complex FFT of length 2n.
+class SineTransformPlan
+{
+    public:
+
+        // constructor
+        explicit SineTransformPlan(int n) : mn(n), msin(n / 2 + 1)
+        {
+            assert(n > 0 && 0 == n % 2);
+            for (int j = 0; j <= n / 2; ++j)  msin[j] = sin(M_PI * j / n);
+            mwavetable = gsl_fft_real_wavetable_alloc(n);
+            mworkspace = gsl_fft_real_workspace_alloc(n);
+        }
+
+        // destructor
+        ~SineTransformPlan()
+        {
+            gsl_fft_real_workspace_free(mworkspace);
+            gsl_fft_real_wavetable_free(mwavetable);
+        }
+
+        // methods
+        /// Transform n values in y in place.  y[0] is not used.
+        void transform(double* y) const
+        {
+            const int n = mn;
+            // fold y into a sequence whose real FFT gives the sine sums
+            y[0] = 0.0;
+            for (int j = 1; j <= n / 2; ++j)
+            {
+                double a = msin[j] * (y[j] + y[n - j]);
+                double b = 0.5 * (y[j] - y[n - j]);
+                y[j] = a + b;
+                y[n - j] = a - b;
+            }
+            int status = gsl_fft_real_transform(y, 1, n,
+                    mwavetable, mworkspace);
+            if (status != GSL_SUCCESS)  throw invalid_argument(EMSGFFT);
+            // unpack the halfcomplex result, y[2m] = -Im(z[m]) and
+            // y[2m + 1] = y[2m - 1] + Re(z[m]) with y[1] = Re(z[0]) / 2
+            double ysum = 0.5 * y[0];
+            y[0] = 0.0;
+            for (int m = 1; m < n / 2; ++m)
+            {
+                double re = y[2 * m - 1];
+                y[2 * m - 1] = ysum;
+                y[2 * m] = -y[2 * m];
+                ysum += re;
+            }
+            y[n - 1] = ysum;
+        }
+
+    private:
+
+        // data
+        int mn;
+        std::vector<double> msin;
+        gsl_fft_real_wavetable* mwavetable;
+        gsl_fft_real_workspace* mworkspace;
+
+        // disable copying
+        SineTransformPlan(const SineTransformPlan&);
+        SineTransformPlan& operator=(const SineTransformPlan&);
+};
+
+
+/// Return a cached sine transformation plan for the specified length.
+const SineTransformPlan& getSineTransformPlan(int n)
+{
+    typedef boost::shared_ptr<SineTransformPlan> PlanPtr;
+    thread_local std::map<int, PlanPtr> plans;
+    std::map<int, PlanPtr>::iterator ii = plans.find(n);
+    if (ii != plans.end())  return *(ii->second);
+    if (plans.size() >= MAX_CACHED_PLANS)  plans.clear();
+    PlanPtr p(new SineTransformPlan(n));
+    plans[n] = p;
+    return *p;
+}
 
 }   // namespace
 
 // PDFUtils functions --------------------------------------------------------
 
+int fftPaddedSize(int npts)
+{
+    // use an even length with no prime factors other than 2, 3 and 5
+    int rv = std::max(2, npts + npts % 2);
+    for (;; rv += 2)
+    {
+        int m = rv;
+        while (0 == m % 2)  m /= 2;
+        while (0 == m % 3)  m /= 3;
+        while (0 == m % 5)  m /= 5;
+        if (1 == m)  break;
+    }
+    return rv;
+}
+
+
 QuantityType fftgtof(const QuantityType& g, double rstep, double rmin)
 {
     if (g.empty())  return g;
     int padrmin = int(round(rmin / rstep));
     int Npad1 = padrmin + g.size();
-    // pad to the next power of 2 for fast Fourier transformation
-    int Npad2 = (1 << int(ceil(log2(Npad1))));
-    // sine transformations needs an odd extension
-    // gpadc array has to be doubled for complex coefficients
-    int Npad4 = 4 * Npad2;
-    valarray<double> gpadc(0.0, Npad4);
-    QuantityType::const_iterator gi;
-    // copy the original g signal
-    int ilo = padrmin;
-    for (gi = g.begin(); gi != g.end(); ++gi, ++ilo)
-    {
-        gpadc[2 * ilo] = *gi;
-    }
-    // copy the odd part of g skipping the first point,
-    // because it is periodic image of gpadc[0]
-    int ihi = 2 * Npad2 - 1;
-    for (ilo = 1; ilo < Npad2; ++ilo, --ihi)
-    {
-        gpadc[2 * ihi] = -1 * gpadc[2 * ilo];
-    }
-    int status;
-    status = gsl_fft_complex_radix2_inverse(&(gpadc[0]), 1, 2 * Npad2);
-    if (status != GSL_SUCCESS)  throw invalid_argument(EMSGFFT);
-    QuantityType f(Npad2);
-    for (int i = 0; i < Npad2; ++i)
-    {
-        f[i] = gpadc[2 * i + 1] * Npad2 * rstep;
-    }
-    // real components should be all close to zero
-    assert(fabs(valarray<double>(gpadc[slice(0, 2 * Npad2, 2)]).min()) <=
-            SQRT_DOUBLE_EPS * gpadc.max());
-    assert(fabs(valarray<double>(gpadc[slice(0, 2 * Npad2, 2)]).max()) <=
-            SQRT_DOUBLE_EPS * gpadc.max());
+    // zero padded signal is transformed in place
+    int Npad2 = fftPaddedSize(Npad1);
+    QuantityType f(Npad2, 0.0);
+    copy(g.begin(), g.end(), f.begin() + padrmin);
+    getSineTransformPlan(Npad2).transform(f.data());
+    QuantityType::iterator fi;
+    for (fi = f.begin(); fi != f.end(); ++fi)  *fi *= rstep;
     return f;
 }
 
@@ -94,6 +183,66 @@ QuantityType fftftog(const QuantityType& f, double qstep, double qmin)
 }
 
 
+vector<int> pdfutils_typePairRemap(
+        const vector<string>& types0, const vector<string>& types1)
+{
+    const int ntps0 = types0.size();
+    vector<int> tpmap(ntps0, -1);
+    for (int i = 0; i < ntps0; ++i)
+    {
+        vector<string>::const_iterator tp =
+            find(types1.begin(), types1.end(), types0[i]);
+        if (tp != types1.end())  tpmap[i] = tp - types1.begin();
+    }
+    vector<int> rv(pdfutils_countTypePairs(ntps0), -1);
+    for (int j = 0; j < ntps0; ++j)
+    {
+        for (int i = 0; i <= j; ++i)
+        {
+            if (tpmap[i] < 0 || tpmap[j] < 0)  continue;
+            rv[pdfutils_typePairIndex(i, j)] =
+                pdfutils_typePairIndex(tpmap[i], tpmap[j]);
+        }
+    }
+    return rv;
+}
+
+
+void pdfutils_addBondGradients(double* grad, int npts,
+        const BaseBondGenerator& bnds, int i, int n,
+        const double* dvdd, const double* dvdmsd)
+{
+    const int site0 = bnds.site0();
+    const int site1 = bnds.site1();
+    // derivatives of distance and msd with respect to the site positions
+    const R3::Vector u = bnds.r01() / bnds.distance();
+    const R3::Vector m = bnds.msdGradient();
+    const R3::Vector du0 = R3::mxvecproduct(u, bnds.r0Jacobian());
+    const R3::Vector dm0 = R3::mxvecproduct(m, bnds.r0Jacobian());
+    const R3::Vector du1 = R3::mxvecproduct(u, bnds.r1Jacobian());
+    const R3::Vector dm1 = R3::mxvecproduct(m, bnds.r1Jacobian());
+    double* g0 = grad + SITE_PARAMETER_COUNT * site0 * npts + i;
+    double* g1 = grad + SITE_PARAMETER_COUNT * site1 * npts + i;
+    for (int p = SITE_X; p <= SITE_Z; ++p)
+    {
+        double* gp0 = g0 + p * npts;
+        double* gp1 = g1 + p * npts;
+        for (int k = 0; k < n; ++k)
+        {
+            gp0[k] -= dvdd[k] * du0[p] + dvdmsd[k] * dm0[p];
+            gp1[k] += dvdd[k] * du1[p] + dvdmsd[k] * dm1[p];
+        }
+    }
+    // msd increases by the same Uiso increment of either site
+    double* gu0 = g0 + SITE_UISO * npts;
+    double* gu1 = g1 + SITE_UISO * npts;
+    for (int k = 0; k < n; ++k)
+    {
+        gu0[k] += dvdmsd[k];
+        gu1[k] += dvdmsd[k];
+    }
+}
+
 }   // namespace srreal
 }   // namespace diffpy
 
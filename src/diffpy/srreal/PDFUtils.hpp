@@ -16,6 +16,9 @@
 *     meanSquareDisplacement
 *     maxUii
 *     fftftog  and  fftgtof
+*     fftPaddedSize
+*     type pair indices for the partial PDF channels
+*     site gradients of the pair contributions
 *
 *****************************************************************************/
 
@@ -23,6 +26,8 @@
 #define PDFUTILS_HPP_INCLUDED
 
 #include <cmath>
+#include <string>
+#include <vector>
 #include <valarray>
 #include <diffpy/srreal/R3linalg.hpp>
 #include <diffpy/srreal/StructureAdapter.hpp>
@@ -42,6 +47,9 @@ const double DEFAULT_PEAKPRECISION = 3.33e-6;
 const double DEFAULT_QGRID_QMAX = 10.0;
 const double DEFAULT_QGRID_QSTEP = 0.05;
 
+/// length of the zero padded signal in fftgtof and fftftog
+int fftPaddedSize(int npts);
+
 /// fast Fourier transformation converting G(r) to F(Q)
 QuantityType fftgtof(const QuantityType& g, double rstep, double rmin=0.0);
 
@@ -58,6 +66,32 @@ template <class T> int pdfutils_rminSteps(const T* pdfc);
 int pdfutils_rmaxSteps(const double& rmax, const double& rstep);
 template <class T> int pdfutils_rmaxSteps(const T* pdfc);
 
+/// number of unordered pairs of ntypes atom types including the self-pairs
+int pdfutils_countTypePairs(int ntypes);
+/// index of an unordered pair of atom type indices, the same for (i, j)
+/// and (j, i).  Pairs of lower type indices have lower pair index.
+int pdfutils_typePairIndex(int tp0, int tp1);
+/// map pair indices of atom types in types0 to pair indices in types1,
+/// return -1 for pairs with atom types that are not in types1.
+std::vector<int> pdfutils_typePairRemap(
+        const std::vector<std::string>& types0,
+        const std::vector<std::string>& types1);
+
+/// site parameters for the gradients of PDF and Debye sums.  SITE_UISO
+/// is an isotropic increment of the displacement tensor of the site.
+enum SiteParameter { SITE_X, SITE_Y, SITE_Z, SITE_UISO };
+/// number of the gradient parameters per site
+const int SITE_PARAMETER_COUNT = 4;
+
+/// Add derivatives of one bond contribution to the site gradients.
+/// The gradients are stored in segments of npts points per site and
+/// parameter starting at grad.  The dvdd and dvdmsd are derivatives of
+/// the contribution at points [i, i + n) with respect to the bond
+/// distance and to the mean square displacement along the bond.
+void pdfutils_addBondGradients(double* grad, int npts,
+        const BaseBondGenerator& bnds, int i, int n,
+        const double* dvdd, const double* dvdmsd);
+
 }   // namespace srreal
 }   // namespace diffpy
 
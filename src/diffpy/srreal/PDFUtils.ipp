@@ -122,6 +122,21 @@ int pdfutils_rmaxSteps(const T* pdfc)
 }
 
 
+inline
+int pdfutils_countTypePairs(int ntypes)
+{
+    return ntypes * (ntypes + 1) / 2;
+}
+
+
+inline
+int pdfutils_typePairIndex(int tp0, int tp1)
+{
+    const int tplo = (tp0 < tp1) ? tp0 : tp1;
+    const int tphi = (tp0 < tp1) ? tp1 : tp0;
+    return pdfutils_countTypePairs(tphi) + tplo;
+}
+
 }   // namespace srreal
 }   // namespace diffpy
 
@@ -18,16 +18,28 @@
 * class PQEvaluatorOptimized -- optimized PairQuantity evaluator with fast
 *     quantity updates
 *
+* class PQEvaluatorThreaded -- PairQuantity evaluator that splits the pair
+*     summation over several threads within one process
+*
 *****************************************************************************/
 
 
 #include <stdexcept>
 #include <sstream>
+#include <numeric>
+#include <typeinfo>
+#include <unordered_map>
+#include <thread>
+#include <exception>
+#include <boost/archive/archive_exception.hpp>
+#include <boost/functional/hash.hpp>
 
 #include <diffpy/serialization.ipp>
 #include <diffpy/srreal/PQEvaluator.hpp>
 #include <diffpy/srreal/PairQuantity.hpp>
 #include <diffpy/srreal/BondCalculator.hpp>
+#include <diffpy/srreal/BondBatch.hpp>
+#include <diffpy/srreal/CellListBondGenerator.hpp>
 #include <diffpy/srreal/StructureDifference.hpp>
 
 using namespace std;
@@ -41,6 +53,10 @@ namespace {
 
 // tolerated load variance for splitting outer loop for parallel evaluation
 const double CPU_LOAD_VARIANCE = 0.1;
+// relative cost of skipping a site that is out of rmax range
+const double SITE_SKIP_COST = 0.05;
+// number of grid cells per rmax used for counting of near neighbors
+const int NEIGHBOR_CELLS_PER_RMAX = 4;
 
 SiteIndices
 complementary_indices(const int sz, const SiteIndices& indices0)
@@ -63,6 +79,42 @@ complementary_indices(const int sz, const SiteIndices& indices0)
     return rv;
 }
 
+/// Split a sequence of work costs into nparts contiguous ranges of about
+/// equal total cost.  Return nparts + 1 range boundaries.
+vector<int>
+balanced_boundaries(const vector<double>& costs, int nparts)
+{
+    const int sz = costs.size();
+    vector<int> rv(nparts + 1, sz);
+    rv[0] = 0;
+    const double total = accumulate(costs.begin(), costs.end(), 0.0);
+    double cumsum = 0.0;
+    int part = 1;
+    for (int i = 0; i < sz && part < nparts; ++i)
+    {
+        const double cumsum0 = cumsum;
+        cumsum += costs[i];
+        double target = total * part / nparts;
+        for (; part < nparts && cumsum >= target;
+                target = total * (++part) / nparts)
+        {
+            // cut before or after item i, whichever is closer to target
+            int cut = (target - cumsum0 < cumsum - target) ? i : (i + 1);
+            rv[part] = max(cut, rv[part - 1]);
+        }
+    }
+    return rv;
+}
+
+
+/// Return index range of the part partindex out of nparts parts.
+pair<int, int>
+balanced_range(const vector<double>& costs, int partindex, int nparts)
+{
+    vector<int> bounds = balanced_boundaries(costs, nparts);
+    return make_pair(bounds[partindex], bounds[partindex + 1]);
+}
+
 }   // namespace
 
 //////////////////////////////////////////////////////////////////////////////
@@ -71,7 +123,7 @@ complementary_indices(const int sz, const SiteIndices& indices0)
 
 PQEvaluatorBasic::PQEvaluatorBasic() :
     mconfigflags(0),
-    mcpuindex(0), mncpu(1), mtypeused(NONE)
+    mcpuindex(0), mncpu(1), mnthreads(0), mtypeused(NONE)
 { }
 
 
@@ -98,31 +150,11 @@ void PQEvaluatorBasic::updateValue(
 {
     mtypeused = BASIC;
     pq.setStructure(stru);
-    BaseBondGeneratorPtr bnds = pq.mstructure->createBondGenerator();
-    pq.configureBondGenerator(*bnds);
-    int cntsites = pq.mstructure->countSites();
-    // loop counter
-    long n = mcpuindex;
-    // split outer loop for many atoms.  The CPUs should have similar load.
-    bool chop_outer = (mncpu <= ((cntsites - 1) * CPU_LOAD_VARIANCE + 1));
-    bool chop_inner = !chop_outer;
-    const bool hasmask = pq.hasMask();
-    if (!this->isParallel())  chop_outer = chop_inner = false;
-    const bool usefullsum = this->getFlag(USEFULLSUM);
-    for (int i0 = 0; i0 < cntsites; ++i0)
+    if (pq.sumsPairContributions())
     {
-        if (chop_outer && (n++ % mncpu))    continue;
-        bnds->selectAnchorSite(i0);
-        int i1hi = usefullsum ? cntsites : (i0 + 1);
-        bnds->selectSiteRange(0, i1hi);
-        for (bnds->rewind(); !bnds->finished(); bnds->next())
-        {
-            if (chop_inner && (n++ % mncpu))    continue;
-            int i1 = bnds->site1();
-            if (hasmask && !pq.getPairMask(i0, i1))   continue;
-            int summationscale = (usefullsum || i0 == i1) ? 1 : 2;
-            pq.addPairContribution(*bnds, summationscale);
-        }
+        BaseBondGeneratorPtr bnds = pq.mstructure->createBondGenerator();
+        pq.configureBondGenerator(*bnds);
+        this->accumulateValue(pq, *bnds, 0, 1, vector<double>());
     }
     mvalue_ticker.click();
 }
@@ -159,6 +191,175 @@ bool PQEvaluatorBasic::isParallel() const
     return mncpu > 1;
 }
 
+
+void PQEvaluatorBasic::setNumThreads(int nthreads)
+{
+    if (nthreads < 0)
+    {
+        const char* emsg = "Number of threads cannot be negative.";
+        throw invalid_argument(emsg);
+    }
+    mnthreads = nthreads;
+}
+
+
+int PQEvaluatorBasic::getNumThreads() const
+{
+    return mnthreads;
+}
+
+
+/// Return PairQuantity objects for evaluating a batch of nframes
+/// structures.  Each object is used by one thread for a contiguous
+/// range of frames.  The basic evaluator processes all frames in pq.
+vector<PairQuantity*>
+PQEvaluatorBasic::batchWorkers(PairQuantity& pq, int nframes)
+{
+    return vector<PairQuantity*>(1, &pq);
+}
+
+// Protected Methods ---------------------------------------------------------
+
+/// Add pair contributions for the share of thread threadindex out of
+/// nthreads threads working on the same structure within this CPU.
+/// Optional anchorcosts are the estimates from anchorCosts, they are
+/// evaluated here when empty and needed.
+void PQEvaluatorBasic::accumulateValue(PairQuantity& pq,
+        BaseBondGenerator& bnds, int threadindex, int nthreads,
+        const vector<double>& anchorcosts) const
+{
+    int cntsites = pq.mstructure->countSites();
+    const bool usefullsum = this->getFlag(USEFULLSUM);
+    // split outer loop for many atoms.  The CPUs should have similar load.
+    bool chop_outer = (mncpu <= ((cntsites - 1) * CPU_LOAD_VARIANCE + 1));
+    bool chop_inner = !chop_outer;
+    if (!this->isParallel())  chop_outer = chop_inner = false;
+    vector<double> costs;
+    if (chop_outer || nthreads > 1)
+    {
+        costs = anchorcosts.empty() ?
+            this->anchorCosts(pq, bnds) : anchorcosts;
+    }
+    // outer loop split into contiguous anchor ranges of similar cost
+    pair<int, int> anchors(0, cntsites);
+    if (chop_outer)  anchors = balanced_range(costs, mcpuindex, mncpu);
+    // threads divide work which was assigned to this CPU.  They can split
+    // the outer loop only if this CPU did not take the inner-loop split.
+    int cntanchors = anchors.second - anchors.first;
+    bool tchop_outer = !chop_inner &&
+        (nthreads <= ((cntanchors - 1) * CPU_LOAD_VARIANCE + 1));
+    bool tchop_inner = !tchop_outer;
+    if (nthreads < 2)  tchop_outer = tchop_inner = false;
+    if (tchop_outer)
+    {
+        vector<double> cpucosts(costs.begin() + anchors.first,
+                costs.begin() + anchors.second);
+        pair<int, int> tanchors =
+            balanced_range(cpucosts, threadindex, nthreads);
+        anchors.second = anchors.first + tanchors.second;
+        anchors.first += tanchors.first;
+    }
+    // loop counters for round-robin split of the inner loop
+    long n = mcpuindex;
+    long m = threadindex;
+    const bool hasmask = pq.hasMask();
+    const CompiledPairMask& pmask = pq.compiledPairMask();
+    BondBatch batch;
+    const bool usebatch = pq.configureBondBatch(batch);
+    for (int i0 = anchors.first; i0 < anchors.second; ++i0)
+    {
+        bnds.selectAnchorSite(i0);
+        int i1hi = usefullsum ? cntsites : (i0 + 1);
+        bnds.selectSiteRange(0, i1hi);
+        for (bnds.rewind(); !bnds.finished(); bnds.next())
+        {
+            if (chop_inner && (n++ % mncpu))    continue;
+            if (tchop_inner && (m++ % nthreads))    continue;
+            int i1 = bnds.site1();
+            if (hasmask && !pmask(i0, i1))   continue;
+            int summationscale = (usefullsum || i0 == i1) ? 1 : 2;
+            if (usebatch)  batch.append(bnds, summationscale);
+            else  pq.addPairContribution(bnds, summationscale);
+        }
+        if (!batch.empty())  pq.addPairContributions(batch);
+        batch.clear();
+    }
+}
+
+
+/// Estimate relative cost of the inner loop for every anchor site.
+/// The cost is dominated by the pair contributions, i.e., by the count of
+/// summed sites within rmax.  These are counted on a grid of small cells
+/// for the plain and cell-list bond generators of non-periodic structures.
+/// The other bond generators are assumed to have uniform density of
+/// neighbors.
+vector<double> PQEvaluatorBasic::anchorCosts(
+        const PairQuantity& pq, const BaseBondGenerator& bnds) const
+{
+    const StructureAdapter& stru = *(pq.mstructure);
+    const int cntsites = stru.countSites();
+    const double& rmax = bnds.getRmax();
+    const bool usefullsum = this->getFlag(USEFULLSUM);
+    vector<double> rv(cntsites);
+    // count of summed sites for every anchor
+    for (int i = 0; i < cntsites; ++i)
+    {
+        rv[i] = usefullsum ? cntsites : (i + 1);
+    }
+    const bool usegrid = (typeid(bnds) == typeid(BaseBondGenerator) ||
+            typeid(bnds) == typeid(CellListBondGenerator)) &&
+        (rmax > 0.0) && isfinite(rmax);
+    if (!usegrid)  return rv;
+    // sort site indices into cubic cells
+    typedef unordered_map<R3::Vector, SiteIndices,
+            boost::hash<R3::Vector> > CellSites;
+    const double cellsize = rmax / NEIGHBOR_CELLS_PER_RMAX;
+    CellSites cellsites;
+    vector<R3::Vector> sitecells(cntsites);
+    for (int i = 0; i < cntsites; ++i)
+    {
+        R3::Vector& c = sitecells[i];
+        c = stru.siteCartesianPosition(i) / cellsize;
+        for (double& x : c)  x = floor(x);
+        cellsites[c].push_back(i);
+    }
+    // offsets of cells with centers within rmax.  Sites beyond rmax in
+    // the edge cells about balance those missed in the outside cells.
+    vector<R3::Vector> offsets;
+    const int hi = NEIGHBOR_CELLS_PER_RMAX;
+    for (int dx = -hi; dx <= hi; ++dx)
+    for (int dy = -hi; dy <= hi; ++dy)
+    for (int dz = -hi; dz <= hi; ++dz)
+    {
+        R3::Vector dc(dx, dy, dz);
+        if (R3::norm(dc) <= hi)  offsets.push_back(dc);
+    }
+    // neighbor cells are shared by all sites in the cell
+    unordered_map<R3::Vector, vector<const SiteIndices*>,
+        boost::hash<R3::Vector> > neighborcells;
+    for (const CellSites::value_type& cs : cellsites)
+    {
+        vector<const SiteIndices*>& nbc = neighborcells[cs.first];
+        for (const R3::Vector& dc : offsets)
+        {
+            CellSites::const_iterator ci = cellsites.find(cs.first + dc);
+            if (ci != cellsites.end())  nbc.push_back(&(ci->second));
+        }
+    }
+    for (int i = 0; i < cntsites; ++i)
+    {
+        int cntnear = 0;
+        for (const SiteIndices* pidx : neighborcells[sitecells[i]])
+        {
+            // indices in the cell are sorted, count only the summed ones
+            cntnear += usefullsum ? pidx->size() :
+                (upper_bound(pidx->begin(), pidx->end(), i) - pidx->begin());
+        }
+        rv[i] = cntnear + SITE_SKIP_COST * rv[i];
+    }
+    return rv;
+}
+
 //////////////////////////////////////////////////////////////////////////////
 // class PQEvaluatorOptimized
 //////////////////////////////////////////////////////////////////////////////
@@ -182,8 +383,9 @@ void PQEvaluatorOptimized::updateValue(
 {
     mtypeused = OPTIMIZED;
     // revert to normal calculation if there is no structure or
-    // if PairQuantity uses mask
-    if (pq.ticker() >= mvalue_ticker || !mlast_structure)
+    // if PairQuantity uses mask or does not sum the pairs
+    if (pq.ticker() >= mvalue_ticker || !mlast_structure ||
+            !pq.sumsPairContributions())
     {
         return this->updateValueCompletely(pq, stru);
     }
@@ -193,55 +395,74 @@ void PQEvaluatorOptimized::updateValue(
     {
         return this->updateValueCompletely(pq, stru);
     }
-    if ((this->getFlag(FIXEDSITEINDEX) || pq.hasPairMask()) &&
+    const bool needsfixedindex = this->getFlag(FIXEDSITEINDEX) ||
+        pq.hasPairMask() || pq.hasSiteIndexedValue();
+    if (needsfixedindex &&
             sd.diffmethod != StructureDifference::Method::SIDEBYSIDE)
     {
         return this->updateValueCompletely(pq, stru);
     }
+    // moved atoms are removed from stru0 and added back in stru1
+    const SiteIndices pop0 = sd.popsites0();
+    const SiteIndices add1 = sd.addsites1();
     // Remove contributions from the extra sites in the old structure
     assert(sd.stru0 == mlast_structure);
     int cntsites0 = sd.stru0->countSites();
     BaseBondGeneratorPtr bnds0 = sd.stru0->createBondGenerator();
     pq.configureBondGenerator(*bnds0);
-    // loop counter
-    long n = mcpuindex;
     bool usefullsum = this->getFlag(USEFULLSUM);
     // the loop is adjusted according to usefullsum and split within
     // the outer loop in case of parallel evaluation.
-    SiteIndices anchors = sd.pop0;
+    SiteIndices anchors = pop0;
     SiteIndices unchanged;
-    if (!sd.pop0.empty())
+    if (!pop0.empty())
     {
-        unchanged = complementary_indices(cntsites0, sd.pop0);
+        unchanged = complementary_indices(cntsites0, pop0);
         anchors.insert(anchors.end(), unchanged.begin(), unchanged.end());
     }
     bnds0->selectSites(anchors.begin(), anchors.end());
     SiteIndices::const_iterator last_anchor = usefullsum ?
-        anchors.end() : (anchors.begin() + sd.pop0.size());
+        anchors.end() : (anchors.begin() + pop0.size());
+    // split anchors among CPUs according to the count of their partners
+    vector<double> costs;
     SiteIndices::const_iterator ii0;
+    for (ii0 = anchors.begin(); ii0 != last_anchor; ++ii0)
+    {
+        const bool popped = (ii0 < anchors.begin() + pop0.size());
+        double c = !usefullsum ? (anchors.end() - ii0) :
+            popped ? cntsites0 : pop0.size();
+        costs.push_back(c);
+    }
+    pair<int, int> cpuanchors = balanced_range(costs, mcpuindex, mncpu);
     bool needsreselection = usefullsum;
     const bool hasmask = pq.hasMask();
-    for (ii0 = anchors.begin(); ii0 != last_anchor; ++ii0)
+    const CompiledPairMask& pmask = pq.compiledPairMask();
+    BondBatch batch;
+    const bool usebatch = pq.configureBondBatch(batch);
+    for (ii0 = anchors.begin() + cpuanchors.first;
+            ii0 != anchors.begin() + cpuanchors.second; ++ii0)
     {
-        if (n++ % mncpu)    continue;
         const int& i0 = *ii0;
         bnds0->selectAnchorSite(i0);
         // when using half sum, deselect visited popped sites
-        if (!usefullsum)  bnds0->selectSites(ii0, anchors.end());
+        if (!usefullsum)  bnds0->narrowSiteSelection(ii0, anchors.end());
         // when using full sum, select only the popped sites when
         // anchored at an unchanged atom
-        else if (needsreselection && ii0 >= (anchors.begin() + sd.pop0.size()))
+        else if (needsreselection && ii0 >= (anchors.begin() + pop0.size()))
         {
-            bnds0->selectSites(sd.pop0.begin(), sd.pop0.end());
+            bnds0->selectSites(pop0.begin(), pop0.end());
             needsreselection = false;
         }
         for (bnds0->rewind(); !bnds0->finished(); bnds0->next())
         {
             int i1 = bnds0->site1();
-            if (hasmask && !pq.getPairMask(i0, i1))   continue;
+            if (hasmask && !pmask(i0, i1))   continue;
             const int summationscale = (usefullsum || i0 == i1) ? -1 : -2;
-            pq.addPairContribution(*bnds0, summationscale);
+            if (usebatch)  batch.append(*bnds0, summationscale);
+            else  pq.addPairContribution(*bnds0, summationscale);
         }
+        if (!batch.empty())  pq.addPairContributions(batch);
+        batch.clear();
     }
     // Add contributions from the new atoms in the updated structure
     // save current value to override the resetValue call from setStructure
@@ -259,28 +480,40 @@ void PQEvaluatorOptimized::updateValue(
     int cntsites1 = sd.stru1->countSites();
     BaseBondGeneratorPtr bnds1 = sd.stru1->createBondGenerator();
     pq.configureBondGenerator(*bnds1);
-    anchors = sd.add1;
+    anchors = add1;
     unchanged.clear();
-    if (!sd.add1.empty())
+    if (!add1.empty())
     {
-        unchanged = complementary_indices(cntsites1, sd.add1);
+        unchanged = complementary_indices(cntsites1, add1);
         anchors.insert(anchors.begin(), unchanged.begin(), unchanged.end());
     }
-    bnds1->selectSites(sd.add1.begin(), sd.add1.end());
+    bnds1->selectSites(add1.begin(), add1.end());
     SiteIndices::const_iterator first_anchor = usefullsum ?
-        anchors.begin() : (anchors.end() - sd.add1.size());
+        anchors.begin() : (anchors.end() - add1.size());
     SiteIndices::const_iterator ii1;
-    needsreselection = usefullsum;
+    costs.clear();
     for (ii1 = first_anchor; ii1 != anchors.end(); ++ii1)
     {
-        if (n++ % mncpu)    continue;
+        const bool added = (ii1 >= anchors.end() - add1.size());
+        double c = !usefullsum ? (ii1 - anchors.begin() + 1) :
+            added ? cntsites1 : add1.size();
+        costs.push_back(c);
+    }
+    cpuanchors = balanced_range(costs, mcpuindex, mncpu);
+    needsreselection = usefullsum;
+    for (ii1 = first_anchor + cpuanchors.first;
+            ii1 != first_anchor + cpuanchors.second; ++ii1)
+    {
         const int& i0 = *ii1;
         bnds1->selectAnchorSite(i0);
         // when using half sum, activate the added site
-        if (!usefullsum)  bnds1->selectSites(anchors.begin(), ii1 + 1);
+        if (!usefullsum)
+        {
+            bnds1->narrowSiteSelection(anchors.begin(), ii1 + 1);
+        }
         // when using full sum select unchanged atoms once anchored
         // at an added atom.
-        else if (needsreselection && ii1 >= (anchors.end() - sd.add1.size()))
+        else if (needsreselection && ii1 >= (anchors.end() - add1.size()))
         {
             bnds1->selectSites(anchors.begin(), anchors.end());
             needsreselection = false;
@@ -288,12 +521,18 @@ void PQEvaluatorOptimized::updateValue(
         for (bnds1->rewind(); !bnds1->finished(); bnds1->next())
         {
             int i1 = bnds1->site1();
-            if (hasmask && !pq.getPairMask(i0, i1))   continue;
+            if (hasmask && !pmask(i0, i1))   continue;
             const int summationscale = (usefullsum || i0 == i1) ? +1 : +2;
-            pq.addPairContribution(*bnds1, summationscale);
+            if (usebatch)  batch.append(*bnds1, summationscale);
+            else  pq.addPairContribution(*bnds1, summationscale);
         }
+        if (!batch.empty())  pq.addPairContributions(batch);
+        batch.clear();
     }
-    mlast_structure = pq.getStructure()->clone();
+    // release the last structure so that its snapshot is updated in place
+    bnds0.reset();
+    sd = StructureDifference();
+    pq.getStructure()->updateSnapshot(mlast_structure);
     mvalue_ticker.click();
 }
 
@@ -302,7 +541,7 @@ void PQEvaluatorOptimized::updateValueCompletely(
         PairQuantity& pq, StructureAdapterPtr stru)
 {
     this->PQEvaluatorBasic::updateValue(pq, stru);
-    mlast_structure = pq.getStructure()->clone();
+    pq.getStructure()->updateSnapshot(mlast_structure);
 }
 
 // Helper classes and functions for PQEvaluatorCheck -------------------------
@@ -417,8 +656,11 @@ void PQEvaluatorCheck::updateValue(
 {
     this->PQEvaluatorOptimized::updateValue(pq, stru);
     if (mtypeused == BASIC)  return;
+    // compare finished values as PairQuantity may defer some summation
+    pq.finishValue();
     unique_ptr<pqresults> results(create_pqresults(pq));
     this->PQEvaluatorBasic::updateValue(pq, stru);
+    pq.finishValue();
     mtypeused = CHECK;
     if (!results->compare(pq))
     {
@@ -427,6 +669,159 @@ void PQEvaluatorCheck::updateValue(
     }
 }
 
+//////////////////////////////////////////////////////////////////////////////
+// class PQEvaluatorThreaded
+//////////////////////////////////////////////////////////////////////////////
+
+PQEvaluatorThreaded::PQEvaluatorThreaded() : mworkers_source(NULL)
+{ }
+
+
+PQEvaluatorType PQEvaluatorThreaded::typeint() const
+{
+    return THREADED;
+}
+
+
+void PQEvaluatorThreaded::updateValue(
+        PairQuantity& pq, StructureAdapterPtr stru)
+{
+    pq.setStructure(stru);
+    const int nthreads = this->countThreads();
+    // use plain serial loop when threads cannot help or when PairQuantity
+    // cannot be copied for per-thread accumulation
+    const bool sumspairs = pq.sumsPairContributions();
+    const bool usethreads = (nthreads > 1) && (pq.countSites() > 1) &&
+        sumspairs && this->updateWorkers(pq, nthreads);
+    if (!usethreads)
+    {
+        mtypeused = BASIC;
+        if (sumspairs)
+        {
+            BaseBondGeneratorPtr bnds = pq.mstructure->createBondGenerator();
+            pq.configureBondGenerator(*bnds);
+            this->accumulateValue(pq, *bnds, 0, 1, vector<double>());
+        }
+        mvalue_ticker.click();
+        return;
+    }
+    mtypeused = THREADED;
+    // Prepare accumulators and bond generators in the calling thread.
+    // The first thread adds directly to pq, the others to its copies.
+    vector<PairQuantity*> accumulators(nthreads, &pq);
+    vector<BaseBondGeneratorPtr> bonds(nthreads);
+    for (int t = 0; t < nthreads; ++t)
+    {
+        if (t > 0)
+        {
+            accumulators[t] = mworkers[t - 1].get();
+            accumulators[t]->setStructure(pq.mstructure);
+        }
+        bonds[t] = pq.mstructure->createBondGenerator();
+        accumulators[t]->configureBondGenerator(*bonds[t]);
+    }
+    // estimate work per anchor site once for all threads
+    const vector<double> costs = this->anchorCosts(pq, *bonds[0]);
+    vector<exception_ptr> errors(nthreads);
+    auto runthread = [&](int t) {
+        try
+        {
+            this->accumulateValue(*accumulators[t], *bonds[t],
+                    t, nthreads, costs);
+        }
+        catch (...)
+        {
+            errors[t] = current_exception();
+        }
+    };
+    vector<thread> threads;
+    threads.reserve(nthreads - 1);
+    for (int t = 1; t < nthreads; ++t)  threads.emplace_back(runthread, t);
+    runthread(0);
+    for (thread& th : threads)  th.join();
+    for (const exception_ptr& e : errors)
+    {
+        if (e)  rethrow_exception(e);
+    }
+    // reduce partial results from the other threads
+    for (int t = 1; t < nthreads; ++t)
+    {
+        pq.executeThreadedMerge(*accumulators[t]);
+    }
+    mvalue_ticker.click();
+}
+
+
+vector<PairQuantity*>
+PQEvaluatorThreaded::batchWorkers(PairQuantity& pq, int nframes)
+{
+    const int nthreads = min(this->countThreads(), nframes);
+    // use pq alone when it cannot be copied for the worker threads
+    if (nthreads <= 1 || !this->updateWorkers(pq, nthreads + 1))
+    {
+        return PQEvaluatorBasic::batchWorkers(pq, nframes);
+    }
+    vector<PairQuantity*> rv;
+    for (PairQuantityPtr& w : mworkers)
+    {
+        // each worker evaluates whole frames in its own thread
+        if (w->getEvaluatorType() != BASIC)  w->setEvaluatorType(BASIC);
+        rv.push_back(w.get());
+    }
+    return rv;
+}
+
+// Private Methods -----------------------------------------------------------
+
+int PQEvaluatorThreaded::countThreads() const
+{
+    if (mnthreads > 0)  return mnthreads;
+    int rv = max(1u, thread::hardware_concurrency());
+    return rv;
+}
+
+
+bool PQEvaluatorThreaded::updateWorkers(PairQuantity& pq, int nthreads)
+{
+    const bool uptodate = (mworkers_source == &pq) &&
+        (int(mworkers.size()) == nthreads - 1) &&
+        (pq.ticker() <= mworkers_ticker);
+    if (uptodate)  return true;
+    mworkers.clear();
+    mworkers_source = NULL;
+    // Copy pq configuration by serialization.  Detach the structure first,
+    // it is shared by all threads and would be otherwise deep-copied.
+    StructureAdapterPtr stru = emptyStructureAdapter();
+    stru.swap(pq.mstructure);
+    string data;
+    try
+    {
+        ostringstream storage(ios::binary);
+        diffpy::serialization::oarchive oa(storage, ios::binary);
+        const PairQuantity* ppq = &pq;
+        oa << ppq;
+        data = storage.str();
+    }
+    catch (boost::archive::archive_exception&)
+    {
+        // PairQuantity classes without serialization support
+        stru.swap(pq.mstructure);
+        return false;
+    }
+    stru.swap(pq.mstructure);
+    for (int t = 1; t < nthreads; ++t)
+    {
+        istringstream storage(data, ios::binary);
+        diffpy::serialization::iarchive ia(storage, ios::binary);
+        PairQuantity* pworker = NULL;
+        ia >> pworker;
+        mworkers.push_back(PairQuantityPtr(pworker));
+    }
+    mworkers_source = &pq;
+    mworkers_ticker = pq.ticker();
+    return true;
+}
+
 // Factory for PairQuantity evaluators ---------------------------------------
 
 PQEvaluatorPtr createPQEvaluator(PQEvaluatorType pqtp, PQEvaluatorPtr pqevsrc)
@@ -446,6 +841,10 @@ PQEvaluatorPtr createPQEvaluator(PQEvaluatorType pqtp, PQEvaluatorPtr pqevsrc)
             rv.reset(new PQEvaluatorCheck());
             break;
 
+        case THREADED:
+            rv.reset(new PQEvaluatorThreaded());
+            break;
+
         default:
             ostringstream emsg;
             emsg << "Invalid PQEvaluatorType value " << pqtp;
@@ -456,6 +855,7 @@ PQEvaluatorPtr createPQEvaluator(PQEvaluatorType pqtp, PQEvaluatorPtr pqevsrc)
         rv->mconfigflags = pqevsrc->mconfigflags;
         rv->mcpuindex = pqevsrc->mcpuindex;
         rv->mncpu = pqevsrc->mncpu;
+        rv->mnthreads = pqevsrc->mnthreads;
         rv->mvalue_ticker = pqevsrc->mvalue_ticker;
         rv->mtypeused = pqevsrc->mtypeused;
     }
@@ -472,5 +872,7 @@ DIFFPY_INSTANTIATE_SERIALIZATION(diffpy::srreal::PQEvaluatorBasic)
 BOOST_CLASS_EXPORT_IMPLEMENT(diffpy::srreal::PQEvaluatorBasic)
 DIFFPY_INSTANTIATE_SERIALIZATION(diffpy::srreal::PQEvaluatorOptimized)
 BOOST_CLASS_EXPORT_IMPLEMENT(diffpy::srreal::PQEvaluatorOptimized)
+DIFFPY_INSTANTIATE_SERIALIZATION(diffpy::srreal::PQEvaluatorThreaded)
+BOOST_CLASS_EXPORT_IMPLEMENT(diffpy::srreal::PQEvaluatorThreaded)
 
 // End of file
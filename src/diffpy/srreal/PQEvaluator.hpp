@@ -18,12 +18,16 @@
 * class PQEvaluatorOptimized -- optimized PairQuantity evaluator with fast
 *     quantity updates
 *
+* class PQEvaluatorThreaded -- PairQuantity evaluator that splits the pair
+*     summation over several threads within one process
+*
 *****************************************************************************/
 
 
 #ifndef PQEVALUATOR_HPP_INCLUDED
 #define PQEVALUATOR_HPP_INCLUDED
 
+#include <vector>
 #include <boost/shared_ptr.hpp>
 #include <boost/serialization/base_object.hpp>
 #include <boost/serialization/assume_abstract.hpp>
@@ -37,12 +41,13 @@ namespace diffpy {
 namespace srreal {
 
 class PairQuantity;
+class BaseBondGenerator;
 
 /// shared pointer to PQEvaluatorBasic
 
 typedef boost::shared_ptr<class PQEvaluatorBasic> PQEvaluatorPtr;
 
-enum PQEvaluatorType {NONE, BASIC, OPTIMIZED, CHECK};
+enum PQEvaluatorType {NONE, BASIC, OPTIMIZED, CHECK, THREADED};
 
 enum PQEvaluatorFlag {
     // sum over full matrix of atom pairs, use pair symmetry otherwise.
@@ -70,9 +75,19 @@ class PQEvaluatorBasic
         bool getFlag(PQEvaluatorFlag flag) const;
         void setupParallelRun(int cpuindex, int ncpu);
         bool isParallel() const;
+        void setNumThreads(int nthreads);
+        int getNumThreads() const;
+        virtual std::vector<PairQuantity*>
+            batchWorkers(PairQuantity&, int nframes);
 
     protected:
 
+        // methods
+        void accumulateValue(PairQuantity&, BaseBondGenerator&,
+                int threadindex, int nthreads,
+                const std::vector<double>& anchorcosts) const;
+        std::vector<double> anchorCosts(
+                const PairQuantity&, const BaseBondGenerator&) const;
 
         // data
         /// per-bit storage of boolean configuration flags
@@ -81,6 +96,8 @@ class PQEvaluatorBasic
         int mcpuindex;
         /// total number of the CPU units
         int mncpu;
+        /// number of threads for THREADED evaluation, 0 for all cores
+        int mnthreads;
         /// ticker for recording when was the value updated
         eventticker::EventTicker mvalue_ticker;
         /// type of PQEvaluator that was actually used
@@ -94,6 +111,7 @@ class PQEvaluatorBasic
             void serialize(Archive& ar, const unsigned int version)
         {
             ar & mconfigflags & mcpuindex & mncpu & mvalue_ticker;
+            if (version >= 1)  ar & mnthreads;
         }
 };
 
@@ -147,6 +165,46 @@ class PQEvaluatorCheck : public PQEvaluatorOptimized
         }
 };
 
+class PQEvaluatorThreaded : public PQEvaluatorBasic
+{
+    public:
+
+        // constructor
+        PQEvaluatorThreaded();
+
+        // methods
+        virtual PQEvaluatorType typeint() const;
+        virtual void updateValue(PairQuantity&, StructureAdapterPtr);
+        virtual std::vector<PairQuantity*>
+            batchWorkers(PairQuantity&, int nframes);
+
+    private:
+
+        // types
+        typedef boost::shared_ptr<PairQuantity> PairQuantityPtr;
+
+        // data
+        /// per-thread copies of the evaluated PairQuantity
+        std::vector<PairQuantityPtr> mworkers;
+        /// PairQuantity object that was copied to mworkers
+        const PairQuantity* mworkers_source;
+        /// configuration ticker of mworkers_source when it was copied
+        eventticker::EventTicker mworkers_ticker;
+
+        // helper methods
+        int countThreads() const;
+        bool updateWorkers(PairQuantity&, int nthreads);
+
+        // serialization
+        friend class boost::serialization::access;
+        template<class Archive>
+            void serialize(Archive& ar, const unsigned int version)
+        {
+            using boost::serialization::base_object;
+            ar & base_object<PQEvaluatorBasic>(*this);
+        }
+};
+
 // Factory function for PairQuantity evaluators ------------------------------
 
 PQEvaluatorPtr createPQEvaluator(
@@ -160,5 +218,7 @@ PQEvaluatorPtr createPQEvaluator(
 BOOST_SERIALIZATION_ASSUME_ABSTRACT(diffpy::srreal::PQEvaluatorBasic)
 BOOST_CLASS_EXPORT_KEY(diffpy::srreal::PQEvaluatorBasic)
 BOOST_CLASS_EXPORT_KEY(diffpy::srreal::PQEvaluatorOptimized)
+BOOST_CLASS_EXPORT_KEY(diffpy::srreal::PQEvaluatorThreaded)
+BOOST_CLASS_VERSION(diffpy::srreal::PQEvaluatorBasic, 1)
 
 #endif  // PQEVALUATOR_HPP_INCLUDED
@@ -17,10 +17,13 @@
 *****************************************************************************/
 
 #include <algorithm>
+#include <exception>
 #include <locale>
 #include <sstream>
+#include <thread>
 
 #include <diffpy/srreal/PairQuantity.hpp>
+#include <diffpy/srreal/SharedParallelData.hpp>
 #include <diffpy/mathutils.hpp>
 #include <diffpy/serialization.ipp>
 
@@ -29,6 +32,83 @@ using namespace std;
 namespace diffpy {
 namespace srreal {
 
+// Local Helpers -------------------------------------------------------------
+
+namespace {
+
+/// Running mean and variance of frame values by the Welford algorithm.
+class FrameStatistics
+{
+    public:
+
+        FrameStatistics() : mcount(0)  { }
+
+        void add(const QuantityType& x)
+        {
+            if (0 == mcount)
+            {
+                mmean.assign(x.size(), 0.0);
+                mm2.assign(x.size(), 0.0);
+            }
+            if (x.size() != mmean.size())
+            {
+                const char* emsg = "Frame values must have the same size.";
+                throw invalid_argument(emsg);
+            }
+            ++mcount;
+            for (size_t i = 0; i < x.size(); ++i)
+            {
+                double dx = x[i] - mmean[i];
+                mmean[i] += dx / mcount;
+                mm2[i] += dx * (x[i] - mmean[i]);
+            }
+        }
+
+        /// combine with statistics from another set of frames
+        void merge(const FrameStatistics& other)
+        {
+            if (0 == other.mcount)  return;
+            if (0 == mcount)
+            {
+                *this = other;
+                return;
+            }
+            if (other.mmean.size() != mmean.size())
+            {
+                const char* emsg = "Frame values must have the same size.";
+                throw invalid_argument(emsg);
+            }
+            const double na = mcount;
+            const double nb = other.mcount;
+            const double n = na + nb;
+            for (size_t i = 0; i < mmean.size(); ++i)
+            {
+                double delta = other.mmean[i] - mmean[i];
+                mmean[i] += delta * nb / n;
+                mm2[i] += other.mm2[i] + delta * delta * na * nb / n;
+            }
+            mcount += other.mcount;
+        }
+
+        const QuantityType& mean() const  { return mmean; }
+
+        QuantityType variance() const
+        {
+            QuantityType rv(mm2.size(), 0.0);
+            if (mcount == 0)  return rv;
+            for (size_t i = 0; i < mm2.size(); ++i)  rv[i] = mm2[i] / mcount;
+            return rv;
+        }
+
+    private:
+
+        long mcount;
+        QuantityType mmean;
+        QuantityType mm2;
+};
+
+}   // namespace
+
 // Class Constants -----------------------------------------------------------
 
 const int PairQuantity::ALLATOMSINT = -1;
@@ -40,7 +120,8 @@ PairQuantity::PairQuantity() :
     mstructure(emptyStructureAdapter()),
     mrmin(0.0),
     mrmax(DEFAULT_BONDGENERATOR_RMAX),
-    mdefaultpairmask(true)
+    mdefaultpairmask(true),
+    mbatchframe(false)
 {
     this->setEvaluatorType(BASIC);
     // attributes
@@ -68,8 +149,16 @@ const QuantityType& PairQuantity::eval(StructureAdapterPtr stru)
 
 void PairQuantity::setStructure(StructureAdapterPtr stru)
 {
-    mstructure = stru.get() ? stru : emptyStructureAdapter();
+    if (!stru)  stru = emptyStructureAdapter();
+    // batch frames with unchanged sites keep the type-dependent data
+    const bool sameframe = mbatchframe && this->hasSameSiteTypes(*stru);
+    mstructure = stru;
     mstructure->customPQConfig(this);
+    if (sameframe)
+    {
+        this->resetFrameValue();
+        return;
+    }
     this->updateMaskData();
     this->resetValue();
 }
@@ -106,6 +195,20 @@ void PairQuantity::mergeParallelData(const string& pdata, int ncpu)
 }
 
 
+void PairQuantity::mergeSharedParallelData(const string& shmname, int ncpu)
+{
+    if (mmergedvaluescount >= ncpu)
+    {
+        const char* emsg = "Number of merged values exceeds NCPU.";
+        throw runtime_error(emsg);
+    }
+    SharedParallelData sdata(shmname);
+    this->executeSharedMerge(sdata);
+    ++mmergedvaluescount;
+    if (mmergedvaluescount == ncpu)  this->finishValue();
+}
+
+
 string PairQuantity::getParallelData() const
 {
     ostringstream storage(ios::binary);
@@ -115,6 +218,56 @@ string PairQuantity::getParallelData() const
 }
 
 
+void PairQuantity::exportSharedParallelData(const string& shmname) const
+{
+    SharedParallelData::writeValue(shmname, this->value());
+}
+
+
+vector<QuantityType>
+PairQuantity::evalBatch(const vector<StructureAdapterPtr>& frames)
+{
+    vector<QuantityType> rv(frames.size());
+    vector<PairQuantity*> workers =
+        mevaluator->batchWorkers(*this, frames.size());
+    auto storeframe = [&rv](int t, int i, const PairQuantity& pq) {
+        rv[i] = pq.batchValue();
+    };
+    this->runBatch(workers, frames, storeframe);
+    return rv;
+}
+
+
+const QuantityType&
+PairQuantity::evalBatchMean(const vector<StructureAdapterPtr>& frames)
+{
+    vector<PairQuantity*> workers =
+        mevaluator->batchWorkers(*this, frames.size());
+    vector<FrameStatistics> stats(workers.size());
+    auto addframe = [&stats](int t, int i, const PairQuantity& pq) {
+        stats[t].add(pq.batchValue());
+    };
+    this->runBatch(workers, frames, addframe);
+    // combine in the thread order for reproducible results
+    for (size_t t = 1; t < stats.size(); ++t)  stats[0].merge(stats[t]);
+    mbatchmean = stats[0].mean();
+    mbatchvariance = stats[0].variance();
+    return mbatchmean;
+}
+
+
+const QuantityType& PairQuantity::getBatchMean() const
+{
+    return mbatchmean;
+}
+
+
+const QuantityType& PairQuantity::getBatchVariance() const
+{
+    return mbatchvariance;
+}
+
+
 void PairQuantity::setRmin(double rmin)
 {
     if (mrmin != rmin)  mticker.click();
@@ -180,6 +333,12 @@ void PairQuantity::setupParallelRun(int cpuindex, int ncpu)
 }
 
 
+void PairQuantity::setNumThreads(int nthreads)
+{
+    mevaluator->setNumThreads(nthreads);
+}
+
+
 void PairQuantity::maskAllPairs(bool mask)
 {
     bool nochange = minvertpairmask.empty() && msiteallmask.empty() &&
@@ -221,8 +380,12 @@ void PairQuantity::setPairMask(int i, int j, bool mask)
     }
     bool modified = false;
     // update ticker if we are switching from type-mask mode
+    // and start from the index pairs that were masked by type
     if (!mtypemask.empty())
     {
+        const CompiledPairMask& pmask = this->compiledPairMask();
+        minvertpairmask.clear();
+        pmask.exportTypePairs(minvertpairmask);
         mtypemask.clear();
         modified = true;
     }
@@ -263,23 +426,19 @@ void PairQuantity::setPairMask(int i, int j, bool mask)
 
 bool PairQuantity::getPairMask(int i, int j) const
 {
-    pair<int,int> ij = (i > j) ? make_pair(j, i) : make_pair(i, j);
-    bool rv = minvertpairmask.count(ij) ?
-        !mdefaultpairmask : mdefaultpairmask;
-    return rv;
+    const CompiledPairMask& pmask = this->compiledPairMask();
+    return pmask(i, j);
 }
 
 
 void PairQuantity::
 setTypeMask(string smbli, string smblj, bool mask)
 {
-    static string upcaseall;
-    if (upcaseall.empty())
-    {
-        upcaseall = ALLATOMSSTR;
-        transform(upcaseall.begin(), upcaseall.end(),
-                upcaseall.begin(), ::toupper);
-    }
+    static const string upcaseall = []() {
+        string rv = ALLATOMSSTR;
+        transform(rv.begin(), rv.end(), rv.begin(), ::toupper);
+        return rv;
+    }();
     // accept "ALL" (upper ALLATOMSSTR) for smbli and smblj
     if (upcaseall == smbli)  smbli = ALLATOMSSTR;
     if (upcaseall == smblj)  smblj = ALLATOMSSTR;
@@ -352,6 +511,16 @@ void PairQuantity::resetValue()
 }
 
 
+/// Reset value for a batch frame that has the same number of sites, atom
+/// types and occupancies as the previous one.  Derived classes can keep
+/// their type-dependent caches and update only the data that depend on
+/// positions, displacement parameters or lattice.
+void PairQuantity::resetFrameValue()
+{
+    this->resetValue();
+}
+
+
 void PairQuantity::configureBondGenerator(BaseBondGenerator& bnds) const
 {
     bnds.setRmin(this->getRmin());
@@ -359,6 +528,15 @@ void PairQuantity::configureBondGenerator(BaseBondGenerator& bnds) const
 }
 
 
+/// Prepare batch for the addPairContributions hook.  Return true when
+/// the bonds of every anchor should be passed in one batch rather than
+/// by addPairContribution calls for every bond.
+bool PairQuantity::configureBondBatch(BondBatch& batch) const
+{
+    return false;
+}
+
+
 void PairQuantity::executeParallelMerge(const string& pdata)
 {
     istringstream storage(pdata, ios::binary);
@@ -374,6 +552,40 @@ void PairQuantity::executeParallelMerge(const string& pdata)
 }
 
 
+void PairQuantity::executeSharedMerge(const SharedParallelData& sdata)
+{
+    if (SharedParallelData::ARCHIVE_DATA == sdata.format())
+    {
+        this->executeParallelMerge(sdata.archive());
+        return;
+    }
+    if (sdata.size() != mvalue.size())
+    {
+        throw invalid_argument("Merged data array must have the same size.");
+    }
+    sdata.addTo(mvalue);
+}
+
+
+void PairQuantity::executeThreadedMerge(const PairQuantity& other)
+{
+    const QuantityType& pvalue = other.mvalue;
+    if (pvalue.size() != mvalue.size())
+    {
+        throw invalid_argument("Merged data array must have the same size.");
+    }
+    transform(mvalue.begin(), mvalue.end(), pvalue.begin(),
+            mvalue.begin(), plus<double>());
+}
+
+
+/// Return the per-frame result for evalBatch and evalBatchMean.
+QuantityType PairQuantity::batchValue() const
+{
+    return this->value();
+}
+
+
 int PairQuantity::countSites() const
 {
     int rv = mstructure.get() ? mstructure->countSites() : 0;
@@ -402,6 +614,30 @@ bool PairQuantity::hasTypeMask() const
 }
 
 
+/// Return false if the value is evaluated in finishValue without
+/// the pair contributions, the evaluators then skip the loop over pairs.
+bool PairQuantity::sumsPairContributions() const
+{
+    return true;
+}
+
+
+/// Return true if the value contains data indexed by the structure sites,
+/// which allows fast updates only when the site indices are preserved.
+bool PairQuantity::hasSiteIndexedValue() const
+{
+    return false;
+}
+
+
+/// Pair mask for fast lookup, which is compiled again after mask changes.
+const CompiledPairMask& PairQuantity::compiledPairMask() const
+{
+    if (mcompiledmaskticker != mticker)  this->compileMask();
+    return mcompiledmask;
+}
+
+
 void PairQuantity::stashPartialValue()
 {
     const char* emsg =
@@ -434,43 +670,59 @@ void PairQuantity::updateMaskData()
             }
         }
     }
-    // For type masking propagate atom types to corresponding atom indices.
-    else
+    this->compileMask();
+}
+
+
+void PairQuantity::compileMask() const
+{
+    int cntsites = this->countSites();
+    mcompiledmaskticker.updateFrom(mticker);
+    if (mtypemask.empty())
     {
-        // build a list of indices per each unique atom type
-        unordered_map< string, list<int> >  siteindices;
-        for (int i = 0; i < cntsites; ++i)
-        {
-            const string& smbl = mstructure->siteAtomType(i);
-            siteindices[smbl].push_back(i);
-            siteindices[ALLATOMSSTR].push_back(i);
-        }
-        // rebuild minvertpairmask according to mtypemask
-        minvertpairmask.clear();
-        TypeMaskStorage::const_iterator tpmsk;
-        // build a list of type masks with all-masks at the begining
-        list< pair<string,string> > orderedpairs;
-        for (tpmsk = mtypemask.begin(); tpmsk != mtypemask.end(); ++tpmsk)
-        {
-            bool hasall = (ALLATOMSSTR == tpmsk->first.first ||
-                    ALLATOMSSTR == tpmsk->first.second);
-            if (hasall)  orderedpairs.push_front(tpmsk->first);
-            else  orderedpairs.push_back(tpmsk->first);
-        }
-        list< pair<string,string> >::const_iterator tpp;
-        for (tpp = orderedpairs.begin(); tpp != orderedpairs.end(); ++tpp)
+        mcompiledmask.compilePairs(
+                mdefaultpairmask, cntsites, minvertpairmask);
+        return;
+    }
+    // For type masking assign integer index to each unique atom type.
+    unordered_map<string, int> typeindices;
+    vector<int> sitetypes(cntsites);
+    for (int i = 0; i < cntsites; ++i)
+    {
+        const string& smbl = mstructure->siteAtomType(i);
+        auto tpidx = typeindices.emplace(smbl, int(typeindices.size()));
+        sitetypes[i] = tpidx.first->second;
+    }
+    const int ntypes = typeindices.size();
+    mcompiledmask.resetTypes(mdefaultpairmask, sitetypes);
+    TypeMaskStorage::const_iterator tpmsk;
+    // build a list of type masks with all-masks at the begining
+    list< pair<string,string> > orderedpairs;
+    for (tpmsk = mtypemask.begin(); tpmsk != mtypemask.end(); ++tpmsk)
+    {
+        bool hasall = (ALLATOMSSTR == tpmsk->first.first ||
+                ALLATOMSSTR == tpmsk->first.second);
+        if (hasall)  orderedpairs.push_front(tpmsk->first);
+        else  orderedpairs.push_back(tpmsk->first);
+    }
+    // expand "all" to the indices of all types present in the structure
+    auto typerange = [&](const string& smbl) {
+        if (ALLATOMSSTR == smbl)  return make_pair(0, ntypes);
+        auto tt = typeindices.find(smbl);
+        if (tt == typeindices.end())  return make_pair(0, 0);
+        return make_pair(tt->second, tt->second + 1);
+    };
+    list< pair<string,string> >::const_iterator tpp;
+    for (tpp = orderedpairs.begin(); tpp != orderedpairs.end(); ++tpp)
+    {
+        bool msk = mtypemask.at(*tpp);
+        pair<int, int> irange = typerange(tpp->first);
+        pair<int, int> jrange = typerange(tpp->second);
+        for (int ti = irange.first; ti < irange.second; ++ti)
         {
-            const list<int>& isites = siteindices[tpp->first];
-            const list<int>& jsites = siteindices[tpp->second];
-            bool msk = mtypemask.at(*tpp);
-            list<int>::const_iterator ii, jj;
-            for (ii = isites.begin(); ii != isites.end(); ++ii)
+            for (int tj = jrange.first; tj < jrange.second; ++tj)
             {
-                jj = (&isites == &jsites) ? ii : jsites.begin();
-                for (; jj != jsites.end(); ++jj)
-                {
-                    this->setPairMaskValue(*ii, *jj, msk);
-                }
+                mcompiledmask.setTypePairMask(ti, tj, msk);
             }
         }
     }
@@ -488,6 +740,63 @@ bool PairQuantity::setPairMaskValue(int i, int j, bool mask)
     return rv;
 }
 
+
+/// Return true if stru has the same number of sites, atom types and
+/// occupancies as the current structure.
+bool PairQuantity::hasSameSiteTypes(const StructureAdapter& stru) const
+{
+    const int cntsites = this->countSites();
+    if (stru.countSites() != cntsites)  return false;
+    for (int i = 0; i < cntsites; ++i)
+    {
+        bool samesite =
+            (stru.siteAtomType(i) == mstructure->siteAtomType(i)) &&
+            (stru.siteOccupancy(i) == mstructure->siteOccupancy(i));
+        if (!samesite)  return false;
+    }
+    return true;
+}
+
+
+/// Evaluate frames in contiguous ranges, one range per each worker
+/// PairQuantity and thread.  Call sink with the thread and frame index
+/// after each frame evaluation.  Workers reuse their type-dependent
+/// caches for consecutive frames with the same atom types.
+void PairQuantity::runBatch(const vector<PairQuantity*>& workers,
+        const vector<StructureAdapterPtr>& frames, const BatchFrameSink& sink)
+{
+    const int nthreads = workers.size();
+    const int nframes = frames.size();
+    vector<exception_ptr> errors(nthreads);
+    auto runthread = [&](int t) {
+        try
+        {
+            const int ilo = t * nframes / nthreads;
+            const int ihi = (t + 1) * nframes / nthreads;
+            for (int i = ilo; i < ihi; ++i)
+            {
+                // the first frame rebuilds all structure caches
+                workers[t]->mbatchframe = (i > ilo);
+                workers[t]->eval(frames[i]);
+                sink(t, i, *workers[t]);
+            }
+        }
+        catch (...)
+        {
+            errors[t] = current_exception();
+        }
+        workers[t]->mbatchframe = false;
+    };
+    vector<thread> threads;
+    for (int t = 1; t < nthreads; ++t)  threads.emplace_back(runthread, t);
+    if (nthreads)  runthread(0);
+    for (thread& th : threads)  th.join();
+    for (const exception_ptr& e : errors)
+    {
+        if (e)  rethrow_exception(e);
+    }
+}
+
 // Other functions -----------------------------------------------------------
 
 /// The purpose of this function is to support Python pickling of
@@ -14,6 +14,13 @@
 *
 * class PairQuantity -- general implementation of pair quantity calculator
 *
+* Separate PairQuantity instances can be evaluated concurrently from
+* several threads, even when they share the same StructureAdapter object,
+* provided the structure is not modified during the evaluation.
+* A single PairQuantity instance must not be used by several threads at
+* once.  Custom classes should be registered with HasClassRegistry before
+* the threads are started.
+*
 *****************************************************************************/
 
 #ifndef PAIRQUANTITY_HPP_INCLUDED
@@ -25,8 +32,10 @@
 #include <boost/serialization/unordered_set.hpp>
 #include <boost/serialization/unordered_map.hpp>
 #include <boost/functional/hash.hpp>
+#include <functional>
 
 #include <diffpy/srreal/PQEvaluator.hpp>
+#include <diffpy/srreal/CompiledPairMask.hpp>
 #include <diffpy/srreal/StructureAdapter.hpp>
 #include <diffpy/srreal/QuantityType.hpp>
 #include <diffpy/Attributes.hpp>
@@ -36,6 +45,8 @@ namespace diffpy {
 namespace srreal {
 
 class BaseBondGenerator;
+class BondBatch;
+class SharedParallelData;
 
 class PairQuantity : public diffpy::Attributes
 {
@@ -56,6 +67,20 @@ class PairQuantity : public diffpy::Attributes
         const QuantityType& value() const;
         void mergeParallelData(const std::string& pdata, int ncpu);
         virtual std::string getParallelData() const;
+        void mergeSharedParallelData(const std::string& shmname, int ncpu);
+        virtual void exportSharedParallelData(const std::string& shmname) const;
+
+        // multi-frame evaluation
+        template <class Iter>
+            std::vector<QuantityType> evalBatch(Iter first, Iter last);
+        std::vector<QuantityType>
+            evalBatch(const std::vector<StructureAdapterPtr>& frames);
+        template <class Iter>
+            const QuantityType& evalBatchMean(Iter first, Iter last);
+        const QuantityType&
+            evalBatchMean(const std::vector<StructureAdapterPtr>& frames);
+        const QuantityType& getBatchMean() const;
+        const QuantityType& getBatchVariance() const;
 
         // configuration
         template <class T> void setStructure(const T&);
@@ -70,6 +95,7 @@ class PairQuantity : public diffpy::Attributes
         PQEvaluatorType getEvaluatorType() const;
         PQEvaluatorType getEvaluatorTypeUsed() const;
         void setupParallelRun(int cpuindex, int ncpu);
+        void setNumThreads(int nthreads);
         void maskAllPairs(bool mask);
         void invertMask();
         void setPairMask(int i, int j, bool mask);
@@ -84,29 +110,37 @@ class PairQuantity : public diffpy::Attributes
 
         friend class PQEvaluatorBasic;
         friend class PQEvaluatorOptimized;
+        friend class PQEvaluatorCheck;
+        friend class PQEvaluatorThreaded;
         friend StructureAdapterPtr
             replacePairQuantityStructure(PairQuantity&, StructureAdapterPtr);
 
         // methods
         virtual void resizeValue(size_t);
         virtual void resetValue();
+        virtual void resetFrameValue();
         virtual void configureBondGenerator(BaseBondGenerator&) const;
         virtual void addPairContribution(const BaseBondGenerator&, int) { }
+        virtual bool configureBondBatch(BondBatch&) const;
+        virtual void addPairContributions(const BondBatch&) { }
+        virtual bool sumsPairContributions() const;
         virtual void executeParallelMerge(const std::string& pdata);
+        virtual void executeSharedMerge(const SharedParallelData& sdata);
+        virtual void executeThreadedMerge(const PairQuantity& other);
         virtual void finishValue() { }
+        virtual QuantityType batchValue() const;
         int countSites() const;
         // support methods for PQEvaluatorOptimized
         bool hasMask() const;
         bool hasPairMask() const;
         bool hasTypeMask() const;
+        virtual bool hasSiteIndexedValue() const;
+        const CompiledPairMask& compiledPairMask() const;
         virtual void stashPartialValue();
         virtual void restorePartialValue();
 
         // data
-        typedef std::unordered_set<
-            std::pair<int,int>,
-            boost::hash< std::pair<int,int> >
-                > PairMaskStorage;
+        typedef CompiledPairMask::PairIndexSet PairMaskStorage;
         typedef std::unordered_map<
             std::pair<std::string,std::string>, bool,
             boost::hash< std::pair<std::string,std::string> >
@@ -125,9 +159,25 @@ class PairQuantity : public diffpy::Attributes
 
     private:
 
+        // types
+        typedef std::function<void(int, int, const PairQuantity&)>
+            BatchFrameSink;
+
+        // data
+        QuantityType mbatchmean;
+        QuantityType mbatchvariance;
+        bool mbatchframe;
+        mutable CompiledPairMask mcompiledmask;
+        mutable eventticker::EventTicker mcompiledmaskticker;
+
         // methods
         void updateMaskData();
+        void compileMask() const;
         bool setPairMaskValue(int i, int j, bool mask);
+        bool hasSameSiteTypes(const StructureAdapter& stru) const;
+        void runBatch(const std::vector<PairQuantity*>& workers,
+                const std::vector<StructureAdapterPtr>& frames,
+                const BatchFrameSink& sink);
 
         // serialization
         friend class boost::serialization::access;
@@ -145,6 +195,7 @@ class PairQuantity : public diffpy::Attributes
             ar & mtypemask;
             ar & mmergedvaluescount;
             ar & mticker;
+            if (Archive::is_loading::value)  this->compileMask();
         }
 
 };
@@ -166,6 +217,30 @@ void PairQuantity::setStructure(const T& stru)
     this->setStructure(pstru);
 }
 
+
+template <class Iter>
+std::vector<QuantityType> PairQuantity::evalBatch(Iter first, Iter last)
+{
+    std::vector<StructureAdapterPtr> frames;
+    for (; first != last; ++first)
+    {
+        frames.push_back(convertToStructureAdapter(*first));
+    }
+    return this->evalBatch(frames);
+}
+
+
+template <class Iter>
+const QuantityType& PairQuantity::evalBatchMean(Iter first, Iter last)
+{
+    std::vector<StructureAdapterPtr> frames;
+    for (; first != last; ++first)
+    {
+        frames.push_back(convertToStructureAdapter(*first));
+    }
+    return this->evalBatchMean(frames);
+}
+
 // Other functions -----------------------------------------------------------
 
 /// The purpose of this function is to support Python pickling of
@@ -16,6 +16,8 @@
 *
 *****************************************************************************/
 
+#include <algorithm>
+
 #include <diffpy/srreal/PeakProfile.hpp>
 #include <diffpy/HasClassRegistry.ipp>
 #include <diffpy/serialization.ipp>
@@ -48,6 +50,37 @@ void PeakProfile::setPrecision(double eps)
 }
 
 
+/// Evaluate profile at x0 + k * dx for k in [0, n) and store it in y.
+void PeakProfile::evaluateGrid(double x0, double dx, int n,
+        double fwhm, double* y) const
+{
+    for (int k = 0; k < n; ++k)  y[k] = (*this)(x0 + k * dx, fwhm);
+}
+
+
+/// Evaluate derivatives of the profile with respect to x and fwhm at
+/// x0 + k * dx for k in [0, n) using central differences.
+void PeakProfile::evaluateGridDerivatives(double x0, double dx, int n,
+        double fwhm, double* dydx, double* dydfwhm) const
+{
+    // step size that balances truncation and roundoff errors
+    const double h = 6e-6 * fwhm;
+    if (!(h > 0.0))
+    {
+        std::fill(dydx, dydx + n, 0.0);
+        std::fill(dydfwhm, dydfwhm + n, 0.0);
+        return;
+    }
+    const PeakProfile& f = *this;
+    for (int k = 0; k < n; ++k)
+    {
+        const double x = x0 + k * dx;
+        dydx[k] = (f(x + h, fwhm) - f(x - h, fwhm)) / (2 * h);
+        dydfwhm[k] = (f(x, fwhm + h) - f(x, fwhm - h)) / (2 * h);
+    }
+}
+
+
 const double& PeakProfile::getPrecision() const
 {
     return mprecision;
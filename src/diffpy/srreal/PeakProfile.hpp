@@ -17,7 +17,11 @@
 *     The operator()(x, fwhm) returns amplitude of a zero-centered profile.
 *     Methods xboundlo(fwhm), xboundhi(fwhm) return low and high x-boundaries,
 *     where amplitude relative to the maximum becomes smaller than precision
-*     set by setPrecision().
+*     set by setPrecision().  The evaluateGrid method fills profile values
+*     at equidistant points and may be overloaded with a faster algorithm.
+*     The evaluateGridDerivatives method returns derivatives with respect
+*     to x and fwhm at the same points, by default from central
+*     differences.
 *
 *****************************************************************************/
 
@@ -48,6 +52,10 @@ class PeakProfile :
         virtual double operator()(double x, double fwhm) const = 0;
         virtual double xboundlo(double fwhm) const = 0;
         virtual double xboundhi(double fwhm) const = 0;
+        virtual void evaluateGrid(double x0, double dx, int n,
+                double fwhm, double* y) const;
+        virtual void evaluateGridDerivatives(double x0, double dx, int n,
+                double fwhm, double* dydx, double* dydfwhm) const;
         virtual void setPrecision(double eps);
         const double& getPrecision() const;
         virtual eventticker::EventTicker& ticker() const  { return mticker; }
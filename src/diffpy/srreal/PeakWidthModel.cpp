@@ -16,6 +16,8 @@
 *
 *****************************************************************************/
 
+#include <stdexcept>
+
 #include <diffpy/srreal/PeakWidthModel.hpp>
 #include <diffpy/HasClassRegistry.ipp>
 #include <diffpy/validators.hpp>
@@ -31,6 +33,35 @@ template class HasClassRegistry<srreal::PeakWidthModel>;
 
 namespace srreal {
 
+// class PeakWidthModel ------------------------------------------------------
+
+/// Prepare batch for calculateBatch.  Return false when the model needs
+/// the bond generator and the widths must be obtained from calculate.
+bool PeakWidthModel::configureBondBatch(BondBatch& batch) const
+{
+    return false;
+}
+
+
+void PeakWidthModel::calculateBatch(
+        const BondBatch& batch, std::vector<double>& fwhm) const
+{
+    const char* emsg =
+        "calculateBatch() is not defined in the peak width model.";
+    throw std::logic_error(emsg);
+}
+
+
+/// Evaluate derivatives of the calculate result with respect to the bond
+/// distance and to the mean square displacement along the bond.
+void PeakWidthModel::calculateDerivatives(const BaseBondGenerator& bnds,
+        double& dfwhmdr, double& dfwhmdmsd) const
+{
+    const char* emsg =
+        "calculateDerivatives() is not defined in the peak width model.";
+    throw std::logic_error(emsg);
+}
+
 // class PeakWidthModelOwner -------------------------------------------------
 
 void PeakWidthModelOwner::setPeakWidthModel(PeakWidthModelPtr pwm)
@@ -16,6 +16,11 @@
 *     The calculate function takes a BondGenerator instance and
 *     returns full width at half maximum, based on peak model parameters
 *     and anisotropic displacement parameters of atoms in the pair.
+*     Models that support calculateBatch evaluate the widths for all
+*     bonds in a BondBatch at once.  Models that support
+*     calculateDerivatives return the partial derivatives of the width
+*     with respect to the bond distance and to the mean square
+*     displacement along the bond, which are used for gradients.
 *
 * class PeakWidthModelOwner -- to be used as a base class for classes
 *     that own PeakWidthModel
@@ -34,6 +39,7 @@
 #include <diffpy/HasClassRegistry.hpp>
 #include <diffpy/EventTicker.hpp>
 #include <diffpy/srreal/BaseBondGenerator.hpp>
+#include <diffpy/srreal/BondBatch.hpp>
 
 namespace diffpy {
 namespace srreal {
@@ -46,6 +52,11 @@ class PeakWidthModel :
 
         // methods
         virtual double calculate(const BaseBondGenerator&) const = 0;
+        virtual bool configureBondBatch(BondBatch&) const;
+        virtual void calculateBatch(const BondBatch&,
+                std::vector<double>& fwhm) const;
+        virtual void calculateDerivatives(const BaseBondGenerator&,
+                double& dfwhmdr, double& dfwhmdmsd) const;
         virtual double maxWidth(StructureAdapterPtr,
                 double rmin, double rmax) const = 0;
         virtual eventticker::EventTicker& ticker() const  { return mticker; }
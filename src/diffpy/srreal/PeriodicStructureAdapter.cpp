@@ -20,6 +20,9 @@
 *****************************************************************************/
 
 #include <cassert>
+#include <cmath>
+#include <algorithm>
+#include <numeric>
 
 #include <diffpy/serialization.ipp>
 #include <diffpy/srreal/PointsInSphere.hpp>
@@ -75,6 +78,12 @@ PeriodicStructureAdapter::diff(StructureAdapterConstPtr other) const
 }
 
 
+void PeriodicStructureAdapter::updateSnapshot(StructureAdapterPtr& snap) const
+{
+    this->assignSnapshot<PeriodicStructureAdapter>(snap);
+}
+
+
 void PeriodicStructureAdapter::setLatPar(
         double a, double b, double c,
         double alphadeg, double betadeg, double gammadeg)
@@ -130,11 +139,41 @@ bool operator!=(
 // class PeriodicStructureBondGenerator
 //////////////////////////////////////////////////////////////////////////////
 
+// Local Helpers -------------------------------------------------------------
+
+namespace {
+
+/// smaller unit cells are faster to scan over the sphere points
+const int CELLGRID_MIN_SITES = 256;
+/// upper limit for the number of sub-cells per site
+const double CELLGRID_MAX_CELLS_PER_SITE = 2.0;
+/// use sub-cells only if they visit at most this fraction of the images
+/// of sites that would be visited for the sphere points
+const double CELLGRID_MAX_COVERAGE = 0.5;
+/// relative increase of sub-cell width over rmax to absorb round-off
+const double CELLGRID_WIDTH_MARGIN = 1e-6;
+
+/// index of a translation by -1, 0 or 1 cells along every axis
+int imageSlot(const int* mno)
+{
+    return (mno[0] + 1) * 9 + (mno[1] + 1) * 3 + (mno[2] + 1);
+}
+
+}   // namespace
+
 // Constructor ---------------------------------------------------------------
 
 PeriodicStructureBondGenerator::PeriodicStructureBondGenerator(
-        StructureAdapterConstPtr adpt) : BaseBondGenerator(adpt)
+        StructureAdapterConstPtr adpt) : BaseBondGenerator(adpt),
+    mgridready(false),
+    mgridused(false),
+    mcntsphere(0),
+    mneighborsready(false),
+    mcellmode(false),
+    mlistmode(false)
 {
+    fill(mgridshape, mgridshape + 3, 0);
+    fill(mimageranks, mimageranks + 27, -1);
     mpstructure = dynamic_cast<const PeriodicStructureAdapter*>(adpt.get());
     assert(mpstructure);
     int cntsites = mpstructure->countSites();
@@ -162,6 +201,22 @@ void PeriodicStructureBondGenerator::rewind()
         double rsphmin = this->getRmin() - buffzone;
         double rsphmax = this->getRmax() + buffzone;
         msphere.reset(new PointsInSphere(rsphmin, rsphmax, L));
+        this->updateImageRanks();
+        mgridready = false;
+    }
+    const bool hassites = (msite_first < msite_last);
+    mlistmode = hassites &&
+        this->useNeighborList() && this->rankSelectedSites();
+    mcellmode = hassites && !mlistmode &&
+        this->useCellGrid() && this->rankSelectedSites();
+    if (mcellmode || mlistmode)
+    {
+        this->collectCandidates();
+        mcandidate = mcandidates.begin();
+        this->setCandidateBond();
+        if (this->finished())   return;
+        this->advanceWhileInvalid();
+        return;
     }
     // BaseBondGenerator::rewind calls this->rewindSymmetry,
     // which takes care of msphere configuration
@@ -187,10 +242,26 @@ void PeriodicStructureBondGenerator::setRmin(double rmin)
 void PeriodicStructureBondGenerator::setRmax(double rmax)
 {
     // destroy msphere so it will be created on rewind with new rmax
-    if (this->getRmax() != rmax)    msphere.reset();
+    if (this->getRmax() != rmax)
+    {
+        msphere.reset();
+        mneighborsready = false;
+    }
     this->BaseBondGenerator::setRmax(rmax);
 }
 
+
+bool PeriodicStructureBondGenerator::usesCellGrid() const
+{
+    return mcellmode;
+}
+
+
+bool PeriodicStructureBondGenerator::usesNeighborList() const
+{
+    return mlistmode;
+}
+
 // Protected Methods ---------------------------------------------------------
 
 bool PeriodicStructureBondGenerator::iterateSymmetry()
@@ -214,6 +285,12 @@ void PeriodicStructureBondGenerator::rewindSymmetry()
 
 void PeriodicStructureBondGenerator::getNextBond()
 {
+    if (mcellmode || mlistmode)
+    {
+        ++mcandidate;
+        this->setCandidateBond();
+        return;
+    }
     ++msite_current;
     // go back to the first site if there is next symmetry element
     if (msite_current >= msite_last && this->iterateSymmetry())
@@ -224,7 +301,6 @@ void PeriodicStructureBondGenerator::getNextBond()
     if (!this->finished())  this->updater1();
 }
 
-// Private Methods -----------------------------------------------------------
 
 void PeriodicStructureBondGenerator::updater1()
 {
@@ -232,6 +308,250 @@ void PeriodicStructureBondGenerator::updater1()
     this->updateDistance();
 }
 
+
+bool PeriodicStructureBondGenerator::allowsCellGrid() const
+{
+    return true;
+}
+
+// Private Methods -----------------------------------------------------------
+
+void PeriodicStructureBondGenerator::updateImageRanks()
+{
+    // nearest images of the unit cell in the order of the sphere points
+    const Lattice& L = mpstructure->getLattice();
+    fill(mimageranks, mimageranks + 27, -1);
+    mimages.clear();
+    mcntsphere = 0;
+    for (msphere->rewind(); !msphere->finished(); msphere->next())
+    {
+        ++mcntsphere;
+        const int* mno = msphere->mno();
+        bool isnearest = (abs(mno[0]) <= 1 && abs(mno[1]) <= 1 &&
+                abs(mno[2]) <= 1);
+        if (!isnearest)  continue;
+        mimageranks[imageSlot(mno)] = mimages.size();
+        mimages.push_back(L.cartesian(R3::Vector(mno[0], mno[1], mno[2])));
+    }
+}
+
+
+bool PeriodicStructureBondGenerator::useCellGrid()
+{
+    if (!mgridready)
+    {
+        const int cntsites = mcartesian_positions_uc.size();
+        const double& rmax = this->getRmax();
+        mgridused = this->allowsCellGrid() &&
+            (cntsites >= CELLGRID_MIN_SITES) && this->binSites(rmax);
+        // sub-cells do not pay off when they cover most of the images
+        if (mgridused)
+        {
+            double ncells = mcellstart.size() - 1;
+            double nvisited = 27.0 * cntsites / ncells;
+            mgridused =
+                (nvisited <= CELLGRID_MAX_COVERAGE * mcntsphere * cntsites);
+        }
+        mgridready = true;
+    }
+    return mgridused;
+}
+
+
+bool PeriodicStructureBondGenerator::binSites(double rcell)
+{
+    mcellstart.clear();
+    mcellsites.clear();
+    msitecells.clear();
+    const int cntsites = mcartesian_positions_uc.size();
+    if (!cntsites || !(rcell > 0.0 && isfinite(rcell)))  return false;
+    // sub-cells must be at least rcell wide along every cell axis
+    const Lattice& L = mpstructure->getLattice();
+    const double rwidth = rcell * (1.0 + CELLGRID_WIDTH_MARGIN);
+    const double rlengths[R3::Ndim] = {L.ar(), L.br(), L.cr()};
+    double shape[R3::Ndim];
+    double ncells = 1.0;
+    for (int k = 0; k < R3::Ndim; ++k)
+    {
+        shape[k] = floor(1.0 / (rwidth * rlengths[k]));
+        if (!(shape[k] >= 1.0))  return false;
+        ncells *= shape[k];
+    }
+    const double maxcells = CELLGRID_MAX_CELLS_PER_SITE * cntsites;
+    while (ncells > maxcells)
+    {
+        double f = max(1.01, cbrt(ncells / maxcells));
+        ncells = 1.0;
+        for (int k = 0; k < R3::Ndim; ++k)
+        {
+            shape[k] = max(1.0, floor(shape[k] / f));
+            ncells *= shape[k];
+        }
+    }
+    for (int k = 0; k < R3::Ndim; ++k)  mgridshape[k] = int(shape[k]);
+    // sort site indices by sub-cells, keep ascending indices in each
+    msitecells.resize(cntsites);
+    mcellstart.assign(int(ncells) + 1, 0);
+    for (int i = 0; i < cntsites; ++i)
+    {
+        R3::Vector xyz = L.fractional(mcartesian_positions_uc[i]);
+        int ijk[R3::Ndim];
+        for (int k = 0; k < R3::Ndim; ++k)
+        {
+            double ck = floor(xyz[k] * mgridshape[k]);
+            ck = min(max(ck, 0.0), mgridshape[k] - 1.0);
+            ijk[k] = int(ck);
+        }
+        int c = (ijk[0] * mgridshape[1] + ijk[1]) * mgridshape[2] + ijk[2];
+        msitecells[i] = c;
+        ++mcellstart[c + 1];
+    }
+    partial_sum(mcellstart.begin(), mcellstart.end(), mcellstart.begin());
+    vector<int> cellfill(mcellstart.begin(), mcellstart.end() - 1);
+    mcellsites.resize(cntsites);
+    for (int i = 0; i < cntsites; ++i)
+    {
+        mcellsites[cellfill[msitecells[i]]++] = i;
+    }
+    return true;
+}
+
+
+/// call f(site, slot) for sites in the 27 sub-cells around the anchor
+/// sub-cell, where slot is the image index of the wrapped sub-cell
+template <class F>
+void PeriodicStructureBondGenerator::visitAdjacentSites(int anchor, F f) const
+{
+    const int* shape = mgridshape;
+    const int c0 = msitecells[anchor];
+    const int ijk0[R3::Ndim] = {
+        c0 / (shape[1] * shape[2]), c0 / shape[2] % shape[1], c0 % shape[2]};
+    int ijk[R3::Ndim];
+    int mno[R3::Ndim];
+    for (int di = -1; di <= 1; ++di)
+    for (int dj = -1; dj <= 1; ++dj)
+    for (int dk = -1; dk <= 1; ++dk)
+    {
+        const int dijk[R3::Ndim] = {di, dj, dk};
+        for (int k = 0; k < R3::Ndim; ++k)
+        {
+            // wrap the sub-cell to the unit cell
+            int ck = ijk0[k] + dijk[k];
+            mno[k] = (ck < 0) ? -1 : (ck < shape[k]) ? 0 : 1;
+            ijk[k] = ck - mno[k] * shape[k];
+        }
+        const int slot = imageSlot(mno);
+        const int c = (ijk[0] * shape[1] + ijk[1]) * shape[2] + ijk[2];
+        vector<int>::const_iterator ii = mcellsites.begin();
+        vector<int>::const_iterator ii0 = ii + mcellstart[c];
+        vector<int>::const_iterator ii1 = ii + mcellstart[c + 1];
+        for (ii = ii0; ii != ii1; ++ii)  f(*ii, slot);
+    }
+}
+
+
+bool PeriodicStructureBondGenerator::useNeighborList()
+{
+    if (!mneighborsready)
+    {
+        mneighbors = this->fetchNeighborList();
+        mneighborsready = true;
+    }
+    return bool(mneighbors);
+}
+
+
+NeighborListCache::NeighborListPtr
+PeriodicStructureBondGenerator::fetchNeighborList()
+{
+    NeighborListCache::NeighborListPtr rv;
+    NeighborListCache* cache = mpstructure->neighborListCache();
+    const double& rmax = this->getRmax();
+    if (!cache || !this->allowsCellGrid())  return rv;
+    if (!(rmax > 0.0 && isfinite(rmax)))  return rv;
+    const vector<R3::Vector>& positions = mcartesian_positions_uc;
+    rv = cache->lookup(*mpstructure, rmax, positions);
+    if (rv)  return rv;
+    // build new neighbor list for rmax plus skin.  This is possible
+    // only for cutoff within cell widths when the nearest images suffice.
+    const double cutoff = rmax + cache->getSkin();
+    const bool binned = this->binSites(cutoff);
+    // the sub-cells for rmax need to be built again
+    mgridready = false;
+    if (!binned)  return rv;
+    boost::shared_ptr<NeighborListCache::NeighborList> nl(
+            new NeighborListCache::NeighborList);
+    const Lattice& L = mpstructure->getLattice();
+    R3::Vector translations[27];
+    for (int i = 0; i < 27; ++i)
+    {
+        translations[i] = L.cartesian(
+                R3::Vector(i / 9 - 1, i / 3 % 3 - 1, i % 3 - 1));
+    }
+    nl->cutoff = cutoff;
+    nl->positions = positions;
+    const int cntsites = positions.size();
+    nl->offsets.reserve(cntsites + 1);
+    nl->offsets.push_back(0);
+    for (int i = 0; i < cntsites; ++i)
+    {
+        const R3::Vector& xyz0 = positions[i];
+        auto addneighbor = [&](int j, int slot) {
+            if (j == i && slot == NeighborListCache::ZERO_IMAGE)  return;
+            R3::Vector xyz1 = positions[j] + translations[slot];
+            if (R3::distance(xyz1, xyz0) > cutoff)  return;
+            nl->sites.push_back(j);
+            nl->images.push_back(slot);
+        };
+        this->visitAdjacentSites(i, addneighbor);
+        nl->offsets.push_back(nl->sites.size());
+    }
+    cache->store(*mpstructure, nl);
+    rv = nl;
+    return rv;
+}
+
+
+void PeriodicStructureBondGenerator::collectCandidates()
+{
+    mcandidates.clear();
+    auto addcandidate = [this](int site, int slot) {
+        const int rank = mimageranks[slot];
+        if (rank < 0)  return;
+        int offset = this->selectedSiteOffset(site);
+        if (offset >= 0)  mcandidates.push_back(make_pair(rank, offset));
+    };
+    if (mlistmode)
+    {
+        const int i0 = this->site0();
+        const int first = mneighbors->offsets[i0];
+        const int last = mneighbors->offsets[i0 + 1];
+        for (int k = first; k < last; ++k)
+        {
+            addcandidate(mneighbors->sites[k], mneighbors->images[k]);
+        }
+    }
+    else
+    {
+        this->visitAdjacentSites(this->site0(), addcandidate);
+    }
+    // generate bonds in the same order as for the sphere points
+    sort(mcandidates.begin(), mcandidates.end());
+}
+
+
+void PeriodicStructureBondGenerator::setCandidateBond()
+{
+    if (mcandidate == mcandidates.end())
+    {
+        msite_current = msite_last;
+        return;
+    }
+    mrcsphere = mimages[mcandidate->first];
+    msite_current = msite_first + mcandidate->second;
+    this->updater1();
+}
+
 }   // namespace srreal
 }   // namespace diffpy
 
@@ -17,6 +17,12 @@
 *
 * class PeriodicStructureBondGenerator -- bond generator
 *
+* For large unit cells and rmax shorter than the cell widths the bond
+* generator bins the unit cell sites into sub-cells of at least rmax and
+* visits only the adjacent sub-cells and their nearest periodic images.
+* The bonds are generated in the same order as from the lattice points
+* in the sphere, which remains in use for small cells and long rmax.
+*
 *****************************************************************************/
 
 #ifndef PERIODICSTRUCTUREADAPTER_HPP_INCLUDED
@@ -24,6 +30,7 @@
 
 #include <diffpy/srreal/AtomicStructureAdapter.hpp>
 #include <diffpy/srreal/Lattice.hpp>
+#include <diffpy/srreal/NeighborListCache.hpp>
 
 namespace diffpy {
 namespace srreal {
@@ -39,6 +46,7 @@ class PeriodicStructureAdapter : public AtomicStructureAdapter
         virtual BaseBondGeneratorPtr createBondGenerator() const;
         virtual double numberDensity() const;
         virtual StructureDifference diff(StructureAdapterConstPtr other) const;
+        virtual void updateSnapshot(StructureAdapterPtr& snap) const;
 
         // methods - own
         void setLatPar(
@@ -88,6 +96,11 @@ class PeriodicStructureBondGenerator : public BaseBondGenerator
         virtual void setRmin(double);
         virtual void setRmax(double);
 
+        /// return true if the last rewind used the sub-cell bins
+        bool usesCellGrid() const;
+        /// return true if the last rewind used the cached neighbor list
+        bool usesNeighborList() const;
+
     protected:
 
         // data
@@ -100,11 +113,43 @@ class PeriodicStructureBondGenerator : public BaseBondGenerator
         virtual void rewindSymmetry();
         virtual void getNextBond();
         virtual void updater1();
+        /// return false when sites have other positions than in the cell
+        virtual bool allowsCellGrid() const;
 
     private:
 
         // data
         std::vector<R3::Vector> mcartesian_positions_uc;
+        // sub-cell bins
+        bool mgridready;
+        bool mgridused;
+        int mgridshape[3];
+        std::vector<int> mcellstart;
+        std::vector<int> mcellsites;
+        std::vector<int> msitecells;
+        // rank of nearest cell images in the sphere or -1 if not there
+        int mimageranks[27];
+        std::vector<R3::Vector> mimages;
+        int mcntsphere;
+        // neighbor list
+        bool mneighborsready;
+        NeighborListCache::NeighborListPtr mneighbors;
+        // bond candidates as pairs of image rank and site offset
+        bool mcellmode;
+        bool mlistmode;
+        std::vector< std::pair<int, int> > mcandidates;
+        std::vector< std::pair<int, int> >::const_iterator mcandidate;
+
+        // methods
+        void updateImageRanks();
+        bool useCellGrid();
+        bool binSites(double rcell);
+        template <class F>
+            void visitAdjacentSites(int anchor, F f) const;
+        bool useNeighborList();
+        NeighborListCache::NeighborListPtr fetchNeighborList();
+        void collectCandidates();
+        void setCandidateBond();
 };
 
 }   // namespace srreal
@@ -59,9 +59,9 @@ double determinant(const Matrix& A)
 }
 
 
-const Matrix& inverse(const Matrix& A)
+Matrix inverse(const Matrix& A)
 {
-    static Matrix B;
+    Matrix B;
     gsl_matrix* gA = gsl_matrix_alloc(Ndim, Ndim);
     for (int i = 0; i != Ndim; ++i)
     {
@@ -146,7 +146,7 @@ ScatteringFactorTableOwner::getScatteringFactorTable() const
 
 const string& ScatteringFactorTableOwner::getRadiationType() const
 {
-    static string empty;
+    static const string empty;
     const string& tp = msftable.get() ? msftable->radiationType() : empty;
     return tp;
 }
@@ -0,0 +1,298 @@
+/*****************************************************************************
+*
+* libdiffpy         Complex Modeling Initiative
+*                   (c) 2026 Brookhaven Science Associates,
+*                   Brookhaven National Laboratory.
+*                   All rights reserved.
+*
+* File coded by:    Pavol Juhas
+*
+* See AUTHORS.txt for a list of people who contributed.
+* See LICENSE.txt for license information.
+*
+******************************************************************************
+*
+* class SharedParallelData -- results of a parallel PairQuantity run
+*   exchanged through a named POSIX shared memory object.
+*
+*****************************************************************************/
+
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <diffpy/srreal/SharedParallelData.hpp>
+
+using namespace std;
+
+namespace diffpy {
+namespace srreal {
+
+// Local Helpers -------------------------------------------------------------
+
+namespace {
+
+const char MAGIC[8] = {'D', 'P', 'Y', 'P', 'D', 'A', 'T', '1'};
+
+// zero gaps of up to this length are cheaper to store than a new run
+const size_t MAX_ZERO_GAP = 2;
+
+struct DataHeader
+{
+    char magic[8];
+    uint32_t format;
+    uint32_t reserved;
+    uint64_t size;
+    uint64_t nruns;
+};
+
+struct RunHeader
+{
+    uint64_t offset;
+    uint64_t count;
+};
+
+string shmName(const string& name)
+{
+    if (name.empty())
+    {
+        throw invalid_argument("Shared memory name cannot be empty.");
+    }
+    string rv = (name[0] == '/') ? name : ('/' + name);
+    return rv;
+}
+
+
+void throwSystemError(const string& what, const string& name)
+{
+    string emsg = what + " '" + name + "': " + strerror(errno);
+    throw runtime_error(emsg);
+}
+
+
+/// create shared memory object and fill it with the header and payload
+template <class F>
+void writeSharedData(const string& name, const DataHeader& hdr,
+        size_t payloadsize, F fillpayload)
+{
+    const string nm = shmName(name);
+    const size_t length = sizeof(DataHeader) + payloadsize;
+    int fd = shm_open(nm.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0)  throwSystemError("Cannot create shared memory", nm);
+    void* addr = MAP_FAILED;
+    if (0 == ftruncate(fd, length))
+    {
+        addr = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (addr == MAP_FAILED)
+    {
+        int errnum = errno;
+        close(fd);
+        shm_unlink(nm.c_str());
+        errno = errnum;
+        throwSystemError("Cannot map shared memory", nm);
+    }
+    close(fd);
+    char* pdata = static_cast<char*>(addr);
+    memcpy(pdata, &hdr, sizeof(DataHeader));
+    fillpayload(pdata + sizeof(DataHeader));
+    munmap(addr, length);
+}
+
+
+/// verify the value runs fit in the mapped memory and the array size
+bool isValidValueData(const DataHeader& hdr, const char* pdata, size_t nbytes)
+{
+    const char* pend = pdata + nbytes;
+    for (uint64_t i = 0; i < hdr.nruns; ++i)
+    {
+        if (size_t(pend - pdata) < sizeof(RunHeader))  return false;
+        RunHeader rh;
+        memcpy(&rh, pdata, sizeof(RunHeader));
+        pdata += sizeof(RunHeader);
+        if (rh.offset > hdr.size || rh.count > hdr.size - rh.offset)
+        {
+            return false;
+        }
+        if (size_t(pend - pdata) / sizeof(double) < rh.count)  return false;
+        pdata += rh.count * sizeof(double);
+    }
+    return (pdata == pend);
+}
+
+}   // namespace
+
+//////////////////////////////////////////////////////////////////////////////
+// class SharedParallelData
+//////////////////////////////////////////////////////////////////////////////
+
+// Static Methods ------------------------------------------------------------
+
+void SharedParallelData::writeValue(const string& name,
+        const QuantityType& value, bool sparse)
+{
+    // find runs of values to be stored as [first, last) index pairs
+    vector< pair<size_t, size_t> > runs;
+    const size_t n = value.size();
+    if (!sparse && n)  runs.push_back(make_pair(size_t(0), n));
+    for (size_t i = 0; sparse && i < n; ++i)
+    {
+        if (0.0 == value[i])  continue;
+        if (runs.empty() || i - runs.back().second > MAX_ZERO_GAP)
+        {
+            runs.push_back(make_pair(i, i + 1));
+        }
+        else  runs.back().second = i + 1;
+    }
+    DataHeader hdr;
+    memcpy(hdr.magic, MAGIC, sizeof(MAGIC));
+    hdr.format = VALUE_DATA;
+    hdr.reserved = 0;
+    hdr.size = n;
+    hdr.nruns = runs.size();
+    size_t payloadsize = runs.size() * sizeof(RunHeader);
+    for (const auto& rn : runs)
+    {
+        payloadsize += (rn.second - rn.first) * sizeof(double);
+    }
+    auto fillruns = [&](char* pdata) {
+        for (const auto& rn : runs)
+        {
+            RunHeader rh = {rn.first, rn.second - rn.first};
+            memcpy(pdata, &rh, sizeof(RunHeader));
+            pdata += sizeof(RunHeader);
+            memcpy(pdata, &(value[rn.first]), rh.count * sizeof(double));
+            pdata += rh.count * sizeof(double);
+        }
+    };
+    writeSharedData(name, hdr, payloadsize, fillruns);
+}
+
+
+void SharedParallelData::writeArchive(const string& name, const string& pdata)
+{
+    DataHeader hdr;
+    memcpy(hdr.magic, MAGIC, sizeof(MAGIC));
+    hdr.format = ARCHIVE_DATA;
+    hdr.reserved = 0;
+    hdr.size = pdata.size();
+    hdr.nruns = 0;
+    auto fillarchive = [&](char* p) {
+        memcpy(p, pdata.data(), pdata.size());
+    };
+    writeSharedData(name, hdr, pdata.size(), fillarchive);
+}
+
+
+void SharedParallelData::remove(const string& name)
+{
+    shm_unlink(shmName(name).c_str());
+}
+
+// Constructor ---------------------------------------------------------------
+
+SharedParallelData::SharedParallelData(const string& name) :
+    mdata(NULL), mlength(0)
+{
+    const string nm = shmName(name);
+    int fd = shm_open(nm.c_str(), O_RDONLY, 0);
+    if (fd < 0)  throwSystemError("Cannot open shared memory", nm);
+    // the host owns the data now, remove the name right away
+    shm_unlink(nm.c_str());
+    struct stat st;
+    void* addr = MAP_FAILED;
+    if (0 == fstat(fd, &st) && size_t(st.st_size) >= sizeof(DataHeader))
+    {
+        addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (addr == MAP_FAILED)
+    {
+        throw invalid_argument("Invalid shared memory for parallel data.");
+    }
+    mdata = addr;
+    mlength = st.st_size;
+    const char* pdata = static_cast<const char*>(mdata);
+    DataHeader hdr;
+    memcpy(&hdr, pdata, sizeof(DataHeader));
+    const size_t nbytes = mlength - sizeof(DataHeader);
+    pdata += sizeof(DataHeader);
+    bool isvalid = (0 == memcmp(hdr.magic, MAGIC, sizeof(MAGIC))) && (
+            (hdr.format == ARCHIVE_DATA && hdr.size == nbytes) ||
+            (hdr.format == VALUE_DATA && isValidValueData(hdr, pdata, nbytes))
+            );
+    if (!isvalid)
+    {
+        munmap(mdata, mlength);
+        throw invalid_argument("Invalid shared memory for parallel data.");
+    }
+}
+
+
+SharedParallelData::~SharedParallelData()
+{
+    munmap(mdata, mlength);
+}
+
+// Public Methods ------------------------------------------------------------
+
+SharedParallelData::DataFormat SharedParallelData::format() const
+{
+    const DataHeader* hdr = static_cast<const DataHeader*>(mdata);
+    return DataFormat(hdr->format);
+}
+
+
+size_t SharedParallelData::size() const
+{
+    const DataHeader* hdr = static_cast<const DataHeader*>(mdata);
+    return hdr->size;
+}
+
+
+void SharedParallelData::addTo(QuantityType& value, size_t offset) const
+{
+    if (VALUE_DATA != this->format())
+    {
+        throw logic_error("Shared parallel data does not contain values.");
+    }
+    if (offset > value.size() || this->size() > value.size() - offset)
+    {
+        throw invalid_argument("Merged data array must have the same size.");
+    }
+    const DataHeader* hdr = static_cast<const DataHeader*>(mdata);
+    const char* pdata = static_cast<const char*>(mdata) + sizeof(DataHeader);
+    for (uint64_t i = 0; i < hdr->nruns; ++i)
+    {
+        RunHeader rh;
+        memcpy(&rh, pdata, sizeof(RunHeader));
+        pdata += sizeof(RunHeader);
+        const double* x = reinterpret_cast<const double*>(pdata);
+        QuantityType::iterator vi = value.begin() + offset + rh.offset;
+        for (uint64_t k = 0; k < rh.count; ++k, ++vi)  *vi += x[k];
+        pdata += rh.count * sizeof(double);
+    }
+}
+
+
+string SharedParallelData::archive() const
+{
+    if (ARCHIVE_DATA != this->format())
+    {
+        throw logic_error("Shared parallel data does not contain archive.");
+    }
+    const char* pdata = static_cast<const char*>(mdata) + sizeof(DataHeader);
+    return string(pdata, this->size());
+}
+
+}   // namespace srreal
+}   // namespace diffpy
+
+// End of file
@@ -0,0 +1,78 @@
+/*****************************************************************************
+*
+* libdiffpy         Complex Modeling Initiative
+*                   (c) 2026 Brookhaven Science Associates,
+*                   Brookhaven National Laboratory.
+*                   All rights reserved.
+*
+* File coded by:    Pavol Juhas
+*
+* See AUTHORS.txt for a list of people who contributed.
+* See LICENSE.txt for license information.
+*
+******************************************************************************
+*
+* class SharedParallelData -- results of a parallel PairQuantity run
+*   exchanged through a named POSIX shared memory object.
+*
+* A worker process exports its partial result with the static write
+* methods, the host process maps the shared memory object by its name,
+* merges the data directly from the mapped memory and removes the object.
+* Value arrays are stored as runs of doubles, where runs of zeros
+* are left out when sparse encoding is allowed.
+*
+*****************************************************************************/
+
+#ifndef SHAREDPARALLELDATA_HPP_INCLUDED
+#define SHAREDPARALLELDATA_HPP_INCLUDED
+
+#include <string>
+#include <diffpy/srreal/QuantityType.hpp>
+
+namespace diffpy {
+namespace srreal {
+
+class SharedParallelData
+{
+    public:
+
+        // types
+        enum DataFormat {VALUE_DATA, ARCHIVE_DATA};
+
+        // export methods used by the worker process
+        static void writeValue(const std::string& name,
+                const QuantityType& value, bool sparse=true);
+        static void writeArchive(const std::string& name,
+                const std::string& pdata);
+        /// remove shared memory object that would not be merged
+        static void remove(const std::string& name);
+
+        // constructor maps and unlinks the named shared memory object
+        explicit SharedParallelData(const std::string& name);
+        ~SharedParallelData();
+
+        // methods
+        DataFormat format() const;
+        /// length of the value array or of the archive string
+        size_t size() const;
+        /// add value runs to the array starting at the specified offset
+        void addTo(QuantityType& value, size_t offset=0) const;
+        /// copy of the archive string from getParallelData
+        std::string archive() const;
+
+    private:
+
+        // data
+        void* mdata;
+        size_t mlength;
+
+        // non-copyable
+        SharedParallelData(const SharedParallelData&);
+        SharedParallelData& operator=(const SharedParallelData&);
+
+};
+
+}   // namespace srreal
+}   // namespace diffpy
+
+#endif  // SHAREDPARALLELDATA_HPP_INCLUDED
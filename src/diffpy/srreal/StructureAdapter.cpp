@@ -77,6 +77,12 @@ StructureAdapter::diff(StructureAdapterConstPtr other) const
     return sd;
 }
 
+
+void StructureAdapter::updateSnapshot(StructureAdapterPtr& snap) const
+{
+    snap = this->clone();
+}
+
 // Routines ------------------------------------------------------------------
 
 double meanSquareDisplacement(const R3::Matrix& Uijcartn,
@@ -89,8 +95,7 @@ double meanSquareDisplacement(const R3::Matrix& Uijcartn,
         assert(eps_eq(Uijcartn(0,1), Uijcartn(1,0)));
         assert(eps_eq(Uijcartn(0,2), Uijcartn(2,0)));
         assert(eps_eq(Uijcartn(1,2), Uijcartn(2,1)));
-        static R3::Vector sn;
-        sn = s / R3::norm(s);
+        R3::Vector sn = s / R3::norm(s);
         rv = Uijcartn(0,0) * sn(0) * sn(0) +
              Uijcartn(1,1) * sn(1) * sn(1) +
              Uijcartn(2,2) * sn(2) * sn(2) +
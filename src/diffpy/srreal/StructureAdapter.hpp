@@ -96,6 +96,11 @@ class StructureAdapter :
         /// Return difference from the other StructureAdapter
         virtual StructureDifference diff(StructureAdapterConstPtr) const;
 
+        /// Store in @param snap a copy of this structure for comparison
+        /// with its later states.  The default is to clone this adapter,
+        /// derived classes may update their previous unshared snapshot.
+        virtual void updateSnapshot(StructureAdapterPtr& snap) const;
+
     private:
 
         // serialization
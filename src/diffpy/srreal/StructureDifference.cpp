@@ -19,6 +19,8 @@
 *
 *****************************************************************************/
 
+#include <algorithm>
+
 #include <diffpy/srreal/StructureDifference.hpp>
 #include <diffpy/srreal/StructureAdapter.hpp>
 
@@ -63,7 +65,29 @@ bool StructureDifference::allowsfastupdate() const
 {
     int N0 = stru0 ? stru0->countSites() : 0;
     double popbound = (1 - sqrt(0.5)) * N0;
-    return int(pop0.size()) < popbound;
+    return int(pop0.size() + moved.size()) < popbound;
+}
+
+
+SiteIndices StructureDifference::popsites0() const
+{
+    if (moved.empty())  return pop0;
+    SiteIndices rv = pop0;
+    std::vector< std::pair<int,int> >::const_iterator mv;
+    for (mv = moved.begin(); mv != moved.end(); ++mv)  rv.push_back(mv->first);
+    std::sort(rv.begin(), rv.end());
+    return rv;
+}
+
+
+SiteIndices StructureDifference::addsites1() const
+{
+    if (moved.empty())  return add1;
+    SiteIndices rv = add1;
+    std::vector< std::pair<int,int> >::const_iterator mv;
+    for (mv = moved.begin(); mv != moved.end(); ++mv)  rv.push_back(mv->second);
+    std::sort(rv.begin(), rv.end());
+    return rv;
 }
 
 }   // namespace srreal
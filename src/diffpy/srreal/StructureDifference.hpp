@@ -22,6 +22,7 @@
 #ifndef STRUCTUREDIFFERENCE_HPP_INCLUDED
 #define STRUCTUREDIFFERENCE_HPP_INCLUDED
 
+#include <utility>
 #include <diffpy/srreal/forwardtypes.hpp>
 
 namespace diffpy {
@@ -37,7 +38,7 @@ class StructureDifference {
 
         // enumeration type for difference methods
         struct Method {
-            enum Type {NONE, SIDEBYSIDE, SORTED};
+            enum Type {NONE, SIDEBYSIDE, SORTED, IDENTITY};
         };
 
         // data
@@ -52,6 +53,10 @@ class StructureDifference {
         /// indices of atoms in stru1 that are not in stru0
         /// These atoms need to be added in a fast update of PairQuantity.
         SiteIndices add1;
+        /// pairs of stru0 and stru1 indices of atoms with the same site
+        /// identity that have changed.  These atoms are removed at their
+        /// stru0 index and added at stru1 index in a fast update.
+        std::vector< std::pair<int,int> > moved;
         /// type of comparison used in obtaining this difference
         Method::Type diffmethod;
 
@@ -61,6 +66,12 @@ class StructureDifference {
         /// structure from stru0 to stru1.
         bool allowsfastupdate() const;
 
+        /// Return sorted indices of pop0 and moved sites in stru0.
+        SiteIndices popsites0() const;
+
+        /// Return sorted indices of add1 and moved sites in stru1.
+        SiteIndices addsites1() const;
+
 };
 
 }   // namespace srreal
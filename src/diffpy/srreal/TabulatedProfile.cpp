@@ -0,0 +1,240 @@
+/*****************************************************************************
+*
+* libdiffpy         Complex Modeling Initiative
+*                   (c) 2026 Brookhaven Science Associates,
+*                   Brookhaven National Laboratory.
+*                   All rights reserved.
+*
+* File coded by:    Pavol Juhas
+*
+* See AUTHORS.txt for a list of people who contributed.
+* See LICENSE.txt for license information.
+*
+******************************************************************************
+*
+* class TabulatedProfile -- PeakProfile decorator which evaluates another
+*     profile by linear interpolation in a precomputed table.
+*     TabulatedProfile of a GaussianProfile is registered as "gaussian-lut".
+*
+*****************************************************************************/
+
+#include <cmath>
+#include <algorithm>
+
+#include <diffpy/srreal/TabulatedProfile.hpp>
+#include <diffpy/srreal/GaussianProfile.hpp>
+#include <diffpy/validators.hpp>
+#include <diffpy/serialization.ipp>
+
+using namespace std;
+
+namespace diffpy {
+namespace srreal {
+
+using diffpy::validators::ensureNonNull;
+using diffpy::validators::ensureEpsilonPositive;
+
+// Local Helpers -------------------------------------------------------------
+
+namespace {
+
+const double DEFAULT_LOOKUPPRECISION = 1e-6;
+// initial and maximum number of intervals in the table
+const int TABLE_INTERVALS_MIN = 64;
+const int TABLE_INTERVALS_MAX = 1 << 22;
+
+}   // namespace
+
+// Constructors --------------------------------------------------------------
+
+TabulatedProfile::TabulatedProfile() :
+    mlookupprecision(DEFAULT_LOOKUPPRECISION),
+    mtablelo(0.0), mtablestep(1.0)
+{
+    this->setProfile(PeakProfilePtr(new GaussianProfile));
+    this->registerDoubleAttribute("lookupprecision", this,
+            &TabulatedProfile::getLookupPrecision,
+            &TabulatedProfile::setLookupPrecision);
+}
+
+
+TabulatedProfile::TabulatedProfile(PeakProfilePtr pkf) :
+    mlookupprecision(DEFAULT_LOOKUPPRECISION),
+    mtablelo(0.0), mtablestep(1.0)
+{
+    this->setProfile(pkf);
+    this->registerDoubleAttribute("lookupprecision", this,
+            &TabulatedProfile::getLookupPrecision,
+            &TabulatedProfile::setLookupPrecision);
+}
+
+
+PeakProfilePtr TabulatedProfile::create() const
+{
+    PeakProfilePtr rv(new TabulatedProfile());
+    return rv;
+}
+
+
+PeakProfilePtr TabulatedProfile::clone() const
+{
+    boost::shared_ptr<TabulatedProfile> rv(new TabulatedProfile(*this));
+    rv->mprofile = mprofile->clone();
+    return rv;
+}
+
+// Public Methods ------------------------------------------------------------
+
+const string& TabulatedProfile::type() const
+{
+    mtype = mprofile->type() + "-lut";
+    return mtype;
+}
+
+
+double TabulatedProfile::operator()(double x, double fwhm) const
+{
+    if (fwhm <= 0)  return 0.0;
+    this->updateTable();
+    return this->lookup(x / fwhm) / fwhm;
+}
+
+
+double TabulatedProfile::xboundlo(double fwhm) const
+{
+    return mprofile->xboundlo(fwhm);
+}
+
+
+double TabulatedProfile::xboundhi(double fwhm) const
+{
+    return mprofile->xboundhi(fwhm);
+}
+
+
+void TabulatedProfile::evaluateGrid(double x0, double dx, int n,
+        double fwhm, double* y) const
+{
+    if (fwhm <= 0)
+    {
+        fill(y, y + n, 0.0);
+        return;
+    }
+    this->updateTable();
+    // table coordinates of the grid points are t0 + k * dt
+    const double t0 = (x0 / fwhm - mtablelo) / mtablestep;
+    const double dt = dx / fwhm / mtablestep;
+    const double tmax = mtable.size() - 1.0;
+    const double scale = 1.0 / fwhm;
+    for (int k = 0; k < n; ++k)
+    {
+        const double t = t0 + k * dt;
+        if (!(t >= 0.0 && t < tmax))
+        {
+            y[k] = 0.0;
+            continue;
+        }
+        const int i = int(t);
+        const double w = t - i;
+        y[k] = scale * ((1 - w) * mtable[i] + w * mtable[i + 1]);
+    }
+}
+
+
+void TabulatedProfile::setPrecision(double eps)
+{
+    mprofile->setPrecision(eps);
+    this->PeakProfile::setPrecision(mprofile->getPrecision());
+}
+
+
+eventticker::EventTicker& TabulatedProfile::ticker() const
+{
+    mticker.updateFrom(mprofile->ticker());
+    return mticker;
+}
+
+
+void TabulatedProfile::setProfile(PeakProfilePtr pkf)
+{
+    ensureNonNull("PeakProfile", pkf);
+    if (mprofile != pkf)  mticker.click();
+    mprofile = pkf;
+    this->PeakProfile::setPrecision(mprofile->getPrecision());
+}
+
+
+const PeakProfilePtr& TabulatedProfile::getProfile() const
+{
+    return mprofile;
+}
+
+
+void TabulatedProfile::setLookupPrecision(double eps)
+{
+    ensureEpsilonPositive("lookupprecision", eps);
+    if (mlookupprecision != eps)  mticker.click();
+    mlookupprecision = eps;
+}
+
+
+const double& TabulatedProfile::getLookupPrecision() const
+{
+    return mlookupprecision;
+}
+
+
+int TabulatedProfile::countTablePoints() const
+{
+    this->updateTable();
+    return mtable.size();
+}
+
+// Private Methods -----------------------------------------------------------
+
+/// Sample f(xrel, 1) with halved steps until the linear interpolation
+/// at the interval midpoints is within the lookup precision.
+void TabulatedProfile::updateTable() const
+{
+    if (!mtable.empty() && mtableticker >= this->ticker())  return;
+    const PeakProfile& pkf = *mprofile;
+    const double xlo = pkf.xboundlo(1.0);
+    const double xhi = pkf.xboundhi(1.0);
+    mtable.clear();
+    mtablelo = xlo;
+    mtablestep = 1.0;
+    mtableticker = this->ticker();
+    if (!(xlo < xhi))  return;
+    for (int n = TABLE_INTERVALS_MIN; true; n *= 2)
+    {
+        const double h = (xhi - xlo) / n;
+        mtable.resize(n + 1);
+        for (int k = 0; k <= n; ++k)  mtable[k] = pkf(xlo + k * h, 1.0);
+        double ymax = 0.0;
+        double dymax = 0.0;
+        for (int k = 0; k < n; ++k)
+        {
+            double ymid = pkf(xlo + (k + 0.5) * h, 1.0);
+            double dy = ymid - (mtable[k] + mtable[k + 1]) / 2;
+            ymax = max(ymax, fabs(ymid));
+            dymax = max(dymax, fabs(dy));
+        }
+        mtablestep = h;
+        if (dymax <= mlookupprecision * ymax)  break;
+        if (2 * n > TABLE_INTERVALS_MAX)  break;
+    }
+}
+
+// Registration --------------------------------------------------------------
+
+bool reg_TabulatedProfile = TabulatedProfile().registerThisType();
+
+}   // namespace srreal
+}   // namespace diffpy
+
+// Serialization -------------------------------------------------------------
+
+DIFFPY_INSTANTIATE_SERIALIZATION(diffpy::srreal::TabulatedProfile)
+BOOST_CLASS_EXPORT_IMPLEMENT(diffpy::srreal::TabulatedProfile)
+
+// End of file
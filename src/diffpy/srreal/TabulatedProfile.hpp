@@ -0,0 +1,115 @@
+/*****************************************************************************
+*
+* libdiffpy         Complex Modeling Initiative
+*                   (c) 2026 Brookhaven Science Associates,
+*                   Brookhaven National Laboratory.
+*                   All rights reserved.
+*
+* File coded by:    Pavol Juhas
+*
+* See AUTHORS.txt for a list of people who contributed.
+* See LICENSE.txt for license information.
+*
+******************************************************************************
+*
+* class TabulatedProfile -- PeakProfile decorator which evaluates another
+*     profile by linear interpolation in a precomputed table.
+*     TabulatedProfile of a GaussianProfile is registered as "gaussian-lut".
+*
+* The wrapped profile is assumed to scale with its width, i.e.,
+* f(x, fwhm) = f(x / fwhm, 1) / fwhm, which holds for area-normalized
+* profiles.  The table samples f(x, 1) between the x-boundaries of the
+* wrapped profile and is refined until the interpolation error is below
+* the lookupprecision attribute relative to the profile maximum.  The
+* table is rebuilt when the wrapped profile or the precision changes.
+* Values outside of the x-boundaries are zero.
+*
+*****************************************************************************/
+
+#ifndef TABULATEDPROFILE_HPP_INCLUDED
+#define TABULATEDPROFILE_HPP_INCLUDED
+
+#include <vector>
+#include <diffpy/srreal/PeakProfile.hpp>
+
+namespace diffpy {
+namespace srreal {
+
+class TabulatedProfile : public PeakProfile
+{
+    public:
+
+        // constructors
+        TabulatedProfile();
+        explicit TabulatedProfile(PeakProfilePtr pkf);
+        PeakProfilePtr create() const;
+        PeakProfilePtr clone() const;
+
+        // methods
+        const std::string& type() const;
+        double operator()(double x, double fwhm) const;
+        double xboundlo(double fwhm) const;
+        double xboundhi(double fwhm) const;
+        void evaluateGrid(double x0, double dx, int n,
+                double fwhm, double* y) const;
+        void setPrecision(double eps);
+        eventticker::EventTicker& ticker() const;
+
+        // access to the tabulated profile
+        void setProfile(PeakProfilePtr pkf);
+        const PeakProfilePtr& getProfile() const;
+        void setLookupPrecision(double eps);
+        const double& getLookupPrecision() const;
+        int countTablePoints() const;
+
+    private:
+
+        // methods
+        void updateTable() const;
+        double lookup(double xrel) const;
+
+        // data
+        PeakProfilePtr mprofile;
+        double mlookupprecision;
+        mutable std::string mtype;
+        mutable std::vector<double> mtable;
+        mutable double mtablelo;
+        mutable double mtablestep;
+        mutable eventticker::EventTicker mtableticker;
+
+        // serialization
+        friend class boost::serialization::access;
+
+        template<class Archive>
+            void serialize(Archive& ar, const unsigned int version)
+        {
+            using boost::serialization::base_object;
+            ar & base_object<PeakProfile>(*this);
+            ar & mprofile & mlookupprecision;
+            if (Archive::is_loading::value)  mtable.clear();
+        }
+
+};
+
+// Inline Methods ------------------------------------------------------------
+
+/// Interpolate the f(xrel, 1) table, return 0 outside of the table.
+inline
+double TabulatedProfile::lookup(double xrel) const
+{
+    const double t = (xrel - mtablelo) / mtablestep;
+    const double tmax = mtable.size() - 1.0;
+    if (!(t >= 0.0 && t < tmax))  return 0.0;
+    const int k = int(t);
+    const double w = t - k;
+    return (1 - w) * mtable[k] + w * mtable[k + 1];
+}
+
+}   // namespace srreal
+}   // namespace diffpy
+
+// Serialization -------------------------------------------------------------
+
+BOOST_CLASS_EXPORT_KEY(diffpy::srreal::TabulatedProfile)
+
+#endif  // TABULATEDPROFILE_HPP_INCLUDED
@@ -127,13 +127,11 @@ typedef unordered_set<WaasKirfFormula,
         wksmbl_hash, wksmbl_equal> SetOfWKFormulas;
 
 
-const SetOfWKFormulas& getWKFormulasSet()
+unique_ptr<SetOfWKFormulas> loadWKFormulasSet()
 {
     using namespace diffpy::runtimepath;
     using diffpy::validators::ensureFileOK;
-    static unique_ptr<SetOfWKFormulas> the_set;
-    if (the_set)  return *the_set;
-    the_set.reset(new SetOfWKFormulas);
+    unique_ptr<SetOfWKFormulas> the_set(new SetOfWKFormulas);
     string wkfile = datapath("f0_WaasKirf.dat");
     ifstream fp(wkfile.c_str());
     ensureFileOK(wkfile, fp);
@@ -182,7 +180,15 @@ const SetOfWKFormulas& getWKFormulasSet()
             wk.symbol.clear();
         }
     }
-    return getWKFormulasSet();
+    return the_set;
+}
+
+
+const SetOfWKFormulas& getWKFormulasSet()
+{
+    // initialization of local static is thread safe in C++11
+    static const unique_ptr<SetOfWKFormulas> the_set(loadWKFormulasSet());
+    return *the_set;
 }
 
 
@@ -219,48 +225,52 @@ SetOfWKFormulas::const_iterator findWKFormula(const string& smbl)
 
 typedef unordered_map<string,int> ElectronNumberStorage;
 
-ElectronNumberStorage& getElectronNumberTable()
+unique_ptr<ElectronNumberStorage> loadElectronNumberTable()
 {
     using namespace diffpy::runtimepath;
     using diffpy::validators::ensureFileOK;
-    static unique_ptr<ElectronNumberStorage> entable;
+    unique_ptr<ElectronNumberStorage> entable(new ElectronNumberStorage);
     typedef ElectronNumberStorage::value_type ENPair;
-    if (!entable)
+    string ionfile = datapath("ionlist.dat");
+    ifstream fp0(ionfile.c_str());
+    ensureFileOK(ionfile, fp0);
+    LineReader line;
+    while (fp0 >> line)
     {
-        entable.reset(new ElectronNumberStorage);
-        string ionfile = datapath("ionlist.dat");
-        ifstream fp0(ionfile.c_str());
-        ensureFileOK(ionfile, fp0);
-        LineReader line;
-        while (fp0 >> line)
+        if (line.isignored())  continue;
+        istringstream fpline(line.line);
+        string element;
+        int z = 0;
+        fpline >> element >> z;
+        if (!fpline)
         {
-            if (line.isignored())  continue;
-            istringstream fpline(line.line);
-            string element;
-            int z = 0;
-            fpline >> element >> z;
-            if (!fpline)
-            {
-                throw line.format_error(ionfile,
-                        "Expected at least 2 columns for (symbol, Z).");
-            }
-            entable->insert(ENPair(element, z));
-            for (int v; fpline >> v;)
-            {
-                ostringstream smbl;
-                smbl << element << abs(v) << ((v > 0) ? '+' : '-');
-                entable->insert(ENPair(smbl.str(), z - v));
-            }
+            throw line.format_error(ionfile,
+                    "Expected at least 2 columns for (symbol, Z).");
         }
-        const size_t mintablesize = 447;
-        if (entable->size() < mintablesize)
+        entable->insert(ENPair(element, z));
+        for (int v; fpline >> v;)
         {
-            ostringstream emsg;
-            emsg << "Incomplete file.  Expected " << mintablesize <<
-                " items loaded " << entable->size() << ".";
-            throw line.format_error(ionfile, emsg.str());
+            ostringstream smbl;
+            smbl << element << abs(v) << ((v > 0) ? '+' : '-');
+            entable->insert(ENPair(smbl.str(), z - v));
         }
     }
+    const size_t mintablesize = 447;
+    if (entable->size() < mintablesize)
+    {
+        ostringstream emsg;
+        emsg << "Incomplete file.  Expected " << mintablesize <<
+            " items loaded " << entable->size() << ".";
+        throw line.format_error(ionfile, emsg.str());
+    }
+    return entable;
+}
+
+
+const ElectronNumberStorage& getElectronNumberTable()
+{
+    static const unique_ptr<ElectronNumberStorage>
+        entable(loadElectronNumberTable());
     return *entable;
 }
 
@@ -268,14 +278,12 @@ ElectronNumberStorage& getElectronNumberTable()
 
 typedef unordered_map<string,double> NeutronBCStorage;
 
-const NeutronBCStorage& getNeutronBCTable()
+unique_ptr<NeutronBCStorage> loadNeutronBCTable()
 {
     using namespace diffpy::runtimepath;
     using diffpy::validators::ensureFileOK;
     typedef NeutronBCStorage::value_type BCPair;
-    static unique_ptr<NeutronBCStorage> bctable;
-    if (bctable)  return *bctable;
-    bctable.reset(new NeutronBCStorage);
+    unique_ptr<NeutronBCStorage> bctable(new NeutronBCStorage);
     string nsffile = datapath("nsftable.dat");
     ifstream fp(nsffile.c_str());
     ensureFileOK(nsffile, fp);
@@ -343,7 +351,14 @@ const NeutronBCStorage& getNeutronBCTable()
     bctable->insert(BCPair("n", bctable->at("1-n")));
     bctable->insert(BCPair("D", bctable->at("2-H")));
     bctable->insert(BCPair("T", bctable->at("3-H")));
-    return getNeutronBCTable();
+    return bctable;
+}
+
+
+const NeutronBCStorage& getNeutronBCTable()
+{
+    static const unique_ptr<NeutronBCStorage> bctable(loadNeutronBCTable());
+    return *bctable;
 }
 
 }   // namespace
@@ -17,11 +17,13 @@
 *
 *****************************************************************************/
 
+#include <cmath>
 #include <cxxtest/TestSuite.h>
 
 #include <boost/make_shared.hpp>
 
 #include <diffpy/srreal/AtomicStructureAdapter.hpp>
+#include <diffpy/srreal/CellListBondGenerator.hpp>
 #include <diffpy/srreal/StructureDifference.hpp>
 #include "serialization_helpers.hpp"
 
@@ -30,6 +32,22 @@ namespace srreal {
 
 using namespace std;
 
+// Local Helpers -------------------------------------------------------------
+
+namespace {
+
+vector< pair<int, double> > listBonds(BaseBondGenerator& bnds)
+{
+    vector< pair<int, double> > rv;
+    for (bnds.rewind(); !bnds.finished(); bnds.next())
+    {
+        rv.push_back(make_pair(bnds.site1(), bnds.distance()));
+    }
+    return rv;
+}
+
+}   // namespace
+
 //////////////////////////////////////////////////////////////////////////////
 // class TestAtomicStructureAdapter
 //////////////////////////////////////////////////////////////////////////////
@@ -57,6 +75,7 @@ class TestAtomicStructureAdapter : public CxxTest::TestSuite
             const DM::Type& NONE = DM::NONE;
             const DM::Type& SIDEBYSIDE = DM::SIDEBYSIDE;
             const DM::Type& SORTED = DM::SORTED;
+            const DM::Type& IDENTITY = DM::IDENTITY;
             StructureDifference sd;
             sd = mstru->diff(emptyStructureAdapter());
             TS_ASSERT(sd.add1.empty());
@@ -85,17 +104,29 @@ class TestAtomicStructureAdapter : public CxxTest::TestSuite
             sd = mstru->diff(cpstru);
             TS_ASSERT_EQUALS(SIDEBYSIDE, sd.diffmethod);
             TS_ASSERT(sd.allowsfastupdate())
-            TS_ASSERT_EQUALS(1u, sd.pop0.size());
-            TS_ASSERT_EQUALS(1u, sd.add1.size());
+            TS_ASSERT(sd.pop0.empty());
+            TS_ASSERT(sd.add1.empty());
+            TS_ASSERT_EQUALS(1u, sd.moved.size());
+            TS_ASSERT_EQUALS(make_pair(0, 0), sd.moved[0]);
+            TS_ASSERT_EQUALS(SiteIndices(1, 0), sd.popsites0());
+            TS_ASSERT_EQUALS(SiteIndices(1, 0), sd.addsites1());
             for (int i = 1; i < (1 - sqrt(0.5)) * SZ; ++i)
             {
                 cpstru->erase(0);
                 sd = mstru->diff(cpstru);
-                TS_ASSERT_EQUALS(SORTED, sd.diffmethod);
+                TS_ASSERT_EQUALS(IDENTITY, sd.diffmethod);
                 TS_ASSERT(sd.allowsfastupdate());
                 TS_ASSERT_EQUALS(i, int(sd.pop0.size()));
                 TS_ASSERT(sd.add1.empty());
+                TS_ASSERT(sd.moved.empty());
             }
+            // atoms with new identities are compared by sorting
+            AtomicStructureAdapterPtr cpstru1 =
+                boost::make_shared<AtomicStructureAdapter>();
+            cpstru1->assign(cpstru->begin(), cpstru->end());
+            sd = mstru->diff(cpstru1);
+            TS_ASSERT_EQUALS(SORTED, sd.diffmethod);
+            TS_ASSERT(sd.allowsfastupdate());
             cpstru->erase(0);
             sd = mstru->diff(cpstru);
             TS_ASSERT(!sd.allowsfastupdate());
@@ -108,6 +139,159 @@ class TestAtomicStructureAdapter : public CxxTest::TestSuite
         }
 
 
+        void test_diff_moved()
+        {
+            Atom ai;
+            ai.atomtype = "C";
+            const int SZ = 10;
+            for (int i = 0; i < SZ; ++i)
+            {
+                ai.xyz_cartn[0] = i;
+                mpstru->append(ai);
+            }
+            AtomicStructureAdapterPtr cpstru =
+                boost::make_shared<AtomicStructureAdapter>(*mpstru);
+            for (int i = 0; i < SZ; ++i)
+            {
+                TS_ASSERT_EQUALS(mpstru->siteIdentity(i),
+                        cpstru->siteIdentity(i));
+            }
+            // move an atom and insert a new one at the front
+            cpstru->at(5).xyz_cartn[1] = 0.5;
+            cpstru->insert(0, ai);
+            TS_ASSERT_EQUALS(mpstru->siteIdentity(0), cpstru->siteIdentity(1));
+            StructureDifference sd = mstru->diff(cpstru);
+            TS_ASSERT_EQUALS(StructureDifference::Method::IDENTITY,
+                    sd.diffmethod);
+            TS_ASSERT(sd.pop0.empty());
+            TS_ASSERT_EQUALS(SiteIndices(1, 0), sd.add1);
+            TS_ASSERT_EQUALS(1u, sd.moved.size());
+            TS_ASSERT_EQUALS(make_pair(5, 6), sd.moved[0]);
+            TS_ASSERT_EQUALS(SiteIndices(1, 5), sd.popsites0());
+            SiteIndices a1 = {0, 6};
+            TS_ASSERT_EQUALS(a1, sd.addsites1());
+            TS_ASSERT(sd.allowsfastupdate());
+        }
+
+
+        void test_diff_journal()
+        {
+            typedef StructureDifference::Method DM;
+            Atom ai;
+            ai.atomtype = "C";
+            for (int i = 0; i < 10; ++i)
+            {
+                ai.xyz_cartn[0] = i;
+                mpstru->append(ai);
+            }
+            Atom& a7 = mpstru->at(7);
+            StructureAdapterPtr snap = mstru->clone();
+            const AtomicStructureAdapter& cstru = *mpstru;
+            const AtomicStructureAdapter& csnap =
+                dynamic_cast<const AtomicStructureAdapter&>(*snap);
+            TS_ASSERT_DIFFERS(&cstru[0], &csnap[0]);
+            StructureDifference sd = snap->diff(mstru);
+            TS_ASSERT_EQUALS(DM::SIDEBYSIDE, sd.diffmethod);
+            TS_ASSERT(sd.pop0.empty());
+            TS_ASSERT(sd.add1.empty());
+            TS_ASSERT(sd.moved.empty());
+            // atom changed through a reference held from before the copy
+            a7.xyz_cartn[1] = 0.5;
+            TS_ASSERT_EQUALS(0.0, csnap[7].xyz_cartn[1]);
+            sd = snap->diff(mstru);
+            TS_ASSERT_EQUALS(1u, sd.moved.size());
+            TS_ASSERT_EQUALS(make_pair(7, 7), sd.moved.at(0));
+            a7.xyz_cartn[1] = 0.0;
+            // modified atom is not shared with the copy
+            mpstru->at(3).xyz_cartn[1] = 0.5;
+            TS_ASSERT_EQUALS(0.0, csnap[3].xyz_cartn[1]);
+            mpstru->at(5);
+            sd = snap->diff(mstru);
+            TS_ASSERT_EQUALS(DM::SIDEBYSIDE, sd.diffmethod);
+            TS_ASSERT(sd.pop0.empty());
+            TS_ASSERT(sd.add1.empty());
+            TS_ASSERT_EQUALS(1u, sd.moved.size());
+            TS_ASSERT_EQUALS(make_pair(3, 3), sd.moved[0]);
+            mpstru->append(ai);
+            sd = snap->diff(mstru);
+            TS_ASSERT_EQUALS(SiteIndices(1, 10), sd.add1);
+            TS_ASSERT_EQUALS(1u, sd.moved.size());
+            // changed site indices are resolved from site identities
+            mpstru->erase(0);
+            sd = snap->diff(mstru);
+            TS_ASSERT_EQUALS(DM::IDENTITY, sd.diffmethod);
+            TS_ASSERT_EQUALS(SiteIndices(1, 0), sd.pop0);
+            TS_ASSERT_EQUALS(SiteIndices(1, 9), sd.add1);
+            TS_ASSERT_EQUALS(make_pair(3, 2), sd.moved.at(0));
+            // modified copy cannot use the journal of its source
+            AtomicStructureAdapterPtr cpstru =
+                boost::make_shared<AtomicStructureAdapter>(*mpstru);
+            cpstru->at(0).xyz_cartn[1] = 0.5;
+            mpstru->at(1).xyz_cartn[1] = 0.5;
+            sd = cpstru->diff(mstru);
+            TS_ASSERT_EQUALS(2u, sd.moved.size());
+        }
+
+
+        void test_updateSnapshot()
+        {
+            Atom ai;
+            ai.atomtype = "C";
+            for (int i = 0; i < 10; ++i)
+            {
+                ai.xyz_cartn[0] = i;
+                mpstru->append(ai);
+            }
+            const AtomicStructureAdapter& cstru = *mpstru;
+            StructureAdapterPtr snap;
+            mstru->updateSnapshot(snap);
+            const AtomicStructureAdapter* psnap =
+                dynamic_cast<const AtomicStructureAdapter*>(snap.get());
+            TS_ASSERT(psnap);
+            const AtomicStructureAdapter& csnap = *psnap;
+            // atoms are shared until modified
+            TS_ASSERT_EQUALS(&cstru[0], &csnap[0]);
+            Atom& a7 = mpstru->at(7);
+            TS_ASSERT_DIFFERS(&cstru[0], &csnap[0]);
+            a7.xyz_cartn[1] = 0.5;
+            TS_ASSERT_EQUALS(1u, snap->diff(mstru).moved.size());
+            // unshared snapshot is updated in place
+            mstru->updateSnapshot(snap);
+            TS_ASSERT_EQUALS(psnap, snap.get());
+            TS_ASSERT_EQUALS(0.5, csnap[7].xyz_cartn[1]);
+            TS_ASSERT_EQUALS(cstru, csnap);
+            // snapshot of the exposed atoms is not shared with them
+            StructureAdapterPtr snap1;
+            mstru->updateSnapshot(snap1);
+            const AtomicStructureAdapter& csnap1 =
+                dynamic_cast<const AtomicStructureAdapter&>(*snap1);
+            TS_ASSERT_DIFFERS(&cstru[0], &csnap1[0]);
+            // the journal is re-based, references from before the snapshot
+            // need to be taken again
+            a7.xyz_cartn[1] = 0.0;
+            TS_ASSERT(snap->diff(mstru).moved.empty());
+            mpstru->at(7);
+            StructureDifference sd = snap->diff(mstru);
+            TS_ASSERT_EQUALS(StructureDifference::Method::SIDEBYSIDE,
+                    sd.diffmethod);
+            TS_ASSERT_EQUALS(1u, sd.moved.size());
+            mpstru->append(ai);
+            sd = snap->diff(mstru);
+            TS_ASSERT_EQUALS(SiteIndices(1, 10), sd.add1);
+            sd = StructureDifference();
+            mstru->updateSnapshot(snap);
+            TS_ASSERT_EQUALS(psnap, snap.get());
+            TS_ASSERT_EQUALS(cstru, csnap);
+            TS_ASSERT(snap->diff(mstru).moved.empty());
+            // shared snapshot is replaced
+            snap1 = snap;
+            mstru->updateSnapshot(snap);
+            TS_ASSERT_DIFFERS(snap1, snap);
+            TS_ASSERT_EQUALS(*mpstru,
+                    dynamic_cast<const AtomicStructureAdapter&>(*snap));
+        }
+
+
         void test_serialization()
         {
             Atom ai;
@@ -148,6 +332,186 @@ class TestAtomicStructureAdapter : public CxxTest::TestSuite
             TS_ASSERT(!(*mpstru == *cpstru));
         }
 
+
+        void test_createBondGenerator()
+        {
+            // 10 x 10 x 10 cluster with distorted cubic positions
+            Atom ai;
+            for (int i = 0; i < 1000; ++i)
+            {
+                ai.xyz_cartn = R3::Vector(i % 10, i / 10 % 10, i / 100);
+                ai.xyz_cartn[i % 3] += 0.2 * sin(i);
+                mpstru->append(ai);
+            }
+            BaseBondGeneratorPtr bnds = mstru->createBondGenerator();
+            CellListBondGenerator* cbnds =
+                dynamic_cast<CellListBondGenerator*>(bnds.get());
+            TS_ASSERT(cbnds);
+            BaseBondGenerator bnds0(mstru);
+            bnds->setRmax(1.5);
+            bnds0.setRmax(1.5);
+            SiteIndices sel;
+            for (int i = 999; i >= 0; i -= 3)  sel.push_back(i);
+            for (int i0 : {0, 5, 444, 555, 999})
+            {
+                bnds->selectAnchorSite(i0);
+                bnds0.selectAnchorSite(i0);
+                TS_ASSERT_EQUALS(listBonds(bnds0), listBonds(*bnds));
+                TS_ASSERT(cbnds->usesCellGrid());
+                bnds->selectSiteRange(0, i0 + 1);
+                bnds0.selectSiteRange(0, i0 + 1);
+                TS_ASSERT_EQUALS(listBonds(bnds0), listBonds(*bnds));
+                bnds->selectSites(sel.begin() + i0 / 10, sel.end());
+                bnds0.selectSites(sel.begin() + i0 / 10, sel.end());
+                TS_ASSERT_EQUALS(listBonds(bnds0), listBonds(*bnds));
+                TS_ASSERT(cbnds->usesCellGrid());
+                bnds->selectSites(sel);
+                bnds0.selectSites(sel);
+                TS_ASSERT_EQUALS(listBonds(bnds0), listBonds(*bnds));
+            }
+            // the grid would not exclude many sites for large rmax
+            bnds->setRmax(10);
+            bnds0.setRmax(10);
+            TS_ASSERT_EQUALS(listBonds(bnds0), listBonds(*bnds));
+            TS_ASSERT(!cbnds->usesCellGrid());
+            // repeated sites are left to the plain loop
+            sel.push_back(sel.front());
+            bnds->setRmax(1.5);
+            bnds0.setRmax(1.5);
+            bnds->selectSites(sel.begin(), sel.end());
+            bnds0.selectSites(sel.begin(), sel.end());
+            TS_ASSERT_EQUALS(listBonds(bnds0), listBonds(*bnds));
+            TS_ASSERT(!cbnds->usesCellGrid());
+        }
+
+
+        void test_createBondGenerator_reselect()
+        {
+            Atom ai;
+            for (int i = 0; i < 1000; ++i)
+            {
+                ai.xyz_cartn = R3::Vector(i % 10, i / 10 % 10, i / 100);
+                mpstru->append(ai);
+            }
+            BaseBondGeneratorPtr bnds = mstru->createBondGenerator();
+            BaseBondGenerator bnds0(mstru);
+            bnds->setRmax(1.1);
+            bnds0.setRmax(1.1);
+            bnds->selectAnchorSite(0);
+            bnds0.selectAnchorSite(0);
+            // smaller selection copied to the buffer of a larger one
+            SiteIndices sel;
+            for (int i = 999; i >= 0; --i)  sel.push_back(i);
+            bnds->selectSites(sel);
+            bnds0.selectSites(sel);
+            TS_ASSERT_EQUALS(listBonds(bnds0), listBonds(*bnds));
+            SiteIndices sel1 = {1, 10, 100};
+            bnds->selectSites(sel1);
+            bnds0.selectSites(sel1);
+            TS_ASSERT_EQUALS(3u, listBonds(*bnds).size());
+            TS_ASSERT_EQUALS(listBonds(bnds0), listBonds(*bnds));
+            // changed content of the same array
+            sel.assign(sel.size(), 0);
+            sel[0] = 1;
+            bnds->selectSites(sel.begin(), sel.begin() + 1);
+            bnds0.selectSites(sel.begin(), sel.begin() + 1);
+            TS_ASSERT_EQUALS(listBonds(bnds0), listBonds(*bnds));
+            // narrowed selection reuses the ranks of the array
+            for (int i = 0; i < 1000; ++i)  sel[i] = (7 * i) % 1000;
+            bnds->selectSites(sel.begin(), sel.end());
+            bnds0.selectSites(sel.begin(), sel.end());
+            TS_ASSERT_EQUALS(listBonds(bnds0), listBonds(*bnds));
+            bnds->narrowSiteSelection(sel.begin() + 300, sel.end());
+            bnds0.narrowSiteSelection(sel.begin() + 300, sel.end());
+            TS_ASSERT_EQUALS(listBonds(bnds0), listBonds(*bnds));
+        }
+
+
+        void test_setNeighborListSkin()
+        {
+            TS_ASSERT_EQUALS(0.0, mpstru->getNeighborListSkin());
+            TS_ASSERT(!mpstru->neighborListCache());
+            TS_ASSERT_THROWS(mpstru->setNeighborListSkin(-1),
+                    invalid_argument);
+            Atom ai;
+            for (int i = 0; i < 1000; ++i)
+            {
+                ai.xyz_cartn = R3::Vector(i % 10, i / 10 % 10, i / 100);
+                ai.xyz_cartn[i % 3] += 0.2 * sin(i);
+                mpstru->append(ai);
+            }
+            mpstru->setNeighborListSkin(0.5);
+            TS_ASSERT_EQUALS(0.5, mpstru->getNeighborListSkin());
+            const NeighborListCache* cache = mpstru->neighborListCache();
+            TS_ASSERT(cache);
+            // copies share the cache
+            AtomicStructureAdapter cpstru(*mpstru);
+            TS_ASSERT_EQUALS(cache, cpstru.neighborListCache());
+            BaseBondGenerator bnds0(mstru);
+            bnds0.setRmax(1.5);
+            BaseBondGeneratorPtr bnds = mstru->createBondGenerator();
+            CellListBondGenerator* cbnds =
+                dynamic_cast<CellListBondGenerator*>(bnds.get());
+            bnds->setRmax(1.5);
+            for (int i0 : {0, 5, 444, 999})
+            {
+                bnds->selectAnchorSite(i0);
+                bnds0.selectAnchorSite(i0);
+                TS_ASSERT_EQUALS(listBonds(bnds0), listBonds(*bnds));
+                TS_ASSERT(cbnds->usesNeighborList());
+            }
+            TS_ASSERT_EQUALS(1u, cache->countBuilds());
+            TS_ASSERT_EQUALS(0u, cache->countReuses());
+            // list is reused for a smaller rmax
+            bnds->setRmax(1.2);
+            bnds0.setRmax(1.2);
+            TS_ASSERT_EQUALS(listBonds(bnds0), listBonds(*bnds));
+            TS_ASSERT_EQUALS(1u, cache->countBuilds());
+            TS_ASSERT_EQUALS(1u, cache->countReuses());
+            // small displacement keeps the list
+            mpstru->at(444).xyz_cartn[0] += 0.2;
+            bnds = mstru->createBondGenerator();
+            bnds->setRmax(1.5);
+            bnds->selectAnchorSite(444);
+            bnds0.setRmax(1.5);
+            bnds0.selectAnchorSite(444);
+            TS_ASSERT_EQUALS(listBonds(bnds0), listBonds(*bnds));
+            TS_ASSERT_EQUALS(1u, cache->countBuilds());
+            TS_ASSERT_EQUALS(2u, cache->countReuses());
+            // displacement over half of the skin requires a new list
+            mpstru->at(444).xyz_cartn[0] += 0.1;
+            bnds = mstru->createBondGenerator();
+            bnds->setRmax(1.5);
+            bnds->selectAnchorSite(444);
+            bnds0.selectAnchorSite(444);
+            TS_ASSERT_EQUALS(listBonds(bnds0), listBonds(*bnds));
+            TS_ASSERT_EQUALS(2u, cache->countBuilds());
+            // erased site requires a new list as well
+            mpstru->erase(0);
+            bnds = mstru->createBondGenerator();
+            bnds->setRmax(1.5);
+            bnds->selectAnchorSite(443);
+            BaseBondGenerator bnds1(mstru);
+            bnds1.setRmax(1.5);
+            bnds1.selectAnchorSite(443);
+            TS_ASSERT_EQUALS(listBonds(bnds1), listBonds(*bnds));
+            TS_ASSERT_EQUALS(3u, cache->countBuilds());
+            // displacement through a reference held from before the build
+            Atom& a100 = mpstru->at(100);
+            listBonds(*bnds);
+            a100.xyz_cartn[0] += 0.4;
+            bnds = mstru->createBondGenerator();
+            bnds->setRmax(1.5);
+            bnds->selectAnchorSite(100);
+            bnds1.selectAnchorSite(100);
+            TS_ASSERT_EQUALS(listBonds(bnds1), listBonds(*bnds));
+            TS_ASSERT_EQUALS(4u, cache->countBuilds());
+            // zero skin disables the cache
+            mpstru->setNeighborListSkin(0.0);
+            TS_ASSERT(!mpstru->neighborListCache());
+            TS_ASSERT_EQUALS(cache, cpstru.neighborListCache());
+        }
+
 };  // class TestAtomicStructureAdapter
 
 }   // namespace srreal
@@ -21,15 +21,49 @@
 #include <boost/make_shared.hpp>
 
 #include <diffpy/srreal/AtomicStructureAdapter.hpp>
+#include <diffpy/srreal/PeriodicStructureAdapter.hpp>
 #include <diffpy/srreal/DebyePDFCalculator.hpp>
 #include <diffpy/srreal/JeongPeakWidth.hpp>
 #include <diffpy/srreal/ConstantPeakWidth.hpp>
 #include <diffpy/srreal/QResolutionEnvelope.hpp>
+#include <diffpy/srreal/SFTXray.hpp>
 #include <diffpy/serialization.hpp>
 
 using namespace std;
 using namespace diffpy::srreal;
 
+// X-ray scattering factors with a sign change at Q = 1
+
+class ZeroCrossingXray : public SFTXray
+{
+    public:
+
+        ScatteringFactorTablePtr create() const
+        {
+            return ScatteringFactorTablePtr(new ZeroCrossingXray);
+        }
+
+        ScatteringFactorTablePtr clone() const
+        {
+            return ScatteringFactorTablePtr(new ZeroCrossingXray(*this));
+        }
+
+        const string& type() const
+        {
+            static const string rv = "zerocrossingxray";
+            return rv;
+        }
+
+        double standardLookup(const string& smbl, double q) const
+        {
+            return this->SFTXray::standardLookup(smbl, q) * (q - 1.0);
+        }
+};
+
+//////////////////////////////////////////////////////////////////////////////
+// class TestDebyePDFCalculator
+//////////////////////////////////////////////////////////////////////////////
+
 class TestDebyePDFCalculator : public CxxTest::TestSuite
 {
     private:
@@ -71,6 +105,508 @@ class TestDebyePDFCalculator : public CxxTest::TestSuite
         }
 
 
+        void test_results_cache()
+        {
+            mpdfc->setRmax(8.0);
+            mpdfc->eval(mstru10);
+            QuantityType pdf0 = mpdfc->getPDF();
+            QuantityType rdf0 = mpdfc->getRDF();
+            TS_ASSERT_EQUALS(pdf0, mpdfc->getPDF());
+            mpdfc->setDoubleAttr("scale", 2.0);
+            QuantityType pdf1 = mpdfc->getPDF();
+            TS_ASSERT_DELTA(2 * pdf0[300], pdf1[300], meps);
+            TS_ASSERT_EQUALS(rdf0, mpdfc->getRDF());
+            // qmin and rstep are applied without new evaluation
+            mpdfc->setDoubleAttr("scale", 1.0);
+            mpdfc->setQmin(1.0);
+            mpdfc->setRstep(0.02);
+            DebyePDFCalculator pdfc1;
+            pdfc1.setRmax(8.0);
+            pdfc1.setQmin(1.0);
+            pdfc1.setRstep(0.02);
+            pdfc1.eval(mstru10);
+            TS_ASSERT_EQUALS(pdfc1.getRgrid(), mpdfc->getRgrid());
+            TS_ASSERT_EQUALS(pdfc1.getPDF(), mpdfc->getPDF());
+            TS_ASSERT_EQUALS(pdfc1.getRDF(), mpdfc->getRDF());
+            mpdfc->eval(mstru9);
+            TS_ASSERT_DIFFERS(pdfc1.getPDF(), mpdfc->getPDF());
+        }
+
+
+        void test_partials()
+        {
+            mpdfc->setRmax(8.0);
+            mpdfc->setQmin(1.0);
+            mpdfc->setEvaluatePartials(true);
+            TS_ASSERT(mpdfc->getEvaluatePartials());
+            mpdfc->eval(mstru10d1);
+            const vector<string>& tps = mpdfc->getPartialTypes();
+            TS_ASSERT_EQUALS(2u, tps.size());
+            TS_ASSERT_EQUALS("Au", tps[0]);
+            TS_ASSERT_EQUALS("C", tps[1]);
+            TS_ASSERT_THROWS(mpdfc->getPartialF(0, 2), invalid_argument);
+            // F is a sum of partials times Q-dependent weights
+            QuantityType fq = mpdfc->getF();
+            QuantityType sfq(fq.size()), sw(fq.size());
+            for (int j = 0; j < 2; ++j)
+            {
+                for (int i = 0; i <= j; ++i)
+                {
+                    QuantityType fqij = mpdfc->getPartialF(i, j);
+                    QuantityType wij = mpdfc->getPartialWeights(i, j);
+                    for (size_t k = 0; k < fq.size(); ++k)
+                    {
+                        sfq[k] += wij[k] * fqij[k];
+                        sw[k] += wij[k];
+                    }
+                }
+            }
+            TS_ASSERT(allclose(fq, sfq));
+            TS_ASSERT_DELTA(1.0, sw.back(), meps);
+            // PDF is a weighted sum of partial PDFs for constant weights
+            mpdfc->setScatteringFactorTableByType("neutron");
+            mpdfc->eval();
+            QuantityType pdf = mpdfc->getPDF();
+            QuantityType spdf(pdf.size());
+            for (int j = 0; j < 2; ++j)
+            {
+                for (int i = 0; i <= j; ++i)
+                {
+                    QuantityType pdfij = mpdfc->getPartialPDF(i, j);
+                    const double w = mpdfc->getPartialWeights(i, j).back();
+                    for (size_t k = 0; k < pdf.size(); ++k)
+                    {
+                        spdf[k] += w * pdfij[k];
+                    }
+                }
+            }
+            TS_ASSERT(allclose(pdf, spdf));
+            // total F is the same as without partials
+            DebyePDFCalculator pdfc1 = *mpdfc;
+            pdfc1.setEvaluatorType(BASIC);
+            pdfc1.setEvaluatePartials(false);
+            pdfc1.eval();
+            TS_ASSERT_EQUALS(pdfc1.getF(), mpdfc->getF());
+            TS_ASSERT_THROWS(pdfc1.getPartialF(0, 0), logic_error);
+        }
+
+
+        void test_partials_optimized()
+        {
+            DebyePDFCalculator pdfcb = *mpdfc;
+            DebyePDFCalculator pdfco = *mpdfc;
+            pdfcb.setEvaluatorType(BASIC);
+            pdfcb.setEvaluatePartials(true);
+            pdfco.setEvaluatePartials(true);
+            pdfco.eval(mstru10);
+            TS_ASSERT_EQUALS(1u, pdfco.getPartialTypes().size());
+            pdfcb.eval(mstru10d1);
+            pdfco.eval(mstru10d1);
+            TS_ASSERT_EQUALS(OPTIMIZED, pdfco.getEvaluatorTypeUsed());
+            TS_ASSERT_EQUALS(2u, pdfco.getPartialTypes().size());
+            TS_ASSERT(allclose(pdfcb.getF(), pdfco.getF()));
+            TS_ASSERT(allclose(pdfcb.getPartialF(0, 1),
+                        pdfco.getPartialF(0, 1)));
+            TS_ASSERT(allclose(pdfcb.getPartialF(1, 1),
+                        pdfco.getPartialF(1, 1)));
+            pdfcb.eval(mstru9);
+            pdfco.eval(mstru9);
+            TS_ASSERT_EQUALS(OPTIMIZED, pdfco.getEvaluatorTypeUsed());
+            TS_ASSERT_EQUALS(1u, pdfco.getPartialTypes().size());
+            TS_ASSERT(allclose(pdfcb.getPartialF(0, 0),
+                        pdfco.getPartialF(0, 0)));
+        }
+
+
+        void test_gradients()
+        {
+            AtomicStructureAdapterPtr stru =
+                boost::make_shared<AtomicStructureAdapter>(*mstru10d1);
+            stru->erase(stru->begin() + 4, stru->end());
+            (*stru)[2].xyz_cartn = R3::Vector(1.2, 0.9, 0.0);
+            (*stru)[3].xyz_cartn = R3::Vector(0.4, 0.7, 1.1);
+            (*stru)[3].anisotropy = true;
+            (*stru)[3].uij_cartn(0, 1) = (*stru)[3].uij_cartn(1, 0) = 0.001;
+            (*stru)[3].uij_cartn(2, 2) = 0.007;
+            DebyePDFCalculator pdfc;
+            pdfc.setEvaluatorType(BASIC);
+            pdfc.setRmax(5.0);
+            pdfc.setDoubleAttr("delta2", 0.5);
+            TS_ASSERT_THROWS(pdfc.getFGradient(0, SITE_X), logic_error);
+            const double h = 1e-5;
+            const SiteParameter params[] = {SITE_X, SITE_Z, SITE_UISO};
+            for (int idx = 0; idx < 4; ++idx)
+            {
+                for (int j = 0; j < 3; ++j)
+                {
+                    const SiteParameter p = params[j];
+                    pdfc.setEvaluateGradients(true);
+                    pdfc.eval(stru);
+                    QuantityType g = pdfc.getFGradient(idx, p);
+                    pdfc.setEvaluateGradients(false);
+                    Atom& a = (*stru)[idx];
+                    const Atom a0 = a;
+                    if (p == SITE_UISO)  a.uij_cartn += h * R3::identity();
+                    else  a.xyz_cartn[p] += h;
+                    pdfc.eval(stru);
+                    QuantityType fp = pdfc.getF();
+                    a = a0;
+                    if (p == SITE_UISO)  a.uij_cartn -= h * R3::identity();
+                    else  a.xyz_cartn[p] -= h;
+                    pdfc.eval(stru);
+                    QuantityType fm = pdfc.getF();
+                    a = a0;
+                    double gmax = 0.0;
+                    double dgmax = 0.0;
+                    for (size_t k = 0; k < g.size(); ++k)
+                    {
+                        const double gfd = (fp[k] - fm[k]) / (2 * h);
+                        gmax = max(gmax, fabs(g[k]));
+                        dgmax = max(dgmax, fabs(g[k] - gfd));
+                    }
+                    TS_ASSERT_LESS_THAN(0.0, gmax);
+                    TS_ASSERT_LESS_THAN(dgmax, 1e-5 * gmax);
+                }
+            }
+            pdfc.setEvaluateGradients(true);
+            pdfc.eval(stru);
+            TS_ASSERT_EQUALS(pdfc.getRgrid().size(),
+                    pdfc.getPDFGradient(1, SITE_Y).size());
+            TS_ASSERT_THROWS(pdfc.getFGradient(4, SITE_X), invalid_argument);
+        }
+
+
+        void test_gradients_optimized()
+        {
+            DebyePDFCalculator pdfcb = *mpdfc;
+            DebyePDFCalculator pdfco = *mpdfc;
+            pdfcb.setEvaluatorType(BASIC);
+            pdfcb.setEvaluateGradients(true);
+            pdfco.setEvaluateGradients(true);
+            pdfco.eval(mstru10);
+            pdfcb.eval(mstru10d1);
+            pdfco.eval(mstru10d1);
+            TS_ASSERT_EQUALS(OPTIMIZED, pdfco.getEvaluatorTypeUsed());
+            TS_ASSERT(allclose(pdfcb.getF(), pdfco.getF()));
+            TS_ASSERT(allclose(pdfcb.getFGradient(0, SITE_X),
+                        pdfco.getFGradient(0, SITE_X)));
+            TS_ASSERT(allclose(pdfcb.getFGradient(1, SITE_UISO),
+                        pdfco.getFGradient(1, SITE_UISO)));
+            pdfcb.eval(mstru9);
+            pdfco.eval(mstru9);
+            TS_ASSERT_EQUALS(OPTIMIZED, pdfco.getEvaluatorTypeUsed());
+            TS_ASSERT(allclose(pdfcb.getFGradient(8, SITE_X),
+                        pdfco.getFGradient(8, SITE_X)));
+            // atom erased from the evaluated structure
+            AtomicStructureAdapterPtr stru =
+                boost::make_shared<AtomicStructureAdapter>(*mstru10);
+            pdfco.eval(stru);
+            stru->erase(9);
+            pdfcb.eval(stru);
+            pdfco.eval(stru);
+            TS_ASSERT_EQUALS(OPTIMIZED, pdfco.getEvaluatorTypeUsed());
+            TS_ASSERT(allclose(pdfcb.getF(), pdfco.getF()));
+            TS_ASSERT(allclose(pdfcb.getFGradient(8, SITE_X),
+                        pdfco.getFGradient(8, SITE_X)));
+        }
+
+
+        void test_getF_pair()
+        {
+            AtomicStructureAdapterPtr stru =
+                boost::make_shared<AtomicStructureAdapter>(*mstru10);
+            stru->erase(stru->begin() + 2, stru->end());
+            const double d = 37.3;
+            (*stru)[1].xyz_cartn[0] = d;
+            mpdfc->setScatteringFactorTableByType("electronnumber");
+            mpdfc->setPeakWidthModelByType("constant");
+            mpdfc->setDoubleAttr("width", 0.1);
+            mpdfc->setRmax(40);
+            mpdfc->setQmax(40);
+            mpdfc->eval(stru);
+            // compare with F for one pair over many recurrence blocks
+            QuantityType fq = mpdfc->getF();
+            QuantityType qgrid = mpdfc->getQgrid();
+            TS_ASSERT_LESS_THAN(500u, fq.size());
+            const double dwsigma = 0.1 / (2 * sqrt(2 * M_LN2));
+            double dfmax = 0.0;
+            for (size_t k = 0; k < fq.size(); ++k)
+            {
+                const double q = qgrid[k];
+                const double f = exp(-0.5 * pow(dwsigma * q, 2)) *
+                    sin(q * d) / d;
+                dfmax = max(dfmax, fabs(fq[k] - f));
+            }
+            TS_ASSERT_LESS_THAN(dfmax, 1e-12);
+        }
+
+
+        void test_histogram()
+        {
+            TS_ASSERT_EQUALS(0.0, mpdfc->getDoubleAttr("debyebinwidth"));
+            TS_ASSERT_THROWS(mpdfc->setDebyeBinWidth(-1e-4),
+                    invalid_argument);
+            // cluster with many repeated distances
+            AtomicStructureAdapterPtr stru =
+                boost::make_shared<AtomicStructureAdapter>();
+            Atom ai;
+            ai.atomtype = "C";
+            ai.uij_cartn = 0.004 * R3::identity();
+            for (int i = 0; i < 4; ++i)
+            {
+                for (int j = 0; j < 4; ++j)
+                {
+                    for (int k = 0; k < 4; ++k)
+                    {
+                        ai.xyz_cartn = R3::Vector(i, j, k) * 1.5;
+                        ai.atomtype = (i + j + k) % 2 ? "C" : "Ni";
+                        stru->append(ai);
+                    }
+                }
+            }
+            DebyePDFCalculator pdfc0, pdfc1;
+            pdfc0.setEvaluatorType(BASIC);
+            pdfc0.setEvaluatePartials(true);
+            pdfc0.eval(stru);
+            const double binwidth = 1e-4;
+            pdfc1.setEvaluatorType(BASIC);
+            pdfc1.setEvaluatePartials(true);
+            pdfc1.setDebyeBinWidth(binwidth);
+            pdfc1.eval(stru);
+            // compare with the documented error bound
+            QuantityType f0 = pdfc0.getPartialF(0, 1);
+            QuantityType f1 = pdfc1.getPartialF(0, 1);
+            const double fmax = fabs(*max_element(f0.begin(), f0.end(),
+                        [](double x, double y) { return fabs(x) < fabs(y); }));
+            double dfmax = 0.0;
+            for (size_t k = 0; k < f0.size(); ++k)
+            {
+                dfmax = max(dfmax, fabs(f1[k] - f0[k]));
+            }
+            TS_ASSERT_LESS_THAN(0.0, dfmax);
+            TS_ASSERT_LESS_THAN(dfmax,
+                    pdfc0.getQmax() * binwidth * fmax);
+            // OPTIMIZED updates adjust the bin counts
+            DebyePDFCalculator pdfco = pdfc1;
+            pdfco.setEvaluatorType(OPTIMIZED);
+            pdfco.eval(stru);
+            (*stru)[5].xyz_cartn[2] += 0.3;
+            (*stru)[7].atomtype = "Ni";
+            pdfc1.eval(stru);
+            pdfco.eval(stru);
+            TS_ASSERT_EQUALS(OPTIMIZED, pdfco.getEvaluatorTypeUsed());
+            TS_ASSERT(allclose(pdfc1.getF(), pdfco.getF()));
+            TS_ASSERT(allclose(pdfc1.getPartialF(0, 0),
+                        pdfco.getPartialF(0, 0)));
+            stru->erase(0);
+            pdfc1.eval(stru);
+            pdfco.eval(stru);
+            TS_ASSERT_EQUALS(OPTIMIZED, pdfco.getEvaluatorTypeUsed());
+            TS_ASSERT(allclose(pdfc1.getF(), pdfco.getF()));
+            pdfco.setEvaluatorType(CHECK);
+            (*stru)[3].xyz_cartn[0] += 0.1;
+            TS_ASSERT_THROWS_NOTHING(pdfco.eval(stru));
+            // threaded summation merges the histograms
+            DebyePDFCalculator pdfct = pdfc1;
+            pdfct.setEvaluatorType(THREADED);
+            pdfct.setNumThreads(3);
+            pdfct.eval(stru);
+            pdfc1.eval(stru);
+            TS_ASSERT_EQUALS(THREADED, pdfct.getEvaluatorTypeUsed());
+            TS_ASSERT(allclose(pdfc1.getF(), pdfct.getF()));
+        }
+
+
+        void test_qtiles()
+        {
+            TS_ASSERT_EQUALS(0, mpdfc->getQTileThreads());
+            TS_ASSERT_THROWS(mpdfc->setQTileThreads(-1), invalid_argument);
+            DebyePDFCalculator pdfc0, pdfc1;
+            pdfc0.setEvaluatorType(BASIC);
+            pdfc0.setEvaluatePartials(true);
+            pdfc0.setQmax(50);
+            pdfc0.setQstep(0.01);
+            pdfc0.eval(mstru10d1);
+            pdfc1 = pdfc0;
+            pdfc1.setEvaluatorType(BASIC);
+            pdfc1.setQTileThreads(4);
+            pdfc1.eval(mstru10d1);
+            TS_ASSERT_LESS_THAN(2000u, pdfc1.getF().size());
+            TS_ASSERT_EQUALS(pdfc0.getF(), pdfc1.getF());
+            TS_ASSERT_EQUALS(pdfc0.getPartialF(0, 1), pdfc1.getPartialF(0, 1));
+            // Q-tiles with the threaded pair summation
+            pdfc1.setEvaluatorType(THREADED);
+            pdfc1.setNumThreads(2);
+            pdfc1.eval(mstru10d1);
+            TS_ASSERT_EQUALS(THREADED, pdfc1.getEvaluatorTypeUsed());
+            TS_ASSERT(allclose(pdfc0.getF(), pdfc1.getF()));
+            // Q-tiles with the OPTIMIZED updates
+            pdfc1.setEvaluatorType(OPTIMIZED);
+            pdfc1.eval(mstru10);
+            pdfc1.eval(mstru10d1);
+            TS_ASSERT_EQUALS(OPTIMIZED, pdfc1.getEvaluatorTypeUsed());
+            TS_ASSERT(allclose(pdfc0.getF(), pdfc1.getF()));
+            TS_ASSERT(allclose(pdfc0.getPartialF(1, 1),
+                        pdfc1.getPartialF(1, 1)));
+            // debyeprecision cutoff inside the first Q-tile applies
+            // to the following tiles as well
+            pdfc0.setScatteringFactorTable(
+                    ScatteringFactorTablePtr(new ZeroCrossingXray));
+            pdfc0.eval(mstru10d1);
+            pdfc1 = pdfc0;
+            pdfc1.setEvaluatorType(BASIC);
+            pdfc1.setQTileThreads(4);
+            pdfc1.eval(mstru10d1);
+            const QuantityType& f0 = pdfc0.getF();
+            TS_ASSERT_EQUALS(1.0, 100 * pdfc0.getQstep());
+            TS_ASSERT_DIFFERS(0.0, f0[50]);
+            TS_ASSERT_EQUALS(0.0, *min_element(f0.begin() + 100, f0.end()));
+            TS_ASSERT_EQUALS(0.0, *max_element(f0.begin() + 100, f0.end()));
+            TS_ASSERT_EQUALS(f0, pdfc1.getF());
+        }
+
+
+        void test_grid_summation()
+        {
+            TS_ASSERT_EQUALS(0.0,
+                    mpdfc->getDoubleAttr("debyegridprecision"));
+            TS_ASSERT_THROWS(mpdfc->setDebyeGridPrecision(-1e-4),
+                    invalid_argument);
+            TS_ASSERT_THROWS(mpdfc->setDebyeGridPrecision(1),
+                    invalid_argument);
+            // two-component cluster with different displacements
+            AtomicStructureAdapterPtr stru =
+                boost::make_shared<AtomicStructureAdapter>();
+            Atom ai;
+            for (int i = 0; i < 3; ++i)
+            {
+                for (int j = 0; j < 3; ++j)
+                {
+                    for (int k = 0; k < 3; ++k)
+                    {
+                        const bool isni = (i + j + k) % 2;
+                        ai.atomtype = isni ? "Ni" : "C";
+                        ai.uij_cartn = (isni ? 0.004 : 0.008) *
+                            R3::identity();
+                        ai.xyz_cartn = R3::Vector(i, j + 0.1 * k, k) * 1.5;
+                        stru->append(ai);
+                    }
+                }
+            }
+            DebyePDFCalculator pdfc0, pdfc1;
+            pdfc0.setEvaluatorType(BASIC);
+            pdfc0.setEvaluatePartials(true);
+            pdfc0.setQmax(8);
+            pdfc0.eval(stru);
+            pdfc1 = pdfc0;
+            pdfc1.setEvaluatorType(BASIC);
+            pdfc1.setDebyeGridPrecision(1e-6);
+            pdfc1.eval(stru);
+            QuantityType f0 = pdfc0.getF();
+            const double fmax = fabs(*max_element(f0.begin(), f0.end(),
+                        [](double x, double y) { return fabs(x) < fabs(y); }));
+            diffpy::mathutils::EpsilonEqual gridclose(1e-5 * fmax);
+            TS_ASSERT(gridclose(f0, pdfc1.getF()));
+            TS_ASSERT(gridclose(pdfc0.getPartialF(0, 1),
+                        pdfc1.getPartialF(0, 1)));
+            TS_ASSERT(gridclose(pdfc0.getPartialF(1, 1),
+                        pdfc1.getPartialF(1, 1)));
+            TS_ASSERT(!allclose(f0, pdfc1.getF()));
+            // OPTIMIZED and THREADED evaluators skip the pair loop
+            DebyePDFCalculator pdfco = pdfc1;
+            pdfco.setEvaluatorType(OPTIMIZED);
+            pdfco.eval(stru);
+            (*stru)[5].xyz_cartn[2] += 0.3;
+            pdfco.eval(stru);
+            pdfc1.eval(stru);
+            TS_ASSERT_EQUALS(BASIC, pdfco.getEvaluatorTypeUsed());
+            TS_ASSERT_EQUALS(pdfc1.getF(), pdfco.getF());
+            DebyePDFCalculator pdfct = pdfc1;
+            pdfct.setEvaluatorType(THREADED);
+            pdfct.setNumThreads(2);
+            pdfct.eval(stru);
+            TS_ASSERT_EQUALS(BASIC, pdfct.getEvaluatorTypeUsed());
+            TS_ASSERT_EQUALS(pdfc1.getF(), pdfct.getF());
+            // constant peak widths are supported
+            pdfc0.setPeakWidthModelByType("constant");
+            pdfc0.setDoubleAttr("width", 0.15);
+            pdfc0.eval(stru);
+            pdfc1.setPeakWidthModelByType("constant");
+            pdfc1.setDoubleAttr("width", 0.15);
+            pdfc1.eval(stru);
+            TS_ASSERT(gridclose(pdfc0.getF(), pdfc1.getF()));
+            // unsupported configurations
+            pdfc1.setPeakWidthModelByType("jeong");
+            pdfc1.setDoubleAttr("delta2", 1.0);
+            TS_ASSERT_THROWS(pdfc1.eval(stru), invalid_argument);
+            pdfc1.setDoubleAttr("delta2", 0.0);
+            pdfc1.setEvaluateGradients(true);
+            TS_ASSERT_THROWS(pdfc1.eval(stru), logic_error);
+            pdfc1.setEvaluateGradients(false);
+            PeriodicStructureAdapterPtr pstru =
+                boost::make_shared<PeriodicStructureAdapter>();
+            pstru->setLatPar(4, 4, 4, 90, 90, 90);
+            pstru->append(ai);
+            TS_ASSERT_THROWS(pdfc1.eval(pstru), invalid_argument);
+        }
+
+
+        void test_grid_summation_cluster()
+        {
+            // spherical Ni cluster of about 1000 atoms
+            AtomicStructureAdapterPtr stru =
+                boost::make_shared<AtomicStructureAdapter>();
+            const double a = 3.52;
+            const double radius = 14;
+            const R3::Vector basis[4] = {R3::Vector(0, 0, 0),
+                R3::Vector(0, 0.5, 0.5), R3::Vector(0.5, 0, 0.5),
+                R3::Vector(0.5, 0.5, 0)};
+            Atom ai;
+            ai.atomtype = "Ni";
+            ai.uij_cartn = 0.005 * R3::identity();
+            for (int i = -4; i <= 4; ++i)
+            {
+                for (int j = -4; j <= 4; ++j)
+                {
+                    for (int k = -4; k <= 4; ++k)
+                    {
+                        for (const R3::Vector& b : basis)
+                        {
+                            ai.xyz_cartn = a * (R3::Vector(i, j, k) + b);
+                            if (R3::norm(ai.xyz_cartn) > radius)  continue;
+                            stru->append(ai);
+                        }
+                    }
+                }
+            }
+            TS_ASSERT_LESS_THAN(1000, stru->countSites());
+            DebyePDFCalculator pdfc0, pdfc1;
+            pdfc0.setQmax(10);
+            pdfc0.setRmax(30);
+            pdfc0.eval(stru);
+            pdfc1 = pdfc0;
+            pdfc1.setDebyeGridPrecision(1e-4);
+            pdfc1.eval(stru);
+            // the range encloses the whole cluster
+            QuantityType f0 = pdfc0.getF();
+            const double fmax = fabs(*max_element(f0.begin(), f0.end(),
+                        [](double x, double y) { return fabs(x) < fabs(y); }));
+            diffpy::mathutils::EpsilonEqual gridclose(1e-4 * fmax);
+            TS_ASSERT(gridclose(f0, pdfc1.getF()));
+            // the range cuts the correlations of the pairs close to rmax,
+            // which have smooth profiles in the grid summation
+            pdfc0.setRmax(15);
+            pdfc0.eval(stru);
+            pdfc1.setRmax(15);
+            pdfc1.eval(stru);
+            QuantityType g0 = pdfc0.getPDF();
+            const double gmax = fabs(*max_element(g0.begin(), g0.end(),
+                        [](double x, double y) { return fabs(x) < fabs(y); }));
+            diffpy::mathutils::EpsilonEqual cutclose(1e-2 * gmax);
+            TS_ASSERT(cutclose(g0, pdfc1.getPDF()));
+        }
+
+
         void test_setQmax()
         {
             const double dq0 = mpdfc->getQstep();
@@ -0,0 +1,114 @@
+/*****************************************************************************
+*
+* libdiffpy         Complex Modeling Initiative
+*                   (c) 2013 Brookhaven Science Associates,
+*                   Brookhaven National Laboratory.
+*                   All rights reserved.
+*
+* File coded by:    Pavol Juhas
+*
+* See AUTHORS.txt for a list of people who contributed.
+* See LICENSE.txt for license information.
+*
+******************************************************************************
+*
+* class TestEventTicker -- unit tests for the EventTicker class
+*
+*****************************************************************************/
+
+#include <cxxtest/TestSuite.h>
+
+#include <algorithm>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include <diffpy/EventTicker.hpp>
+#include "serialization_helpers.hpp"
+
+using diffpy::eventticker::EventTicker;
+
+//////////////////////////////////////////////////////////////////////////////
+// class TestEventTicker
+//////////////////////////////////////////////////////////////////////////////
+
+class TestEventTicker : public CxxTest::TestSuite
+{
+    public:
+
+        void test_click()
+        {
+            EventTicker tc0, tc1;
+            TS_ASSERT_EQUALS(tc0, tc1);
+            TS_ASSERT_EQUALS(EventTicker::value_type(0, 0), tc0.value());
+            tc0.click();
+            TS_ASSERT(tc1 < tc0);
+            tc1.click();
+            TS_ASSERT(tc0 < tc1);
+            TS_ASSERT_EQUALS(tc0.value().first, tc1.value().first);
+            TS_ASSERT_EQUALS(tc0.value().second + 1, tc1.value().second);
+        }
+
+
+        void test_updateFrom()
+        {
+            EventTicker tc0, tc1;
+            tc0.click();
+            tc1.updateFrom(tc0);
+            TS_ASSERT_EQUALS(tc0, tc1);
+            tc1.click();
+            tc1.updateFrom(tc0);
+            TS_ASSERT(tc0 < tc1);
+        }
+
+
+        void test_concurrent_clicks()
+        {
+            const int nthreads = 4;
+            const int nclicks = 1000;
+            EventTicker tc0;
+            tc0.click();
+            std::vector< std::vector<EventTicker::value_type> >
+                values(nthreads);
+            auto clicker = [&](int i) {
+                EventTicker tc;
+                for (int k = 0; k < nclicks; ++k)
+                {
+                    tc.click();
+                    values[i].push_back(tc.value());
+                }
+            };
+            std::vector<std::thread> threads;
+            for (int i = 0; i < nthreads; ++i)
+            {
+                threads.push_back(std::thread(clicker, i));
+            }
+            for (std::thread& t : threads)  t.join();
+            std::set<EventTicker::value_type> allvalues;
+            for (const auto& vi : values)
+            {
+                TS_ASSERT(tc0.value() < vi.front());
+                TS_ASSERT(std::is_sorted(vi.begin(), vi.end()));
+                allvalues.insert(vi.begin(), vi.end());
+            }
+            TS_ASSERT_EQUALS(size_t(nthreads * nclicks), allvalues.size());
+            EventTicker tc1;
+            tc1.click();
+            TS_ASSERT(*allvalues.rbegin() < tc1.value());
+        }
+
+
+        void test_serialization()
+        {
+            EventTicker tc0, tc1;
+            tc0.click();
+            tc1.click();
+            EventTicker tc0d = dumpandload(tc0);
+            TS_ASSERT_EQUALS(tc0, tc0d);
+            EventTicker tc1d = dumpandload(tc1);
+            TS_ASSERT(tc0d < tc1d);
+        }
+
+};  // class TestEventTicker
+
+// End of file
@@ -293,6 +293,31 @@ class TestOverlapCalculator : public CxxTest::TestSuite
         }
 
 
+        void test_threaded_neighbors()
+        {
+            OverlapCalculator olct;
+            olct.setAtomRadiiTable(molc->getAtomRadiiTable());
+            olct.setEvaluatorType(THREADED);
+            olct.setNumThreads(3);
+            molc->eval(mnacl);
+            olct.eval(mnacl);
+            TS_ASSERT_EQUALS(THREADED, olct.getEvaluatorTypeUsed());
+            // merged pairs are ordered by the first site as in serial run
+            TS_ASSERT_EQUALS(molc->sites0(), olct.sites0());
+            SiteIndices s1b = molc->sites1(), s1t = olct.sites1();
+            sort(s1b.begin(), s1b.end());
+            sort(s1t.begin(), s1t.end());
+            TS_ASSERT_EQUALS(s1b, s1t);
+            TS_ASSERT_EQUALS(molc->coordinations(), olct.coordinations());
+            TS_ASSERT_EQUALS(molc->getNeighborSites(5),
+                    olct.getNeighborSites(5));
+            TS_ASSERT_DELTA(molc->totalSquareOverlap(),
+                    olct.totalSquareOverlap(), meps);
+            TS_ASSERT_DELTA(0.72, olct.flipDiffTotal(0, 5), meps);
+            TS_ASSERT_DELTA(1.08, olct.flipDiffTotal(4, 0), meps);
+        }
+
+
         void test_neighborhoods()
         {
             auto tb = molc->getAtomRadiiTable();
@@ -19,16 +19,49 @@
 #include <cxxtest/TestSuite.h>
 
 #include <diffpy/srreal/StructureAdapter.hpp>
+#include <diffpy/srreal/AtomicStructureAdapter.hpp>
+#include <diffpy/srreal/CrystalStructureAdapter.hpp>
 #include <diffpy/srreal/PDFCalculator.hpp>
 #include <diffpy/srreal/JeongPeakWidth.hpp>
 #include <diffpy/srreal/ConstantPeakWidth.hpp>
 #include <diffpy/srreal/QResolutionEnvelope.hpp>
+#include <diffpy/srreal/ZeroBaseline.hpp>
+#include <diffpy/srreal/PDFUtils.hpp>
 #include <diffpy/serialization.hpp>
 #include "test_helpers.hpp"
 
 using namespace std;
 using namespace diffpy::srreal;
 
+// baseline type without attributes that differs from ZeroBaseline
+
+class UnitBaseline : public ZeroBaseline
+{
+    public:
+
+        PDFBaselinePtr create() const
+        {
+            return PDFBaselinePtr(new UnitBaseline);
+        }
+
+        PDFBaselinePtr clone() const
+        {
+            return PDFBaselinePtr(new UnitBaseline(*this));
+        }
+
+        const string& type() const
+        {
+            static const string rv = "unit";
+            return rv;
+        }
+
+        double operator()(const double& r) const  { return 1.0; }
+};
+
+//////////////////////////////////////////////////////////////////////////////
+// class TestPDFCalculator
+//////////////////////////////////////////////////////////////////////////////
+
 class TestPDFCalculator : public CxxTest::TestSuite
 {
     private:
@@ -38,6 +71,39 @@ class TestPDFCalculator : public CxxTest::TestSuite
         double meps;
         double mepsdb;
 
+        /// maximum difference between the PDF gradient and its central
+        /// difference estimate relative to the maximum gradient
+        double gradientError(PDFCalculator& pdfc,
+                AtomicStructureAdapterPtr stru, int idx, SiteParameter p)
+        {
+            const double h = 1e-5;
+            pdfc.setEvaluateGradients(true);
+            pdfc.eval(stru);
+            QuantityType g = pdfc.getPDFGradient(idx, p);
+            pdfc.setEvaluateGradients(false);
+            Atom& a = stru->at(idx);
+            const Atom a0 = a;
+            if (p == SITE_UISO)  a.uij_cartn += h * R3::identity();
+            else  a.xyz_cartn[p] += h;
+            pdfc.eval(stru);
+            QuantityType gp = pdfc.getPDF();
+            a = a0;
+            if (p == SITE_UISO)  a.uij_cartn -= h * R3::identity();
+            else  a.xyz_cartn[p] -= h;
+            pdfc.eval(stru);
+            QuantityType gm = pdfc.getPDF();
+            a = a0;
+            double gmax = 0.0;
+            double dgmax = 0.0;
+            for (size_t i = 0; i < g.size(); ++i)
+            {
+                gmax = max(gmax, fabs(g[i]));
+                dgmax = max(dgmax, fabs(g[i] - (gp[i] - gm[i]) / (2 * h)));
+            }
+            TS_ASSERT_LESS_THAN(0.0, gmax);
+            return dgmax / gmax;
+        }
+
     public:
 
         void setUp()
@@ -141,6 +207,286 @@ class TestPDFCalculator : public CxxTest::TestSuite
         }
 
 
+        void test_results_cache()
+        {
+            StructureAdapterPtr catio3;
+            catio3 = loadTestPeriodicStructure("CaTiO3.stru");
+            mpdfc->setRmax(5.0);
+            mpdfc->eval(catio3);
+            QuantityType pdf0 = mpdfc->getPDF();
+            QuantityType f0 = mpdfc->getF();
+            TS_ASSERT_EQUALS(pdf0, mpdfc->getPDF());
+            // envelope and baseline changes apply to the cached results
+            mpdfc->setDoubleAttr("scale", 2.0);
+            QuantityType pdf1 = mpdfc->getPDF();
+            TS_ASSERT_DELTA(2 * pdf0[250], pdf1[250], meps);
+            TS_ASSERT_EQUALS(f0, mpdfc->getF());
+            mpdfc->setDoubleAttr("scale", 1.0);
+            TS_ASSERT_EQUALS(pdf0, mpdfc->getPDF());
+            // baselines of other type but equal attributes are told apart
+            mpdfc->setBaselineByType("zero");
+            QuantityType pdfz = mpdfc->getPDF();
+            mpdfc->setBaseline(PDFBaselinePtr(new UnitBaseline));
+            TS_ASSERT_DIFFERS(pdfz, mpdfc->getPDF());
+            mpdfc->setBaselineByType("zero");
+            TS_ASSERT_EQUALS(pdfz, mpdfc->getPDF());
+            mpdfc->setBaselineByType("linear");
+            // qmin is applied without new evaluation
+            mpdfc->setQmax(25);
+            mpdfc->eval();
+            QuantityType pdf2 = mpdfc->getPDF();
+            mpdfc->setQmin(1);
+            TS_ASSERT_DIFFERS(pdf2, mpdfc->getPDF());
+            PDFCalculator pdfc1;
+            pdfc1.setRmax(5.0);
+            pdfc1.setQmax(25);
+            pdfc1.setQmin(1);
+            pdfc1.eval(catio3);
+            TS_ASSERT_EQUALS(pdfc1.getPDF(), mpdfc->getPDF());
+            TS_ASSERT_EQUALS(pdfc1.getF(), mpdfc->getF());
+            TS_ASSERT_EQUALS(pdfc1.getRDF(), mpdfc->getRDF());
+            // results are updated after new evaluation
+            mpdfc->eval(memptystru);
+            QuantityType pdf3 = mpdfc->getPDF();
+            TS_ASSERT_EQUALS(0.0, *min_element(pdf3.begin(), pdf3.end()));
+            TS_ASSERT_EQUALS(0.0, *max_element(pdf3.begin(), pdf3.end()));
+        }
+
+
+        void test_partials()
+        {
+            StructureAdapterPtr catio3;
+            catio3 = loadTestPeriodicStructure("CaTiO3.stru");
+            mpdfc->setRmax(5.0);
+            mpdfc->setQmax(25);
+            PDFCalculator pdfc0 = *mpdfc;
+            pdfc0.setEvaluatorType(BASIC);
+            TS_ASSERT(!mpdfc->getEvaluatePartials());
+            mpdfc->setEvaluatePartials(true);
+            TS_ASSERT(mpdfc->getEvaluatePartials());
+            TS_ASSERT_THROWS(mpdfc->getPartialPDF(0, 0), logic_error);
+            pdfc0.eval(catio3);
+            mpdfc->eval(catio3);
+            TS_ASSERT_THROWS(pdfc0.getPartialPDF(0, 0), logic_error);
+            TS_ASSERT_EQUALS(pdfc0.getPDF(), mpdfc->getPDF());
+            const vector<string>& tps = mpdfc->getPartialTypes();
+            TS_ASSERT_EQUALS(3u, tps.size());
+            TS_ASSERT_EQUALS(catio3->siteAtomType(0), tps[0]);
+            TS_ASSERT_THROWS(mpdfc->getPartialPDF(0, 3), invalid_argument);
+            TS_ASSERT_THROWS(mpdfc->getPartialWeight(-1, 0),
+                    invalid_argument);
+            TS_ASSERT_EQUALS(mpdfc->getPartialPDF(0, 2),
+                    mpdfc->getPartialPDF(2, 0));
+            // total results are weighted sums of the partials
+            QuantityType pdf = mpdfc->getPDF();
+            QuantityType rdf = mpdfc->getRDF();
+            QuantityType fq = mpdfc->getF();
+            QuantityType spdf(pdf.size()), srdf(rdf.size()), sfq(fq.size());
+            double sw = 0.0;
+            for (int j = 0; j < 3; ++j)
+            {
+                for (int i = 0; i <= j; ++i)
+                {
+                    const double w = mpdfc->getPartialWeight(i, j);
+                    TS_ASSERT_LESS_THAN(0.0, w);
+                    sw += w;
+                    QuantityType pdfij = mpdfc->getPartialPDF(i, j);
+                    QuantityType rdfij = mpdfc->getPartialRDF(i, j);
+                    QuantityType fqij = mpdfc->getPartialF(i, j);
+                    for (size_t k = 0; k < pdf.size(); ++k)
+                    {
+                        spdf[k] += w * pdfij[k];
+                        srdf[k] += w * rdfij[k];
+                    }
+                    for (size_t k = 0; k < fq.size(); ++k)
+                    {
+                        sfq[k] += w * fqij[k];
+                    }
+                }
+            }
+            diffpy::mathutils::EpsilonEqual allclose;
+            TS_ASSERT_DELTA(1.0, sw, meps);
+            TS_ASSERT(allclose(pdf, spdf));
+            TS_ASSERT(allclose(rdf, srdf));
+            TS_ASSERT(allclose(fq, sfq));
+        }
+
+
+        void test_partials_optimized()
+        {
+            AtomicStructureAdapterPtr stru(new AtomicStructureAdapter);
+            Atom ai;
+            ai.atomtype = "C";
+            ai.uij_cartn = R3::identity();
+            ai.uij_cartn(0, 0) = ai.uij_cartn(1, 1) =
+                ai.uij_cartn(2, 2) = 0.004;
+            for (int i = 0; i < 10; ++i)
+            {
+                ai.xyz_cartn[0] = i;
+                stru->append(ai);
+            }
+            PDFCalculator pdfcb, pdfco;
+            pdfcb.setEvaluatorType(BASIC);
+            pdfcb.setEvaluatePartials(true);
+            pdfco.setEvaluatePartials(true);
+            pdfco.eval(stru);
+            // change atom type and position of one atom
+            (*stru)[0].atomtype = "Au";
+            (*stru)[5].xyz_cartn[1] = 0.5;
+            pdfcb.eval(stru);
+            pdfco.eval(stru);
+            TS_ASSERT_EQUALS(OPTIMIZED, pdfco.getEvaluatorTypeUsed());
+            TS_ASSERT_EQUALS(2u, pdfco.getPartialTypes().size());
+            TS_ASSERT_EQUALS("Au", pdfco.getPartialTypes()[0]);
+            diffpy::mathutils::EpsilonEqual allclose;
+            TS_ASSERT(allclose(pdfcb.getPDF(), pdfco.getPDF()));
+            TS_ASSERT(allclose(pdfcb.getPartialPDF(0, 0),
+                        pdfco.getPartialPDF(0, 0)));
+            TS_ASSERT(allclose(pdfcb.getPartialPDF(0, 1),
+                        pdfco.getPartialPDF(0, 1)));
+            TS_ASSERT(allclose(pdfcb.getPartialPDF(1, 1),
+                        pdfco.getPartialPDF(1, 1)));
+            // remove the Au atom type
+            (*stru)[0].atomtype = "C";
+            pdfcb.eval(stru);
+            pdfco.eval(stru);
+            TS_ASSERT_EQUALS(OPTIMIZED, pdfco.getEvaluatorTypeUsed());
+            TS_ASSERT_EQUALS(1u, pdfco.getPartialTypes().size());
+            TS_ASSERT(allclose(pdfcb.getPartialPDF(0, 0),
+                        pdfco.getPartialPDF(0, 0)));
+            TS_ASSERT(allclose(pdfcb.getPDF(), pdfco.getPDF()));
+        }
+
+
+        void test_gradients()
+        {
+            AtomicStructureAdapterPtr stru(new AtomicStructureAdapter);
+            Atom ai;
+            ai.atomtype = "C";
+            ai.uij_cartn = 0.004 * R3::identity();
+            const double xyz[4][3] = {
+                {0.0, 0.0, 0.0}, {1.4, 0.1, 0.0},
+                {0.3, 1.5, -0.2}, {1.1, 0.9, 1.3}};
+            for (int i = 0; i < 4; ++i)
+            {
+                ai.xyz_cartn = R3::Vector(xyz[i][0], xyz[i][1], xyz[i][2]);
+                stru->append(ai);
+            }
+            Atom& a2 = stru->at(2);
+            a2.atomtype = "O";
+            a2.anisotropy = true;
+            a2.uij_cartn = R3::Matrix(
+                    0.006, 0.001, 0.0,
+                    0.001, 0.003, 0.0005,
+                    0.0, 0.0005, 0.008);
+            PDFCalculator pdfc;
+            pdfc.setEvaluatorType(BASIC);
+            TS_ASSERT_THROWS(pdfc.getPDFGradient(0, SITE_X), logic_error);
+            pdfc.setRmax(4.0);
+            pdfc.setQmax(25.0);
+            pdfc.setDoubleAttr("peakprecision", 1e-12);
+            pdfc.setDoubleAttr("delta2", 1.0);
+            pdfc.setDoubleAttr("qbroad", 0.02);
+            const double eps = 1e-5;
+            TS_ASSERT_LESS_THAN(gradientError(pdfc, stru, 1, SITE_X), eps);
+            TS_ASSERT_LESS_THAN(gradientError(pdfc, stru, 1, SITE_Z), eps);
+            TS_ASSERT_LESS_THAN(gradientError(pdfc, stru, 1, SITE_UISO), eps);
+            TS_ASSERT_LESS_THAN(gradientError(pdfc, stru, 2, SITE_X), eps);
+            TS_ASSERT_LESS_THAN(gradientError(pdfc, stru, 2, SITE_Y), eps);
+            TS_ASSERT_LESS_THAN(gradientError(pdfc, stru, 2, SITE_UISO), eps);
+            // the PDF does not change for a rigid translation
+            pdfc.setEvaluateGradients(true);
+            pdfc.eval(stru);
+            QuantityType gsum = pdfc.getRDFGradient(0, SITE_Y);
+            for (int i = 1; i < 4; ++i)
+            {
+                QuantityType gi = pdfc.getRDFGradient(i, SITE_Y);
+                for (size_t k = 0; k < gsum.size(); ++k)  gsum[k] += gi[k];
+            }
+            TS_ASSERT_DELTA(0.0, *min_element(gsum.begin(), gsum.end()), meps);
+            TS_ASSERT_DELTA(0.0, *max_element(gsum.begin(), gsum.end()), meps);
+            TS_ASSERT_THROWS(pdfc.getPDFGradient(4, SITE_X), invalid_argument);
+            TS_ASSERT_THROWS(pdfc.getPDFGradient(-1, SITE_X),
+                    invalid_argument);
+        }
+
+
+        void test_gradients_crystal()
+        {
+            // monoclinic structure in the P21/c space group
+            CrystalStructureAdapterPtr stru(new CrystalStructureAdapter);
+            stru->setLatPar(5.0, 6.0, 7.0, 90, 100, 90);
+            const R3::Matrix& I = R3::identity();
+            R3::Matrix R2 = -I;
+            R2(1, 1) = 1;
+            stru->addSymOp(I, R3::Vector(0.0, 0.0, 0.0));
+            stru->addSymOp(R2, R3::Vector(0.0, 0.5, 0.5));
+            stru->addSymOp(-I, R3::Vector(0.0, 0.0, 0.0));
+            stru->addSymOp(-R2, R3::Vector(0.0, 0.5, 0.5));
+            Atom ai;
+            // isotropic Cartesian Uij set after the conversion
+            ai.atomtype = "Ti";
+            ai.xyz_cartn = R3::Vector(0.1, 0.2, 0.3);
+            stru->toCartesian(ai);
+            ai.uij_cartn = 0.005 * I;
+            stru->append(ai);
+            ai.atomtype = "O";
+            ai.xyz_cartn = R3::Vector(0.35, 0.05, 0.2);
+            stru->toCartesian(ai);
+            ai.uij_cartn = 0.008 * I;
+            stru->append(ai);
+            TS_ASSERT_EQUALS(4, stru->siteMultiplicity(0));
+            TS_ASSERT_EQUALS(4u, stru->getEquivalentJacobians(1).size());
+            PDFCalculator pdfc;
+            pdfc.setEvaluatorType(BASIC);
+            pdfc.setRmax(5.0);
+            pdfc.setDoubleAttr("peakprecision", 1e-12);
+            const double eps = 1e-5;
+            TS_ASSERT_LESS_THAN(gradientError(pdfc, stru, 0, SITE_X), eps);
+            TS_ASSERT_LESS_THAN(gradientError(pdfc, stru, 0, SITE_Y), eps);
+            TS_ASSERT_LESS_THAN(gradientError(pdfc, stru, 1, SITE_Z), eps);
+            TS_ASSERT_LESS_THAN(gradientError(pdfc, stru, 1, SITE_UISO), eps);
+        }
+
+
+        void test_gradients_optimized()
+        {
+            AtomicStructureAdapterPtr stru(new AtomicStructureAdapter);
+            Atom ai;
+            ai.atomtype = "C";
+            ai.uij_cartn = 0.004 * R3::identity();
+            for (int i = 0; i < 10; ++i)
+            {
+                ai.xyz_cartn[0] = i;
+                stru->append(ai);
+            }
+            PDFCalculator pdfcb, pdfco;
+            pdfcb.setEvaluatorType(BASIC);
+            pdfcb.setEvaluateGradients(true);
+            pdfco.setEvaluateGradients(true);
+            pdfco.eval(stru);
+            stru->at(5).xyz_cartn[1] = 0.5;
+            pdfcb.eval(stru);
+            pdfco.eval(stru);
+            TS_ASSERT_EQUALS(OPTIMIZED, pdfco.getEvaluatorTypeUsed());
+            diffpy::mathutils::EpsilonEqual allclose;
+            TS_ASSERT(allclose(pdfcb.getPDF(), pdfco.getPDF()));
+            TS_ASSERT(allclose(pdfcb.getPDFGradient(5, SITE_Y),
+                        pdfco.getPDFGradient(5, SITE_Y)));
+            TS_ASSERT(allclose(pdfcb.getPDFGradient(4, SITE_Y),
+                        pdfco.getPDFGradient(4, SITE_Y)));
+            // remove the last atom
+            stru->erase(9);
+            pdfcb.eval(stru);
+            pdfco.eval(stru);
+            TS_ASSERT_EQUALS(OPTIMIZED, pdfco.getEvaluatorTypeUsed());
+            TS_ASSERT(allclose(pdfcb.getPDFGradient(8, SITE_X),
+                        pdfco.getPDFGradient(8, SITE_X)));
+            TS_ASSERT(allclose(pdfcb.getPDFGradient(0, SITE_UISO),
+                        pdfco.getPDFGradient(0, SITE_UISO)));
+        }
+
+
         void test_getRDF()
         {
             QuantityType rdf = mpdfc->getRDF();
@@ -170,7 +516,7 @@ class TestPDFCalculator : public CxxTest::TestSuite
         void test_getF()
         {
             QuantityType fq = mpdfc->getF();
-            TS_ASSERT_EQUALS(1024u, fq.size());
+            TS_ASSERT_EQUALS(1000u, fq.size());
             TS_ASSERT_EQUALS(0.0, *min_element(fq.begin(), fq.end()));
             TS_ASSERT_EQUALS(0.0, *max_element(fq.begin(), fq.end()));
         }
@@ -178,7 +524,7 @@ class TestPDFCalculator : public CxxTest::TestSuite
 
         void test_getQgrid()
         {
-            TS_ASSERT_EQUALS(1024u, mpdfc->getQgrid().size());
+            TS_ASSERT_EQUALS(1000u, mpdfc->getQgrid().size());
         }
 
 
@@ -196,10 +542,10 @@ class TestPDFCalculator : public CxxTest::TestSuite
 
         void test_getQstep()
         {
-            const double qstep0 = 100 * M_PI / 1024;
-            const double qstep1 = 100 * M_PI / 2048;
-            const double qstep2 = 100 * M_PI / 4096;
-            const double qstep3 = M_PI / (1024 * 0.03);
+            const double qstep0 = 100 * M_PI / 1000;
+            const double qstep1 = 100 * M_PI / 2000;
+            const double qstep2 = 100 * M_PI / 2400;
+            const double qstep3 = M_PI / (800 * 0.03);
             TS_ASSERT_DELTA(qstep0, mpdfc->getQstep(), meps);
             mpdfc->setRmax(20);
             TS_ASSERT_DELTA(qstep1, mpdfc->getQstep(), meps);
@@ -221,6 +567,39 @@ class TestPDFCalculator : public CxxTest::TestSuite
         }
 
 
+        void test_fftgtof()
+        {
+            TS_ASSERT_EQUALS(2, fftPaddedSize(0));
+            TS_ASSERT_EQUALS(2, fftPaddedSize(2));
+            TS_ASSERT_EQUALS(8, fftPaddedSize(7));
+            TS_ASSERT_EQUALS(30, fftPaddedSize(29));
+            TS_ASSERT_EQUALS(1000, fftPaddedSize(999));
+            // compare with the sine sums for a mixed-radix length
+            const double dr = 0.1;
+            QuantityType g(21);
+            for (size_t i = 0; i < g.size(); ++i)  g[i] = sin(0.7 * i) + 0.1;
+            QuantityType f = fftgtof(g, dr, 0.8);
+            TS_ASSERT_EQUALS(30u, f.size());
+            for (int k = 0; k < 30; ++k)
+            {
+                double fk = 0.0;
+                for (size_t i = 0; i < g.size(); ++i)
+                {
+                    fk += dr * g[i] * sin(M_PI * (i + 8) * k / 30);
+                }
+                TS_ASSERT_DELTA(fk, f[k], 1e-12);
+            }
+            // the inverse transformation restores the signal
+            QuantityType g1 = fftftog(f, M_PI / (30 * dr));
+            TS_ASSERT_EQUALS(30u, g1.size());
+            for (size_t i = 0; i < g.size(); ++i)
+            {
+                TS_ASSERT_DELTA(g[i], g1[i + 8], 1e-12);
+            }
+            TS_ASSERT_DELTA(0.0, g1[29], 1e-12);
+        }
+
+
         void test_getRgrid()
         {
             QuantityType rgrid0 = mpdfc->getRgrid();
@@ -20,14 +20,22 @@
 
 #include <algorithm>
 #include <functional>
+#include <thread>
+#include <unistd.h>
 #include <boost/make_shared.hpp>
 
 #include <diffpy/srreal/PQEvaluator.hpp>
 #include <diffpy/srreal/AtomicStructureAdapter.hpp>
 #include <diffpy/srreal/PeriodicStructureAdapter.hpp>
+#include <diffpy/srreal/CrystalStructureAdapter.hpp>
 #include <diffpy/srreal/PairCounter.hpp>
 #include <diffpy/srreal/PDFCalculator.hpp>
+#include <diffpy/srreal/DebyePDFCalculator.hpp>
+#include <diffpy/srreal/BVSCalculator.hpp>
+#include <diffpy/srreal/JeongPeakWidth.hpp>
 #include <diffpy/srreal/OverlapCalculator.hpp>
+#include <diffpy/srreal/BondCalculator.hpp>
+#include <diffpy/srreal/SharedParallelData.hpp>
 #include "test_helpers.hpp"
 
 namespace diffpy {
@@ -47,6 +55,23 @@ class BadPairCounter : public PairCounter
         virtual void restorePartialValue()  { }
 };
 
+// calculators that add pair contributions one bond at a time
+
+class PerBondPeakWidth : public JeongPeakWidth
+{
+    public:
+
+        virtual bool configureBondBatch(BondBatch&) const  { return false; }
+};
+
+
+class PerBondBVSCalculator : public BVSCalculator
+{
+    protected:
+
+        virtual bool configureBondBatch(BondBatch&) const  { return false; }
+};
+
 //////////////////////////////////////////////////////////////////////////////
 // class TestPQEvaluator
 //////////////////////////////////////////////////////////////////////////////
@@ -117,6 +142,8 @@ class TestPQEvaluator : public CxxTest::TestSuite
             TS_ASSERT_EQUALS(NONE, pdfc.getEvaluatorTypeUsed());
             pdfc.setEvaluatorType(CHECK);
             TS_ASSERT_EQUALS(NONE, pdfc.getEvaluatorTypeUsed());
+            pdfc.setEvaluatorType(THREADED);
+            TS_ASSERT_EQUALS(NONE, pdfc.getEvaluatorTypeUsed());
             pdfc.setEvaluatorType(BASIC);
             TS_ASSERT_EQUALS(NONE, pdfc.getEvaluatorTypeUsed());
         }
@@ -155,6 +182,30 @@ class TestPQEvaluator : public CxxTest::TestSuite
         }
 
 
+        void test_PDF_held_reference()
+        {
+            // changes through a reference taken before the evaluation
+            // do not leak into the evaluator snapshot
+            Atom& a3 = mstru10d1->at(3);
+            mpdfco.eval(mstru10d1);
+            mpdfco.eval(mstru10d1);
+            TS_ASSERT_EQUALS(OPTIMIZED, mpdfco.getEvaluatorTypeUsed());
+            a3.xyz_cartn[2] += 0.7;
+            // the change is seen after the site is accessed again
+            mstru10d1->at(3);
+            TS_ASSERT(allclose(mzeros, this->pdfcdiff(mstru10d1)));
+            TS_ASSERT_EQUALS(OPTIMIZED, mpdfco.getEvaluatorTypeUsed());
+            // and through a held non-const iterator
+            AtomicStructureAdapter::iterator ai = mstru10d1->begin();
+            ai[5].xyz_cartn[0] -= 0.3;
+            TS_ASSERT(allclose(mzeros, this->pdfcdiff(mstru10d1)));
+            ai[5].xyz_cartn[0] -= 0.3;
+            mstru10d1->at(5);
+            TS_ASSERT(allclose(mzeros, this->pdfcdiff(mstru10d1)));
+            TS_ASSERT_EQUALS(OPTIMIZED, mpdfco.getEvaluatorTypeUsed());
+        }
+
+
         void test_PDF_reverse_atoms()
         {
             mpdfco.eval(mstru10);
@@ -163,6 +214,19 @@ class TestPQEvaluator : public CxxTest::TestSuite
         }
 
 
+        void test_PDF_moved_atoms()
+        {
+            mpdfco.setEvaluatorType(CHECK);
+            mpdfco.eval(mstru10);
+            AtomicStructureAdapterPtr stru1 =
+                boost::make_shared<AtomicStructureAdapter>(*mstru10);
+            stru1->at(7).xyz_cartn[2] = 0.5;
+            stru1->erase(0);
+            TS_ASSERT(allclose(mzeros, this->pdfcdiff(stru1)));
+            TS_ASSERT_EQUALS(CHECK, mpdfco.getEvaluatorTypeUsed());
+        }
+
+
         void test_PDF_remove_atom()
         {
             mpdfco.eval(mstru10);
@@ -234,6 +298,49 @@ class TestPQEvaluator : public CxxTest::TestSuite
         }
 
 
+        void test_bond_batch()
+        {
+            StructureAdapterPtr litao =
+                loadTestPeriodicStructure("LiTaO3.stru");
+            boost::shared_ptr<JeongPeakWidth> pwm(new JeongPeakWidth);
+            boost::shared_ptr<JeongPeakWidth> pwm1(new PerBondPeakWidth);
+            pwm->setDelta2(1.5);
+            pwm1->setDelta2(1.5);
+            // PDFCalculator
+            mpdfcb.setPeakWidthModel(pwm);
+            mpdfco.setPeakWidthModel(pwm1);
+            mpdfco.setEvaluatorType(BASIC);
+            TS_ASSERT(allclose(mzeros, this->pdfcdiff(litao)));
+            TS_ASSERT(allclose(mzeros, this->pdfcdiff(mstru10)));
+            mpdfcb.setPeakWidthModelByType("constant");
+            mpdfcb.getPeakWidthModel()->setDoubleAttr("width", 0.1);
+            TS_ASSERT(!allclose(mzeros, this->pdfcdiff(mstru10)));
+            mpdfco.setPeakWidthModelByType("constant");
+            mpdfco.getPeakWidthModel()->setDoubleAttr("width", 0.1);
+            TS_ASSERT(allclose(mzeros, this->pdfcdiff(mstru10)));
+            // DebyePDFCalculator
+            DebyePDFCalculator dbpdfc, dbpdfc1;
+            dbpdfc.setPeakWidthModel(pwm);
+            dbpdfc1.setPeakWidthModel(pwm1);
+            dbpdfc.eval(litao);
+            dbpdfc1.eval(litao);
+            TS_ASSERT(allclose(dbpdfc1.getPDF(), dbpdfc.getPDF()));
+            // BVSCalculator
+            BVSCalculator bvc;
+            PerBondBVSCalculator bvc1;
+            bvc.eval(litao);
+            bvc1.eval(litao);
+            TS_ASSERT(allclose(bvc1.value(), bvc.value()));
+            // optimized updates use batches for removed and added sites
+            mpdfcb.setPeakWidthModel(pwm);
+            mpdfco.setPeakWidthModel(pwm);
+            mpdfco.setEvaluatorType(OPTIMIZED);
+            this->pdfcdiff(mstru10);
+            TS_ASSERT(allclose(mzeros, this->pdfcdiff(mstru10d1)));
+            TS_ASSERT_EQUALS(OPTIMIZED, mpdfco.getEvaluatorTypeUsed());
+        }
+
+
         void test_optimized_supported()
         {
             mpdfcb.eval(mstru10);
@@ -288,6 +395,321 @@ class TestPQEvaluator : public CxxTest::TestSuite
             TS_ASSERT_EQUALS(CHECK, badcounter.getEvaluatorTypeUsed());
         }
 
+
+
+        void test_parallel_split()
+        {
+            // dense core followed by a sparse shell
+            AtomicStructureAdapterPtr stru =
+                boost::make_shared<AtomicStructureAdapter>();
+            Atom ai = mstru10->at(0);
+            for (int i = 0; i < 6 * 6 * 6; ++i)
+            {
+                ai.xyz_cartn = R3::Vector(i % 6, i / 6 % 6, i / 36);
+                stru->append(ai);
+            }
+            for (int i = 0; i < 12 * 12 * 12; ++i)
+            {
+                ai.xyz_cartn = R3::Vector(i % 12, i / 12 % 12, i / 144);
+                ai.xyz_cartn *= 3.0;
+                ai.xyz_cartn -= R3::Vector(15.5, 15.5, 15.5);
+                stru->append(ai);
+            }
+            const int ncpu = 4;
+            PairCounter pcount;
+            pcount.setRmax(4.0);
+            const int cnt = pcount(stru);
+            PDFCalculator pmaster;
+            pmaster.setStructure(stru);
+            int cntsum = 0;
+            for (int cpuindex = 0; cpuindex < ncpu; ++cpuindex)
+            {
+                PairCounter pc;
+                pc.setRmax(4.0);
+                pc.setupParallelRun(cpuindex, ncpu);
+                int cntcpu = pc(stru);
+                cntsum += cntcpu;
+                TS_ASSERT_LESS_THAN(0, cntcpu);
+                PDFCalculator pdfc;
+                pdfc.setupParallelRun(cpuindex, ncpu);
+                pdfc.eval(stru);
+                pmaster.mergeParallelData(pdfc.getParallelData(), ncpu);
+            }
+            TS_ASSERT_EQUALS(cnt, cntsum);
+            mpdfcb.eval(stru);
+            TS_ASSERT(allclose(mpdfcb.getPDF(), pmaster.getPDF()));
+        }
+
+
+        void test_shared_parallel_data()
+        {
+            const std::string shmname =
+                "/libdiffpy-test-" + std::to_string(getpid());
+            // zero runs are left out in the sparse encoding
+            QuantityType v(100, 0.0);
+            v[3] = 1;  v[5] = 2;  v[90] = 3;
+            SharedParallelData::writeValue(shmname, v);
+            SharedParallelData sdata(shmname);
+            TS_ASSERT_EQUALS(SharedParallelData::VALUE_DATA, sdata.format());
+            TS_ASSERT_EQUALS(100u, sdata.size());
+            QuantityType v1(v.size(), 1.0);
+            sdata.addTo(v1);
+            TS_ASSERT_EQUALS(2, v1[3]);
+            TS_ASSERT_EQUALS(1, v1[4]);
+            TS_ASSERT_EQUALS(4, v1[90]);
+            QuantityType v2(10);
+            TS_ASSERT_THROWS(sdata.addTo(v2), invalid_argument);
+            // the name is removed once the data are mapped by the host
+            TS_ASSERT_THROWS(SharedParallelData{shmname}, runtime_error);
+            // merge of PDF, bond and overlap values
+            const int ncpu = 3;
+            PDFCalculator pmaster;
+            pmaster.setStructure(mstru10);
+            BondCalculator bmaster;
+            bmaster.setRmax(3.5);
+            bmaster.setStructure(mstru10);
+            OverlapCalculator omaster;
+            omaster.setStructure(mstru10);
+            for (int cpuindex = 0; cpuindex < ncpu; ++cpuindex)
+            {
+                PDFCalculator pdfc;
+                pdfc.setupParallelRun(cpuindex, ncpu);
+                pdfc.eval(mstru10);
+                pdfc.exportSharedParallelData(shmname);
+                pmaster.mergeSharedParallelData(shmname, ncpu);
+                BondCalculator bdc;
+                bdc.setRmax(3.5);
+                bdc.setupParallelRun(cpuindex, ncpu);
+                bdc.eval(mstru10);
+                bdc.exportSharedParallelData(shmname);
+                bmaster.mergeSharedParallelData(shmname, ncpu);
+                OverlapCalculator olc;
+                olc.setupParallelRun(cpuindex, ncpu);
+                olc.eval(mstru10);
+                olc.exportSharedParallelData(shmname);
+                omaster.mergeSharedParallelData(shmname, ncpu);
+            }
+            mpdfcb.eval(mstru10);
+            TS_ASSERT(allclose(mpdfcb.getPDF(), pmaster.getPDF()));
+            BondCalculator bdcb;
+            bdcb.setRmax(3.5);
+            bdcb.eval(mstru10);
+            TS_ASSERT_EQUALS(bdcb.distances(), bmaster.distances());
+            OverlapCalculator olcb;
+            olcb.eval(mstru10);
+            TS_ASSERT_EQUALS(olcb.value().size(), omaster.value().size());
+        }
+
+
+        void test_threaded_PDF()
+        {
+            PDFCalculator pdfct;
+            pdfct.setEvaluatorType(THREADED);
+            pdfct.setNumThreads(3);
+            TS_ASSERT_EQUALS(THREADED, pdfct.getEvaluatorType());
+            mpdfcb.eval(mstru10);
+            pdfct.eval(mstru10);
+            TS_ASSERT_EQUALS(THREADED, pdfct.getEvaluatorTypeUsed());
+            TS_ASSERT(allclose(mpdfcb.getPDF(), pdfct.getPDF()));
+            // periodic structure with a type mask
+            StructureAdapterPtr litao =
+                loadTestPeriodicStructure("LiTaO3.stru");
+            mpdfcb.setTypeMask("O2-", "all", false);
+            pdfct.setTypeMask("O2-", "all", false);
+            mpdfcb.eval(litao);
+            pdfct.eval(litao);
+            TS_ASSERT_EQUALS(THREADED, pdfct.getEvaluatorTypeUsed());
+            TS_ASSERT(allclose(mpdfcb.getPDF(), pdfct.getPDF()));
+            // more threads than the atom sites
+            pdfct.setNumThreads(16);
+            mpdfcb.eval(mstru10);
+            pdfct.eval(mstru10);
+            TS_ASSERT(allclose(mpdfcb.getPDF(), pdfct.getPDF()));
+            // single thread uses the BASIC evaluation
+            pdfct.setNumThreads(1);
+            pdfct.eval(mstru10);
+            TS_ASSERT_EQUALS(BASIC, pdfct.getEvaluatorTypeUsed());
+            TS_ASSERT(allclose(mpdfcb.getPDF(), pdfct.getPDF()));
+            TS_ASSERT_THROWS(pdfct.setNumThreads(-1), invalid_argument);
+        }
+
+
+        void test_threaded_merges()
+        {
+            BondCalculator bdcb, bdct;
+            bdct.setEvaluatorType(THREADED);
+            bdct.setNumThreads(4);
+            bdcb.setRmax(3.5);
+            bdct.setRmax(3.5);
+            bdcb.eval(mstru10);
+            bdct.eval(mstru10);
+            TS_ASSERT_EQUALS(THREADED, bdct.getEvaluatorTypeUsed());
+            TS_ASSERT_EQUALS(bdcb.distances(), bdct.distances());
+            TS_ASSERT_EQUALS(bdcb.sites0(), bdct.sites0());
+            TS_ASSERT_EQUALS(bdcb.sites1(), bdct.sites1());
+            OverlapCalculator olcb, olct;
+            olct.setEvaluatorType(THREADED);
+            olct.setNumThreads(4);
+            olcb.eval(mstru10);
+            olct.eval(mstru10);
+            TS_ASSERT_EQUALS(olcb.value().size(), olct.value().size());
+        }
+
+
+        void test_threaded_unsupported()
+        {
+            // PairCounter classes are not registered for serialization
+            // and cannot be copied to the worker threads.
+            BadPairCounter badcounter;
+            badcounter.setEvaluatorType(THREADED);
+            badcounter.setNumThreads(2);
+            TS_ASSERT_EQUALS(45, badcounter(mstru10));
+            TS_ASSERT_EQUALS(BASIC, badcounter.getEvaluatorTypeUsed());
+        }
+
+
+        void test_eval_batch()
+        {
+            vector<StructureAdapterPtr> frames;
+            frames.push_back(mstru10);
+            frames.push_back(mstru10d1);
+            frames.push_back(mstru10r);
+            frames.push_back(mstru9);
+            vector<QuantityType> pdfs;
+            for (StructureAdapterPtr stru : frames)
+            {
+                mpdfcb.eval(stru);
+                pdfs.push_back(mpdfcb.getPDF());
+            }
+            const size_t npts = pdfs[0].size();
+            QuantityType mean(npts, 0.0), variance(npts, 0.0);
+            for (const QuantityType& pdf : pdfs)
+            {
+                for (size_t i = 0; i < npts; ++i)  mean[i] += pdf[i] / 4;
+            }
+            for (const QuantityType& pdf : pdfs)
+            {
+                for (size_t i = 0; i < npts; ++i)
+                {
+                    variance[i] += pow(pdf[i] - mean[i], 2) / 4;
+                }
+            }
+            PDFCalculator pdfc;
+            vector<QuantityType> pdfsb = pdfc.evalBatch(frames);
+            TS_ASSERT_EQUALS(frames.size(), pdfsb.size());
+            for (size_t k = 0; k < pdfs.size(); ++k)
+            {
+                TS_ASSERT(allclose(pdfs[k], pdfsb[k]));
+            }
+            pdfc.evalBatchMean(frames.begin(), frames.end());
+            TS_ASSERT(allclose(mean, pdfc.getBatchMean()));
+            TS_ASSERT(allclose(variance, pdfc.getBatchVariance()));
+            // frames processed in parallel threads
+            pdfc.setEvaluatorType(THREADED);
+            pdfc.setNumThreads(3);
+            pdfsb = pdfc.evalBatch(frames.begin(), frames.end());
+            for (size_t k = 0; k < pdfs.size(); ++k)
+            {
+                TS_ASSERT(allclose(pdfs[k], pdfsb[k]));
+            }
+            pdfc.evalBatchMean(frames);
+            TS_ASSERT(allclose(mean, pdfc.getBatchMean()));
+            TS_ASSERT(allclose(variance, pdfc.getBatchVariance()));
+            TS_ASSERT(pdfc.evalBatch(vector<StructureAdapterPtr>()).empty());
+        }
+
+
+        void test_eval_batch_frames()
+        {
+            vector<StructureAdapterPtr> frames;
+            frames.push_back(mstru10);
+            AtomicStructureAdapterPtr stru;
+            // frames with the same atom types and occupancies
+            stru = boost::make_shared<AtomicStructureAdapter>(*mstru10);
+            stru->at(3).xyz_cartn[1] = 0.4;
+            frames.push_back(stru);
+            stru = boost::make_shared<AtomicStructureAdapter>(*stru);
+            for (Atom& a : *stru)  a.uij_cartn = 0.02 * R3::identity();
+            frames.push_back(stru);
+            // changed occupancy and atom type
+            stru = boost::make_shared<AtomicStructureAdapter>(*stru);
+            stru->at(2).occupancy = 0.5;
+            frames.push_back(stru);
+            frames.push_back(mstru10d1);
+            frames.push_back(mstru10);
+            PDFCalculator pdfc;
+            DebyePDFCalculator dbpdfc;
+            vector<QuantityType> pdfs, dbpdfs;
+            vector<double> qsteps;
+            for (StructureAdapterPtr s : frames)
+            {
+                PDFCalculator pdfc1;
+                pdfc1.eval(s);
+                pdfs.push_back(pdfc1.getPDF());
+                DebyePDFCalculator dbpdfc1;
+                dbpdfc1.eval(s);
+                dbpdfs.push_back(dbpdfc1.getPDF());
+                qsteps.push_back(dbpdfc1.getQstep());
+            }
+            // displacement parameters change the Q-grid of the Debye sum
+            TS_ASSERT(qsteps[1] != qsteps[2]);
+            vector<QuantityType> pdfsb = pdfc.evalBatch(frames);
+            vector<QuantityType> dbpdfsb = dbpdfc.evalBatch(frames);
+            for (size_t k = 0; k < frames.size(); ++k)
+            {
+                TS_ASSERT(allclose(pdfs[k], pdfsb[k]));
+                TS_ASSERT(allclose(dbpdfs[k], dbpdfsb[k]));
+            }
+        }
+
+
+        void test_concurrent_instances()
+        {
+            CrystalStructureAdapterPtr nacl(new CrystalStructureAdapter);
+            nacl->setLatPar(5.6, 5.6, 5.7, 90, 90, 90);
+            Atom a;
+            a.uij_cartn = 0.01 * R3::identity();
+            a.atomtype = "Na1+";
+            a.xyz_cartn = R3::Vector(0.0, 0.0, 0.0);
+            nacl->toCartesian(a);
+            nacl->append(a);
+            a.atomtype = "Cl1-";
+            a.xyz_cartn = R3::Vector(0.5, 0.5, 0.5);
+            nacl->toCartesian(a);
+            nacl->append(a);
+            nacl->addSymOp(R3::identity(), R3::Vector(0.0, 0.0, 0.0));
+            nacl->addSymOp(R3::identity(), R3::Vector(0.5, 0.5, 0.0));
+            nacl->addSymOp(R3::identity(), R3::Vector(0.5, 0.0, 0.5));
+            nacl->addSymOp(R3::identity(), R3::Vector(0.0, 0.5, 0.5));
+            vector<StructureAdapterPtr> strus;
+            strus.push_back(loadTestPeriodicStructure("LiTaO3.stru"));
+            strus.push_back(nacl);
+            for (StructureAdapterPtr stru : strus)
+            {
+                mpdfcb.eval(stru);
+                const QuantityType pdf0 = mpdfcb.getPDF();
+                // start from an empty symmetry cache in the shared crystal
+                nacl->setSymmetryPrecision(2 * nacl->getSymmetryPrecision());
+                const int nthreads = 4;
+                vector<QuantityType> pdfs(nthreads);
+                auto evalpdf = [&](int i) {
+                    PDFCalculator pdfc;
+                    pdfc.eval(stru);
+                    pdfs[i] = pdfc.getPDF();
+                };
+                vector<std::thread> threads;
+                for (int i = 0; i < nthreads; ++i)
+                {
+                    threads.push_back(std::thread(evalpdf, i));
+                }
+                for (std::thread& t : threads)  t.join();
+                for (const QuantityType& pdf : pdfs)
+                {
+                    TS_ASSERT(allclose(pdf0, pdf));
+                }
+            }
+        }
+
 };  // class TestPQEvaluator
 
 }   // namespace srreal
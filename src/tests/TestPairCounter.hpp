@@ -128,6 +128,38 @@ public:
     }
 
 
+    void test_pairMask()
+    {
+        Atom a;
+        for (int i = 0; i < 10; ++i)
+        {
+            a.atomtype = (i % 2) ? "B" : "A";
+            a.xyz_cartn = R3::Vector(1.0*i, 0.0, 0.0);
+            mstru->append(a);
+        }
+        PairCounter pcount;
+        pcount.setTypeMask("A", "B", false);
+        TS_ASSERT_EQUALS(20, pcount(mstru));
+        TS_ASSERT(pcount.getPairMask(0, 2));
+        TS_ASSERT(!pcount.getPairMask(0, 1));
+        TS_ASSERT(!pcount.getPairMask(1, 0));
+        // switch to index mode keeps the masked pairs
+        pcount.setPairMask(0, 2, false);
+        TS_ASSERT_EQUALS(19, pcount(mstru));
+        TS_ASSERT(!pcount.getPairMask(1, 0));
+        TS_ASSERT(!pcount.getPairMask(2, 0));
+        pcount.maskAllPairs(false);
+        pcount.setPairMask(0, pcount.ALLATOMSINT, true);
+        TS_ASSERT_EQUALS(9, pcount(mstru));
+        TS_ASSERT(pcount.getPairMask(7, 0));
+        TS_ASSERT(!pcount.getPairMask(7, 8));
+        TS_ASSERT(!pcount.getPairMask(50, 60));
+        pcount.setPairMask(8, 7, true);
+        TS_ASSERT_EQUALS(10, pcount(mstru));
+        TS_ASSERT(pcount.getPairMask(7, 8));
+    }
+
+
     void test_parallel()
     {
         const int ncpu = 7;
@@ -24,12 +24,48 @@
 #include <diffpy/srreal/PeakProfile.hpp>
 #include <diffpy/srreal/GaussianProfile.hpp>
 #include <diffpy/srreal/CroppedGaussianProfile.hpp>
+#include <diffpy/srreal/TabulatedProfile.hpp>
 #include "serialization_helpers.hpp"
 
 using namespace std;
 using namespace diffpy::srreal;
 using diffpy::mathutils::eps_eq;
 
+namespace {
+
+// user-defined profile that implements only the abstract methods
+class LorentzianProfile : public PeakProfile
+{
+    public:
+
+        PeakProfilePtr create() const
+        {
+            return PeakProfilePtr(new LorentzianProfile);
+        }
+
+        PeakProfilePtr clone() const
+        {
+            return PeakProfilePtr(new LorentzianProfile(*this));
+        }
+
+        const string& type() const
+        {
+            static string rv = "lorentzian";
+            return rv;
+        }
+
+        double operator()(double x, double fwhm) const
+        {
+            double hw = fwhm / 2;
+            return hw / M_PI / (x * x + hw * hw);
+        }
+
+        double xboundlo(double fwhm) const  { return -10 * fwhm; }
+        double xboundhi(double fwhm) const  { return +10 * fwhm; }
+};
+
+}   // namespace
+
 
 class TestPeakProfile : public CxxTest::TestSuite
 {
@@ -98,6 +134,87 @@ class TestPeakProfile : public CxxTest::TestSuite
         }
 
 
+        void test_evaluateGrid()
+        {
+            const double fwhm = 0.23;
+            const double dx = 0.01;
+            const double x0 = mpkgauss->xboundlo(fwhm) + 0.0042;
+            const int n = int((mpkgauss->xboundhi(fwhm) - x0) / dx) + 1;
+            vector<double> y(n);
+            mpkgauss->evaluateGrid(x0, dx, n, fwhm, y.data());
+            const PeakProfile& pkgauss = *mpkgauss;
+            const double ymax = pkgauss(0, fwhm);
+            for (int k = 0; k < n; ++k)
+            {
+                TS_ASSERT_DELTA(pkgauss(x0 + k * dx, fwhm), y[k],
+                        1e-13 * ymax);
+            }
+            mpkgcrop->setPrecision(1e-4);
+            const PeakProfile& pkgcrop = *mpkgcrop;
+            mpkgcrop->evaluateGrid(x0, dx, n, fwhm, y.data());
+            for (int k = 0; k < n; ++k)
+            {
+                TS_ASSERT_DELTA(pkgcrop(x0 + k * dx, fwhm), y[k],
+                        1e-13 * ymax);
+            }
+            TS_ASSERT_EQUALS(0.0, y.front());
+            TS_ASSERT_EQUALS(0.0, y.back());
+            mpkgauss->evaluateGrid(x0, dx, n, 0.0, y.data());
+            TS_ASSERT_EQUALS(vector<double>(n, 0.0), y);
+        }
+
+
+        void test_TabulatedProfile()
+        {
+            PeakProfilePtr pklut = PeakProfile::createByType("gaussian-lut");
+            TS_ASSERT_EQUALS("gaussian-lut", pklut->type());
+            TS_ASSERT_EQUALS(2, pklut->namesOfDoubleAttributes().size());
+            const double eps = pklut->getDoubleAttr("lookupprecision");
+            TS_ASSERT_EQUALS(1e-6, eps);
+            const PeakProfile& pkgauss = *mpkgauss;
+            const PeakProfile& pkf = *pklut;
+            const double fwhm = 0.3;
+            const double ymax = pkgauss(0, fwhm);
+            for (double x = -1; x < 1; x += 0.0123)
+            {
+                TS_ASSERT_DELTA(pkgauss(x, fwhm), pkf(x, fwhm), eps * ymax);
+            }
+            TS_ASSERT_EQUALS(mpkgauss->xboundhi(fwhm), pklut->xboundhi(fwhm));
+            TS_ASSERT_EQUALS(0.0, pkf(1.1 * pkf.xboundhi(fwhm), fwhm));
+            TS_ASSERT_EQUALS(0.0, pkf(0, 0));
+            // table is updated for new precisions
+            TabulatedProfile& tpkf = static_cast<TabulatedProfile&>(*pklut);
+            const int npts = tpkf.countTablePoints();
+            tpkf.setLookupPrecision(1e-3);
+            TS_ASSERT(tpkf.countTablePoints() < npts);
+            TS_ASSERT_THROWS(tpkf.setLookupPrecision(0), invalid_argument);
+            tpkf.setPrecision(1e-3);
+            TS_ASSERT_EQUALS(1e-3, tpkf.getPrecision());
+            TS_ASSERT_EQUALS(1e-3, tpkf.getProfile()->getPrecision());
+            TS_ASSERT_EQUALS(0.0, pkf(-1.6 * fwhm, fwhm));
+            TS_ASSERT_LESS_THAN(0.0, pkf(-1.5 * fwhm, fwhm));
+            // clone owns a separate copy of the tabulated profile
+            PeakProfilePtr pk1 = pklut->clone();
+            pk1->setPrecision(1e-5);
+            TS_ASSERT_EQUALS(1e-3, tpkf.getProfile()->getPrecision());
+            PeakProfilePtr pk2 = dumpandload(pklut);
+            TS_ASSERT_EQUALS(1e-3, pk2->getDoubleAttr("lookupprecision"));
+            TS_ASSERT_EQUALS(pkf(0.05, fwhm), (*pk2)(0.05, fwhm));
+            // user-defined profile
+            PeakProfilePtr lorentz(new LorentzianProfile);
+            TabulatedProfile lutlorentz(lorentz);
+            TS_ASSERT_EQUALS("lorentzian-lut", lutlorentz.type());
+            const double ylmax = (*lorentz)(0, fwhm);
+            vector<double> y(100);
+            lutlorentz.evaluateGrid(-0.5, 0.01, 100, fwhm, y.data());
+            for (int k = 0; k < 100; ++k)
+            {
+                double x = -0.5 + k * 0.01;
+                TS_ASSERT_DELTA((*lorentz)(x, fwhm), y[k], 1e-6 * ylmax);
+            }
+        }
+
+
         void test_xboundlo()
         {
             const double epsy = 1e-8;
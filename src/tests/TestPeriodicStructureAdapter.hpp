@@ -21,6 +21,8 @@
 
 #include <typeinfo>
 #include <sstream>
+#include <algorithm>
+#include <cmath>
 #include <cxxtest/TestSuite.h>
 
 #include <diffpy/srreal/PeriodicStructureAdapter.hpp>
@@ -45,6 +47,43 @@ int countBonds(BaseBondGenerator& bnds)
 }
 
 
+vector< pair<int, double> > sortedBonds(BaseBondGenerator& bnds)
+{
+    vector< pair<int, double> > rv;
+    for (bnds.rewind(); !bnds.finished(); bnds.next())
+    {
+        rv.push_back(make_pair(bnds.site1(), bnds.distance()));
+    }
+    sort(rv.begin(), rv.end());
+    return rv;
+}
+
+
+/// bonds from all translations by up to 2 cells
+vector< pair<int, double> > sortedBondsBruteForce(
+        const PeriodicStructureAdapter& stru, int anchor,
+        const SiteIndices& sites, double rmax)
+{
+    const Lattice& L = stru.getLattice();
+    const R3::Vector r0 = L.ucvCartesian(stru[anchor].xyz_cartn);
+    vector< pair<int, double> > rv;
+    for (int i : sites)
+    {
+        const R3::Vector r1 = L.ucvCartesian(stru[i].xyz_cartn);
+        for (int m = -2; m <= 2; ++m)
+        for (int n = -2; n <= 2; ++n)
+        for (int o = -2; o <= 2; ++o)
+        {
+            R3::Vector r01 = r1 + L.cartesian(R3::Vector(m, n, o)) - r0;
+            double d = R3::norm(r01);
+            if (d <= rmax && d > 1e-6)  rv.push_back(make_pair(i, d));
+        }
+    }
+    sort(rv.begin(), rv.end());
+    return rv;
+}
+
+
 template <class Tstru, class Tbnds>
 double testmsd0(const Tstru& stru, const Tbnds& bnds)
 {
@@ -417,6 +456,114 @@ class TestPeriodicStructureBondGenerator : public CxxTest::TestSuite
             }
         }
 
+
+        void test_cellGrid()
+        {
+            PeriodicStructureAdapterPtr stru(new PeriodicStructureAdapter);
+            stru->setLatPar(12, 13, 14, 80, 95, 105);
+            Atom a;
+            for (int i = 0; i < 600; ++i)
+            {
+                a.xyz_cartn = R3::Vector(
+                        0.5 + 0.5 * sin(i), 0.5 + 0.5 * sin(2 * i), i / 600.0);
+                stru->toCartesian(a);
+                stru->append(a);
+            }
+            BaseBondGeneratorPtr bnds = stru->createBondGenerator();
+            PeriodicStructureBondGenerator& pbnds =
+                dynamic_cast<PeriodicStructureBondGenerator&>(*bnds);
+            const double rmax = 3.5;
+            bnds->setRmax(rmax);
+            SiteIndices all(600), sel;
+            for (int i = 0; i < 600; ++i)  all[i] = i;
+            for (int i = 599; i >= 0; i -= 2)  sel.push_back(i);
+            for (int i0 : {0, 77, 300, 599})
+            {
+                bnds->selectAnchorSite(i0);
+                bnds->selectSiteRange(0, 600);
+                vector< pair<int, double> > b0, b1;
+                b0 = sortedBondsBruteForce(*stru, i0, all, rmax);
+                b1 = sortedBonds(*bnds);
+                TS_ASSERT(pbnds.usesCellGrid());
+                TS_ASSERT_EQUALS(b0.size(), b1.size());
+                for (size_t k = 0; k < b0.size() && k < b1.size(); ++k)
+                {
+                    TS_ASSERT_EQUALS(b0[k].first, b1[k].first);
+                    TS_ASSERT_DELTA(b0[k].second, b1[k].second, 1e-10);
+                }
+                bnds->selectSites(sel.begin() + i0 / 3, sel.end());
+                SiteIndices sel1(sel.begin() + i0 / 3, sel.end());
+                b0 = sortedBondsBruteForce(*stru, i0, sel1, rmax);
+                b1 = sortedBonds(*bnds);
+                TS_ASSERT(pbnds.usesCellGrid());
+                TS_ASSERT_EQUALS(b0.size(), b1.size());
+                for (size_t k = 0; k < b0.size() && k < b1.size(); ++k)
+                {
+                    TS_ASSERT_EQUALS(b0[k].first, b1[k].first);
+                    TS_ASSERT_DELTA(b0[k].second, b1[k].second, 1e-10);
+                }
+            }
+            // the sphere points are used for rmax over the cell widths
+            bnds->setRmax(12);
+            bnds->selectSiteRange(0, 600);
+            TS_ASSERT_LESS_THAN(0, countBonds(*bnds));
+            TS_ASSERT(!pbnds.usesCellGrid());
+        }
+
+
+        void test_neighborList()
+        {
+            PeriodicStructureAdapterPtr stru(new PeriodicStructureAdapter);
+            stru->setLatPar(12, 13, 14, 80, 95, 105);
+            Atom a;
+            for (int i = 0; i < 60; ++i)
+            {
+                a.xyz_cartn = R3::Vector(
+                        0.5 + 0.5 * sin(i), 0.5 + 0.5 * sin(2 * i), i / 60.0);
+                stru->toCartesian(a);
+                stru->append(a);
+            }
+            stru->setNeighborListSkin(0.5);
+            const NeighborListCache* cache = stru->neighborListCache();
+            BaseBondGeneratorPtr bnds = stru->createBondGenerator();
+            PeriodicStructureBondGenerator& pbnds =
+                dynamic_cast<PeriodicStructureBondGenerator&>(*bnds);
+            const double rmax = 4;
+            bnds->setRmax(rmax);
+            SiteIndices all(60);
+            for (int i = 0; i < 60; ++i)  all[i] = i;
+            for (int i0 : {0, 17, 59})
+            {
+                bnds->selectAnchorSite(i0);
+                vector< pair<int, double> > b0, b1;
+                b0 = sortedBondsBruteForce(*stru, i0, all, rmax);
+                b1 = sortedBonds(*bnds);
+                TS_ASSERT(pbnds.usesNeighborList());
+                TS_ASSERT_EQUALS(b0.size(), b1.size());
+                for (size_t k = 0; k < b0.size() && k < b1.size(); ++k)
+                {
+                    TS_ASSERT_EQUALS(b0[k].first, b1[k].first);
+                    TS_ASSERT_DELTA(b0[k].second, b1[k].second, 1e-10);
+                }
+            }
+            TS_ASSERT_EQUALS(1u, cache->countBuilds());
+            // changed lattice requires a new list
+            stru->setLatPar(12, 13, 14.1, 80, 95, 105);
+            bnds = stru->createBondGenerator();
+            bnds->setRmax(rmax);
+            bnds->selectAnchorSite(17);
+            vector< pair<int, double> > b0, b1;
+            b0 = sortedBondsBruteForce(*stru, 17, all, rmax);
+            b1 = sortedBonds(*bnds);
+            TS_ASSERT_EQUALS(b0.size(), b1.size());
+            TS_ASSERT_EQUALS(2u, cache->countBuilds());
+            // neighbors beyond the nearest cell images are not listed
+            bnds->setRmax(12);
+            TS_ASSERT_LESS_THAN(0, countBonds(*bnds));
+            TS_ASSERT(!dynamic_cast<PeriodicStructureBondGenerator&>(
+                        *bnds).usesNeighborList());
+        }
+
 };  // class TestPeriodicStructureBondGenerator
 
 }   // namespace srreal